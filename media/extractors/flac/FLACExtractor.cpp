@@ -39,6 +39,7 @@
 #include <media/stagefright/MetaDataUtils.h>
 #include <private/android_filesystem_config.h> // for AID_MEDIA
 #include <system/audio.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -167,8 +168,20 @@ private:
     // most recent error reported by libFLAC parser
     FLAC__StreamDecoderErrorStatus mErrorStatus;
 
+    // Frame boundaries learned while decoding, so that seeks into regions
+    // that were already played do not need libFLAC's bisection search,
+    // which issues many small reads when the file has no SEEKTABLE.
+    struct FrameIndexEntry {
+        FLAC__uint64 mSample;
+        FLAC__uint64 mOffset;
+    };
+    Vector<FrameIndexEntry> mFrameIndex;
+    FLAC__uint64 mFrameIndexInterval;
+
     status_t init();
     MediaBufferHelper *readBuffer(bool doSeek, FLAC__uint64 sample);
+    void addFrameIndexEntry(FLAC__uint64 sample, FLAC__uint64 offset);
+    bool seekUsingFrameIndex(FLAC__uint64 sample);
 
     // no copy constructor or assignment
     FLACParser(const FLACParser &);
@@ -403,7 +416,30 @@ void FLACParser::errorCallback(FLAC__StreamDecoderErrorStatus status)
 // Copy samples from FLAC native 32-bit non-interleaved to 16-bit signed
 // or 32-bit float interleaved.
 // TODO: Consider moving to audio_utils.
-// These are candidates for optimization if needed.
+// The common mono and stereo layouts use a compile-time channel count, which
+// lets the compiler vectorize the loops (e.g. into interleaving stores).
+template <unsigned kChannels>
+static void copyTo16SignedFixed(
+        short *dst,
+        const int *const *src,
+        unsigned nSamples,
+        int leftShift) {
+    if (leftShift >= 0) {
+        for (unsigned i = 0; i < nSamples; ++i) {
+            for (unsigned c = 0; c < kChannels; ++c) {
+                dst[i * kChannels + c] = src[c][i] << leftShift;
+            }
+        }
+    } else {
+        const int rightShift = -leftShift;
+        for (unsigned i = 0; i < nSamples; ++i) {
+            for (unsigned c = 0; c < kChannels; ++c) {
+                dst[i * kChannels + c] = src[c][i] >> rightShift;
+            }
+        }
+    }
+}
+
 static void copyTo16Signed(
         short *dst,
         const int *const *src,
@@ -411,6 +447,16 @@ static void copyTo16Signed(
         unsigned nChannels,
         unsigned bitsPerSample) {
     const int leftShift = 16 - (int)bitsPerSample; // cast to int to prevent unsigned overflow.
+    switch (nChannels) {
+    case 1:
+        copyTo16SignedFixed<1>(dst, src, nSamples, leftShift);
+        return;
+    case 2:
+        copyTo16SignedFixed<2>(dst, src, nSamples, leftShift);
+        return;
+    default:
+        break;
+    }
     if (leftShift >= 0) {
         for (unsigned i = 0; i < nSamples; ++i) {
             for (unsigned c = 0; c < nChannels; ++c) {
@@ -427,6 +473,19 @@ static void copyTo16Signed(
     }
 }
 
+template <unsigned kChannels>
+static void copyToFloatFixed(
+        float *dst,
+        const int *const *src,
+        unsigned nSamples,
+        unsigned leftShift) {
+    for (unsigned i = 0; i < nSamples; ++i) {
+        for (unsigned c = 0; c < kChannels; ++c) {
+            dst[i * kChannels + c] = float_from_i32(src[c][i] << leftShift);
+        }
+    }
+}
+
 static void copyToFloat(
         float *dst,
         const int *const *src,
@@ -434,6 +493,16 @@ static void copyToFloat(
         unsigned nChannels,
         unsigned bitsPerSample) {
     const unsigned leftShift = 32 - bitsPerSample;
+    switch (nChannels) {
+    case 1:
+        copyToFloatFixed<1>(dst, src, nSamples, leftShift);
+        return;
+    case 2:
+        copyToFloatFixed<2>(dst, src, nSamples, leftShift);
+        return;
+    default:
+        break;
+    }
     for (unsigned i = 0; i < nSamples; ++i) {
         for (unsigned c = 0; c < nChannels; ++c) {
             *dst++ = float_from_i32(src[c][i] << leftShift);
@@ -461,7 +530,8 @@ FLACParser::FLACParser(
       mStreamInfoValid(false),
       mWriteRequested(false),
       mWriteCompleted(false),
-      mErrorStatus((FLAC__StreamDecoderErrorStatus) -1)
+      mErrorStatus((FLAC__StreamDecoderErrorStatus) -1),
+      mFrameIndexInterval(0)
 {
     ALOGV("FLACParser::FLACParser");
     memset(&mStreamInfo, 0, sizeof(mStreamInfo));
@@ -553,6 +623,8 @@ status_t FLACParser::init()
             AMediaFormat_setInt64(mTrackMetadata,
                     AMEDIAFORMAT_KEY_DURATION, (getTotalSamples() * 1000000LL) / getSampleRate());
         }
+        // index at most one frame boundary every half second
+        mFrameIndexInterval = getSampleRate() / 2;
     } else {
         ALOGE("missing STREAMINFO");
         return NO_INIT;
@@ -577,18 +649,111 @@ void FLACParser::releaseBuffers()
 {
 }
 
+void FLACParser::addFrameIndexEntry(FLAC__uint64 sample, FLAC__uint64 offset)
+{
+    // Bound the index to the same order of memory as a typical SEEKTABLE.
+    static const size_t kMaxFrameIndexEntries = 16384;
+
+    // find the first entry after the new one
+    size_t lo = 0, hi = mFrameIndex.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mFrameIndex[mid].mSample <= sample) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo > 0 && sample - mFrameIndex[lo - 1].mSample < mFrameIndexInterval) {
+        return;
+    }
+    if (lo < mFrameIndex.size() && mFrameIndex[lo].mSample - sample < mFrameIndexInterval) {
+        return;
+    }
+    if (mFrameIndex.size() >= kMaxFrameIndexEntries) {
+        return;
+    }
+    FrameIndexEntry entry;
+    entry.mSample = sample;
+    entry.mOffset = offset;
+    mFrameIndex.insertAt(entry, lo);
+}
+
+bool FLACParser::seekUsingFrameIndex(FLAC__uint64 sample)
+{
+    if (mFrameIndex.isEmpty() || sample >= getTotalSamples()) {
+        return false;
+    }
+    // find the last indexed frame at or before the target
+    size_t lo = 0, hi = mFrameIndex.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mFrameIndex[mid].mSample <= sample) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return false;
+    }
+    const FrameIndexEntry &entry = mFrameIndex[lo - 1];
+    if (sample - entry.mSample > 2 * mFrameIndexInterval) {
+        // We have not decoded this part of the stream yet.
+        return false;
+    }
+
+    if (!FLAC__stream_decoder_flush(mDecoder)) {
+        return false;
+    }
+    mCurrentPos = entry.mOffset;
+    mEOF = false;
+    // decode forward to the frame that contains the target sample
+    for (;;) {
+        mWriteRequested = true;
+        mWriteCompleted = false;
+        if (!FLAC__stream_decoder_process_single(mDecoder) || !mWriteCompleted
+                || mWriteHeader.number_type != FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER) {
+            return false;
+        }
+        const FLAC__uint64 first = mWriteHeader.number.sample_number;
+        if (sample < first) {
+            return false;
+        }
+        if (sample - first < mWriteHeader.blocksize) {
+            // Drop the leading samples, as libFLAC does for an absolute seek.
+            const unsigned skip = sample - first;
+            for (unsigned c = 0; c < getChannels(); ++c) {
+                mWriteBuffer[c] += skip;
+            }
+            mWriteHeader.blocksize -= skip;
+            mWriteHeader.number.sample_number = sample;
+            return true;
+        }
+    }
+}
+
 MediaBufferHelper *FLACParser::readBuffer(bool doSeek, FLAC__uint64 sample)
 {
-    mWriteRequested = true;
-    mWriteCompleted = false;
     if (doSeek) {
-        // We implement the seek callback, so this works without explicit flush
-        if (!FLAC__stream_decoder_seek_absolute(mDecoder, sample)) {
-            ALOGE("FLACParser::readBuffer seek to sample %lld failed", (long long)sample);
-            return NULL;
+        if (seekUsingFrameIndex(sample)) {
+            ALOGV("FLACParser::readBuffer indexed seek to sample %lld succeeded",
+                    (long long)sample);
+        } else {
+            mWriteRequested = true;
+            mWriteCompleted = false;
+            // We implement the seek callback, so this works without explicit flush,
+            // unless an indexed seek attempt left the decoder in an error state.
+            FLAC__stream_decoder_flush(mDecoder);
+            if (!FLAC__stream_decoder_seek_absolute(mDecoder, sample)) {
+                ALOGE("FLACParser::readBuffer seek to sample %lld failed", (long long)sample);
+                return NULL;
+            }
+            ALOGV("FLACParser::readBuffer seek to sample %lld succeeded", (long long)sample);
         }
-        ALOGV("FLACParser::readBuffer seek to sample %lld succeeded", (long long)sample);
     } else {
+        mWriteRequested = true;
+        mWriteCompleted = false;
         if (!FLAC__stream_decoder_process_single(mDecoder)) {
             ALOGE("FLACParser::readBuffer process_single failed");
             return NULL;
@@ -641,6 +806,11 @@ MediaBufferHelper *FLACParser::readBuffer(bool doSeek, FLAC__uint64 sample)
     CHECK(mWriteHeader.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
     FLAC__uint64 sampleNumber = mWriteHeader.number.sample_number;
     int64_t timeUs = (1000000LL * sampleNumber) / getSampleRate();
+    // the decoder has consumed this frame, so its position is the next frame
+    FLAC__uint64 nextFrameOffset;
+    if (FLAC__stream_decoder_get_decode_position(mDecoder, &nextFrameOffset)) {
+        addFrameIndexEntry(sampleNumber + blocksize, nextFrameOffset);
+    }
     AMediaFormat *meta = buffer->meta_data();
     AMediaFormat_setInt64(meta, AMEDIAFORMAT_KEY_TIME_US, timeUs);
     AMediaFormat_setInt32(meta, AMEDIAFORMAT_KEY_IS_SYNC_FRAME, 1);
@@ -47,7 +47,7 @@ struct ImageItem {
     ImageItem(uint32_t _type, uint32_t _id, bool _hidden) :
             type(_type), itemId(_id), hidden(_hidden),
             rows(0), columns(0), width(0), height(0), rotation(0),
-            offset(0), size(0), nextTileIndex(0) {}
+            offset(0), size(0), nextTileIndex(0), resolveStatus(NO_INIT) {}
 
     bool isGrid() const {
         return type == FOURCC("grid");
@@ -81,6 +81,8 @@ struct ImageItem {
     Vector<uint32_t> dimgRefs;
     Vector<uint32_t> cdscRefs;
     size_t nextTileIndex;
+    // Properties (and grid layout) are resolved on first use.
+    status_t resolveStatus;
 };
 
 struct ExifItem {
@@ -674,7 +676,7 @@ struct AssociationEntry {
 };
 
 struct ItemProperty : public RefBase {
-    ItemProperty() {}
+    ItemProperty() : mOffset(0), mSize(0), mParseStatus(NO_INIT) {}
 
     virtual void attachTo(ImageItem &/*image*/) const {
         ALOGW("Unrecognized property");
@@ -684,7 +686,25 @@ struct ItemProperty : public RefBase {
         return OK;
     }
 
+    // Remember where the property lives; it is only parsed once an item
+    // that uses it is resolved.
+    void defer(off64_t offset, size_t size) {
+        mOffset = offset;
+        mSize = size;
+    }
+
+    status_t resolve() {
+        if (mParseStatus == NO_INIT) {
+            mParseStatus = parse(mOffset, mSize);
+        }
+        return mParseStatus;
+    }
+
 private:
+    off64_t mOffset;
+    size_t mSize;
+    status_t mParseStatus;
+
     DISALLOW_EVIL_CONSTRUCTORS(ItemProperty);
 };
 
@@ -964,10 +984,7 @@ status_t IpcoBox::onChunkData(uint32_t type, off64_t offset, size_t size) {
             break;
         }
     }
-    status_t err = itemProperty->parse(offset, size);
-    if (err != OK) {
-        return err;
-    }
+    itemProperty->defer(offset, size);
     mItemProperties->push_back(itemProperty);
     return OK;
 }
@@ -1403,35 +1420,30 @@ status_t ItemTable::buildImageItemsIfPossible(uint32_t type) {
 
         ALOGV("adding %s: itemId %d", image.isGrid() ? "grid" : "image", info.itemId);
 
-        if (image.isGrid()) {
-            // ImageGrid struct is at least 8-byte, at most 12-byte (if flags&1)
-            if (size < 8 || size > 12) {
-                return ERROR_MALFORMED;
-            }
-            uint8_t buf[12];
-            if (!mDataSource->readAt(offset, buf, size)) {
-                return ERROR_IO;
-            }
-
-            image.rows = buf[2] + 1;
-            image.columns = buf[3] + 1;
-
-            ALOGV("rows %d, columans %d", image.rows, image.columns);
-        } else {
-            image.offset = offset;
-            image.size = size;
-        }
+        // For grids this is the ImageGrid struct, read when the grid is resolved.
+        image.offset = offset;
+        image.size = size;
         mItemIdToItemMap.add(info.itemId, image);
     }
 
-    for (size_t i = 0; i < mAssociations.size(); i++) {
-        attachProperty(mAssociations[i]);
-    }
-
     for (size_t i = 0; i < mItemReferences.size(); i++) {
         mItemReferences[i]->apply(mItemIdToItemMap, mItemIdToExifMap);
     }
 
+    // Index the associations by item id once, so resolving an item doesn't
+    // have to scan the whole ipma list.
+    for (size_t i = 0; i < mAssociations.size(); i++) {
+        uint32_t itemId = mAssociations[i].itemId;
+        if (mItemIdToItemMap.indexOfKey(itemId) < 0) {
+            continue;
+        }
+        ssize_t assocIndex = mItemIdToAssociationsMap.indexOfKey(itemId);
+        if (assocIndex < 0) {
+            assocIndex = mItemIdToAssociationsMap.add(itemId, Vector<size_t>());
+        }
+        mItemIdToAssociationsMap.editValueAt(assocIndex).push_back(i);
+    }
+
     bool foundPrimary = false;
     for (size_t i = 0; i < mItemIdToItemMap.size(); i++) {
         // add all non-hidden images, also add the primary even if it's marked
@@ -1459,24 +1471,67 @@ status_t ItemTable::buildImageItemsIfPossible(uint32_t type) {
     return OK;
 }
 
-void ItemTable::attachProperty(const AssociationEntry &association) {
-    ssize_t itemIndex = mItemIdToItemMap.indexOfKey(association.itemId);
-
-    // ignore non-image items
-    if (itemIndex < 0) {
-        return;
-    }
-
+status_t ItemTable::attachProperty(const AssociationEntry &association, ImageItem &image) {
     uint16_t propertyIndex = association.index;
     if (propertyIndex >= mItemProperties.size()) {
         ALOGW("Ignoring invalid property index %d", propertyIndex);
-        return;
+        return OK;
+    }
+
+    status_t err = mItemProperties[propertyIndex]->resolve();
+    if (err != OK) {
+        return err;
     }
 
     ALOGV("attach property %d to item id %d)",
             propertyIndex, association.itemId);
 
-    mItemProperties[propertyIndex]->attachTo(mItemIdToItemMap.editValueAt(itemIndex));
+    mItemProperties[propertyIndex]->attachTo(image);
+    return OK;
+}
+
+status_t ItemTable::resolveImageItem(size_t itemIndex) {
+    ImageItem &image = mItemIdToItemMap.editValueAt(itemIndex);
+    if (image.resolveStatus != NO_INIT) {
+        return image.resolveStatus;
+    }
+
+    image.resolveStatus = OK;
+
+    if (image.isGrid()) {
+        // ImageGrid struct is at least 8-byte, at most 12-byte (if flags&1)
+        if (image.size < 8 || image.size > 12) {
+            image.resolveStatus = ERROR_MALFORMED;
+            return image.resolveStatus;
+        }
+        uint8_t buf[12];
+        if (!mDataSource->readAt(image.offset, buf, image.size)) {
+            image.resolveStatus = ERROR_IO;
+            return image.resolveStatus;
+        }
+
+        image.rows = buf[2] + 1;
+        image.columns = buf[3] + 1;
+        image.offset = 0;
+        image.size = 0;
+
+        ALOGV("rows %d, columans %d", image.rows, image.columns);
+    }
+
+    ssize_t assocIndex = mItemIdToAssociationsMap.indexOfKey(image.itemId);
+    if (assocIndex < 0) {
+        return OK;
+    }
+    const Vector<size_t> &associations = mItemIdToAssociationsMap.valueAt(assocIndex);
+    for (size_t i = 0; i < associations.size(); i++) {
+        status_t err = attachProperty(mAssociations[associations[i]], image);
+        if (err != OK) {
+            image.resolveStatus = err;
+            return err;
+        }
+    }
+
+    return OK;
 }
 
 uint32_t ItemTable::countImages() const {
@@ -1495,6 +1550,9 @@ AMediaFormat *ItemTable::getImageMeta(const uint32_t imageIndex) {
     const uint32_t itemIndex = mDisplayables[imageIndex];
     ALOGV("image[%u]: item index %u", imageIndex, itemIndex);
 
+    if (resolveImageItem(itemIndex) != OK) {
+        return NULL;
+    }
     const ImageItem *image = &mItemIdToItemMap[itemIndex];
 
     ssize_t tileItemIndex = -1;
@@ -1503,7 +1561,7 @@ AMediaFormat *ItemTable::getImageMeta(const uint32_t imageIndex) {
             return NULL;
         }
         tileItemIndex = mItemIdToItemMap.indexOfKey(image->dimgRefs[0]);
-        if (tileItemIndex < 0) {
+        if (tileItemIndex < 0 || resolveImageItem(tileItemIndex) != OK) {
             return NULL;
         }
     }
@@ -1537,7 +1595,9 @@ AMediaFormat *ItemTable::getImageMeta(const uint32_t imageIndex) {
 
     if (!image->thumbnails.empty()) {
         ssize_t thumbItemIndex = mItemIdToItemMap.indexOfKey(image->thumbnails[0]);
-        if (thumbItemIndex >= 0) {
+        if (thumbItemIndex >= 0 && resolveImageItem(thumbItemIndex) != OK) {
+            ALOGW("%s: thumbnail is malformed for image[%u]!", __FUNCTION__, imageIndex);
+        } else if (thumbItemIndex >= 0) {
             const ImageItem &thumbnail = mItemIdToItemMap[thumbItemIndex];
 
             if (thumbnail.hvcc != NULL) {
@@ -83,6 +83,7 @@ private:
     uint32_t mCurrentItemIndex;
     KeyedVector<uint32_t, ImageItem> mItemIdToItemMap;
     KeyedVector<uint32_t, ExifItem> mItemIdToExifMap;
+    KeyedVector<uint32_t, Vector<size_t> > mItemIdToAssociationsMap;
     Vector<uint32_t> mDisplayables;
 
     status_t parseIlocBox(off64_t offset, size_t size);
@@ -92,7 +93,8 @@ private:
     status_t parseIdatBox(off64_t offset, size_t size);
     status_t parseIrefBox(off64_t offset, size_t size);
 
-    void attachProperty(const AssociationEntry &association);
+    status_t attachProperty(const AssociationEntry &association, ImageItem &image);
+    status_t resolveImageItem(size_t itemIndex);
     status_t buildImageItemsIfPossible(uint32_t type);
 
     DISALLOW_EVIL_CONSTRUCTORS(ItemTable);
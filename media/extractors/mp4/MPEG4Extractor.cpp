@@ -320,6 +320,13 @@ status_t CachedRangedDataSource::setCachedRange(off64_t offset,
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Upper bound on the sample table ('stbl') bytes one extractor keeps in
+// memory. Within the budget every stbl box is read in one go when it is
+// parsed and served from memory for the lifetime of the extractor, so sample
+// lookups during playback and seeking don't go back to the data source (a
+// binder call for sources proxied from another process).
+static const size_t kMaxCachedSampleTableBytes = 16 * 1024 * 1024;
+
 static const bool kUseHexDump = false;
 
 static const char *FourCC2MIME(uint32_t fourcc) {
@@ -406,6 +413,7 @@ MPEG4Extractor::MPEG4Extractor(DataSourceHelper *source, const char *mime)
       mMoofFound(false),
       mMdatFound(false),
       mDataSource(source),
+      mCachedSampleTableBytes(0),
       mInitCheck(NO_INIT),
       mHeaderTimescale(0),
       mIsQT(false),
@@ -492,6 +500,10 @@ media_status_t MPEG4Extractor::getTrackMetaData(
         return AMEDIA_ERROR_UNKNOWN;
     }
 
+    if (resolveHeifTrackMeta(track) != OK) {
+        return AMEDIA_ERROR_MALFORMED;
+    }
+
     [=] {
         int64_t duration;
         int32_t samplerate;
@@ -677,12 +689,27 @@ status_t MPEG4Extractor::readMetaData() {
             AMediaFormat_setInt64(mFileMetaData,
                     AMEDIAFORMAT_KEY_EXIF_SIZE, (int64_t)exifSize);
         }
+        bool resolvedImage = false;
         for (uint32_t imageIndex = 0;
                 imageIndex < mItemTable->countImages(); imageIndex++) {
-            AMediaFormat *meta = mItemTable->getImageMeta(imageIndex);
-            if (meta == NULL) {
-                ALOGE("heif image %u has no meta!", imageIndex);
-                continue;
+            // Only the first usable image is resolved here, so that a file
+            // without any decodable image still fails init. The others get a
+            // placeholder format and are resolved on first access, which keeps
+            // opening a gallery with many items cheap.
+            AMediaFormat *meta;
+            bool metaPending = false;
+            if (!resolvedImage) {
+                meta = mItemTable->getImageMeta(imageIndex);
+                if (meta == NULL) {
+                    ALOGE("heif image %u has no meta!", imageIndex);
+                    continue;
+                }
+                resolvedImage = true;
+            } else {
+                meta = AMediaFormat_new();
+                AMediaFormat_setString(meta,
+                        AMEDIAFORMAT_KEY_MIME, MEDIA_MIMETYPE_IMAGE_ANDROID_HEIC);
+                metaPending = true;
             }
             // Some heif files advertise image sequence brands (eg. 'hevc') in
             // ftyp box, but don't have any valid tracks in them. Instead of
@@ -706,6 +733,7 @@ status_t MPEG4Extractor::readMetaData() {
             track->meta = meta;
             AMediaFormat_setInt32(track->meta, AMEDIAFORMAT_KEY_TRACK_ID, imageIndex);
             track->timescale = 1000000;
+            track->heif_meta_pending = metaPending;
         }
     }
 
@@ -955,9 +983,11 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
             if (chunk_type == FOURCC("stbl")) {
                 ALOGV("sampleTable chunk is %" PRIu64 " bytes long.", chunk_size);
 
-                if (mDataSource->flags()
+                bool cacheable = chunk_size <= kMaxCachedSampleTableBytes
+                        && mCachedSampleTableBytes + chunk_size <= kMaxCachedSampleTableBytes;
+                if (cacheable || (mDataSource->flags()
                         & (DataSourceBase::kWantsPrefetching
-                            | DataSourceBase::kIsCachingDataSource)) {
+                            | DataSourceBase::kIsCachingDataSource))) {
                     CachedRangedDataSource *cachedSource =
                         new CachedRangedDataSource(mDataSource);
 
@@ -965,6 +995,9 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
                             *offset, chunk_size,
                             true /* assume ownership on success */) == OK) {
                         mDataSource = cachedSource;
+                        if (cacheable) {
+                            mCachedSampleTableBytes += chunk_size;
+                        }
                     } else {
                         delete cachedSource;
                     }
@@ -4260,6 +4293,9 @@ MediaTrackHelper *MPEG4Extractor::getTrack(size_t index) {
         return NULL;
     }
 
+    if (resolveHeifTrackMeta(track) != OK) {
+        return NULL;
+    }
 
     Trex *trex = NULL;
     int32_t trackId;
@@ -6668,6 +6704,29 @@ media_status_t MPEG4Source::fragmentedRead(
     return AMEDIA_OK;
 }
 
+status_t MPEG4Extractor::resolveHeifTrackMeta(Track *track) {
+    if (!track->heif_meta_pending) {
+        return OK;
+    }
+
+    int32_t imageIndex;
+    if (mItemTable == NULL || !AMediaFormat_getInt32(
+            track->meta, AMEDIAFORMAT_KEY_TRACK_ID, &imageIndex)) {
+        return ERROR_MALFORMED;
+    }
+
+    AMediaFormat *meta = mItemTable->getImageMeta(imageIndex);
+    if (meta == NULL) {
+        ALOGE("heif image %d has no meta!", imageIndex);
+        return ERROR_MALFORMED;
+    }
+    AMediaFormat_copy(track->meta, meta);
+    AMediaFormat_delete(meta);
+    AMediaFormat_setInt32(track->meta, AMEDIAFORMAT_KEY_TRACK_ID, imageIndex);
+    track->heif_meta_pending = false;
+    return OK;
+}
+
 MPEG4Extractor::Track *MPEG4Extractor::findTrackByMimePrefix(
         const char *mimePrefix) {
     for (Track *track = mFirstTrack; track != NULL; track = track->next) {
@@ -93,6 +93,8 @@ private:
         // Initial start offset (move to later time), from empty edit list entry.
         uint64_t elst_initial_empty_edit_ticks;
         bool subsample_encryption;
+        // HEIF image track whose format is filled in on first access.
+        bool heif_meta_pending;
 
         uint8_t *mTx3gBuffer;
         size_t mTx3gSize, mTx3gFilled;
@@ -110,6 +112,7 @@ private:
             elst_shift_start_ticks = 0;
             elst_initial_empty_edit_ticks = 0;
             subsample_encryption = false;
+            heif_meta_pending = false;
             mTx3gBuffer = NULL;
             mTx3gSize = mTx3gFilled = 0;
         }
@@ -138,6 +141,7 @@ private:
     Vector<Trex> mTrex;
 
     DataSourceHelper *mDataSource;
+    size_t mCachedSampleTableBytes;
     status_t mInitCheck;
     uint32_t mHeaderTimescale;
     bool mIsQT;
@@ -177,6 +181,7 @@ private:
     status_t parseSegmentIndex(off64_t data_offset, size_t data_size);
 
     Track *findTrackByMimePrefix(const char *mimePrefix);
+    status_t resolveHeifTrackMeta(Track *track);
 
     status_t parseChannelCountSampleRate(
             off64_t *offset, uint16_t *channelCount, uint16_t *sampleRate);
@@ -20,6 +20,8 @@
 
 #include "MPEG2PSExtractor.h"
 
+#include <android-base/macros.h>
+
 #include <AnotherPacketSource.h>
 #include <ESQueue.h>
 
@@ -63,10 +65,21 @@ private:
     ElementaryStreamQueue *mQueue;
     sp<AnotherPacketSource> mSource;
 
+    // File offsets of the most recent PES packets by timestamp, used to
+    // locate the start of sync access units once the queue emits them.
+    KeyedVector<int64_t, off64_t> mPESOffsets;
+
+    // Offsets of the PES packets starting sync access units, by time.
+    KeyedVector<int64_t, off64_t> mSyncPoints;
+
     status_t appendPESData(
             unsigned PTS_DTS_flags,
             uint64_t PTS, uint64_t DTS,
-            const uint8_t *data, size_t size);
+            const uint8_t *data, size_t size,
+            off64_t offset);
+
+    // Drops all queued data, keeping the format.
+    void flush();
 
     DISALLOW_EVIL_CONSTRUCTORS(Track);
 };
@@ -99,7 +112,8 @@ MPEG2PSExtractor::MPEG2PSExtractor(DataSourceHelper *source)
       mFinalResult(OK),
       mBuffer(new ABuffer(0)),
       mScanning(true),
-      mProgramStreamMapValid(false) {
+      mProgramStreamMapValid(false),
+      mSeekTrack(NULL) {
     for (size_t i = 0; i < 500; ++i) {
         if (feedMore() != OK) {
             break;
@@ -118,6 +132,25 @@ MPEG2PSExtractor::MPEG2PSExtractor(DataSourceHelper *source)
     }
     AMediaFormat_delete(meta);
 
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        Track *track = mTracks.valueAt(i);
+        sp<MetaData> format = track->mSource->getFormat();
+        const char *mime;
+        if (format != NULL && format->findCString(kKeyMIMEType, &mime)
+                && !strncasecmp("video/", mime, 6)) {
+            mSeekTrack = track;
+            break;
+        }
+        if (mSeekTrack == NULL) {
+            mSeekTrack = track;
+        }
+    }
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        if (mTracks.valueAt(i) != mSeekTrack) {
+            mTracks.valueAt(i)->mSyncPoints.clear();
+        }
+    }
+
     mScanning = false;
 }
 
@@ -158,34 +191,43 @@ media_status_t MPEG2PSExtractor::getMetaData(AMediaFormat *meta) {
 }
 
 uint32_t MPEG2PSExtractor::flags() const {
-    return CAN_PAUSE;
+    return CAN_PAUSE | CAN_SEEK_BACKWARD | CAN_SEEK_FORWARD;
 }
 
 status_t MPEG2PSExtractor::feedMore() {
     Mutex::Autolock autoLock(mLock);
+    return feedMore_l();
+}
 
-    // How much data we're reading at a time
-    static const size_t kChunkSize = 8192;
+status_t MPEG2PSExtractor::feedMore_l() {
+    // How much data we're reading at a time. Reads are aligned to this
+    // size within the file, and the unparsed remainder is only moved to the
+    // front of the buffer when the next read would not fit behind it.
+    static const size_t kChunkSize = 65536;
 
     for (;;) {
         status_t err = dequeueChunk();
 
         if (err == -EAGAIN && mFinalResult == OK) {
-            memmove(mBuffer->base(), mBuffer->data(), mBuffer->size());
-            mBuffer->setRange(0, mBuffer->size());
-
-            if (mBuffer->size() + kChunkSize > mBuffer->capacity()) {
-                size_t newCapacity = mBuffer->capacity() + kChunkSize;
-                sp<ABuffer> newBuffer = new ABuffer(newCapacity);
-                memcpy(newBuffer->data(), mBuffer->data(), mBuffer->size());
-                newBuffer->setRange(0, mBuffer->size());
-                mBuffer = newBuffer;
+            size_t readSize = kChunkSize - (size_t)(mOffset % kChunkSize);
+
+            if (mBuffer->offset() + mBuffer->size() + readSize > mBuffer->capacity()) {
+                if (mBuffer->size() + readSize > mBuffer->capacity()) {
+                    size_t newCapacity = mBuffer->size() + kChunkSize;
+                    sp<ABuffer> newBuffer = new ABuffer(newCapacity);
+                    memcpy(newBuffer->data(), mBuffer->data(), mBuffer->size());
+                    newBuffer->setRange(0, mBuffer->size());
+                    mBuffer = newBuffer;
+                } else {
+                    memmove(mBuffer->base(), mBuffer->data(), mBuffer->size());
+                    mBuffer->setRange(0, mBuffer->size());
+                }
             }
 
             ssize_t n = mDataSource->readAt(
-                    mOffset, mBuffer->data() + mBuffer->size(), kChunkSize);
+                    mOffset, mBuffer->data() + mBuffer->size(), readSize);
 
-            if (n < (ssize_t)kChunkSize) {
+            if (n <= 0) {
                 mFinalResult = (n < 0) ? (status_t)n : ERROR_END_OF_STREAM;
                 return mFinalResult;
             }
@@ -246,6 +288,150 @@ status_t MPEG2PSExtractor::dequeueChunk() {
     return res;
 }
 
+status_t MPEG2PSExtractor::seek(int64_t seekTimeUs,
+        const MediaTrackHelper::ReadOptions::SeekMode &seekMode) {
+    Mutex::Autolock autoLock(mLock);
+
+    const KeyedVector<int64_t, off64_t> &syncPoints = mSeekTrack->mSyncPoints;
+    if (syncPoints.isEmpty()) {
+        ALOGW("No sync point to seek to.");
+        // ... and therefore we have nothing useful to do here.
+        return OK;
+    }
+
+    // Determine whether we're seeking beyond the known area.
+    bool shouldSeekBeyond =
+            (seekTimeUs > syncPoints.keyAt(syncPoints.size() - 1));
+
+    // Determine the sync point to seek.
+    size_t index = 0;
+    for (; index < syncPoints.size(); ++index) {
+        int64_t timeUs = syncPoints.keyAt(index);
+        if (timeUs > seekTimeUs) {
+            break;
+        }
+    }
+
+    switch (seekMode) {
+        case MediaTrackHelper::ReadOptions::SEEK_NEXT_SYNC:
+            if (index == syncPoints.size()) {
+                ALOGW("Next sync not found; starting from the latest sync.");
+                --index;
+            }
+            break;
+        case MediaTrackHelper::ReadOptions::SEEK_CLOSEST_SYNC:
+        case MediaTrackHelper::ReadOptions::SEEK_CLOSEST:
+            ALOGW("seekMode not supported: %d; falling back to PREVIOUS_SYNC",
+                    seekMode);
+            FALLTHROUGH_INTENDED;
+        case MediaTrackHelper::ReadOptions::SEEK_PREVIOUS_SYNC:
+            if (index == 0) {
+                ALOGW("Previous sync not found; starting from the earliest "
+                        "sync.");
+            } else {
+                --index;
+            }
+            break;
+        default:
+            return ERROR_UNSUPPORTED;
+    }
+
+    if (!shouldSeekBeyond || mOffset <= syncPoints.valueAt(index)) {
+        seekToOffset_l(syncPoints.valueAt(index));
+    }
+
+    if (shouldSeekBeyond) {
+        status_t err = seekBeyond_l(seekTimeUs);
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    // Fast-forward to sync frame.
+    const sp<AnotherPacketSource> &impl = mSeekTrack->mSource;
+    status_t err;
+    feedUntilBufferAvailable_l(mSeekTrack);
+    while (impl->hasBufferAvailable(&err)) {
+        sp<AMessage> meta = impl->getMetaAfterLastDequeued(0);
+        sp<ABuffer> buffer;
+        if (meta == NULL) {
+            return UNKNOWN_ERROR;
+        }
+        int32_t sync;
+        if (meta->findInt32("isSync", &sync) && sync) {
+            break;
+        }
+        err = impl->dequeueAccessUnit(&buffer);
+        if (err != OK) {
+            return err;
+        }
+        feedUntilBufferAvailable_l(mSeekTrack);
+    }
+
+    return OK;
+}
+
+void MPEG2PSExtractor::seekToOffset_l(off64_t offset) {
+    mOffset = offset;
+    mBuffer->setRange(0, 0);
+    mFinalResult = OK;
+
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        mTracks.valueAt(i)->flush();
+    }
+}
+
+status_t MPEG2PSExtractor::seekBeyond_l(int64_t seekTimeUs) {
+    // If we're seeking beyond where we know --- read until we reach there.
+    const KeyedVector<int64_t, off64_t> &syncPoints = mSeekTrack->mSyncPoints;
+    size_t syncPointsSize = syncPoints.size();
+
+    while (seekTimeUs > syncPoints.keyAt(syncPoints.size() - 1)) {
+        if (syncPointsSize < syncPoints.size()) {
+            syncPointsSize = syncPoints.size();
+            int64_t syncTimeUs = syncPoints.keyAt(syncPointsSize - 1);
+            // Dequeue buffers before sync point in order to avoid too much
+            // cache building up.
+            sp<ABuffer> buffer;
+            for (size_t i = 0; i < mTracks.size(); ++i) {
+                const sp<AnotherPacketSource> &impl = mTracks.valueAt(i)->mSource;
+                int64_t timeUs;
+                status_t err;
+                while ((err = impl->nextBufferTime(&timeUs)) == OK) {
+                    if (timeUs < syncTimeUs) {
+                        impl->dequeueAccessUnit(&buffer);
+                    } else {
+                        break;
+                    }
+                }
+                if (err != OK && err != -EWOULDBLOCK) {
+                    return err;
+                }
+            }
+        }
+        if (feedMore_l() != OK) {
+            return ERROR_END_OF_STREAM;
+        }
+    }
+
+    return OK;
+}
+
+status_t MPEG2PSExtractor::feedUntilBufferAvailable_l(Track *track) {
+    status_t finalResult;
+    while (!track->mSource->hasBufferAvailable(&finalResult)) {
+        if (finalResult != OK) {
+            return finalResult;
+        }
+
+        status_t err = feedMore_l();
+        if (err != OK) {
+            track->mSource->signalEOS(err);
+        }
+    }
+    return OK;
+}
+
 ssize_t MPEG2PSExtractor::dequeuePack() {
     // 32 + 2 + 3 + 1 + 15 + 1 + 15+ 1 + 9 + 1 + 22 + 1 + 1 | +5
 
@@ -568,9 +754,11 @@ ssize_t MPEG2PSExtractor::dequeuePES() {
         status_t err = OK;
 
         if (index >= 0) {
+            // mBuffer starts at this PES packet
+            off64_t offset = mOffset - mBuffer->size();
             err =
                 mTracks.editValueAt(index)->appendPESData(
-                    PTS_DTS_flags, PTS, DTS, br.data(), dataLength);
+                    PTS_DTS_flags, PTS, DTS, br.data(), dataLength, offset);
         }
 
         br.skipBits(dataLength * 8);
@@ -687,6 +875,18 @@ media_status_t MPEG2PSExtractor::Track::read(
         return AMEDIA_ERROR_UNKNOWN;
     }
 
+    int64_t seekTimeUs;
+    ReadOptions::SeekMode seekMode;
+    if (mExtractor->mSeekTrack == this && options
+            && options->getSeekTo(&seekTimeUs, &seekMode)) {
+        status_t err = mExtractor->seek(seekTimeUs, seekMode);
+        if (err == ERROR_END_OF_STREAM) {
+            return AMEDIA_ERROR_END_OF_STREAM;
+        } else if (err != OK) {
+            return AMEDIA_ERROR_UNKNOWN;
+        }
+    }
+
     status_t finalResult;
     while (!mSource->hasBufferAvailable(&finalResult)) {
         if (finalResult != OK) {
@@ -746,17 +946,37 @@ media_status_t MPEG2PSExtractor::Track::read(
     return AMEDIA_OK;
 }
 
+void MPEG2PSExtractor::Track::flush() {
+    if (mQueue != NULL) {
+        mQueue->clear(false /* clearFormat */);
+    }
+    if (mSource != NULL) {
+        sp<MetaData> format = mSource->getFormat();
+        mSource->clear();
+        mSource->setFormat(format);
+    }
+    mPESOffsets.clear();
+}
+
 status_t MPEG2PSExtractor::Track::appendPESData(
         unsigned PTS_DTS_flags,
         uint64_t PTS, uint64_t /* DTS */,
-        const uint8_t *data, size_t size) {
+        const uint8_t *data, size_t size,
+        off64_t offset) {
     if (mQueue == NULL) {
         return OK;
     }
 
+    // Access units are emitted a few PES packets after they start.
+    static const size_t kMaxPESOffsets = 64;
+
     int64_t timeUs;
     if (PTS_DTS_flags == 2 || PTS_DTS_flags == 3) {
         timeUs = (PTS * 100) / 9;
+        if (mPESOffsets.size() >= kMaxPESOffsets) {
+            mPESOffsets.removeItemsAt(0);
+        }
+        mPESOffsets.add(timeUs, offset);
     } else {
         timeUs = 0;
     }
@@ -769,6 +989,17 @@ status_t MPEG2PSExtractor::Track::appendPESData(
 
     sp<ABuffer> accessUnit;
     while ((accessUnit = mQueue->dequeueAccessUnit()) != NULL) {
+        int64_t accessUnitTimeUs;
+        int32_t isSync;
+        if ((mExtractor->mScanning || mExtractor->mSeekTrack == this)
+                && accessUnit->meta()->findInt64("timeUs", &accessUnitTimeUs)
+                && accessUnit->meta()->findInt32("isSync", &isSync) && isSync) {
+            ssize_t index = mPESOffsets.indexOfKey(accessUnitTimeUs);
+            if (index >= 0) {
+                mSyncPoints.add(accessUnitTimeUs, mPESOffsets.valueAt(index));
+            }
+        }
+
         if (mSource == NULL) {
             sp<MetaData> meta = mQueue->getFormat();
 
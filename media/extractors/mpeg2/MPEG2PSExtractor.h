@@ -63,7 +63,18 @@ private:
     bool mProgramStreamMapValid;
     KeyedVector<unsigned, unsigned> mStreamTypeByESID;
 
+    // The track whose sync points drive seeking (video if present);
+    // seek requests on other tracks are ignored.
+    Track *mSeekTrack;
+
     status_t feedMore();
+    status_t feedMore_l();
+
+    status_t seek(int64_t seekTimeUs,
+            const MediaTrackHelper::ReadOptions::SeekMode &seekMode);
+    void seekToOffset_l(off64_t offset);
+    status_t seekBeyond_l(int64_t seekTimeUs);
+    status_t feedUntilBufferAvailable_l(Track *track);
 
     status_t dequeueChunk();
     ssize_t dequeuePack();
@@ -20,7 +20,6 @@
 
 #include "OggExtractor.h"
 
-#include <cutils/properties.h>
 #include <utils/Vector.h>
 #include <media/stagefright/DataSourceBase.h>
 #include <media/ExtractorUtils.h>
@@ -135,11 +134,28 @@ protected:
 
     Vector<TOCEntry> mTableOfContents;
 
+    // Page offsets and times learned while seeking on sources where no
+    // table of contents could be built up front, kept sorted by time.
+    Vector<TOCEntry> mSeekIndex;
+
     int32_t mHapticChannelCount;
 
+    uint8_t *mPageBuffer;
+
     ssize_t readPage(off64_t offset, Page *page);
     status_t findNextPage(off64_t startOffset, off64_t *pageOffset);
 
+    // Returns true if the page at the given offset carries a valid checksum.
+    bool verifyPageCrc(off64_t offset, size_t *budget);
+
+    // Returns the number of bytes by which the packet that is left
+    // unterminated at the end of the current page extends into the pages
+    // starting at the given offset, capped at maxSize.
+    size_t peekContinuedPacketSize(off64_t offset, size_t maxSize);
+
+    status_t seekToApproximateTime(int64_t timeUs);
+    void addSeekIndexEntry(off64_t pageOffset, int64_t timeUs);
+
     virtual int64_t getTimeUsOfGranule(uint64_t granulePos) const = 0;
 
     // Extract codec format, metadata tags, and various codec specific data;
@@ -321,7 +337,8 @@ MyOggExtractor::MyOggExtractor(
       mNumHeaders(numHeaders),
       mSeekPreRollUs(seekPreRollUs),
       mFirstDataOffset(-1),
-      mHapticChannelCount(0) {
+      mHapticChannelCount(0),
+      mPageBuffer(NULL) {
     mCurrentPage.mNumSegments = 0;
     mCurrentPage.mFlags = 0;
 
@@ -332,6 +349,7 @@ MyOggExtractor::MyOggExtractor(
 }
 
 MyOggExtractor::~MyOggExtractor() {
+    free(mPageBuffer);
     AMediaFormat_delete(mFileMeta);
     AMediaFormat_delete(mMeta);
     vorbis_comment_clear(&mVc);
@@ -342,39 +360,200 @@ media_status_t MyOggExtractor::getFormat(AMediaFormat *meta) const {
     return AMediaFormat_copy(meta, mMeta);
 }
 
+// Header, full lacing table and 255 maximum-sized segments.
+static const size_t kMaxPageSize = 27 + 255 + 255 * 255;
+
+// Ogg page checksums use the CRC-32 polynomial 0x04c11db7 without bit
+// reflection, a zero initial value and no final xor. The tables below allow
+// eight bytes to be folded into the checksum per iteration (slice-by-8).
+static const size_t kOggCrcSlices = 8;
+
+static const uint32_t (*getOggCrcTables())[256] {
+    static uint32_t sTables[kOggCrcSlices][256];
+    static bool sInitialized = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i << 24;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+            }
+            sTables[0][i] = crc;
+        }
+        for (size_t k = 1; k < kOggCrcSlices; ++k) {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t prev = sTables[k - 1][i];
+                sTables[k][i] = (prev << 8) ^ sTables[0][prev >> 24];
+            }
+        }
+        return true;
+    }();
+    (void)sInitialized;
+    return sTables;
+}
+
+static uint32_t oggCrc32(uint32_t crc, const uint8_t *data, size_t size) {
+    const uint32_t (*t)[256] = getOggCrcTables();
+
+    while (size >= kOggCrcSlices) {
+        crc ^= U32_AT(data);
+        crc = t[7][crc >> 24] ^ t[6][(crc >> 16) & 0xff]
+                ^ t[5][(crc >> 8) & 0xff] ^ t[4][crc & 0xff]
+                ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += kOggCrcSlices;
+        size -= kOggCrcSlices;
+    }
+    while (size-- > 0) {
+        crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+// Returns a pointer to the first "OggS" capture pattern fully contained in
+// [data, data + size), or NULL if there is none. memchr is vectorized by the
+// C library, which makes skipping over non-matching bytes cheap.
+static const uint8_t *findCapturePattern(const uint8_t *data, size_t size) {
+    const uint8_t *end = data + size;
+    const uint8_t *p = data;
+    while (end - p >= 4) {
+        p = (const uint8_t *)memchr(p, 'O', end - p - 3);
+        if (p == NULL) {
+            return NULL;
+        }
+        if (!memcmp(p, "OggS", 4)) {
+            return p;
+        }
+        ++p;
+    }
+    return NULL;
+}
+
 status_t MyOggExtractor::findNextPage(
         off64_t startOffset, off64_t *pageOffset) {
     *pageOffset = startOffset;
 
+    // The first capture pattern found, in case the file was written with
+    // bad checksums and no page verifies.
+    off64_t firstCandidate = -1;
+
+    // Bytes of candidate pages that may still be read for verification,
+    // a file with bad checksums must not cost a page read per false match.
+    size_t crcBudget = 2 * kMaxPageSize;
+
+    // Scan in blocks rather than probing four bytes at a time; a block
+    // comfortably covers the typical amount of junk between pages.
+    static const size_t kScanBlockSize = 4096;
+    uint8_t block[kScanBlockSize];
+
     for (;;) {
-        char signature[4];
-        ssize_t n = mSource->readAt(*pageOffset, &signature, 4);
+        ssize_t n = mSource->readAt(*pageOffset, block, sizeof(block));
 
         if (n < 4) {
+            if (n >= 0 && firstCandidate >= 0) {
+                *pageOffset = firstCandidate;
+                return OK;
+            }
+
             *pageOffset = 0;
 
             return (n < 0) ? n : (status_t)ERROR_END_OF_STREAM;
         }
 
-        if (!memcmp(signature, "OggS", 4)) {
-            if (*pageOffset > startOffset) {
-                ALOGV("skipped %lld bytes of junk to reach next frame",
-                     (long long)(*pageOffset - startOffset));
+        const uint8_t *match = findCapturePattern(block, n);
+        if (match == NULL) {
+            // The last three bytes may hold the start of a capture pattern
+            // that straddles the block boundary.
+            *pageOffset += n - 3;
+
+            if (firstCandidate >= 0
+                    && *pageOffset - firstCandidate > (off64_t)kMaxPageSize) {
+                *pageOffset = firstCandidate;
+                return OK;
             }
+            continue;
+        }
 
+        off64_t candidate = *pageOffset + (match - block);
+        if (firstCandidate >= 0 && candidate - firstCandidate > (off64_t)kMaxPageSize) {
+            // A real page would have started within a page's length.
+            *pageOffset = firstCandidate;
             return OK;
         }
 
-        // see how far ahead to skip; avoid some fruitless comparisons
-        unsigned int i;
-        for (i = 1; i < 4 ; i++) {
-            if (signature[i] == 'O')
-                break;
+        if (!verifyPageCrc(candidate, &crcBudget)) {
+            // "OggS" also occurs inside packet data; don't lock onto it.
+            if (firstCandidate < 0) {
+                firstCandidate = candidate;
+            }
+            if (crcBudget == 0) {
+                *pageOffset = firstCandidate;
+                return OK;
+            }
+            *pageOffset = candidate + 1;
+            continue;
+        }
+
+        *pageOffset = candidate;
+        if (*pageOffset > startOffset) {
+            ALOGV("skipped %lld bytes of junk to reach next frame",
+                 (long long)(*pageOffset - startOffset));
         }
-        *pageOffset += i;
+
+        return OK;
     }
 }
 
+// Reads the page at |offset| and checks its CRC. The page size is taken
+// from |budget|, which is set to zero instead if the page exceeds it.
+bool MyOggExtractor::verifyPageCrc(off64_t offset, size_t *budget) {
+    Page page;
+    ssize_t pageSize = readPage(offset, &page);
+    if (pageSize <= 0) {
+        return false;
+    }
+
+    if ((size_t)pageSize > *budget) {
+        *budget = 0;
+        return false;
+    }
+    *budget -= pageSize;
+
+    if (mPageBuffer == NULL) {
+        mPageBuffer = (uint8_t *)malloc(kMaxPageSize);
+        if (mPageBuffer == NULL) {
+            return false;
+        }
+    }
+    CHECK_LE((size_t)pageSize, kMaxPageSize);
+
+    if (mSource->readAt(offset, mPageBuffer, pageSize) < pageSize) {
+        return false;
+    }
+
+    uint32_t expected = U32LE_AT(&mPageBuffer[22]);
+    memset(&mPageBuffer[22], 0, 4);
+
+    return oggCrc32(0, mPageBuffer, pageSize) == expected;
+}
+
+size_t MyOggExtractor::peekContinuedPacketSize(off64_t offset, size_t maxSize) {
+    size_t size = 0;
+    Page page;
+    ssize_t pageSize;
+    while (size < maxSize && (pageSize = readPage(offset, &page)) > 0) {
+        if ((page.mFlags & 1) == 0) {
+            // Not a continuation page, the packet ends where the data does.
+            break;
+        }
+        for (size_t i = 0; i < page.mNumSegments; ++i) {
+            size += page.mLace[i];
+            if (page.mLace[i] < 255) {
+                return size < maxSize ? size : maxSize;
+            }
+        }
+        offset += pageSize;
+    }
+    return size < maxSize ? size : maxSize;
+}
+
 // Given the offset of the "current" page, find the page immediately preceding
 // it (if any) and return its granule position.
 // To do this we back up from the "current" page's offset until we find any
@@ -439,16 +618,7 @@ status_t MyOggExtractor::seekToTime(int64_t timeUs) {
     }
 
     if (mTableOfContents.isEmpty()) {
-        // Perform approximate seeking based on avg. bitrate.
-        uint64_t bps = approxBitrate();
-        if (bps <= 0) {
-            return INVALID_OPERATION;
-        }
-
-        off64_t pos = timeUs * bps / 8000000ll;
-
-        ALOGV("seeking to offset %lld", (long long)pos);
-        return seekToOffset(pos);
+        return seekToApproximateTime(timeUs);
     }
 
     size_t left = 0;
@@ -480,6 +650,72 @@ status_t MyOggExtractor::seekToTime(int64_t timeUs) {
     return seekToOffset(entry.mPageOffset);
 }
 
+status_t MyOggExtractor::seekToApproximateTime(int64_t timeUs) {
+    // Perform approximate seeking based on avg. bitrate, refined by the
+    // pages we have landed on in earlier seeks: interpolate between the
+    // closest known pages on either side of the target time.
+    uint64_t bps = approxBitrate();
+    if (bps <= 0) {
+        return INVALID_OPERATION;
+    }
+
+    off64_t pos = timeUs * bps / 8000000ll;
+
+    size_t right = 0;
+    while (right < mSeekIndex.size() && mSeekIndex.itemAt(right).mTimeUs <= timeUs) {
+        ++right;
+    }
+    if (right > 0) {
+        const TOCEntry &lo = mSeekIndex.itemAt(right - 1);
+        if (right < mSeekIndex.size()) {
+            const TOCEntry &hi = mSeekIndex.itemAt(right);
+            pos = lo.mPageOffset + (off64_t)((double)(hi.mPageOffset - lo.mPageOffset)
+                    * (timeUs - lo.mTimeUs) / (hi.mTimeUs - lo.mTimeUs));
+        } else {
+            pos = lo.mPageOffset + (timeUs - lo.mTimeUs) * bps / 8000000ll;
+        }
+    } else if (right < mSeekIndex.size()) {
+        const TOCEntry &hi = mSeekIndex.itemAt(right);
+        off64_t start = mFirstDataOffset >= 0 ? mFirstDataOffset : 0;
+        if (hi.mTimeUs > 0 && hi.mPageOffset > start) {
+            pos = start + (off64_t)((double)(hi.mPageOffset - start) * timeUs / hi.mTimeUs);
+        }
+    }
+
+    ALOGV("seeking to offset %lld", (long long)pos);
+    status_t err = seekToOffset(pos);
+    if (err == OK && mOffset > mFirstDataOffset && mPrevGranulePosition > 0) {
+        addSeekIndexEntry(mOffset, getTimeUsOfGranule(mPrevGranulePosition));
+    }
+    return err;
+}
+
+void MyOggExtractor::addSeekIndexEntry(off64_t pageOffset, int64_t timeUs) {
+    // Same budget as the table of contents.
+    static const size_t kMaxNumSeekIndexEntries = 8192 / sizeof(TOCEntry);
+
+    size_t i = 0;
+    while (i < mSeekIndex.size() && mSeekIndex.itemAt(i).mTimeUs < timeUs) {
+        ++i;
+    }
+    if (i < mSeekIndex.size() && (mSeekIndex.itemAt(i).mTimeUs == timeUs
+            || mSeekIndex.itemAt(i).mPageOffset <= pageOffset)) {
+        // Already known, or inconsistent with what we know.
+        return;
+    }
+    if (i > 0 && mSeekIndex.itemAt(i - 1).mPageOffset >= pageOffset) {
+        return;
+    }
+    if (mSeekIndex.size() >= kMaxNumSeekIndexEntries) {
+        return;
+    }
+
+    TOCEntry entry;
+    entry.mPageOffset = pageOffset;
+    entry.mTimeUs = timeUs;
+    mSeekIndex.insertAt(entry, i);
+}
+
 status_t MyOggExtractor::seekToOffset(off64_t offset) {
     if (mFirstDataOffset >= 0 && offset < mFirstDataOffset) {
         // Once we know where the actual audio data starts (past the headers)
@@ -514,12 +750,16 @@ status_t MyOggExtractor::seekToOffset(off64_t offset) {
 }
 
 ssize_t MyOggExtractor::readPage(off64_t offset, Page *page) {
-    uint8_t header[27];
+    // Fetch the fixed header together with the largest possible lacing
+    // table in a single read; pages near the end of the data may return
+    // fewer bytes, which is fine as long as the lacing table is complete.
+    static const size_t kHeaderSize = 27;
+    uint8_t header[kHeaderSize + sizeof(page->mLace)];
     ssize_t n;
     if ((n = mSource->readAt(offset, header, sizeof(header)))
-            < (ssize_t)sizeof(header)) {
+            < (ssize_t)kHeaderSize) {
         ALOGV("failed to read %zu bytes at offset %#016llx, got %zd bytes",
-                sizeof(header), (long long)offset, n);
+                kHeaderSize, (long long)offset, n);
 
         if (n == 0 || n == ERROR_END_OF_STREAM) {
             return AMEDIA_ERROR_END_OF_STREAM;
@@ -558,13 +798,12 @@ ssize_t MyOggExtractor::readPage(off64_t offset, Page *page) {
     page->mPageNo = U32LE_AT(&header[18]);
 
     page->mNumSegments = header[26];
-    if (mSource->readAt(
-                offset + sizeof(header), page->mLace, page->mNumSegments)
-            < (ssize_t)page->mNumSegments) {
+    if (n < (ssize_t)(kHeaderSize + page->mNumSegments)) {
         return AMEDIA_ERROR_IO;
     }
+    memcpy(page->mLace, &header[kHeaderSize], page->mNumSegments);
 
-    size_t totalSize = 0;;
+    size_t totalSize = 0;
     for (size_t i = 0; i < page->mNumSegments; ++i) {
         totalSize += page->mLace[i];
     }
@@ -581,7 +820,7 @@ ssize_t MyOggExtractor::readPage(off64_t offset, Page *page) {
     ALOGV("%c %s", page->mFlags & 1 ? '+' : ' ', tmp.string());
 #endif
 
-    return sizeof(header) + page->mNumSegments + totalSize;
+    return kHeaderSize + page->mNumSegments + totalSize;
 }
 
 media_status_t MyOpusExtractor::readNextPacket(MediaBufferHelper **out) {
@@ -777,40 +1016,51 @@ media_status_t MyOggExtractor::_readNextPacket(MediaBufferHelper **out, bool cal
                 dataOffset += mCurrentPage.mLace[j];
             }
 
+            static const size_t kMaxPacketSize = 16 * 1024 * 1024; // arbitrary limit
             size_t fullSize = packetSize;
             if (buffer != NULL) {
                 fullSize += buffer->range_length();
             }
-            if (fullSize > 16 * 1024 * 1024) { // arbitrary limit of 16 MB packet size
+            if (fullSize > kMaxPacketSize) {
                 if (buffer != NULL) {
                     buffer->release();
                 }
                 ALOGE("b/36592202");
                 return AMEDIA_ERROR_MALFORMED;
             }
-            MediaBufferHelper *tmp;
-            if (mBufferGroup) {
-                mBufferGroup->acquire_buffer(&tmp, false, fullSize);
-                ALOGV("acquired buffer %p from group", tmp);
-            } else {
-                tmp = new StandAloneMediaBuffer(fullSize);
-            }
-            if (tmp == NULL) {
+            if (buffer == NULL || buffer->size() < fullSize) {
+                size_t allocSize = fullSize;
+                if (!gotFullPacket) {
+                    // The packet continues on the following page(s). Size the
+                    // buffer for all of it now, so that the remaining segments
+                    // are read in place instead of being copied page by page.
+                    allocSize += peekContinuedPacketSize(
+                            mOffset + mCurrentPageSize, kMaxPacketSize - fullSize);
+                }
+                MediaBufferHelper *tmp;
+                if (mBufferGroup) {
+                    mBufferGroup->acquire_buffer(&tmp, false, allocSize);
+                    ALOGV("acquired buffer %p from group", tmp);
+                } else {
+                    tmp = new StandAloneMediaBuffer(allocSize);
+                }
+                if (tmp == NULL) {
+                    if (buffer != NULL) {
+                        buffer->release();
+                    }
+                    ALOGE("b/36592202");
+                    return AMEDIA_ERROR_MALFORMED;
+                }
+                AMediaFormat_clear(tmp->meta_data());
                 if (buffer != NULL) {
+                    memcpy(tmp->data(), buffer->data(), buffer->range_length());
+                    tmp->set_range(0, buffer->range_length());
                     buffer->release();
+                } else {
+                    tmp->set_range(0, 0);
                 }
-                ALOGE("b/36592202");
-                return AMEDIA_ERROR_MALFORMED;
-            }
-            AMediaFormat_clear(tmp->meta_data());
-            if (buffer != NULL) {
-                memcpy(tmp->data(), buffer->data(), buffer->range_length());
-                tmp->set_range(0, buffer->range_length());
-                buffer->release();
-            } else {
-                tmp->set_range(0, 0);
+                buffer = tmp;
             }
-            buffer = tmp;
 
             ssize_t n = mSource->readAt(
                     dataOffset,
@@ -18,7 +18,13 @@
 #define LOG_TAG "ExtractorUnitTest"
 #include <utils/Log.h>
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
 #include <datasource/FileSource.h>
+#include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/MediaBufferGroup.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaDataUtils.h>
@@ -41,6 +47,7 @@
 using namespace android;
 
 #define OUTPUT_DUMP_FILE "/data/local/tmp/extractorOutput"
+#define HEIC_GALLERY_FILE "/data/local/tmp/extractorGallery.heic"
 
 constexpr int32_t kMaxCount = 10;
 constexpr int32_t kOpusSeekPreRollUs = 80000;  // 80 ms;
@@ -496,6 +503,521 @@ TEST_P(ExtractorUnitTest, SeekTest) {
     seekablePoints.clear();
 }
 
+// Times full reads of the program stream and seeks to each of its sync points.
+TEST_P(ExtractorUnitTest, PSThroughputAndSeekLatencyTest) {
+    if (mDisableTest || mExtractorName != MPEG2PS) return;
+
+    ALOGV("Measures MPEG2PS extractor read throughput and seek latency");
+    string inputFileName = gEnv->getRes() + GetParam().second;
+
+    int32_t status = setDataSource(inputFileName);
+    ASSERT_EQ(status, 0) << "SetDataSource failed for" << GetParam().first << "extractor";
+
+    // Read every track to the end a few times, from a new extractor each time.
+    const int32_t kNumPasses = 5;
+    size_t numBytes = 0;
+    size_t numSamples = 0;
+    size_t prevPassSamples = 0;
+    int64_t startUs = ALooper::GetNowUs();
+    for (int32_t pass = 0; pass < kNumPasses; pass++) {
+        if (mExtractor) {
+            delete mExtractor;
+            mExtractor = nullptr;
+        }
+        status = createExtractor();
+        ASSERT_EQ(status, 0) << "Extractor creation failed for" << GetParam().first << "extractor";
+
+        int32_t numTracks = mExtractor->countTracks();
+        ASSERT_GT(numTracks, 0) << "Extractor didn't find any track for the given clip";
+
+        size_t passSamples = 0;
+        for (int32_t idx = 0; idx < numTracks; idx++) {
+            MediaTrackHelper *track = mExtractor->getTrack(idx);
+            ASSERT_NE(track, nullptr) << "Failed to get track for index " << idx;
+
+            CMediaTrack *cTrack = wrap(track);
+            ASSERT_NE(cTrack, nullptr) << "Failed to get track wrapper for index " << idx;
+
+            MediaBufferGroup *bufferGroup = new MediaBufferGroup();
+            status = cTrack->start(track, bufferGroup->wrap());
+            ASSERT_EQ(OK, (media_status_t)status) << "Failed to start the track";
+
+            while (status != AMEDIA_ERROR_END_OF_STREAM) {
+                MediaBufferHelper *buffer = nullptr;
+                status = track->read(&buffer);
+                if (buffer) {
+                    numBytes += buffer->range_length();
+                    passSamples++;
+                    buffer->release();
+                }
+            }
+            status = cTrack->stop(track);
+            ASSERT_EQ(OK, status) << "Failed to stop the track";
+            delete bufferGroup;
+            delete track;
+        }
+        ASSERT_GT(passSamples, 0) << "No samples extracted";
+        if (pass > 0) {
+            ASSERT_EQ(prevPassSamples, passSamples) << "Passes extracted different samples";
+        }
+        prevPassSamples = passSamples;
+        numSamples += passSamples;
+    }
+    int64_t readUs = ALooper::GetNowUs() - startUs;
+
+    // Seek to every sync point of the track that drives seeking, in a
+    // scattered order, and check that the sync frame itself is returned.
+    int32_t seekTrackIdx = 0;
+    AMediaFormat *trackFormat = AMediaFormat_new();
+    ASSERT_NE(trackFormat, nullptr) << "AMediaFormat_new returned null format";
+    for (int32_t idx = 0; idx < mExtractor->countTracks(); idx++) {
+        const char *mime;
+        ASSERT_EQ(AMEDIA_OK, mExtractor->getTrackMetaData(trackFormat, idx, 0));
+        if (AMediaFormat_getString(trackFormat, AMEDIAFORMAT_KEY_MIME, &mime)
+                && !strncmp(mime, "video/", 6)) {
+            seekTrackIdx = idx;
+            break;
+        }
+    }
+    AMediaFormat_delete(trackFormat);
+
+    MediaTrackHelper *track = mExtractor->getTrack(seekTrackIdx);
+    ASSERT_NE(track, nullptr) << "Failed to get track for index " << seekTrackIdx;
+    CMediaTrack *cTrack = wrap(track);
+    ASSERT_NE(cTrack, nullptr) << "Failed to get track wrapper for index " << seekTrackIdx;
+    MediaBufferGroup *bufferGroup = new MediaBufferGroup();
+    status = cTrack->start(track, bufferGroup->wrap());
+    ASSERT_EQ(OK, (media_status_t)status) << "Failed to start the track";
+
+    vector<int64_t> seekablePoints;
+    getSeekablePoints(seekablePoints, track);
+    ASSERT_GT(seekablePoints.size(), 0) << "Failed to get seekable points";
+
+    size_t numSeekPoints = seekablePoints.size();
+    // Any stride co-prime with the number of points visits all of them.
+    size_t stride = 1;
+    for (size_t candidate = numSeekPoints / 2 + 1; candidate < numSeekPoints; candidate++) {
+        size_t a = candidate, b = numSeekPoints;
+        while (b) {
+            size_t t = a % b;
+            a = b;
+            b = t;
+        }
+        if (a == 1) {
+            stride = candidate;
+            break;
+        }
+    }
+
+    int64_t totalSeekUs = 0;
+    int64_t maxSeekUs = 0;
+    for (size_t i = 0; i < numSeekPoints; i++) {
+        int64_t seekToTimeStamp = seekablePoints[(i * stride) % numSeekPoints];
+        MediaTrackHelper::ReadOptions options(
+                CMediaTrackReadOptions::SEEK_PREVIOUS_SYNC | CMediaTrackReadOptions::SEEK,
+                seekToTimeStamp);
+
+        MediaBufferHelper *buffer = nullptr;
+        int64_t seekStartUs = ALooper::GetNowUs();
+        status = track->read(&buffer, &options);
+        int64_t seekUs = ALooper::GetNowUs() - seekStartUs;
+        ASSERT_EQ(AMEDIA_OK, status) << "Seek to " << seekToTimeStamp << " failed";
+        ASSERT_NE(buffer, nullptr);
+
+        int64_t timeStamp;
+        AMediaFormat_getInt64(buffer->meta_data(), AMEDIAFORMAT_KEY_TIME_US, &timeStamp);
+        buffer->release();
+        // A sync frame whose pack could not be indexed is reached through
+        // the preceding indexed one.
+        EXPECT_LE(timeStamp, seekToTimeStamp) << "Seek went past the requested sync frame";
+        EXPECT_NE(find(seekablePoints.begin(), seekablePoints.end(), timeStamp),
+                  seekablePoints.end()) << "Seek didn't return a sync frame";
+
+        totalSeekUs += seekUs;
+        maxSeekUs = max(maxSeekUs, seekUs);
+    }
+
+    status = cTrack->stop(track);
+    ASSERT_EQ(OK, status) << "Failed to stop the track";
+    delete bufferGroup;
+    delete track;
+
+    ALOGI("%s: %d passes, %zu samples, %zu bytes in %lld us (%.1f MB/s); "
+          "%zu seeks, avg %lld us, max %lld us",
+          GetParam().second.c_str(), kNumPasses, numSamples, numBytes, (long long)readUs,
+          numBytes / (readUs > 0 ? (double)readUs : 1.0), numSeekPoints,
+          (long long)(totalSeekUs / (int64_t)numSeekPoints), (long long)maxSeekUs);
+}
+
+// Builds a gallery-style HEIC in memory: a grid primary image made of many
+// hidden hvc1 tiles, a thumbnail and an Exif block, with all image data in
+// one mdat. Tiles share their hvcC and ispe properties, as encoders write them.
+class HeicBuilder {
+  public:
+    static constexpr int32_t kTileWidth = 512;
+    static constexpr int32_t kTileHeight = 512;
+    static constexpr int32_t kThumbWidth = 320;
+    static constexpr int32_t kThumbHeight = 240;
+    static constexpr uint8_t kRotation = 1;  // 90 degrees CCW
+
+    HeicBuilder(int32_t rows, int32_t columns) : mRows(rows), mColumns(columns) {}
+
+    uint32_t gridId() const { return 1; }
+    uint32_t tileId(int32_t tile) const { return 2 + tile; }
+    uint32_t thumbId() const { return 2 + mRows * mColumns; }
+    uint32_t exifId() const { return 3 + mRows * mColumns; }
+    size_t exifSize() const { return sizeof(kExifData); }
+
+    vector<uint8_t> build() {
+        // The meta box size doesn't depend on the offsets it records, so
+        // lay it out once to find where mdat starts.
+        vector<uint8_t> ftypAndMeta = buildHeader(0);
+        return buildFile(ftypAndMeta.size() + 8);
+    }
+
+  private:
+    static constexpr uint8_t kExifData[] = {
+            0, 0, 0, 6, 'E', 'x', 'i', 'f', 0, 0, 'M', 'M', 0, 42, 0, 0, 0, 8};
+
+    int32_t mRows;
+    int32_t mColumns;
+    vector<uint8_t> mOut;
+
+    void u8(uint8_t v) { mOut.push_back(v); }
+    void u16(uint16_t v) {
+        u8(v >> 8);
+        u8(v);
+    }
+    void u32(uint32_t v) {
+        u16(v >> 16);
+        u16(v);
+    }
+    void fourcc(const char *s) { mOut.insert(mOut.end(), s, s + 4); }
+    size_t beginBox(const char *type) {
+        size_t start = mOut.size();
+        u32(0);
+        fourcc(type);
+        return start;
+    }
+    size_t beginFullBox(const char *type, uint8_t version, uint32_t flags) {
+        size_t start = beginBox(type);
+        u32((version << 24) | flags);
+        return start;
+    }
+    void endBox(size_t start) {
+        uint32_t size = mOut.size() - start;
+        mOut[start] = size >> 24;
+        mOut[start + 1] = size >> 16;
+        mOut[start + 2] = size >> 8;
+        mOut[start + 3] = size;
+    }
+
+    void hvcC() {
+        size_t box = beginBox("hvcC");
+        u8(1);  // configurationVersion
+        for (int32_t i = 1; i < 21; i++) u8(0);
+        u8(0xFC | 3);  // lengthSizeMinusOne
+        u8(0);         // numOfArrays
+        endBox(box);
+    }
+    void ispe(int32_t width, int32_t height) {
+        size_t box = beginFullBox("ispe", 0, 0);
+        u32(width);
+        u32(height);
+        endBox(box);
+    }
+    void infe(uint32_t id, const char *type, bool hidden) {
+        size_t box = beginFullBox("infe", 2, hidden ? 1 : 0);
+        u16(id);
+        u16(0);  // item_protection_index
+        fourcc(type);
+        u8(0);  // empty item_name
+        endBox(box);
+    }
+    void iref(const char *type, uint32_t from, const vector<uint32_t> &to) {
+        size_t box = beginBox(type);
+        u16(from);
+        u16(to.size());
+        for (uint32_t id : to) u16(id);
+        endBox(box);
+    }
+
+    static size_t tileSampleSize() { return 4 + 2 + 8; }
+
+    void tileSample(uint32_t id) {
+        u32(2 + 8);
+        u8(19 << 1);  // IDR_W_RADL
+        u8(1);
+        for (int32_t i = 0; i < 8; i++) u8(id + i);
+    }
+
+    vector<uint8_t> buildHeader(size_t dataOffset) {
+        int32_t numTiles = mRows * mColumns;
+        mOut.clear();
+
+        size_t box = beginBox("ftyp");
+        fourcc("heic");
+        u32(0);
+        fourcc("mif1");
+        fourcc("heic");
+        endBox(box);
+
+        size_t meta = beginFullBox("meta", 0, 0);
+
+        box = beginFullBox("hdlr", 0, 0);
+        u32(0);
+        fourcc("pict");
+        u32(0);
+        u32(0);
+        u32(0);
+        u8(0);
+        endBox(box);
+
+        box = beginFullBox("pitm", 0, 0);
+        u16(gridId());
+        endBox(box);
+
+        box = beginFullBox("iinf", 0, 0);
+        u16(numTiles + 3);
+        infe(gridId(), "grid", false);
+        for (int32_t tile = 0; tile < numTiles; tile++) {
+            infe(tileId(tile), "hvc1", true);
+        }
+        infe(thumbId(), "hvc1", false);
+        infe(exifId(), "Exif", false);
+        endBox(box);
+
+        // Item data goes into mdat in item id order: the grid descriptor,
+        // the tiles, the thumbnail and the Exif block.
+        box = beginFullBox("iloc", 0, 0);
+        u8(0x44);  // offset_size 4, length_size 4
+        u8(0x00);  // base_offset_size 0
+        u16(numTiles + 3);
+        uint32_t offset = dataOffset;
+        auto location = [&](uint32_t id, uint32_t length) {
+            u16(id);
+            u16(0);  // data_reference_index
+            u16(1);  // extent_count
+            u32(offset);
+            u32(length);
+            offset += length;
+        };
+        location(gridId(), 8);
+        for (int32_t tile = 0; tile < numTiles; tile++) {
+            location(tileId(tile), tileSampleSize());
+        }
+        location(thumbId(), tileSampleSize());
+        location(exifId(), exifSize());
+        endBox(box);
+
+        size_t iprp = beginBox("iprp");
+        size_t ipco = beginBox("ipco");
+        hvcC();                                   // 1: tile config
+        ispe(kTileWidth, kTileHeight);            // 2: tile size
+        ispe(mColumns * kTileWidth, mRows * kTileHeight);  // 3: grid size
+        box = beginBox("irot");                   // 4: grid rotation
+        u8(kRotation);
+        endBox(box);
+        hvcC();                                   // 5: thumbnail config
+        ispe(kThumbWidth, kThumbHeight);          // 6: thumbnail size
+        box = beginFullBox("pixi", 0, 0);         // 7: unrecognized
+        u8(3);
+        u8(8);
+        u8(8);
+        u8(8);
+        endBox(box);
+        endBox(ipco);
+
+        box = beginFullBox("ipma", 0, 0);
+        u32(numTiles + 2);
+        u16(gridId());
+        u8(2);
+        u8(3);
+        u8(0x80 | 4);
+        for (int32_t tile = 0; tile < numTiles; tile++) {
+            u16(tileId(tile));
+            u8(3);
+            u8(0x80 | 1);
+            u8(2);
+            u8(7);
+        }
+        u16(thumbId());
+        u8(2);
+        u8(0x80 | 5);
+        u8(6);
+        endBox(box);
+        endBox(iprp);
+
+        box = beginFullBox("iref", 0, 0);
+        vector<uint32_t> tiles;
+        for (int32_t tile = 0; tile < numTiles; tile++) {
+            tiles.push_back(tileId(tile));
+        }
+        iref("dimg", gridId(), tiles);
+        iref("thmb", thumbId(), {gridId()});
+        iref("cdsc", exifId(), {gridId()});
+        endBox(box);
+
+        endBox(meta);
+        return mOut;
+    }
+
+    vector<uint8_t> buildFile(size_t dataOffset) {
+        buildHeader(dataOffset);
+
+        size_t box = beginBox("mdat");
+        u16(0);  // ImageGrid version and flags
+        u8(mRows - 1);
+        u8(mColumns - 1);
+        u16(mColumns * kTileWidth);
+        u16(mRows * kTileHeight);
+        for (int32_t tile = 0; tile < mRows * mColumns; tile++) {
+            tileSample(tileId(tile));
+        }
+        tileSample(thumbId());
+        mOut.insert(mOut.end(), kExifData, kExifData + sizeof(kExifData));
+        endBox(box);
+        return mOut;
+    }
+};
+
+constexpr uint8_t HeicBuilder::kExifData[];
+
+// Opens a HEIC with many items over and over, the way a gallery does when it
+// fetches the size, thumbnail and Exif of each picture.
+class HeifGalleryTest : public ::testing::Test {
+  public:
+    HeifGalleryTest() : mFp(nullptr) {}
+
+    virtual void TearDown() override {
+        if (mFp) {
+            fclose(mFp);
+            mFp = nullptr;
+        }
+        unlink(HEIC_GALLERY_FILE);
+    }
+
+    FILE *mFp;
+};
+
+using FormatPtr = unique_ptr<AMediaFormat, decltype(&AMediaFormat_delete)>;
+
+TEST_F(HeifGalleryTest, ManyItemOpenTest) {
+    ALOGV("Measures the cost of opening a HEIC with many items");
+    const int32_t kRows = 8;
+    const int32_t kColumns = 6;
+    const int32_t kNumOpens = 200;
+
+    HeicBuilder builder(kRows, kColumns);
+    vector<uint8_t> heic = builder.build();
+
+    mFp = fopen(HEIC_GALLERY_FILE, "w+b");
+    ASSERT_NE(mFp, nullptr) << "Unable to create " << HEIC_GALLERY_FILE;
+    ASSERT_EQ(fwrite(heic.data(), 1, heic.size(), mFp), heic.size());
+    fflush(mFp);
+    int32_t fd = fileno(mFp);
+
+    int64_t totalOpenUs = 0;
+    int64_t maxOpenUs = 0;
+    for (int32_t i = 0; i < kNumOpens; i++) {
+        int64_t startUs = ALooper::GetNowUs();
+        sp<DataSource> dataSource = new FileSource(dup(fd), 0, heic.size());
+        unique_ptr<MPEG4Extractor> extractor(
+                new MPEG4Extractor(new DataSourceHelper(dataSource->wrap())));
+        ASSERT_EQ(extractor->countTracks(), 1u) << "Only the grid should be displayable";
+
+        FormatPtr trackFormatHolder(AMediaFormat_new(), &AMediaFormat_delete);
+        AMediaFormat *trackFormat = trackFormatHolder.get();
+        ASSERT_EQ(AMEDIA_OK, extractor->getTrackMetaData(trackFormat, 0, 0));
+        FormatPtr fileFormatHolder(AMediaFormat_new(), &AMediaFormat_delete);
+        AMediaFormat *fileFormat = fileFormatHolder.get();
+        ASSERT_EQ(AMEDIA_OK, extractor->getMetaData(fileFormat));
+        int64_t openUs = ALooper::GetNowUs() - startUs;
+        totalOpenUs += openUs;
+        maxOpenUs = max(maxOpenUs, openUs);
+
+        if (i == 0) {
+            const char *mime;
+            ASSERT_TRUE(AMediaFormat_getString(fileFormat, AMEDIAFORMAT_KEY_MIME, &mime));
+            EXPECT_STREQ(mime, MEDIA_MIMETYPE_CONTAINER_HEIF);
+            int64_t exifOffset, exifSize;
+            ASSERT_TRUE(AMediaFormat_getInt64(fileFormat, AMEDIAFORMAT_KEY_EXIF_OFFSET,
+                                              &exifOffset));
+            ASSERT_TRUE(AMediaFormat_getInt64(fileFormat, AMEDIAFORMAT_KEY_EXIF_SIZE,
+                                              &exifSize));
+            // The size of the item, less the offset to the 'Exif\0\0' header.
+            EXPECT_EQ(exifSize, (int64_t)builder.exifSize() - 4);
+            EXPECT_EQ(exifOffset + exifSize, (int64_t)heic.size());
+
+            ASSERT_TRUE(AMediaFormat_getString(trackFormat, AMEDIAFORMAT_KEY_MIME, &mime));
+            EXPECT_STREQ(mime, MEDIA_MIMETYPE_IMAGE_ANDROID_HEIC);
+            int32_t value = 0;
+            EXPECT_TRUE(AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_IS_DEFAULT, &value));
+            EXPECT_TRUE(AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_WIDTH, &value));
+            EXPECT_EQ(value, kColumns * HeicBuilder::kTileWidth);
+            EXPECT_TRUE(AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_HEIGHT, &value));
+            EXPECT_EQ(value, kRows * HeicBuilder::kTileHeight);
+            EXPECT_TRUE(AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_ROTATION, &value));
+            EXPECT_EQ(value, 360 - HeicBuilder::kRotation * 90);
+            EXPECT_TRUE(AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_GRID_ROWS, &value));
+            EXPECT_EQ(value, kRows);
+            EXPECT_TRUE(
+                    AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_GRID_COLUMNS, &value));
+            EXPECT_EQ(value, kColumns);
+            EXPECT_TRUE(AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_TILE_WIDTH, &value));
+            EXPECT_EQ(value, HeicBuilder::kTileWidth);
+            EXPECT_TRUE(
+                    AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_TILE_HEIGHT, &value));
+            EXPECT_EQ(value, HeicBuilder::kTileHeight);
+            EXPECT_TRUE(
+                    AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_THUMBNAIL_WIDTH, &value));
+            EXPECT_EQ(value, HeicBuilder::kThumbWidth);
+            EXPECT_TRUE(AMediaFormat_getInt32(trackFormat, AMEDIAFORMAT_KEY_THUMBNAIL_HEIGHT,
+                                              &value));
+            EXPECT_EQ(value, HeicBuilder::kThumbHeight);
+            void *csd;
+            size_t csdSize;
+            EXPECT_TRUE(AMediaFormat_getBuffer(trackFormat, AMEDIAFORMAT_KEY_CSD_HEVC, &csd,
+                                               &csdSize));
+            EXPECT_TRUE(AMediaFormat_getBuffer(trackFormat, AMEDIAFORMAT_KEY_THUMBNAIL_CSD_HEVC,
+                                               &csd, &csdSize));
+
+            // Every tile of the grid comes out of the image track, in order.
+            // The group outlives the track, which returns its buffers on teardown.
+            unique_ptr<MediaBufferGroup> bufferGroup(new MediaBufferGroup());
+            unique_ptr<MediaTrackHelper> track(extractor->getTrack(0));
+            ASSERT_NE(track.get(), nullptr) << "Failed to get the image track";
+            unique_ptr<CMediaTrack, decltype(&free)> cTrack(wrap(track.get()), &free);
+            ASSERT_NE(cTrack.get(), nullptr) << "Failed to get the image track wrapper";
+            ASSERT_EQ(AMEDIA_OK, cTrack->start(track.get(), bufferGroup->wrap()));
+
+            MediaTrackHelper::ReadOptions options(CMediaTrackReadOptions::SEEK_CLOSEST_SYNC |
+                                                          CMediaTrackReadOptions::SEEK,
+                                                  0);
+            int32_t numTiles = 0;
+            media_status_t status = AMEDIA_OK;
+            while (status != AMEDIA_ERROR_END_OF_STREAM) {
+                MediaBufferHelper *buffer = nullptr;
+                status = track->read(&buffer, numTiles == 0 ? &options : nullptr);
+                if (buffer) {
+                    const uint8_t *data = (const uint8_t *)buffer->data() + buffer->range_offset();
+                    ASSERT_EQ(buffer->range_length(), 4u + 2 + 8);
+                    EXPECT_EQ(data[6], (uint8_t)builder.tileId(numTiles));
+                    numTiles++;
+                    buffer->release();
+                }
+                ASSERT_TRUE(status == AMEDIA_OK || status == AMEDIA_ERROR_END_OF_STREAM);
+            }
+            EXPECT_EQ(numTiles, kRows * kColumns);
+            ASSERT_EQ(AMEDIA_OK, cTrack->stop(track.get()));
+        }
+    }
+
+    ALOGI("%d opens of a %d-item HEIC (%zu bytes): avg %lld us, max %lld us", kNumOpens,
+          kRows * kColumns + 3, heic.size(), (long long)(totalOpenUs / kNumOpens),
+          (long long)maxOpenUs);
+}
+
 // TODO: (b/145332185)
 // Add MIDI inputs
 INSTANTIATE_TEST_SUITE_P(ExtractorUnitTestAll, ExtractorUnitTest,
@@ -657,6 +657,16 @@ status_t StagefrightRecorder::setParam64BitFileOffset(bool use64Bit) {
     return OK;
 }
 
+status_t StagefrightRecorder::setParamFragmentDuration(int64_t durationUs) {
+    ALOGV("setParamFragmentDuration: %lld us", (long long)durationUs);
+    if (durationUs < 0) {
+        return BAD_VALUE;
+    }
+    // 0 turns off fragmented recording.
+    mFragmentDurationUs = durationUs;
+    return OK;
+}
+
 status_t StagefrightRecorder::setParamVideoCameraId(int32_t cameraId) {
     ALOGV("setParamVideoCameraId: %d", cameraId);
     if (cameraId < 0) {
@@ -804,6 +814,11 @@ status_t StagefrightRecorder::setParameter(
         if (safe_strtoi32(value.string(), &use64BitOffset)) {
             return setParam64BitFileOffset(use64BitOffset != 0);
         }
+    } else if (key == "param-fragment-duration-ms") {
+        int64_t fragmentDurationMs;
+        if (safe_strtoi64(value.string(), &fragmentDurationMs)) {
+            return setParamFragmentDuration(1000LL * fragmentDurationMs);
+        }
     } else if (key == "param-geotag-longitude") {
         int64_t longitudex10000;
         if (safe_strtoi64(value.string(), &longitudex10000)) {
@@ -2013,6 +2028,9 @@ void StagefrightRecorder::setupMPEG4orWEBMMetaData(sp<MetaData> *meta) {
     if (mOutputFormat == OUTPUT_FORMAT_MPEG_4 || mOutputFormat == OUTPUT_FORMAT_THREE_GPP) {
         (*meta)->setInt32(kKeyEmptyTrackMalFormed, true);
         (*meta)->setInt32(kKey4BitTrackIds, true);
+        if (mFragmentDurationUs > 0) {
+            (*meta)->setInt64(kKeyFragmentDurationUs, mFragmentDurationUs);
+        }
     }
 }
 
@@ -2214,6 +2232,7 @@ status_t StagefrightRecorder::reset() {
     mIFramesIntervalSec = 1;
     mAudioSourceNode = 0;
     mUse64BitFileOffset = false;
+    mFragmentDurationUs = 0;
     mMovieTimeScale  = -1;
     mAudioTimeScale  = -1;
     mVideoTimeScale  = -1;
@@ -2378,6 +2397,8 @@ status_t StagefrightRecorder::dump(
     result.append(buffer);
     snprintf(buffer, SIZE, "     Interleave duration (us): %d\n", mInterleaveDurationUs);
     result.append(buffer);
+    snprintf(buffer, SIZE, "     Fragment duration (us): %" PRId64 "\n", mFragmentDurationUs);
+    result.append(buffer);
     snprintf(buffer, SIZE, "     Progress notification: %" PRId64 " us\n", mTrackEveryTimeDurationUs);
     result.append(buffer);
     snprintf(buffer, SIZE, "   Audio\n");
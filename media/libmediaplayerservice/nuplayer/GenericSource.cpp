@@ -52,6 +52,18 @@ static const int kInitialMarkMs        = 5000;  // 5secs
 //static const int kPausePlaybackMarkMs  = 2000;  // 2secs
 static const int kResumePlaybackMarkMs = 15000;  // 15secs
 
+// Maximum number of video access units read ahead on a local SEEK_CLOSEST seek.
+static const size_t kMaxSeekPrefetchBuffers = 64;
+
+// Local playback refills a track once less than kLocalLowWatermarkUs is
+// buffered and reads it ahead up to kLocalHighWatermarkUs.
+static const int64_t kLocalLowWatermarkUs = 250000LL;
+static const int64_t kLocalHighWatermarkUs = 1000000LL;
+
+// Unless it runs low, a track doesn't read further ahead of the other one than
+// this, so that interleaved content is read from one region of the file.
+static const int64_t kMaxTrackSkewUs = 1000000LL;
+
 NuPlayer::GenericSource::GenericSource(
         const sp<AMessage> &notify,
         bool uidValid,
@@ -852,9 +864,16 @@ status_t NuPlayer::GenericSource::dequeueAccessUnit(
         return -EWOULDBLOCK;
     }
 
+    ReadStats *readStats = audio ? &mAudioReadStats : &mVideoReadStats;
+
     status_t finalResult;
     if (!track->mPackets->hasBufferAvailable(&finalResult)) {
         if (finalResult == OK) {
+            if (mStarted && !readStats->mStarved) {
+                ++readStats->mNumUnderruns;
+            }
+            readStats->mStarved = true;
+
             postReadBuffer(
                     audio ? MEDIA_TRACK_TYPE_AUDIO : MEDIA_TRACK_TYPE_VIDEO);
             return -EWOULDBLOCK;
@@ -863,19 +882,19 @@ status_t NuPlayer::GenericSource::dequeueAccessUnit(
     }
 
     status_t result = track->mPackets->dequeueAccessUnit(accessUnit);
+    readStats->mStarved = false;
 
     // start pulling in more buffers if cache is running low
     // so that decoder has less chance of being starved
     if (!mIsStreaming) {
-        if (track->mPackets->getAvailableBufferCount(&finalResult) < 2) {
+        if (track->mPackets->getAvailableBufferCount(&finalResult) < 2
+                || track->mPackets->getBufferedDurationUs(&finalResult)
+                        < getLowWatermarkUs()) {
             postReadBuffer(audio? MEDIA_TRACK_TYPE_AUDIO : MEDIA_TRACK_TYPE_VIDEO);
         }
     } else {
         int64_t durationUs = track->mPackets->getBufferedDurationUs(&finalResult);
-        // TODO: maxRebufferingMarkMs could be larger than
-        // mBufferingSettings.mResumePlaybackMarkMs
-        int64_t restartBufferingMarkUs =
-             mBufferingSettings.mResumePlaybackMarkMs * 1000LL / 2;
+        int64_t restartBufferingMarkUs = getLowWatermarkUs();
         if (finalResult == OK) {
             if (durationUs < restartBufferingMarkUs) {
                 postReadBuffer(audio? MEDIA_TRACK_TYPE_AUDIO : MEDIA_TRACK_TYPE_VIDEO);
@@ -1160,6 +1179,25 @@ status_t NuPlayer::GenericSource::doSeek(int64_t seekTimeUs, MediaPlayerSeekMode
 
         if (mode != MediaPlayerSeekMode::SEEK_CLOSEST) {
             seekTimeUs = std::max<int64_t>(0, actualTimeUs);
+        } else if (actualTimeUs < seekTimeUs && !mIsStreaming) {
+            // The decoder has to decode from the sync sample up to the target
+            // anyway; read the rest of the GOP in one burst here so that it
+            // doesn't wait on a read round trip every few frames. Not done when
+            // streaming, where each read may block on the network.
+            status_t finalResult = OK;
+            size_t numBuffers = mVideoTrack.mPackets->getAvailableBufferCount(&finalResult);
+            while (mVideoTimeUs < seekTimeUs && finalResult == OK
+                    && numBuffers < kMaxSeekPrefetchBuffers) {
+                readBuffer(MEDIA_TRACK_TYPE_VIDEO);
+                size_t newNumBuffers =
+                        mVideoTrack.mPackets->getAvailableBufferCount(&finalResult);
+                if (newNumBuffers == numBuffers) {
+                    break;  // source would block
+                }
+                numBuffers = newNumBuffers;
+            }
+            ALOGV("seek prefetched %zu video buffers up to %lld us",
+                    numBuffers, (long long)mVideoTimeUs);
         }
         mVideoLastDequeueTimeUs = actualTimeUs;
     }
@@ -1170,6 +1208,10 @@ status_t NuPlayer::GenericSource::doSeek(int64_t seekTimeUs, MediaPlayerSeekMode
         mAudioLastDequeueTimeUs = seekTimeUs;
     }
 
+    // Waiting for the first buffer after a seek isn't an underrun.
+    mAudioReadStats.mStarved = true;
+    mVideoReadStats.mStarved = true;
+
     if (mSubtitleTrack.mSource != NULL) {
         mSubtitleTrack.mPackets->clear();
         mFetchSubtitleDataGeneration++;
@@ -1318,9 +1360,90 @@ void NuPlayer::GenericSource::onReadBuffer(const sp<AMessage>& msg) {
     CHECK(msg->findInt32("trackType", &tmpType));
     media_track_type trackType = (media_track_type)tmpType;
     mPendingReadBufferTypes &= ~(1 << trackType);
+
+    if (trackType == MEDIA_TRACK_TYPE_AUDIO) {
+        ++mAudioReadStats.mNumReadMessages;
+    } else if (trackType == MEDIA_TRACK_TYPE_VIDEO) {
+        ++mVideoReadStats.mNumReadMessages;
+    }
+
     readBuffer(trackType);
 }
 
+int64_t NuPlayer::GenericSource::getLowWatermarkUs() const {
+    if (!mIsStreaming) {
+        return kLocalLowWatermarkUs;
+    }
+
+    // TODO: maxRebufferingMarkMs could be larger than
+    // mBufferingSettings.mResumePlaybackMarkMs
+    return mBufferingSettings.mResumePlaybackMarkMs * 1000LL / 2;
+}
+
+int64_t NuPlayer::GenericSource::getHighWatermarkUs() const {
+    if (!mIsStreaming) {
+        return kLocalHighWatermarkUs;
+    }
+
+    return (mPreparing ? mBufferingSettings.mInitialMarkMs
+            : mBufferingSettings.mResumePlaybackMarkMs) * 1000LL;
+}
+
+bool NuPlayer::GenericSource::needsMoreData_l(media_track_type trackType) {
+    bool audio = (trackType == MEDIA_TRACK_TYPE_AUDIO);
+    Track *track = audio ? &mAudioTrack : &mVideoTrack;
+    Track *otherTrack = audio ? &mVideoTrack : &mAudioTrack;
+
+    if (track->mSource == NULL) {
+        return false;
+    }
+
+    status_t finalResult;
+    int64_t durationUs = track->mPackets->getBufferedDurationUs(&finalResult);
+    if (finalResult != OK || durationUs >= getHighWatermarkUs()) {
+        return false;
+    }
+
+    if (durationUs < getLowWatermarkUs() || otherTrack->mSource == NULL) {
+        return true;
+    }
+
+    otherTrack->mPackets->getBufferedDurationUs(&finalResult);
+    if (finalResult != OK) {
+        return true;
+    }
+
+    int64_t timeUs = audio ? mAudioTimeUs : mVideoTimeUs;
+    int64_t otherTimeUs = audio ? mVideoTimeUs : mAudioTimeUs;
+    return timeUs <= otherTimeUs + kMaxTrackSkewUs;
+}
+
+void NuPlayer::GenericSource::scheduleReads_l() {
+    bool audioNeedsData = needsMoreData_l(MEDIA_TRACK_TYPE_AUDIO);
+    bool videoNeedsData = needsMoreData_l(MEDIA_TRACK_TYPE_VIDEO);
+
+    // Serve the track with less data buffered first.
+    if (audioNeedsData && videoNeedsData) {
+        status_t finalResult;
+        int64_t audioDurationUs =
+            mAudioTrack.mPackets->getBufferedDurationUs(&finalResult);
+        int64_t videoDurationUs =
+            mVideoTrack.mPackets->getBufferedDurationUs(&finalResult);
+
+        if (videoDurationUs < audioDurationUs) {
+            postReadBuffer(MEDIA_TRACK_TYPE_VIDEO);
+            postReadBuffer(MEDIA_TRACK_TYPE_AUDIO);
+        } else {
+            postReadBuffer(MEDIA_TRACK_TYPE_AUDIO);
+            postReadBuffer(MEDIA_TRACK_TYPE_VIDEO);
+        }
+    } else if (audioNeedsData) {
+        postReadBuffer(MEDIA_TRACK_TYPE_AUDIO);
+    } else if (videoNeedsData) {
+        postReadBuffer(MEDIA_TRACK_TYPE_VIDEO);
+    }
+}
+
 void NuPlayer::GenericSource::readBuffer(
         media_track_type trackType, int64_t seekTimeUs, MediaPlayerSeekMode mode,
         int64_t *actualTimeUs, bool formatChange) {
@@ -1368,7 +1491,8 @@ void NuPlayer::GenericSource::readBuffer(
     }
 
     int32_t generation = getDataGeneration(trackType);
-    for (size_t numBuffers = 0; numBuffers < maxBuffers; ) {
+    size_t numBuffers = 0;
+    while (numBuffers < maxBuffers) {
         Vector<MediaBufferBase *> mediaBuffers;
         status_t err = NO_ERROR;
 
@@ -1458,15 +1582,21 @@ void NuPlayer::GenericSource::readBuffer(
         }
     }
 
-    if (mIsStreaming
-        && (trackType == MEDIA_TRACK_TYPE_VIDEO || trackType == MEDIA_TRACK_TYPE_AUDIO)) {
+    if (trackType != MEDIA_TRACK_TYPE_VIDEO && trackType != MEDIA_TRACK_TYPE_AUDIO) {
+        return;
+    }
+
+    if (trackType == MEDIA_TRACK_TYPE_AUDIO) {
+        mAudioReadStats.mNumBuffersRead += numBuffers;
+    } else {
+        mVideoReadStats.mNumBuffersRead += numBuffers;
+    }
+
+    if (mIsStreaming) {
         status_t finalResult;
         int64_t durationUs = track->mPackets->getBufferedDurationUs(&finalResult);
 
-        // TODO: maxRebufferingMarkMs could be larger than
-        // mBufferingSettings.mResumePlaybackMarkMs
-        int64_t markUs = (mPreparing ? mBufferingSettings.mInitialMarkMs
-            : mBufferingSettings.mResumePlaybackMarkMs) * 1000LL;
+        int64_t markUs = getHighWatermarkUs();
         if (finalResult == ERROR_END_OF_STREAM || durationUs >= markUs) {
             if (mPreparing || mSentPauseOnBuffering) {
                 Track *counterTrack =
@@ -1487,11 +1617,11 @@ void NuPlayer::GenericSource::readBuffer(
                     }
                 }
             }
-            return;
         }
-
-        postReadBuffer(trackType);
     }
+
+    // Keep both tracks filled up to the high watermark, a batch at a time.
+    scheduleReads_l();
 }
 
 void NuPlayer::GenericSource::queueDiscontinuityIfNeeded(
@@ -1509,6 +1639,15 @@ void NuPlayer::GenericSource::queueDiscontinuityIfNeeded(
     }
 }
 
+void NuPlayer::GenericSource::getTrackStats(bool audio, const sp<AMessage> &stats) {
+    Mutex::Autolock _l(mLock);
+
+    const ReadStats &readStats = audio ? mAudioReadStats : mVideoReadStats;
+    stats->setInt64("source-read-messages", readStats.mNumReadMessages);
+    stats->setInt64("source-buffers-read", readStats.mNumBuffersRead);
+    stats->setInt64("source-underruns", readStats.mNumUnderruns);
+}
+
 void NuPlayer::GenericSource::notifyBufferingUpdate(int32_t percentage) {
     // Buffering percent could go backward as it's estimated from remaining
     // data and last access time. This could cause the buffering position
@@ -86,6 +86,8 @@ struct NuPlayer::GenericSource : public NuPlayer::Source,
 
     virtual bool isStreaming() const;
 
+    virtual void getTrackStats(bool audio, const sp<AMessage> &stats);
+
     // Modular DRM
     virtual void signalBufferReturned(MediaBufferBase *buffer);
 
@@ -125,6 +127,23 @@ private:
         sp<AnotherPacketSource> mPackets;
     };
 
+    // Read activity of an audio or video track, reported via getTrackStats().
+    struct ReadStats {
+        ReadStats()
+            : mNumReadMessages(0),
+              mNumBuffersRead(0),
+              mNumUnderruns(0),
+              mStarved(true) {
+        }
+
+        int64_t mNumReadMessages;
+        int64_t mNumBuffersRead;
+        // times the decoder found the track empty while playing
+        int64_t mNumUnderruns;
+        // set until the first buffer after start or seek is dequeued
+        bool mStarved;
+    };
+
     Vector<sp<IMediaSource> > mSources;
     Track mAudioTrack;
     int64_t mAudioTimeUs;
@@ -134,6 +153,8 @@ private:
     int64_t mVideoLastDequeueTimeUs;
     Track mSubtitleTrack;
     Track mTimedTextTrack;
+    ReadStats mAudioReadStats;
+    ReadStats mVideoReadStats;
 
     BufferingSettings mBufferingSettings;
     int32_t mPrevBufferPercentage;
@@ -222,6 +243,13 @@ private:
     void queueDiscontinuityIfNeeded(
             bool seeking, bool formatChange, media_track_type trackType, Track *track);
 
+    // Buffered duration below which an audio/video track is refilled, and
+    // up to which it is read ahead.
+    int64_t getLowWatermarkUs() const;
+    int64_t getHighWatermarkUs() const;
+    bool needsMoreData_l(media_track_type trackType);
+    void scheduleReads_l();
+
     void schedulePollBuffering();
     void onPollBuffering();
     void notifyBufferingUpdate(int32_t percentage);
@@ -726,6 +726,8 @@ void NuPlayer::onMessageReceived(const sp<AMessage> &msg) {
                             && info->findInt32("type", &type)
                             && type == MEDIA_TRACK_TYPE_TIMEDTEXT) {
                         ++mTimedTextGeneration;
+                        mTimedTextGlobalDescription.clear();
+                        mTimedTextGlobalParcel.freeData();
                     }
                 }
             } else {
@@ -2244,11 +2246,27 @@ void NuPlayer::getStats(Vector<sp<AMessage> > *trackStats) {
     trackStats->clear();
 
     Mutex::Autolock autoLock(mDecoderLock);
+    sp<Renderer> renderer = mRenderer;
+    sp<Source> source = mSource;
     if (mVideoDecoder != NULL) {
-        trackStats->push_back(mVideoDecoder->getStats());
+        sp<AMessage> stats = mVideoDecoder->getStats();
+        if (renderer != NULL) {
+            renderer->getVideoStats(stats);
+        }
+        if (source != NULL) {
+            source->getTrackStats(false /* audio */, stats);
+        }
+        trackStats->push_back(stats);
     }
     if (mAudioDecoder != NULL) {
-        trackStats->push_back(mAudioDecoder->getStats());
+        sp<AMessage> stats = mAudioDecoder->getStats();
+        if (renderer != NULL) {
+            renderer->getAudioStats(stats);
+        }
+        if (source != NULL) {
+            source->getTrackStats(true /* audio */, stats);
+        }
+        trackStats->push_back(stats);
     }
 }
 
@@ -2798,25 +2816,47 @@ void NuPlayer::sendTimedTextData(const sp<ABuffer> &buffer) {
     size = buffer->size();
 
     Parcel parcel;
+    const Parcel *out = &parcel;
     if (size > 0) {
         CHECK(buffer->meta()->findInt64("timeUs", &timeUs));
         int32_t global = 0;
         if (buffer->meta()->findInt32("global", &global) && global) {
-            flag |= TextDescriptions::GLOBAL_DESCRIPTIONS;
+            out = getTimedTextGlobalParcel(buffer, timeUs);
         } else {
             flag |= TextDescriptions::LOCAL_DESCRIPTIONS;
+            TextDescriptions::getParcelOfDescriptions(
+                    (const uint8_t *)data, size, flag, timeUs / 1000, &parcel);
         }
-        TextDescriptions::getParcelOfDescriptions(
-                (const uint8_t *)data, size, flag, timeUs / 1000, &parcel);
     }
 
-    if ((parcel.dataSize() > 0)) {
-        notifyListener(MEDIA_TIMED_TEXT, 0, 0, &parcel);
+    if ((out->dataSize() > 0)) {
+        notifyListener(MEDIA_TIMED_TEXT, 0, 0, out);
     } else {  // send an empty timed text
         notifyListener(MEDIA_TIMED_TEXT, 0, 0);
     }
 }
 
+// The global description is only decoded again when the track's sample
+// description changes, not each time it is resent after a seek.
+const Parcel *NuPlayer::getTimedTextGlobalParcel(const sp<ABuffer> &buffer, int64_t timeUs) {
+    if (mTimedTextGlobalDescription != NULL
+            && mTimedTextGlobalDescription->size() == buffer->size()
+            && !memcmp(mTimedTextGlobalDescription->data(), buffer->data(), buffer->size())) {
+        return &mTimedTextGlobalParcel;
+    }
+
+    mTimedTextGlobalDescription.clear();
+    mTimedTextGlobalParcel.freeData();
+    status_t err = TextDescriptions::getParcelOfDescriptions(
+            buffer->data(), buffer->size(),
+            TextDescriptions::IN_BAND_TEXT_3GPP | TextDescriptions::GLOBAL_DESCRIPTIONS,
+            timeUs / 1000, &mTimedTextGlobalParcel);
+    if (err == OK) {
+        mTimedTextGlobalDescription = ABuffer::CreateAsCopy(buffer->data(), buffer->size());
+    }
+    return &mTimedTextGlobalParcel;
+}
+
 const char *NuPlayer::getDataSourceType() {
     switch (mDataSourceType) {
         case DATA_SOURCE_TYPE_HTTP_LIVE:
@@ -18,6 +18,7 @@
 
 #define NU_PLAYER_H_
 
+#include <binder/Parcel.h>
 #include <media/AudioResamplerPublic.h>
 #include <mediadrm/ICrypto.h>
 #include <media/MediaPlayerInterface.h>
@@ -116,6 +117,7 @@ private:
     struct CCDecoder;
     struct GenericSource;
     struct HTTPLiveSource;
+    struct PcmBatcher;
     struct Renderer;
     struct RTSPSource;
     struct StreamingSource;
@@ -202,6 +204,10 @@ private:
 
     int32_t mPollDurationGeneration;
     int32_t mTimedTextGeneration;
+    // Global description of the selected 3GPP timed text track and what it
+    // decoded to; the source sends it again on every seek.
+    sp<ABuffer> mTimedTextGlobalDescription;
+    Parcel mTimedTextGlobalParcel;
 
     enum FlushStatus {
         NONE,
@@ -334,6 +340,7 @@ private:
     void sendSubtitleData(const sp<ABuffer> &buffer, int32_t baseIndex);
     void sendTimedMetaData(const sp<ABuffer> &buffer);
     void sendTimedTextData(const sp<ABuffer> &buffer);
+    const Parcel *getTimedTextGlobalParcel(const sp<ABuffer> &buffer, int64_t timeUs);
 
     void writeTrackInfo(Parcel* reply, const sp<AMessage>& format) const;
 
@@ -23,6 +23,7 @@
 
 #include <media/stagefright/foundation/ABitReader.h>
 #include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ABufferPool.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/avc_utils.h>
@@ -33,7 +34,16 @@ namespace android {
 // In CEA-708B, the maximum bandwidth of CC is set to 9600bps.
 static const size_t kMaxBandwithSizeBytes = 9600 / 8;
 
+// Maximum number of released CC buffers kept around for reuse.
+static const size_t kMaxNumPooledCCBuffers = 16;
+
+// cc_count is a 5-bit field.
+static const size_t kMaxCCCount = 31;
+
 struct CCData {
+    CCData()
+        : mType(0), mData1(0), mData2(0) {
+    }
     CCData(uint8_t type, uint8_t data1, uint8_t data2)
         : mType(type), mData1(data1), mData2(data2) {
     }
@@ -120,7 +130,8 @@ static void dumpBytePair(const sp<ABuffer> &ccBuf) {
 NuPlayer::CCDecoder::CCDecoder(const sp<AMessage> &notify)
     : mNotify(notify),
       mSelectedTrack(-1),
-      mDTVCCPacket(new ABuffer(kMaxBandwithSizeBytes)) {
+      mDTVCCPacket(new ABuffer(kMaxBandwithSizeBytes)),
+      mCCBufferPool(new ABufferPool(kMaxBandwithSizeBytes, kMaxNumPooledCCBuffers)) {
     mDTVCCPacket->setRange(0, 0);
 
     // In CEA-608, streams from packets which have the value 0 of cc_type contain CC1 and CC2, and
@@ -220,6 +231,54 @@ bool NuPlayer::CCDecoder::isTrackValid(size_t index) const {
     return index < getTrackCount();
 }
 
+// Returns an empty buffer of at least |size| bytes, or NULL if out of memory.
+// Buffers up to the CC bandwidth come from mCCBufferPool and return to it when
+// dropped, including those handed out with kWhatClosedCaptionData.
+sp<ABuffer> NuPlayer::CCDecoder::acquireCCBuffer(size_t size) {
+    sp<ABuffer> buffer;
+    if (size <= mCCBufferPool->bufferSize()) {
+        buffer = mCCBufferPool->acquire();
+    } else {
+        buffer = new ABuffer(size);
+    }
+    if (buffer->capacity() == 0) {
+        ALOGW("b/129068792, no memory available, %zu", size);
+        android_errorWriteLog(0x534e4554, "129068792");
+        return NULL;
+    }
+    buffer->setRange(0, 0);
+    return buffer;
+}
+
+// Appends CC data to that of the display frame at |timeUs|.
+bool NuPlayer::CCDecoder::appendCCData(int64_t timeUs, const void *data, size_t size) {
+    sp<ABuffer> buffer;
+    ssize_t index = mCCMap.indexOfKey(timeUs);
+    if (index < 0) {
+        buffer = acquireCCBuffer(size);
+        if (buffer == NULL) {
+            return false;
+        }
+        mCCMap.add(timeUs, buffer);
+    } else {
+        buffer = mCCMap.valueAt(index);
+        if (buffer->capacity() - buffer->size() < size) {
+            sp<ABuffer> newBuffer = acquireCCBuffer(buffer->size() + size);
+            if (newBuffer == NULL) {
+                return false;
+            }
+            memcpy(newBuffer->data(), buffer->data(), buffer->size());
+            newBuffer->setRange(0, buffer->size());
+            mCCMap.replaceValueAt(index, newBuffer);
+            buffer = newBuffer;
+        }
+    }
+
+    memcpy(buffer->data() + buffer->size(), data, size);
+    buffer->setRange(0, buffer->size() + size);
+    return true;
+}
+
 // returns true if a new CC track is found
 bool NuPlayer::CCDecoder::extractFromSEI(const sp<ABuffer> &accessUnit) {
     sp<ABuffer> sei;
@@ -382,7 +441,8 @@ bool NuPlayer::CCDecoder::parseMPEGCCData(int64_t timeUs, const uint8_t *data, s
         return false;
     }
 
-    sp<ABuffer> line21CCBuf = NULL;
+    CCData line21CCData[kMaxCCCount];
+    size_t numLine21CCData = 0;
 
     for (size_t i = 0; i < cc_count; ++i) {
         br.skipBits(5);
@@ -429,12 +489,7 @@ bool NuPlayer::CCDecoder::parseMPEGCCData(int64_t timeUs, const uint8_t *data, s
 
                 if (isSelected() && mTracks[mSelectedTrack].mTrackType == kTrackTypeCEA608
                         && mTracks[mSelectedTrack].mTrackChannel == mLine21Channels[cc_type]) {
-                    if (line21CCBuf == NULL) {
-                        line21CCBuf = new ABuffer((cc_count - i) * sizeof(CCData));
-                        line21CCBuf->setRange(0, 0);
-                    }
-                    memcpy(line21CCBuf->data() + line21CCBuf->size(), &cc, sizeof(cc));
-                    line21CCBuf->setRange(0, line21CCBuf->size() + sizeof(CCData));
+                    line21CCData[numLine21CCData++] = cc;
                 }
             } else {
                 br.skipBits(16);
@@ -449,8 +504,8 @@ bool NuPlayer::CCDecoder::parseMPEGCCData(int64_t timeUs, const uint8_t *data, s
     }
 
     if (isSelected() && mTracks[mSelectedTrack].mTrackType == kTrackTypeCEA608
-            && line21CCBuf != NULL && line21CCBuf->size() > 0) {
-        mCCMap.add(timeUs, line21CCBuf);
+            && numLine21CCData > 0) {
+        appendCCData(timeUs, line21CCData, numLine21CCData * sizeof(CCData));
     }
 
     return trackAdded;
@@ -492,15 +547,9 @@ bool NuPlayer::CCDecoder::parseDTVCCPacket(int64_t timeUs, const uint8_t *data,
 
         if (block_size > 0) {
             size_t trackIndex = getTrackIndex(kTrackTypeCEA708, service_number, &trackAdded);
-            if (mSelectedTrack == (ssize_t)trackIndex) {
-                sp<ABuffer> ccPacket = new ABuffer(block_size);
-                if (ccPacket->capacity() == 0) {
-                    ALOGW("b/129068792, no memory available, %zu", block_size);
-                    android_errorWriteLog(0x534e4554, "129068792");
-                    return false;
-                }
-                memcpy(ccPacket->data(), br.data(), block_size);
-                mCCMap.add(timeUs, ccPacket);
+            if (mSelectedTrack == (ssize_t)trackIndex
+                    && !appendCCData(timeUs, br.data(), block_size)) {
+                return false;
             }
         }
         br.skipBits(block_size * 8);
@@ -542,34 +591,35 @@ void NuPlayer::CCDecoder::display(int64_t timeUs) {
         return;
     }
 
-    ssize_t index = mCCMap.indexOfKey(timeUs);
-    if (index < 0) {
+    // Deliver the data of every frame up to the one being rendered in one
+    // batch, including frames that were dropped before reaching here.
+    size_t count = 0;
+    size_t size = 0;
+    while (count < mCCMap.size() && mCCMap.keyAt(count) <= timeUs) {
+        size += mCCMap.valueAt(count)->size();
+        ++count;
+    }
+
+    if (count == 0) {
         ALOGV("cc for timestamp %" PRId64 " not found", timeUs);
         return;
     }
 
     sp<ABuffer> ccBuf;
 
-    if (index == 0) {
-        ccBuf = mCCMap.valueAt(index);
+    if (count == 1) {
+        ccBuf = mCCMap.valueAt(0);
     } else {
-        size_t size = 0;
-
-        for (ssize_t i = 0; i <= index; ++i) {
-            size += mCCMap.valueAt(i)->size();
-        }
-
-        ccBuf = new ABuffer(size);
-        ccBuf->setRange(0, 0);
+        ccBuf = acquireCCBuffer(size);
 
-        for (ssize_t i = 0; i <= index; ++i) {
-            sp<ABuffer> buf = mCCMap.valueAt(i);
+        for (size_t i = 0; ccBuf != NULL && i < count; ++i) {
+            const sp<ABuffer> &buf = mCCMap.valueAt(i);
             memcpy(ccBuf->data() + ccBuf->size(), buf->data(), buf->size());
             ccBuf->setRange(0, ccBuf->size() + buf->size());
         }
     }
 
-    if (ccBuf->size() > 0) {
+    if (ccBuf != NULL && ccBuf->size() > 0) {
 #if 0
         dumpBytePair(ccBuf);
 #endif
@@ -584,8 +634,8 @@ void NuPlayer::CCDecoder::display(int64_t timeUs) {
         msg->post();
     }
 
-    // remove all entries before timeUs
-    mCCMap.removeItemsAt(0, index + 1);
+    // remove all entries up to timeUs
+    mCCMap.removeItemsAt(0, count);
 }
 
 void NuPlayer::CCDecoder::flush() {
@@ -22,6 +22,8 @@
 
 namespace android {
 
+struct ABufferPool;
+
 struct NuPlayer::CCDecoder : public RefBase {
     enum {
         kWhatClosedCaptionData,
@@ -64,6 +66,7 @@ private:
     };
 
     sp<AMessage> mNotify;
+    // CC data of the selected track for each display frame, by timestamp.
     KeyedVector<int64_t, sp<ABuffer> > mCCMap;
     ssize_t mSelectedTrack;
     KeyedVector<CCTrack, size_t> mTrackIndices;
@@ -75,7 +78,11 @@ private:
     // CEA-708 closed caption
     sp<ABuffer> mDTVCCPacket;
 
+    sp<ABufferPool> mCCBufferPool;
+
     bool isTrackValid(size_t index) const;
+    sp<ABuffer> acquireCCBuffer(size_t size);
+    bool appendCCData(int64_t timeUs, const void *data, size_t size);
     size_t getTrackIndex(int32_t trackType, size_t channel, bool *trackAdded);
 
     // Extract from H.264 SEIs
@@ -67,6 +67,41 @@ static const char *kPlayerDataSourceType = "android.media.mediaplayer.dataSource
 static const char *kPlayerRebuffering = "android.media.mediaplayer.rebufferingMs";
 static const char *kPlayerRebufferingCount = "android.media.mediaplayer.rebuffers";
 static const char *kPlayerRebufferingAtExit = "android.media.mediaplayer.rebufferExit";
+//
+static const char *kPlayerAudioDeepBuffer = "android.media.mediaplayer.audio.deepBuffer";
+static const char *kPlayerAudioWakeupsPerMin = "android.media.mediaplayer.audio.wakeupsPerMin";
+static const char *kPlayerAudioWritesPerMin = "android.media.mediaplayer.audio.writesPerMin";
+static const char *kPlayerAudioChunkBytes = "android.media.mediaplayer.audio.chunkBytes";
+static const char *kPlayerSeekCount = "android.media.mediaplayer.seeks";
+static const char *kPlayerSeekToDisplayMs = "android.media.mediaplayer.seekToDisplayMs";
+static const char *kPlayerSeekToDisplayMaxMs = "android.media.mediaplayer.seekToDisplayMaxMs";
+static const char *kPlayerVReadsPerMin = "android.media.mediaplayer.video.readsPerMin";
+static const char *kPlayerVSamplesPerRead = "android.media.mediaplayer.video.samplesPerRead";
+static const char *kPlayerVUnderruns = "android.media.mediaplayer.video.underruns";
+static const char *kPlayerAReadsPerMin = "android.media.mediaplayer.audio.readsPerMin";
+static const char *kPlayerASamplesPerRead = "android.media.mediaplayer.audio.samplesPerRead";
+static const char *kPlayerAUnderruns = "android.media.mediaplayer.audio.underruns";
+
+// Copies the source read statistics of one track into |item|.
+static void setSourceReadMetrics(
+        mediametrics::Item *item, const sp<AMessage> &stats, int64_t playingTimeUs,
+        const char *readsPerMinKey, const char *samplesPerReadKey, const char *underrunsKey) {
+    int64_t numReads, numBuffers, numUnderruns;
+    if (!stats->findInt64("source-read-messages", &numReads)
+            || !stats->findInt64("source-buffers-read", &numBuffers)
+            || !stats->findInt64("source-underruns", &numUnderruns)) {
+        return;
+    }
+
+    // normalized by playing time, so sessions of any length compare
+    if (playingTimeUs >= 1000000) {
+        item->setInt64(readsPerMinKey, numReads * 60000000LL / playingTimeUs);
+    }
+    if (numReads > 0) {
+        item->setDouble(samplesPerReadKey, (double)numBuffers / numReads);
+    }
+    item->setInt64(underrunsKey, numUnderruns);
+}
 
 
 NuPlayerDriver::NuPlayerDriver(pid_t pid)
@@ -625,11 +660,45 @@ void NuPlayerDriver::updateMetrics(const char *where) {
                     mMetricsItem->setDouble(kPlayerFrameRate, (double) frameRate);
                 }
 
+                int64_t numSeeks, seekAvgUs, seekMaxUs;
+                if (stats->findInt64("seek-to-display-count", &numSeeks)
+                        && stats->findInt64("seek-to-display-avg-us", &seekAvgUs)
+                        && stats->findInt64("seek-to-display-max-us", &seekMaxUs)) {
+                    mMetricsItem->setInt64(kPlayerSeekCount, numSeeks);
+                    mMetricsItem->setInt64(kPlayerSeekToDisplayMs, (seekAvgUs + 500) / 1000);
+                    mMetricsItem->setInt64(kPlayerSeekToDisplayMaxMs, (seekMaxUs + 500) / 1000);
+                }
+
+                setSourceReadMetrics(mMetricsItem, stats, playingTimeUs,
+                        kPlayerVReadsPerMin, kPlayerVSamplesPerRead, kPlayerVUnderruns);
+
             } else if (mime.startsWith("audio/")) {
                 mMetricsItem->setCString(kPlayerAMime, mime.c_str());
                 if (!name.empty()) {
                     mMetricsItem->setCString(kPlayerACodec, name.c_str());
                 }
+
+                int32_t deepBuffer;
+                int64_t numWakeups, numWrites;
+                if (stats->findInt32("audio-deep-buffer", &deepBuffer)
+                        && stats->findInt64("audio-drain-wakeups", &numWakeups)
+                        && stats->findInt64("audio-sink-writes", &numWrites)) {
+                    mMetricsItem->setInt32(kPlayerAudioDeepBuffer, deepBuffer);
+                    int64_t chunkBytes;
+                    if (stats->findInt64("audio-chunk-bytes", &chunkBytes) && chunkBytes > 0) {
+                        mMetricsItem->setInt64(kPlayerAudioChunkBytes, chunkBytes);
+                    }
+                    // normalized by playing time, so sessions of any length compare
+                    if (playingTimeUs >= 1000000) {
+                        mMetricsItem->setInt64(kPlayerAudioWakeupsPerMin,
+                                numWakeups * 60000000LL / playingTimeUs);
+                        mMetricsItem->setInt64(kPlayerAudioWritesPerMin,
+                                numWrites * 60000000LL / playingTimeUs);
+                    }
+                }
+
+                setSourceReadMetrics(mMetricsItem, stats, playingTimeUs,
+                        kPlayerAReadsPerMin, kPlayerASamplesPerRead, kPlayerAUnderruns);
             }
         }
     }
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "NuPlayerPcmBatcher"
+#include <utils/Log.h>
+
+#include "NuPlayerPcmBatcher.h"
+
+#include <media/MediaCodecBuffer.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+namespace android {
+
+// Largest timestamp jump between two buffers that still counts as contiguous;
+// covers the rounding of per-buffer timestamps by the decoder.
+static const int64_t kMaxContiguousGapUs = 1000;
+
+NuPlayer::PcmBatcher::PcmBatcher(
+        size_t frameSize, int32_t sampleRate, int64_t chunkUs, int64_t maxPendingUs)
+    : mFrameSize(frameSize),
+      mSampleRate(sampleRate),
+      mChunkBytes(0),
+      mMaxPendingBytes(0) {
+    CHECK_GT(mFrameSize, 0u);
+    CHECK_GT(mSampleRate, 0);
+    mChunkBytes = bytesForDurationUs(chunkUs);
+    if (mChunkBytes < mFrameSize) {
+        mChunkBytes = mFrameSize;
+    }
+    mMaxPendingBytes = bytesForDurationUs(maxPendingUs);
+    if (mMaxPendingBytes < mChunkBytes) {
+        mMaxPendingBytes = mChunkBytes;
+    }
+    ALOGV("chunk %zu bytes, at most %zu bytes pending", mChunkBytes, mMaxPendingBytes);
+}
+
+size_t NuPlayer::PcmBatcher::bytesForDurationUs(int64_t durationUs) const {
+    if (durationUs <= 0) {
+        return 0;
+    }
+    return (size_t)(durationUs * mSampleRate / 1000000LL) * mFrameSize;
+}
+
+bool NuPlayer::PcmBatcher::canCopy(
+        const sp<MediaCodecBuffer> &buffer, size_t pendingBytes) const {
+    return buffer->size() > 0
+            && buffer->size() % mFrameSize == 0
+            && pendingBytes + buffer->size() <= mMaxPendingBytes;
+}
+
+bool NuPlayer::PcmBatcher::append(
+        const sp<MediaCodecBuffer> &chunk, const sp<MediaCodecBuffer> &buffer) const {
+    size_t size = buffer->size();
+    if (chunk->offset() + chunk->size() + size > chunk->capacity()) {
+        return false;
+    }
+
+    int64_t chunkTimeUs, timeUs;
+    CHECK(chunk->meta()->findInt64("timeUs", &chunkTimeUs));
+    CHECK(buffer->meta()->findInt64("timeUs", &timeUs));
+    int64_t expectedTimeUs =
+        chunkTimeUs + (int64_t)(chunk->size() / mFrameSize) * 1000000LL / mSampleRate;
+    if (timeUs > expectedTimeUs + kMaxContiguousGapUs
+            || timeUs < expectedTimeUs - kMaxContiguousGapUs) {
+        ALOGV("not appending, buffer at %lld us, chunk ends at %lld us",
+                (long long)timeUs, (long long)expectedTimeUs);
+        return false;
+    }
+
+    memcpy(chunk->data() + chunk->size(), buffer->data(), size);
+    chunk->setRange(chunk->offset(), chunk->size() + size);
+    return true;
+}
+
+sp<MediaCodecBuffer> NuPlayer::PcmBatcher::newChunk(const sp<MediaCodecBuffer> &buffer) const {
+    size_t size = buffer->size();
+    sp<MediaCodecBuffer> chunk = new MediaCodecBuffer(
+            buffer->format(), new ABuffer(size > mChunkBytes ? size : mChunkBytes));
+    memcpy(chunk->data(), buffer->data(), size);
+    chunk->setRange(0, size);
+
+    int64_t timeUs;
+    CHECK(buffer->meta()->findInt64("timeUs", &timeUs));
+    chunk->meta()->setInt64("timeUs", timeUs);
+    return chunk;
+}
+
+}  // namespace android
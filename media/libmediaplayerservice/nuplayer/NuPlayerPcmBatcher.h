@@ -0,0 +1,61 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NUPLAYER_PCM_BATCHER_H_
+
+#define NUPLAYER_PCM_BATCHER_H_
+
+#include "NuPlayer.h"
+
+namespace android {
+
+class MediaCodecBuffer;
+
+// Copies decoded PCM into renderer-owned chunks, so that codec output buffers
+// can be returned as soon as they are queued rather than once they have been
+// written to the AudioSink. How much audio the renderer can hold is then bound
+// by |maxPendingUs| instead of by the number of codec output buffers.
+struct NuPlayer::PcmBatcher : public RefBase {
+    PcmBatcher(size_t frameSize, int32_t sampleRate, int64_t chunkUs, int64_t maxPendingUs);
+
+    size_t chunkBytes() const { return mChunkBytes; }
+    size_t maxPendingBytes() const { return mMaxPendingBytes; }
+
+    // Whether |buffer| may be copied while |pendingBytes| of copied audio are
+    // still queued. Returns false once the copied audio reaches its cap, after
+    // which the codec buffer itself is queued and backpressure is restored.
+    bool canCopy(const sp<MediaCodecBuffer> &buffer, size_t pendingBytes) const;
+
+    // Appends a copy of |buffer| to |chunk| if it continues it in time and fits.
+    bool append(const sp<MediaCodecBuffer> &chunk, const sp<MediaCodecBuffer> &buffer) const;
+
+    // Returns a new chunk starting with a copy of |buffer|.
+    sp<MediaCodecBuffer> newChunk(const sp<MediaCodecBuffer> &buffer) const;
+
+private:
+    size_t mFrameSize;
+    int32_t mSampleRate;
+    size_t mChunkBytes;
+    size_t mMaxPendingBytes;
+
+    size_t bytesForDurationUs(int64_t durationUs) const;
+
+    DISALLOW_EVIL_CONSTRUCTORS(PcmBatcher);
+};
+
+}  // namespace android
+
+#endif  // NUPLAYER_PCM_BATCHER_H_
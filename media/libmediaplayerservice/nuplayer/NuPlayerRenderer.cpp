@@ -19,6 +19,7 @@
 #include <utils/Log.h>
 
 #include "AWakeLock.h"
+#include "NuPlayerPcmBatcher.h"
 #include "NuPlayerRenderer.h"
 #include <algorithm>
 #include <cutils/properties.h>
@@ -69,6 +70,11 @@ static inline int32_t getAudioSinkPcmMsSetting() {
             "media.stagefright.audio.sink", 500 /* default_value */);
 }
 
+static inline int32_t getAudioSinkDeepBufferMsSetting() {
+    return property_get_int32(
+            "media.stagefright.audio.deep.sink", 2000 /* default_value */);
+}
+
 // Maximum time in paused state when offloading audio decompression. When elapsed, the AudioSink
 // is closed to allow the audio DSP to power down.
 static const int64_t kOffloadPauseMaxUs = 10000000LL;
@@ -82,6 +88,12 @@ static const int64_t kMinimumAudioClockUpdatePeriodUs = 20 /* msec */ * 1000;
 // Used to set max media time in MediaClock.
 static const int64_t kDefaultVideoFrameIntervalUs = 100000LL;
 
+// Maximum number of video frames released per video drain wake-up.
+static const size_t kMaxVideoFramesPerDrain = 4;
+
+// Smallest chunk decoded PCM is copied into in deep buffer mode.
+static const int64_t kMinPcmChunkUs = 20000LL;
+
 // static
 const NuPlayer::Renderer::PcmInfo NuPlayer::Renderer::AUDIO_PCMINFO_INITIALIZER = {
         AUDIO_CHANNEL_NONE,
@@ -132,6 +144,12 @@ NuPlayer::Renderer::Renderer(
       mAnchorNumFramesWritten(-1),
       mVideoLateByUs(0LL),
       mNextVideoTimeMediaUs(-1),
+      mNumVideoDrainWakeups(0),
+      mNumVideoFramesReleased(0),
+      mVideoFlushTimeUs(-1),
+      mNumSeekToDisplay(0),
+      mTotalSeekToDisplayUs(0),
+      mMaxSeekToDisplayUs(0),
       mHasAudio(false),
       mHasVideo(false),
       mNotifyCompleteAudio(false),
@@ -153,6 +171,10 @@ NuPlayer::Renderer::Renderer(
       mTotalBuffersQueued(0),
       mLastAudioBufferDrained(0),
       mUseAudioCallback(false),
+      mDeepBufferAudio(false),
+      mAudioChunkBytes(0),
+      mNumAudioDrainWakeups(0),
+      mNumAudioSinkWrites(0),
       mWakeLock(new AWakeLock()) {
     CHECK(mediaClock != NULL);
     mPlaybackRate = mPlaybackSettings.mSpeed;
@@ -590,6 +612,11 @@ void NuPlayer::Renderer::onMessageReceived(const sp<AMessage> &msg) {
                 break;
             }
 
+            {
+                Mutex::Autolock autoLock(mLock);
+                ++mNumAudioDrainWakeups;
+            }
+
             if (onDrainAudioQueue()) {
                 uint32_t numFramesPlayed;
                 CHECK_EQ(mAudioSink->getPosition(&numFramesPlayed),
@@ -612,6 +639,9 @@ void NuPlayer::Renderer::onMessageReceived(const sp<AMessage> &msg) {
                 // Let's give it more data after about half that time
                 // has elapsed.
                 delayUs /= 2;
+                if (mDeepBufferAudio) {
+                    delayUs = std::max(delayUs, getDeepBufferDrainDelayUs());
+                }
                 // check the buffer size to estimate maximum delay permitted.
                 const int64_t maxDrainDelayUs = std::max(
                         mAudioSink->getBufferDurationInUs(), (int64_t)500000 /* half second */);
@@ -817,6 +847,10 @@ void NuPlayer::Renderer::postDrainAudioQueue_l(int64_t delayUs) {
         return;
     }
 
+    if (mDeepBufferAudio && delayUs == 0 && !mPaused) {
+        delayUs = getDeepBufferDrainDelayUs();
+    }
+
     // FIXME: if paused, wait until AudioTrack stop() is complete before delivering data.
     if (mPaused) {
         const int64_t diffUs = mPauseDrainAudioAllowedUs - ALooper::GetNowUs();
@@ -831,6 +865,102 @@ void NuPlayer::Renderer::postDrainAudioQueue_l(int64_t delayUs) {
     msg->post(delayUs);
 }
 
+// In deep buffer mode the sink is only topped up once it has played down to half
+// of its buffer. Decoded buffers queue up in the meantime and are written in one
+// go, instead of waking up for every buffer the decoder hands over.
+int64_t NuPlayer::Renderer::getDeepBufferDrainDelayUs() {
+    uint32_t numFramesPlayed;
+    if (mAudioSink->getPosition(&numFramesPlayed) != OK) {
+        return 0;
+    }
+    uint32_t numFramesPendingPlayout =
+        (mNumFramesWritten > numFramesPlayed ? mNumFramesWritten - numFramesPlayed : 0);
+    int64_t pendingUs = mAudioSink->msecsPerFrame() * numFramesPendingPlayout * 1000LL;
+    if (mPlaybackRate > 1.0f) {
+        pendingUs /= mPlaybackRate;
+    }
+    const int64_t lowWaterUs = mAudioSink->getBufferDurationInUs() / 2;
+    return pendingUs > lowWaterUs ? pendingUs - lowWaterUs : 0;
+}
+
+// A drain wake-up tops up half of the sink, so that is how much copied audio the
+// renderer holds. Chunks follow the latency of the output the sink was opened on,
+// as AudioSink::latency() is that output's latency plus the sink buffer itself.
+// Only touched on the looper, which may hold mLock here (flushQueue()).
+void NuPlayer::Renderer::setUpPcmBatcher() {
+    mPcmBatcher.clear();
+    mAudioChunkBytes = 0;
+    if (!mDeepBufferAudio || mAudioSink->frameSize() <= 0) {
+        return;
+    }
+    const int64_t bufferUs = mAudioSink->getBufferDurationInUs();
+    const int64_t outputLatencyUs = (int64_t)mAudioSink->latency() * 1000LL - bufferUs;
+    const int64_t maxPendingUs = bufferUs / 2;
+    const int64_t chunkUs = std::min(std::max(outputLatencyUs, kMinPcmChunkUs), maxPendingUs);
+    mPcmBatcher = new PcmBatcher(
+            mAudioSink->frameSize(), mCurrentPcmInfo.mSampleRate, chunkUs, maxPendingUs);
+    mAudioChunkBytes = mPcmBatcher->chunkBytes();
+}
+
+// Chunk entries are the only ones with data but no reply message.
+size_t NuPlayer::Renderer::getBatchedAudioBytes_l() const {
+    size_t bytes = 0;
+    for (List<QueueEntry>::const_iterator it = mAudioQueue.begin();
+            it != mAudioQueue.end(); ++it) {
+        if (it->mBuffer != NULL && it->mNotifyConsumed == nullptr) {
+            bytes += it->mBuffer->size() - it->mOffset;
+        }
+    }
+    return bytes;
+}
+
+// In deep buffer mode decoded PCM is copied into renderer-owned chunks and the
+// codec buffer is returned right away, so a drain wake-up is not limited to the
+// handful of output buffers the decoder has.
+bool NuPlayer::Renderer::copyIntoAudioChunk_l(const QueueEntry &entry) {
+    int32_t eos;
+    if (mPcmBatcher == NULL
+            || entry.mNotifyConsumed->findInt32("eos", &eos)
+            || !mPcmBatcher->canCopy(entry.mBuffer, getBatchedAudioBytes_l())) {
+        return false;
+    }
+
+    bool appended = false;
+    if (!mAudioQueue.empty()) {
+        QueueEntry *last = &*--mAudioQueue.end();
+        if (last->mBuffer != NULL && last->mNotifyConsumed == nullptr
+                && mPcmBatcher->append(last->mBuffer, entry.mBuffer)) {
+            last->mBufferOrdinal = entry.mBufferOrdinal;
+            appended = true;
+        }
+    }
+    if (!appended) {
+        QueueEntry chunk = entry;
+        chunk.mBuffer = mPcmBatcher->newChunk(entry.mBuffer);
+        chunk.mNotifyConsumed = NULL;
+        mAudioQueue.push_back(chunk);
+    }
+    entry.mNotifyConsumed->post();
+    return true;
+}
+
+void NuPlayer::Renderer::getAudioStats(const sp<AMessage> &stats) {
+    Mutex::Autolock autoLock(mLock);
+    stats->setInt32("audio-deep-buffer", mDeepBufferAudio);
+    stats->setInt64("audio-drain-wakeups", mNumAudioDrainWakeups);
+    stats->setInt64("audio-sink-writes", mNumAudioSinkWrites);
+    stats->setInt64("audio-chunk-bytes", mAudioChunkBytes);
+}
+
+void NuPlayer::Renderer::getVideoStats(const sp<AMessage> &stats) {
+    Mutex::Autolock autoLock(mLock);
+    if (mNumSeekToDisplay > 0) {
+        stats->setInt64("seek-to-display-count", mNumSeekToDisplay);
+        stats->setInt64("seek-to-display-avg-us", mTotalSeekToDisplayUs / mNumSeekToDisplay);
+        stats->setInt64("seek-to-display-max-us", mMaxSeekToDisplayUs);
+    }
+}
+
 void NuPlayer::Renderer::prepareForMediaRenderingStart_l() {
     mAudioRenderingStartGeneration = mAudioDrainGeneration;
     mVideoRenderingStartGeneration = mVideoDrainGeneration;
@@ -943,7 +1073,9 @@ size_t NuPlayer::Renderer::fillAudioBuffer(void *buffer, size_t size) {
 
         entry->mOffset += copy;
         if (entry->mOffset == entry->mBuffer->size()) {
-            entry->mNotifyConsumed->post();
+            if (entry->mNotifyConsumed != nullptr) {
+                entry->mNotifyConsumed->post();
+            }
             mAudioQueue.erase(mAudioQueue.begin());
             entry = NULL;
         }
@@ -992,7 +1124,8 @@ void NuPlayer::Renderer::drainAudioQueueUntilLastEOS() {
         int32_t eos;
         QueueEntry *entry = &*it++;
         if ((entry->mBuffer == nullptr && entry->mNotifyConsumed == nullptr)
-                || (entry->mNotifyConsumed->findInt32("eos", &eos) && eos != 0)) {
+                || (entry->mNotifyConsumed != nullptr
+                        && entry->mNotifyConsumed->findInt32("eos", &eos) && eos != 0)) {
             itEOS = it;
             foundEOS = true;
         }
@@ -1009,7 +1142,7 @@ void NuPlayer::Renderer::drainAudioQueueUntilLastEOS() {
                     // TAG for re-opening audio sink.
                     onChangeAudioFormat(it->mMeta, it->mNotifyConsumed);
                 }
-            } else {
+            } else if (it->mNotifyConsumed != nullptr) {
                 it->mNotifyConsumed->post();
             }
         }
@@ -1133,7 +1266,9 @@ bool NuPlayer::Renderer::onDrainAudioQueue() {
                 copy -= remainder;
             }
 
-            entry->mNotifyConsumed->post();
+            if (entry->mNotifyConsumed != nullptr) {
+                entry->mNotifyConsumed->post();
+            }
             mAudioQueue.erase(mAudioQueue.begin());
 
             entry = NULL;
@@ -1144,6 +1279,7 @@ bool NuPlayer::Renderer::onDrainAudioQueue() {
 
         {
             Mutex::Autolock autoLock(mLock);
+            ++mNumAudioSinkWrites;
             int64_t maxTimeMedia;
             maxTimeMedia =
                 mAnchorTimeMediaUs +
@@ -1354,6 +1490,62 @@ void NuPlayer::Renderer::postDrainVideoQueue() {
 }
 
 void NuPlayer::Renderer::onDrainVideoQueue() {
+    ++mNumVideoDrainWakeups;
+
+    // Release the frames that are already inside the render lead window
+    // together, instead of waking up again for each one of them. At high
+    // frame rates this is what keeps message jitter from turning into judder.
+    size_t numDrained = 0;
+    int64_t mediaTimeUs;
+    do {
+        drainVideoFrame();
+    } while (++numDrained < kMaxVideoFramesPerDrain && isNextVideoFrameDue(&mediaTimeUs));
+}
+
+// Returns whether the next video frame would be due by the time the video drain
+// is posted for it by postDrainVideoQueue(), plus one vsync of slack.
+bool NuPlayer::Renderer::isNextVideoFrameDue(int64_t *mediaTimeUs) {
+    if (mPaused || !mVideoSampleReceived || getSyncQueues() || mVideoQueue.empty()) {
+        return false;
+    }
+
+    QueueEntry &entry = *mVideoQueue.begin();
+    if (entry.mBuffer == NULL) {
+        // let EOS go through the regular path
+        return false;
+    }
+
+    int64_t nowUs = ALooper::GetNowUs();
+    int64_t vsyncPeriodUs = mVideoScheduler->getVsyncPeriod() / 1000;
+    int64_t realTimeUs;
+    int64_t leadUs;
+    if (mFlags & FLAG_REAL_TIME) {
+        CHECK(entry.mBuffer->meta()->findInt64("timeUs", &realTimeUs));
+        leadUs = 2 * vsyncPeriodUs;
+    } else {
+        CHECK(entry.mBuffer->meta()->findInt64("timeUs", mediaTimeUs));
+        if (*mediaTimeUs < mAudioFirstAnchorTimeMediaUs) {
+            return false;
+        }
+        realTimeUs = getRealTimeUs(*mediaTimeUs, nowUs);
+        leadUs = vsyncPeriodUs ? (45000 / vsyncPeriodUs) * vsyncPeriodUs : 0ll;
+    }
+
+    if (realTimeUs - nowUs > leadUs + vsyncPeriodUs) {
+        return false;
+    }
+
+    if (!(mFlags & FLAG_REAL_TIME)) {
+        // bookkeeping postDrainVideoQueue() would have done for this frame
+        mNextVideoTimeMediaUs = *mediaTimeUs;
+        if (!mHasAudio) {
+            mMediaClock->updateMaxTimeMedia(*mediaTimeUs + kDefaultVideoFrameIntervalUs);
+        }
+    }
+    return true;
+}
+
+void NuPlayer::Renderer::drainVideoFrame() {
     if (mVideoQueue.empty()) {
         return;
     }
@@ -1429,7 +1621,20 @@ void NuPlayer::Renderer::onDrainVideoQueue() {
     mVideoQueue.erase(mVideoQueue.begin());
     entry = NULL;
 
+    if (!mVideoSampleReceived && mVideoFlushTimeUs >= 0) {
+        // first frame out after a flush, i.e. after a seek
+        int64_t latencyUs = nowUs - mVideoFlushTimeUs;
+        mVideoFlushTimeUs = -1;
+        ALOGV("first video frame %lld us after flush", (long long)latencyUs);
+
+        Mutex::Autolock autoLock(mLock);
+        ++mNumSeekToDisplay;
+        mTotalSeekToDisplayUs += latencyUs;
+        mMaxSeekToDisplayUs = std::max(mMaxSeekToDisplayUs, latencyUs);
+    }
+
     mVideoSampleReceived = true;
+    ++mNumVideoFramesReleased;
 
     if (!mPaused) {
         if (!mVideoRenderingStarted) {
@@ -1530,7 +1735,9 @@ void NuPlayer::Renderer::onQueueBuffer(const sp<AMessage> &msg) {
 
     if (audio) {
         Mutex::Autolock autoLock(mLock);
-        mAudioQueue.push_back(entry);
+        if (!copyIntoAudioChunk_l(entry)) {
+            mAudioQueue.push_back(entry);
+        }
         postDrainAudioQueue_l();
     } else {
         mVideoQueue.push_back(entry);
@@ -1566,7 +1773,9 @@ void NuPlayer::Renderer::onQueueBuffer(const sp<AMessage> &msg) {
         // Audio data starts More than 0.1 secs before video.
         // Drop some audio.
 
-        (*mAudioQueue.begin()).mNotifyConsumed->post();
+        if ((*mAudioQueue.begin()).mNotifyConsumed != nullptr) {
+            (*mAudioQueue.begin()).mNotifyConsumed->post();
+        }
         mAudioQueue.erase(mAudioQueue.begin());
         return;
     }
@@ -1700,9 +1909,15 @@ void NuPlayer::Renderer::onFlush(const sp<AMessage> &msg) {
         mDrainVideoQueuePending = false;
 
         if (mVideoScheduler != NULL) {
+            ALOGV("video pacing: %lld frames in %lld wake-ups, %zu of %zu paced frames juddered",
+                    (long long)mNumVideoFramesReleased, (long long)mNumVideoDrainWakeups,
+                    mVideoScheduler->getJudderFrameCount(),
+                    mVideoScheduler->getPacedFrameCount());
             mVideoScheduler->restart();
         }
 
+        mVideoFlushTimeUs = ALooper::GetNowUs();
+
         Mutex::Autolock autoLock(mLock);
         ++mVideoDrainGeneration;
         prepareForMediaRenderingStart_l();
@@ -1720,7 +1935,9 @@ void NuPlayer::Renderer::flushQueue(List<QueueEntry> *queue) {
         QueueEntry *entry = &*queue->begin();
 
         if (entry->mBuffer != NULL) {
-            entry->mNotifyConsumed->post();
+            if (entry->mNotifyConsumed != nullptr) {
+                entry->mNotifyConsumed->post();
+            }
         } else if (entry->mNotifyConsumed != nullptr) {
             // Is it needed to open audio sink now?
             onChangeAudioFormat(entry->mMeta, entry->mNotifyConsumed);
@@ -2000,6 +2217,8 @@ status_t NuPlayer::Renderer::onOpenAudioSink(
             offloadFlags &= ~AUDIO_OUTPUT_FLAG_DEEP_BUFFER;
             audioSinkChanged = true;
             mAudioSink->close();
+            mDeepBufferAudio = false;
+            setUpPcmBatcher();
 
             err = mAudioSink->open(
                     sampleRate,
@@ -2072,10 +2291,16 @@ status_t NuPlayer::Renderer::onOpenAudioSink(
             ++mAudioDrainGeneration;  // discard pending kWhatDrainAudioQueue message.
         }
 
+        // Audio-only playback on a deep buffer output gets a larger sink, which is then
+        // topped up in batches (see getDeepBufferDrainDelayUs()).
+        const bool deepBuffer = (pcmFlags & AUDIO_OUTPUT_FLAG_DEEP_BUFFER)
+                && !hasVideo && !mUseAudioCallback;
+
         // Compute the desired buffer size.
         // For callback mode, the amount of time before wakeup is about half the buffer size.
-        const uint32_t frameCount =
-                (unsigned long long)sampleRate * getAudioSinkPcmMsSetting() / 1000;
+        const uint32_t frameCount = (unsigned long long)sampleRate
+                * (deepBuffer ? getAudioSinkDeepBufferMsSetting() : getAudioSinkPcmMsSetting())
+                / 1000;
 
         // The doNotReconnect means AudioSink will signal back and let NuPlayer to re-construct
         // AudioSink. We don't want this when there's video because it will cause a video seek to
@@ -2103,9 +2328,14 @@ status_t NuPlayer::Renderer::onOpenAudioSink(
             ALOGW("openAudioSink: non offloaded open failed status: %d", err);
             mAudioSink->close();
             mCurrentPcmInfo = AUDIO_PCMINFO_INITIALIZER;
+            mDeepBufferAudio = false;
+            setUpPcmBatcher();
             return err;
         }
         mCurrentPcmInfo = info;
+        mDeepBufferAudio = deepBuffer;
+        setUpPcmBatcher();
+        ALOGV_IF(deepBuffer, "openAudioSink: deep buffer PCM, %u frames", frameCount);
         if (!mPaused) { // for preview mode, don't start if paused
             mAudioSink->start();
         }
@@ -2119,6 +2349,8 @@ status_t NuPlayer::Renderer::onOpenAudioSink(
 
 void NuPlayer::Renderer::onCloseAudioSink() {
     mAudioSink->close();
+    mDeepBufferAudio = false;
+    setUpPcmBatcher();
     mCurrentOffloadInfo = AUDIO_INFO_INITIALIZER;
     mCurrentPcmInfo = AUDIO_PCMINFO_INITIALIZER;
 }
@@ -74,6 +74,11 @@ struct NuPlayer::Renderer : public AHandler {
     status_t getCurrentPosition(int64_t *mediaUs);
     int64_t getVideoLateByUs();
 
+    // adds the audio sink wake-up and write counts to |stats|
+    void getAudioStats(const sp<AMessage> &stats);
+    // adds the flush (seek) to first displayed frame latencies to |stats|
+    void getVideoStats(const sp<AMessage> &stats);
+
     status_t openAudioSink(
             const sp<AMessage> &format,
             bool offloadOnly,
@@ -180,6 +185,15 @@ private:
     int64_t mAnchorNumFramesWritten;
     int64_t mVideoLateByUs;
     int64_t mNextVideoTimeMediaUs;
+    // wake-ups of the video drain vs. frames released, for pacing stats
+    int64_t mNumVideoDrainWakeups;
+    int64_t mNumVideoFramesReleased;
+    // time of the last video flush still waiting for its first frame, or -1
+    int64_t mVideoFlushTimeUs;
+    // flush to first displayed frame latencies, protected by mLock
+    int64_t mNumSeekToDisplay;
+    int64_t mTotalSeekToDisplayUs;
+    int64_t mMaxSeekToDisplayUs;
     bool mHasAudio;
     bool mHasVideo;
 
@@ -220,6 +234,16 @@ private:
     int32_t mLastAudioBufferDrained;
     bool mUseAudioCallback;
 
+    // PCM sink opened with AUDIO_OUTPUT_FLAG_DEEP_BUFFER for audio-only playback;
+    // the sink is topped up in larger batches, see getDeepBufferDrainDelayUs().
+    bool mDeepBufferAudio;
+    // set with mDeepBufferAudio; decoded PCM is copied into chunks it sizes
+    sp<PcmBatcher> mPcmBatcher;
+    int64_t mAudioChunkBytes;
+    // protected by mLock
+    int64_t mNumAudioDrainWakeups;
+    int64_t mNumAudioSinkWrites;
+
     sp<AWakeLock> mWakeLock;
 
     std::atomic_flag mSyncFlag = ATOMIC_FLAG_INIT;
@@ -240,6 +264,10 @@ private:
     bool onDrainAudioQueue();
     void drainAudioQueueUntilLastEOS();
     int64_t getPendingAudioPlayoutDurationUs(int64_t nowUs);
+    int64_t getDeepBufferDrainDelayUs();
+    void setUpPcmBatcher();
+    size_t getBatchedAudioBytes_l() const;
+    bool copyIntoAudioChunk_l(const QueueEntry &entry);
     void postDrainAudioQueue_l(int64_t delayUs = 0);
 
     void clearAnchorTime();
@@ -251,6 +279,8 @@ private:
     int64_t getRealTimeUs(int64_t mediaTimeUs, int64_t nowUs);
 
     void onDrainVideoQueue();
+    void drainVideoFrame();
+    bool isNextVideoFrameDue(int64_t *mediaTimeUs);
     void postDrainVideoQueue();
 
     void prepareForMediaRenderingStart_l();
@@ -131,6 +131,9 @@ struct NuPlayer::Source : public AHandler {
 
     virtual void setOffloadAudio(bool /* offload */) {}
 
+    // Adds source side counters of the audio or video track to |stats|.
+    virtual void getTrackStats(bool /* audio */, const sp<AMessage> & /* stats */) {}
+
     // Modular DRM
     virtual status_t prepareDrm(
             const uint8_t /*uuid*/[16], const Vector<uint8_t> &/*drmSessionId*/,
@@ -195,9 +195,17 @@ bool NuPlayer::StreamingSource::haveSufficientDataOnAllTracks() {
     sp<AnotherPacketSource> audioTrack = getSource(true /*audio*/);
     sp<AnotherPacketSource> videoTrack = getSource(false /*audio*/);
 
+    // A track at its memory cap counts as having enough data. The parser keeps
+    // being fed while the other track is below kMinDurationUs, as both come
+    // from the same TS packets and holding off would starve it.
+    const bool audioFull = audioTrack != NULL && audioTrack->isFull();
+    const bool videoFull = videoTrack != NULL && videoTrack->isFull();
+    ALOGV_IF(audioFull || videoFull, "track buffers are full (audio %d, video %d)",
+            audioFull, videoFull);
+
     status_t err;
     int64_t durationUs;
-    if (audioTrack != NULL
+    if (audioTrack != NULL && !audioFull
             && (durationUs = audioTrack->getBufferedDurationUs(&err))
                     < kMinDurationUs
             && err == OK) {
@@ -206,7 +214,7 @@ bool NuPlayer::StreamingSource::haveSufficientDataOnAllTracks() {
         return false;
     }
 
-    if (videoTrack != NULL
+    if (videoTrack != NULL && !videoFull
             && (durationUs = videoTrack->getBufferedDurationUs(&err))
                     < kMinDurationUs
             && err == OK) {
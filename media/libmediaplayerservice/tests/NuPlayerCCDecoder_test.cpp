@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "NuPlayerCCDecoder_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+#include "NuPlayerCCDecoder.h"
+
+namespace android {
+
+static const int64_t kTimeoutNs = 5000000000LL;
+
+struct CCNotificationCollector : public AHandler {
+    // Waits until at least |count| notifications have been received.
+    bool waitFor(size_t count) {
+        Mutex::Autolock autoLock(mLock);
+        while (mMessages.size() < count) {
+            if (mCondition.waitRelative(mLock, kTimeoutNs) != OK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Vector<sp<AMessage> > messages() {
+        Mutex::Autolock autoLock(mLock);
+        return mMessages;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        Mutex::Autolock autoLock(mLock);
+        mMessages.push(msg);
+        mCondition.broadcast();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    Vector<sp<AMessage> > mMessages;
+};
+
+class NuPlayerCCDecoderTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        mLooper = new ALooper;
+        mLooper->setName("NuPlayerCCDecoderTest");
+        mLooper->start();
+
+        mCollector = new CCNotificationCollector;
+        mLooper->registerHandler(mCollector);
+
+        mDecoder = new NuPlayer::CCDecoder(new AMessage(0, mCollector));
+    }
+
+    virtual void TearDown() override {
+        mDecoder.clear();
+        mLooper->stop();
+    }
+
+protected:
+    sp<ALooper> mLooper;
+    sp<CCNotificationCollector> mCollector;
+    sp<NuPlayer::CCDecoder> mDecoder;
+
+    // Decodes an MPEG-2 picture carrying one CEA-608 field 1 byte pair
+    // in ATSC A/53 user data.
+    void decodeLine21(int64_t timeUs, uint8_t data1, uint8_t data2) {
+        const uint8_t userData[] = {
+            0x00, 0x00, 0x01, 0xb2,     // user_data_start_code
+            'G', 'A', '9', '4',         // user_identifier
+            0x03,                       // user_data_type_code
+            0xc0 | 1,                   // process_cc_data_flag, cc_count
+            0xff,                       // em_data
+            0xfc, data1, data2,         // cc_valid, cc_type 0
+            0xff,                       // marker_bits
+        };
+
+        sp<ABuffer> accessUnit = ABuffer::CreateAsCopy(userData, sizeof(userData));
+        accessUnit->meta()->setInt64("timeUs", timeUs);
+
+        size_t offset = 0;
+        accessUnit->meta()->setBuffer(
+                "mpeg-user-data", ABuffer::CreateAsCopy(&offset, sizeof(offset)));
+
+        mDecoder->decode(accessUnit);
+    }
+};
+
+static void expectByteTriplets(
+        const sp<ABuffer> &buffer, const char *pairs, size_t numPairs) {
+    ASSERT_EQ(numPairs * 3, buffer->size());
+    for (size_t i = 0; i < numPairs; ++i) {
+        EXPECT_EQ(0, buffer->data()[3 * i]) << "pair " << i;
+        EXPECT_EQ(pairs[2 * i], buffer->data()[3 * i + 1]) << "pair " << i;
+        EXPECT_EQ(pairs[2 * i + 1], buffer->data()[3 * i + 2]) << "pair " << i;
+    }
+}
+
+TEST_F(NuPlayerCCDecoderTest, DisplayBatchesFramesUpToTimestamp) {
+    // A resume caption loading command on CC1 reveals the track.
+    decodeLine21(0, 0x14, 0x20);
+    ASSERT_TRUE(mCollector->waitFor(1));
+    ASSERT_EQ(1u, mDecoder->getTrackCount());
+    ASSERT_EQ(OK, mDecoder->selectTrack(0, true));
+
+    decodeLine21(1000, 'A', 'B');
+    decodeLine21(2000, 'C', 'D');
+    decodeLine21(3000, 'E', 'F');
+
+    // The frame at 1000us was dropped, its captions come with the next one.
+    mDecoder->display(2500);
+    mDecoder->display(3000);
+    mDecoder->display(3500);
+
+    decodeLine21(4000, 'G', 'H');
+    decodeLine21(5000, 'I', 'J');
+    mDecoder->display(5000);
+
+    ASSERT_TRUE(mCollector->waitFor(4));
+    usleep(50000);
+
+    Vector<sp<AMessage> > messages = mCollector->messages();
+    ASSERT_EQ(4u, messages.size());
+
+    int32_t what;
+    ASSERT_TRUE(messages[0]->findInt32("what", &what));
+    EXPECT_EQ(NuPlayer::CCDecoder::kWhatTrackAdded, what);
+
+    const int64_t kExpectedTimeUs[] = { 2500, 3000, 5000 };
+    const char *kExpectedPairs[] = { "ABCD", "EF", "GHIJ" };
+
+    sp<ABuffer> batches[3];
+    for (size_t i = 0; i < 3; ++i) {
+        const sp<AMessage> &msg = messages[i + 1];
+        ASSERT_TRUE(msg->findInt32("what", &what));
+        EXPECT_EQ(NuPlayer::CCDecoder::kWhatClosedCaptionData, what);
+        ASSERT_TRUE(msg->findBuffer("buffer", &batches[i]));
+
+        int64_t timeUs;
+        ASSERT_TRUE(batches[i]->meta()->findInt64("timeUs", &timeUs));
+        EXPECT_EQ(kExpectedTimeUs[i], timeUs);
+
+        int32_t trackIndex;
+        ASSERT_TRUE(batches[i]->meta()->findInt32("track-index", &trackIndex));
+        EXPECT_EQ(0, trackIndex);
+    }
+
+    // Buffers handed out are never reused for later frames.
+    for (size_t i = 0; i < 3; ++i) {
+        expectByteTriplets(
+                batches[i], kExpectedPairs[i], strlen(kExpectedPairs[i]) / 2);
+    }
+}
+
+}  // namespace android
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "NuPlayerPcmBatcher_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <media/MediaCodecBuffer.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <utils/Vector.h>
+
+#include "NuPlayerPcmBatcher.h"
+
+namespace android {
+
+// 16-bit stereo at 48 kHz.
+static const size_t kFrameSize = 4;
+static const int32_t kSampleRate = 48000;
+static const int64_t kBufferUs = 10000;
+static const size_t kBufferBytes = 480 * kFrameSize;
+
+class NuPlayerPcmBatcherTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        mBatcher = new NuPlayer::PcmBatcher(
+                kFrameSize, kSampleRate, 40000 /* chunkUs */, 100000 /* maxPendingUs */);
+    }
+
+    sp<MediaCodecBuffer> makeBuffer(int64_t timeUs, uint8_t fill, size_t size = kBufferBytes) {
+        sp<MediaCodecBuffer> buffer = new MediaCodecBuffer(new AMessage, new ABuffer(size));
+        memset(buffer->data(), fill, size);
+        buffer->meta()->setInt64("timeUs", timeUs);
+        return buffer;
+    }
+
+    // Queues |buffer| the way the renderer does: appended to the last chunk if
+    // possible, otherwise as a new chunk.
+    void queue(const sp<MediaCodecBuffer> &buffer) {
+        if (mChunks.empty() || !mBatcher->append(mChunks.top(), buffer)) {
+            mChunks.push(mBatcher->newChunk(buffer));
+        }
+    }
+
+    sp<NuPlayer::PcmBatcher> mBatcher;
+    Vector<sp<MediaCodecBuffer> > mChunks;
+};
+
+TEST_F(NuPlayerPcmBatcherTest, SizesFollowDurations) {
+    EXPECT_EQ(mBatcher->chunkBytes(), 1920u * kFrameSize);
+    EXPECT_EQ(mBatcher->maxPendingBytes(), 4800u * kFrameSize);
+}
+
+TEST_F(NuPlayerPcmBatcherTest, BatchesContiguousBuffersUpToChunkSize) {
+    for (int i = 0; i < 10; ++i) {
+        queue(makeBuffer(i * kBufferUs, i));
+    }
+
+    ASSERT_EQ(mChunks.size(), 3u);
+    EXPECT_EQ(mChunks[0]->size(), 4 * kBufferBytes);
+    EXPECT_EQ(mChunks[1]->size(), 4 * kBufferBytes);
+    EXPECT_EQ(mChunks[2]->size(), 2 * kBufferBytes);
+
+    for (size_t i = 0; i < mChunks.size(); ++i) {
+        int64_t timeUs;
+        ASSERT_TRUE(mChunks[i]->meta()->findInt64("timeUs", &timeUs));
+        EXPECT_EQ(timeUs, (int64_t)i * 4 * kBufferUs);
+        for (size_t j = 0; j < mChunks[i]->size() / kBufferBytes; ++j) {
+            EXPECT_EQ(mChunks[i]->data()[j * kBufferBytes], i * 4 + j);
+            EXPECT_EQ(mChunks[i]->data()[(j + 1) * kBufferBytes - 1], i * 4 + j);
+        }
+    }
+}
+
+TEST_F(NuPlayerPcmBatcherTest, StartsNewChunkOnTimestampGap) {
+    queue(makeBuffer(0, 0));
+    queue(makeBuffer(kBufferUs, 1));
+    queue(makeBuffer(5 * kBufferUs, 2));
+    queue(makeBuffer(6 * kBufferUs + 500, 3));  // within rounding of the chunk end
+
+    ASSERT_EQ(mChunks.size(), 2u);
+    EXPECT_EQ(mChunks[0]->size(), 2 * kBufferBytes);
+    EXPECT_EQ(mChunks[1]->size(), 2 * kBufferBytes);
+}
+
+TEST_F(NuPlayerPcmBatcherTest, OversizedBufferGetsItsOwnChunk) {
+    queue(makeBuffer(0, 0));
+    queue(makeBuffer(kBufferUs, 1, 3 * mBatcher->chunkBytes()));
+
+    ASSERT_EQ(mChunks.size(), 2u);
+    EXPECT_EQ(mChunks[1]->size(), 3 * mBatcher->chunkBytes());
+}
+
+TEST_F(NuPlayerPcmBatcherTest, CopyStopsAtPendingLimit) {
+    sp<MediaCodecBuffer> buffer = makeBuffer(0, 0);
+    EXPECT_TRUE(mBatcher->canCopy(buffer, 0));
+    EXPECT_TRUE(mBatcher->canCopy(buffer, mBatcher->maxPendingBytes() - kBufferBytes));
+    EXPECT_FALSE(mBatcher->canCopy(buffer, mBatcher->maxPendingBytes() - kBufferBytes + 1));
+    EXPECT_FALSE(mBatcher->canCopy(makeBuffer(0, 0, 0), 0));
+    EXPECT_FALSE(mBatcher->canCopy(makeBuffer(0, 0, kBufferBytes + 1), 0));
+}
+
+}  // namespace android
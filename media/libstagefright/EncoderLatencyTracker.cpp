@@ -0,0 +1,86 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "EncoderLatencyTracker"
+#include <utils/Log.h>
+
+#include <media/stagefright/EncoderLatencyTracker.h>
+
+namespace android {
+
+EncoderLatencyTracker::EncoderLatencyTracker(int64_t maxLatencyUs)
+    : mMaxPendingUs(maxLatencyUs),
+      mMaxLatencyUs(0),
+      mTotalLatencyUs(0),
+      mNumSamples(0) {
+}
+
+void EncoderLatencyTracker::onInputQueued(int64_t timeUs, int64_t nowUs) {
+    while (!mPendingInputs.empty()
+            && nowUs - mPendingInputs.begin()->mQueuedUs > mMaxPendingUs) {
+        ALOGV("input at %lld us never came out of the encoder",
+                (long long)mPendingInputs.begin()->mTimeUs);
+        mPendingInputs.erase(mPendingInputs.begin());
+    }
+    PendingInput input;
+    input.mTimeUs = timeUs;
+    input.mQueuedUs = nowUs;
+    mPendingInputs.push_back(input);
+}
+
+bool EncoderLatencyTracker::takeLatency(int64_t timeUs, int64_t nowUs, int64_t *latencyUs) {
+    if (mPendingInputs.empty()) {
+        return false;
+    }
+    // Only a few inputs are in flight, so a linear search is fine.
+    List<PendingInput>::iterator it = mPendingInputs.begin();
+    while (it != mPendingInputs.end() && it->mTimeUs != timeUs) {
+        ++it;
+    }
+    if (it == mPendingInputs.end()) {
+        // The encoder has its own output timeline. The output starts in the
+        // last input queued at or before its time, and everything queued
+        // before that input has been consumed too.
+        List<PendingInput>::iterator last = mPendingInputs.end();
+        for (it = mPendingInputs.begin(); it != mPendingInputs.end(); ++it) {
+            if (it->mTimeUs <= timeUs) {
+                last = it;
+            }
+        }
+        if (last == mPendingInputs.end()) {
+            it = mPendingInputs.begin();
+        } else {
+            it = last;
+            mPendingInputs.erase(mPendingInputs.begin(), last);
+        }
+    }
+    *latencyUs = nowUs - it->mQueuedUs;
+    mPendingInputs.erase(it);
+
+    if (*latencyUs > mMaxLatencyUs) {
+        mMaxLatencyUs = *latencyUs;
+    }
+    mTotalLatencyUs += *latencyUs;
+    ++mNumSamples;
+    return true;
+}
+
+void EncoderLatencyTracker::clear() {
+    mPendingInputs.clear();
+}
+
+}  // namespace android
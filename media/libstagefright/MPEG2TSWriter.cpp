@@ -525,6 +525,7 @@ status_t MPEG2TSWriter::start(MetaData *param ) {
     mNumSourcesDone = 0;
     mNumTSPacketsWritten = 0;
     mNumTSPacketsBeforeMeta = 0;
+    mPMTPacket.clear();
 
     for (size_t i = 0; i < mSources.size(); ++i) {
         sp<AMessage> notify =
@@ -698,19 +699,24 @@ void MPEG2TSWriter::writeProgramAssociationTable() {
         0x00, 0x00, 0x00, 0x00   // b???? ???? ???? ???? ???? ???? ???? ????
     };
 
-    sp<ABuffer> buffer = new ABuffer(188);
-    memset(buffer->data(), 0xff, buffer->size());
-    memcpy(buffer->data(), kData, sizeof(kData));
+    if (mPATPacket == NULL) {
+        mPATPacket = new ABuffer(188);
+        memset(mPATPacket->data(), 0xff, mPATPacket->size());
+        memcpy(mPATPacket->data(), kData, sizeof(kData));
+
+        uint32_t crc = htonl(crc32(&mPATPacket->data()[5], 12));
+        memcpy(&mPATPacket->data()[17], &crc, sizeof(crc));
+    }
 
     if (++mPATContinuityCounter == 16) {
         mPATContinuityCounter = 0;
     }
-    buffer->data()[3] |= mPATContinuityCounter;
 
-    uint32_t crc = htonl(crc32(&buffer->data()[5], 12));
-    memcpy(&buffer->data()[17], &crc, sizeof(crc));
+    // The continuity counter lives in the TS header, outside of the CRC.
+    uint8_t *data = mPATPacket->data();
+    data[3] = (data[3] & 0xf0) | mPATContinuityCounter;
 
-    CHECK_EQ(internalWrite(buffer->data(), buffer->size()), (ssize_t)buffer->size());
+    CHECK_EQ(internalWrite(data, mPATPacket->size()), (ssize_t)mPATPacket->size());
 }
 
 void MPEG2TSWriter::writeProgramMap() {
@@ -755,13 +761,23 @@ void MPEG2TSWriter::writeProgramMap() {
         0xe0, 0x00, 0xf0, 0x00   // b111? ???? ???? ???? 1111 0000 0000 0000
     };
 
+    if (++mPMTContinuityCounter == 16) {
+        mPMTContinuityCounter = 0;
+    }
+
+    if (mPMTPacket != NULL) {
+        uint8_t *data = mPMTPacket->data();
+        data[3] = (data[3] & 0xf0) | mPMTContinuityCounter;
+
+        CHECK_EQ(internalWrite(data, mPMTPacket->size()),
+                 (ssize_t)mPMTPacket->size());
+        return;
+    }
+
     sp<ABuffer> buffer = new ABuffer(188);
     memset(buffer->data(), 0xff, buffer->size());
     memcpy(buffer->data(), kData, sizeof(kData));
 
-    if (++mPMTContinuityCounter == 16) {
-        mPMTContinuityCounter = 0;
-    }
     buffer->data()[3] |= mPMTContinuityCounter;
 
     size_t section_length = 5 * mSources.size() + 4 + 9;
@@ -786,6 +802,8 @@ void MPEG2TSWriter::writeProgramMap() {
     uint32_t crc = htonl(crc32(&buffer->data()[5], 12+mSources.size()*5));
     memcpy(&buffer->data()[17+mSources.size()*5], &crc, sizeof(crc));
 
+    mPMTPacket = buffer;
+
     CHECK_EQ(internalWrite(buffer->data(), buffer->size()), (ssize_t)buffer->size());
 }
 
@@ -826,14 +844,8 @@ void MPEG2TSWriter::writeAccessUnit(
     // reserved = b1
     // the first fragment of "buffer" follows
 
-    sp<ABuffer> buffer = new ABuffer(188);
-    memset(buffer->data(), 0xff, buffer->size());
-
     const unsigned PID = 0x1e0 + sourceIndex + 1;
 
-    const unsigned continuity_counter =
-        mSources.editItemAt(sourceIndex)->incrementContinuityCounter();
-
     // XXX if there are multiple streams of a kind (more than 1 audio or
     // more than 1 video) they need distinct stream_ids.
     const unsigned stream_id =
@@ -855,7 +867,25 @@ void MPEG2TSWriter::writeAccessUnit(
         PES_packet_length = 0;
     }
 
-    uint8_t *ptr = buffer->data();
+    // The first packet carries the 14 byte PES header, every following one
+    // up to 184 bytes of payload.
+    size_t numTSPackets = 1;
+    if (accessUnit->size() > 188 - 18) {
+        numTSPackets += (accessUnit->size() - (188 - 18) + 183) / 184;
+    }
+
+    size_t outputSize = numTSPackets * 188;
+    if (mOutputBuffer == NULL || mOutputBuffer->capacity() < outputSize) {
+        mOutputBuffer = new ABuffer(outputSize);
+    }
+    mOutputBuffer->setRange(0, outputSize);
+
+    uint8_t *packetDataStart = mOutputBuffer->data();
+
+    const unsigned continuity_counter =
+        mSources.editItemAt(sourceIndex)->incrementContinuityCounter();
+
+    uint8_t *ptr = packetDataStart;
     *ptr++ = 0x47;
     *ptr++ = 0x40 | (PID >> 8);
     *ptr++ = PID & 0xff;
@@ -865,6 +895,7 @@ void MPEG2TSWriter::writeAccessUnit(
         *ptr++ = paddingSize - 1;
         if (paddingSize >= 2) {
             *ptr++ = 0x00;
+            memset(ptr, 0xff, paddingSize - 2);
             ptr += paddingSize - 2;
         }
     }
@@ -883,15 +914,14 @@ void MPEG2TSWriter::writeAccessUnit(
     *ptr++ = (PTS >> 7) & 0xff;
     *ptr++ = ((PTS & 0x7f) << 1) | 1;
 
-    size_t sizeLeft = buffer->data() + buffer->size() - ptr;
+    size_t sizeLeft = packetDataStart + 188 - ptr;
     size_t copy = accessUnit->size();
     if (copy > sizeLeft) {
         copy = sizeLeft;
     }
 
     memcpy(ptr, accessUnit->data(), copy);
-
-    CHECK_EQ(internalWrite(buffer->data(), buffer->size()), (ssize_t)buffer->size());
+    packetDataStart += 188;
 
     size_t offset = copy;
     while (offset < accessUnit->size()) {
@@ -907,12 +937,10 @@ void MPEG2TSWriter::writeAccessUnit(
         // continuity_counter = b????
         // the fragment of "buffer" follows.
 
-        memset(buffer->data(), 0xff, buffer->size());
-
         const unsigned continuity_counter =
             mSources.editItemAt(sourceIndex)->incrementContinuityCounter();
 
-        ptr = buffer->data();
+        ptr = packetDataStart;
         *ptr++ = 0x47;
         *ptr++ = 0x00 | (PID >> 8);
         *ptr++ = PID & 0xff;
@@ -925,22 +953,26 @@ void MPEG2TSWriter::writeAccessUnit(
             *ptr++ = paddingSize - 1;
             if (paddingSize >= 2) {
                 *ptr++ = 0x00;
+                memset(ptr, 0xff, paddingSize - 2);
                 ptr += paddingSize - 2;
             }
         }
 
-        size_t sizeLeft = buffer->data() + buffer->size() - ptr;
+        size_t sizeLeft = packetDataStart + 188 - ptr;
         size_t copy = accessUnit->size() - offset;
         if (copy > sizeLeft) {
             copy = sizeLeft;
         }
 
         memcpy(ptr, accessUnit->data() + offset, copy);
-        CHECK_EQ(internalWrite(buffer->data(), buffer->size()),
-                 (ssize_t)buffer->size());
 
         offset += copy;
+        packetDataStart += 188;
     }
+
+    CHECK(packetDataStart == mOutputBuffer->data() + outputSize);
+
+    CHECK_EQ(internalWrite(mOutputBuffer->data(), outputSize), (ssize_t)outputSize);
 }
 
 void MPEG2TSWriter::writeTS() {
@@ -980,6 +1012,8 @@ uint32_t MPEG2TSWriter::crc32(const uint8_t *p_start, size_t length) {
 }
 
 ssize_t MPEG2TSWriter::internalWrite(const void *data, size_t size) {
+    mNumTSPacketsWritten += size / 188;
+
     if (mFile != NULL) {
         return fwrite(data, 1, size, mFile);
     }
@@ -26,6 +26,7 @@
 #include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <utils/Log.h>
@@ -49,6 +50,7 @@
 #include <media/mediarecorder.h>
 #include <cutils/properties.h>
 
+#include "include/DeltaTableEntries.h"
 #include "include/ESDS.h"
 #include "include/HevcUtils.h"
 
@@ -71,6 +73,9 @@ static const int64_t kInitialDelayTimeUs     = 700000LL;
 static const int64_t kMaxMetadataSize = 0x4000000LL;   // 64MB max per-frame metadata size
 static const int64_t kMaxCttsOffsetTimeUs = 30 * 60 * 1000000LL;  // 30 minutes
 static const size_t kESDSScratchBufferSize = 10;  // kMaxAtomSize in Mpeg4Extractor 64MB
+// Fragment durations other tracks may run ahead of a track that has not
+// delivered any data yet, before the 'moov' is written without it.
+static const int64_t kMaxPendingFragments = 4;
 
 static const char kMetaKey_Version[]    = "com.android.version";
 static const char kMetaKey_Manufacturer[]      = "com.android.manufacturer";
@@ -157,6 +162,7 @@ public:
     bool isAudio() const { return mIsAudio; }
     bool isMPEG4() const { return mIsMPEG4; }
     bool usePrefix() const { return mIsAvc || mIsHevc || mIsHeic; }
+    bool isInInitSegment() const { return mInInitSegment; }
     bool isExifData(MediaBufferBase *buffer, uint32_t *tiffHdrOffset) const;
     void addChunkOffset(off64_t offset);
     void addItemOffsetAndSize(off64_t offset, size_t size, bool isExif);
@@ -168,6 +174,20 @@ public:
     void resetInternal();
     int64_t trackMetaDataSize();
 
+    // Movie fragments
+    static size_t getTrafBoxSize(size_t numSamples) {
+        return 8 + 16 + 20 + 20 + numSamples * 16;  // traf, tfhd, tfdt, trun
+    }
+    uint32_t getFragmentSampleSize(MediaBuffer *sample) const;
+    // Writes the 'traf' box for |samples|, whose data starts |dataOffset| bytes
+    // after the beginning of the 'moof' at |moofOffset|. Returns the number of
+    // bytes of sample data described.
+    // |trackStartTimeUs| is the track start time snapshotted with the chunks.
+    uint32_t writeTrafBox(const List<MediaBuffer *> &samples, int64_t trackStartTimeUs,
+            uint32_t trafNumber, off64_t moofOffset, uint32_t dataOffset);
+    void writeTrexBox();
+    void writeTfraBox();
+
 private:
     // A helper class to handle faster write box with table entries
     template<class TYPE, unsigned ENTRY_SIZE>
@@ -335,10 +355,11 @@ private:
     List<MediaBuffer *> mChunkSamples;
 
     bool mSamplesHaveSameSize;
-    ListTableEntries<uint32_t, 1> *mStszTableEntries;
-    ListTableEntries<off64_t, 1> *mCo64TableEntries;
+    uint32_t mNumSamples;
+    DeltaTableEntries<uint32_t> *mStszTableEntries;
+    DeltaTableEntries<off64_t> *mCo64TableEntries;
     ListTableEntries<uint32_t, 3> *mStscTableEntries;
-    ListTableEntries<uint32_t, 1> *mStssTableEntries;
+    DeltaTableEntries<uint32_t> *mStssTableEntries;
     ListTableEntries<uint32_t, 2> *mSttsTableEntries;
     ListTableEntries<uint32_t, 2> *mCttsTableEntries;
     ListTableEntries<uint32_t, 3> *mElstTableEntries; // 3columns: segDuration, mediaTime, mediaRate
@@ -347,6 +368,18 @@ private:
     int64_t mMinCttsOffsetTicks;
     int64_t mMaxCttsOffsetTicks;
 
+    // Movie fragment state, only used by the writer thread.
+    struct FragmentRandomAccessEntry {
+        int64_t timeTicks;
+        off64_t moofOffset;
+        uint32_t trafNumber;
+        uint32_t sampleNumber;
+    };
+    std::vector<FragmentRandomAccessEntry> mFragmentRandomAccessEntries;
+    int64_t mFragmentStartOffsetTicks;  // Track start offset in the movie timeline
+    int64_t mLastFragmentSampleDurationTicks;
+    bool mInInitSegment;  // Described in the 'moov' of a fragmented file
+
     // Save the last 10 frames' timestamp and frame type for debug.
     struct TimestampDebugHelperEntry {
         int64_t pts;
@@ -375,6 +408,9 @@ private:
     bool mGotAllCodecSpecificData;
     bool mTrackingProgressStatus;
 
+    // Guards mReachedEOS and mStartTimestampUs, which the writer thread
+    // looks at while the track thread is running.
+    mutable Mutex mStateLock;
     bool mReachedEOS;
     int64_t mStartTimestampUs;
     int64_t mStartTimeRealUs;
@@ -404,6 +440,8 @@ private:
 
     int64_t getStartTimeOffsetTimeUs() const;
     int32_t getStartTimeOffsetScaledTime() const;
+    int64_t getStartTimeOffsetTimeUs(int64_t trackStartTimeUs) const;
+    int32_t getStartTimeOffsetScaledTime(int64_t trackStartTimeUs) const;
 
     static void *ThreadWrapper(void *me);
     status_t threadEntry();
@@ -519,6 +557,10 @@ void MPEG4Writer::initInternal(int fd, bool isFirstSession) {
     mSendNotify = false;
     mWriteSeekErr = false;
     mFallocateErr = false;
+    mNumWriteSyscalls = 0;
+    mNumBytesWritten = 0;
+    mWriteBatchCount = 0;
+    mWriteBatchBytes = 0;
 
     // Reset following variables for all the sessions and they will be
     // initialized in start(MetaData *param).
@@ -534,6 +576,9 @@ void MPEG4Writer::initInternal(int fd, bool isFirstSession) {
     mWriteBoxToMemory = false;
     mFreeBoxOffset = 0;
     mStreamableFile = false;
+    mFragmentDurationUs = 0;
+    mInitSegmentWritten = false;
+    mFragmentSequenceNumber = 0;
     mTimeScale = -1;
     mHasFileLevelMeta = false;
     mFileLevelMetaDataSize = 0;
@@ -607,7 +652,7 @@ status_t MPEG4Writer::Track::dump(
     snprintf(buffer, SIZE, "       reached EOS: %s\n",
             mReachedEOS? "true": "false");
     result.append(buffer);
-    snprintf(buffer, SIZE, "       frames encoded : %d\n", mStszTableEntries->count());
+    snprintf(buffer, SIZE, "       frames encoded : %d\n", mNumSamples);
     result.append(buffer);
     snprintf(buffer, SIZE, "       duration encoded : %" PRId64 " us\n", mTrackDurationUs);
     result.append(buffer);
@@ -888,6 +933,27 @@ status_t MPEG4Writer::start(MetaData *param) {
         return OK;
     }
 
+    int64_t fragmentDurationUs;
+    if (param && param->findInt64(kKeyFragmentDurationUs, &fragmentDurationUs) &&
+            fragmentDurationUs > 0) {
+        if (mHasFileLevelMeta) {
+            ALOGW("Fragmented output is not supported for image tracks");
+        } else {
+            // Sample sizes in 'trun' boxes assume 4-byte NAL length fields.
+            if (!mUse4ByteNalLength) {
+                ALOGE("Fragmented output requires 4-byte NAL length fields");
+                return BAD_VALUE;
+            }
+            mFragmentDurationUs = fragmentDurationUs;
+            // A chunk must not span more than one fragment.
+            if (mInterleaveDurationUs > mFragmentDurationUs) {
+                mInterleaveDurationUs = mFragmentDurationUs;
+            }
+            ALOGI("Writing fragmented file, fragment duration %" PRId64 " us",
+                    mFragmentDurationUs);
+        }
+    }
+
     if (!param ||
         !param->findInt32(kKeyTimeScale, &mTimeScale)) {
         // Increased by a factor of 10 to improve precision of segment duration in edit list entry.
@@ -904,7 +970,8 @@ status_t MPEG4Writer::start(MetaData *param) {
      */
     mStreamableFile =
         (mMaxFileSizeLimitBytes != 0 &&
-         mMaxFileSizeLimitBytes >= kMinStreamableFileSizeInBytes);
+         mMaxFileSizeLimitBytes >= kMinStreamableFileSizeInBytes &&
+         !isFragmented());
 
     /*
      * mWriteBoxToMemory is true if the amount of data in a file-level meta or
@@ -998,7 +1065,10 @@ status_t MPEG4Writer::start(MetaData *param) {
 
     mOffset = mMdatOffset;
     seekOrPostError(mFd, mMdatOffset, SEEK_SET);
-    write("\x00\x00\x00\x01mdat????????", 16);
+    if (!isFragmented()) {
+        // Fragmented files get one 'mdat' per fragment, after the 'moov'.
+        write("\x00\x00\x00\x01mdat????????", 16);
+    }
 
     /* Confirm whether the writing of the initial file atoms, ftyp and free,
      * are written to the file properly by posting kWhatNoIOErrorSoFar to the
@@ -1039,7 +1109,7 @@ status_t MPEG4Writer::stopWriterThread() {
         return OK;
     }
     {
-        Mutex::Autolock autolock(mLock);
+        Mutex::Autolock autolock(mChunkQueueLock);
         mDone = true;
         mChunkReadyCondition.signal();
     }
@@ -1111,6 +1181,8 @@ void MPEG4Writer::writeCompositionMatrix(int degrees) {
 }
 
 void MPEG4Writer::printWriteDurations() {
+    ALOGD("%" PRIu64 " bytes written in %" PRIu64 " write calls",
+            mNumBytesWritten, mNumWriteSyscalls);
     if (mWriteDurationPQ.empty()) {
         return;
     }
@@ -1248,6 +1320,17 @@ status_t MPEG4Writer::reset(bool stopSource) {
         return err;
     }
 
+    if (isFragmented()) {
+        // The 'moov', all fragments and the 'mfra' box have been written out
+        // by the writer thread already.
+        CHECK(mBoxes.empty());
+        status_t errRelease = release();
+        if (err == OK) {
+            err = errRelease;
+        }
+        return err;
+    }
+
     // Fix up the size of the 'mdat' chunk.
     seekOrPostError(mFd, mMdatOffset + 8, SEEK_SET);
     uint64_t size = mOffset - mMdatOffset;
@@ -1387,6 +1470,17 @@ void MPEG4Writer::writeMoovBox(int64_t durationUs) {
         writeUdtaBox();
     }
     writeMoovLevelMetaBox();
+    if (isFragmented()) {
+        // Composition offsets are signed in fragments, so no start time
+        // adjustment is needed.
+        for (List<Track *>::iterator it = mTracks.begin();
+            it != mTracks.end(); ++it) {
+            (*it)->writeTrackHeader();
+        }
+        writeMvexBox();
+        endBox();  // moov
+        return;
+    }
     // Loop through all the tracks to get the global time offset if there is
     // any ctts table appears in a video track.
     int64_t minCttsOffsetTimeUs = kMaxCttsOffsetTimeUs;
@@ -1445,6 +1539,9 @@ void MPEG4Writer::writeFtypBox(MetaData *param) {
             writeFourcc("mp42");
         }
     }
+    if (isFragmented()) {
+        writeFourcc("iso5");
+    }
 
     endBox();
 }
@@ -1468,12 +1565,12 @@ void MPEG4Writer::sendSessionSummary() {
         return;
     }
 
-    for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+    for (List<ChunkInfo *>::iterator it = mChunkInfos.begin();
          it != mChunkInfos.end(); ++it) {
-        uint32_t trackNum = (it->mTrack->getTrackId().getId() << 28);
+        uint32_t trackNum = ((*it)->mTrack->getTrackId().getId() << 28);
         notify(MEDIA_RECORDER_TRACK_EVENT_INFO,
                 trackNum | MEDIA_RECORDER_TRACK_INTER_CHUNK_TIME_MS,
-                it->mMaxInterChunkDurUs);
+                (*it)->mMaxInterChunkDurUs);
     }
 }
 
@@ -1500,12 +1597,12 @@ off64_t MPEG4Writer::addSample_l(
     } else {
         if (tiffHdrOffset > 0) {
             tiffHdrOffset = htonl(tiffHdrOffset);
-            writeOrPostError(mFd, &tiffHdrOffset, 4);  // exif_tiff_header_offset field
+            appendFieldToWriteBatch_l(&tiffHdrOffset, 4);  // exif_tiff_header_offset field
             mOffset += 4;
         }
 
-        writeOrPostError(mFd, (const uint8_t*)buffer->data() + buffer->range_offset(),
-                         buffer->range_length());
+        appendToWriteBatch_l((const uint8_t*)buffer->data() + buffer->range_offset(),
+                             buffer->range_length());
 
         mOffset += buffer->range_length();
     }
@@ -1538,6 +1635,7 @@ void MPEG4Writer::addMultipleLengthPrefixedSamples_l(MediaBuffer *buffer) {
     while (getNextNALUnit(&data, &searchSize, &nextNalStart,
             &nextNalSize, true) == OK) {
         size_t currentNalSize = nextNalStart - currentNalStart - 4 /* strip start-code */;
+        // The NAL data is only referenced by the write batch; |buffer| keeps it alive.
         MediaBuffer *nalBuf = new MediaBuffer((void *)currentNalStart, currentNalSize);
         addLengthPrefixedSample_l(nalBuf);
         nalBuf->release();
@@ -1559,8 +1657,8 @@ void MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
         x[1] = (length >> 16) & 0xff;
         x[2] = (length >> 8) & 0xff;
         x[3] = length & 0xff;
-        writeOrPostError(mFd, &x, 4);
-        writeOrPostError(mFd, (const uint8_t*)buffer->data() + buffer->range_offset(), length);
+        appendFieldToWriteBatch_l(&x, 4);
+        appendToWriteBatch_l((const uint8_t*)buffer->data() + buffer->range_offset(), length);
         mOffset += length + 4;
     } else {
         CHECK_LT(length, 65536u);
@@ -1568,12 +1666,44 @@ void MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
         uint8_t x[2];
         x[0] = length >> 8;
         x[1] = length & 0xff;
-        writeOrPostError(mFd, &x, 2);
-        writeOrPostError(mFd, (const uint8_t*)buffer->data() + buffer->range_offset(), length);
+        appendFieldToWriteBatch_l(&x, 2);
+        appendToWriteBatch_l((const uint8_t*)buffer->data() + buffer->range_offset(), length);
         mOffset += length + 2;
     }
 }
 
+void MPEG4Writer::appendToWriteBatch_l(const void *data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (mWriteBatchCount == kMaxWriteBatchEntries) {
+        flushWriteBatch_l();
+    }
+    mWriteBatch[mWriteBatchCount].iov_base = const_cast<void *>(data);
+    mWriteBatch[mWriteBatchCount].iov_len = size;
+    ++mWriteBatchCount;
+    mWriteBatchBytes += size;
+}
+
+void MPEG4Writer::appendFieldToWriteBatch_l(const void *data, size_t size) {
+    CHECK_LE(size, (size_t)kMaxWriteBatchFieldSize);
+    if (mWriteBatchCount == kMaxWriteBatchEntries) {
+        flushWriteBatch_l();
+    }
+    uint8_t *field = mWriteBatchFields[mWriteBatchCount];
+    memcpy(field, data, size);
+    appendToWriteBatch_l(field, size);
+}
+
+void MPEG4Writer::flushWriteBatch_l() {
+    if (mWriteBatchCount == 0) {
+        return;
+    }
+    writevOrPostError(mFd, mWriteBatch, mWriteBatchCount, mWriteBatchBytes);
+    mWriteBatchCount = 0;
+    mWriteBatchBytes = 0;
+}
+
 size_t MPEG4Writer::write(
         const void *ptr, size_t size, size_t nmemb) {
 
@@ -1622,6 +1752,10 @@ void MPEG4Writer::writeOrPostError(int fd, const void* buf, size_t count) {
     if (mWriteDurationPQ.size() > kWriteDurationsCount) {
         mWriteDurationPQ.pop();
     }
+    ++mNumWriteSyscalls;
+    if (bytesWritten > 0) {
+        mNumBytesWritten += bytesWritten;
+    }
 
     /* Write as much as possible during stop() execution when there was an error
      * (mWriteSeekErr == true) in the previous call to write() or lseek64().
@@ -1639,6 +1773,37 @@ void MPEG4Writer::writeOrPostError(int fd, const void* buf, size_t count) {
     WARN_UNLESS(msg->post() == OK, "writeOrPostError:error posting ERROR_IO");
 }
 
+void MPEG4Writer::writevOrPostError(
+        int fd, const struct iovec *iov, int iovcnt, size_t count) {
+    if (mWriteSeekErr == true)
+        return;
+
+    auto beforeTP = std::chrono::high_resolution_clock::now();
+    ssize_t bytesWritten = ::writev(fd, iov, iovcnt);
+    auto afterTP = std::chrono::high_resolution_clock::now();
+    auto writeDuration =
+            std::chrono::duration_cast<std::chrono::microseconds>(afterTP - beforeTP).count();
+    mWriteDurationPQ.emplace(writeDuration);
+    if (mWriteDurationPQ.size() > kWriteDurationsCount) {
+        mWriteDurationPQ.pop();
+    }
+    ++mNumWriteSyscalls;
+    if (bytesWritten > 0) {
+        mNumBytesWritten += bytesWritten;
+    }
+
+    if (bytesWritten == count)
+        return;
+    mWriteSeekErr = true;
+    ALOGE("writevOrPostError bytesWritten:%zd, count:%zu, iovcnt:%d, error:%s(%d)",
+          bytesWritten, count, iovcnt, std::strerror(errno), errno);
+
+    // Can't guarantee that file is usable or write would succeed anymore, hence signal to stop.
+    sp<AMessage> msg = new AMessage(kWhatIOError, mReflector);
+    msg->setInt32("err", ERROR_IO);
+    WARN_UNLESS(msg->post() == OK, "writevOrPostError:error posting ERROR_IO");
+}
+
 void MPEG4Writer::seekOrPostError(int fd, off64_t offset, int whence) {
     if (mWriteSeekErr == true)
         return;
@@ -2043,16 +2208,20 @@ MPEG4Writer::Track::Track(
       mTrackDurationUs(0),
       mEstimatedTrackSizeBytes(0),
       mSamplesHaveSameSize(true),
-      mStszTableEntries(new ListTableEntries<uint32_t, 1>(1000)),
-      mCo64TableEntries(new ListTableEntries<off64_t, 1>(1000)),
+      mNumSamples(0),
+      mStszTableEntries(new DeltaTableEntries<uint32_t>()),
+      mCo64TableEntries(new DeltaTableEntries<off64_t>()),
       mStscTableEntries(new ListTableEntries<uint32_t, 3>(1000)),
-      mStssTableEntries(new ListTableEntries<uint32_t, 1>(1000)),
+      mStssTableEntries(new DeltaTableEntries<uint32_t>()),
       mSttsTableEntries(new ListTableEntries<uint32_t, 2>(1000)),
       mCttsTableEntries(new ListTableEntries<uint32_t, 2>(1000)),
       mElstTableEntries(new ListTableEntries<uint32_t, 3>(3)), // Reserve 3 rows, a row has 3 items
       mMinCttsOffsetTimeUs(0),
       mMinCttsOffsetTicks(0),
       mMaxCttsOffsetTicks(0),
+      mFragmentStartOffsetTicks(-1),
+      mLastFragmentSampleDurationTicks(0),
+      mInInitSegment(false),
       mCodecSpecificData(NULL),
       mCodecSpecificDataSize(0),
       mGotAllCodecSpecificData(false),
@@ -2127,13 +2296,18 @@ void MPEG4Writer::Track::resetInternal() {
     mTrackDurationUs = 0;
     mEstimatedTrackSizeBytes = 0;
     mSamplesHaveSameSize = false;
+    mNumSamples = 0;
+    mFragmentRandomAccessEntries.clear();
+    mFragmentStartOffsetTicks = -1;
+    mInInitSegment = false;
+    mLastFragmentSampleDurationTicks = 0;
     if (mStszTableEntries != NULL) {
         delete mStszTableEntries;
-        mStszTableEntries = new ListTableEntries<uint32_t, 1>(1000);
+        mStszTableEntries = new DeltaTableEntries<uint32_t>();
     }
     if (mCo64TableEntries != NULL) {
         delete mCo64TableEntries;
-        mCo64TableEntries = new ListTableEntries<off64_t, 1>(1000);
+        mCo64TableEntries = new DeltaTableEntries<off64_t>();
     }
     if (mStscTableEntries != NULL) {
         delete mStscTableEntries;
@@ -2141,7 +2315,7 @@ void MPEG4Writer::Track::resetInternal() {
     }
     if (mStssTableEntries != NULL) {
         delete mStssTableEntries;
-        mStssTableEntries = new ListTableEntries<uint32_t, 1>(1000);
+        mStssTableEntries = new DeltaTableEntries<uint32_t>();
     }
     if (mSttsTableEntries != NULL) {
         delete mSttsTableEntries;
@@ -2181,25 +2355,36 @@ void MPEG4Writer::Track::updateTrackSizeEstimate() {
 
 void MPEG4Writer::Track::addOneStscTableEntry(
         size_t chunkId, size_t sampleId) {
+    // Fragmented files describe their samples in 'trun' boxes instead, so
+    // none of the sample tables are kept for them.
+    if (mOwner->isFragmented()) {
+        return;
+    }
     mStscTableEntries->add(htonl(chunkId));
     mStscTableEntries->add(htonl(sampleId));
     mStscTableEntries->add(htonl(1));
 }
 
 void MPEG4Writer::Track::addOneStssTableEntry(size_t sampleId) {
-    mStssTableEntries->add(htonl(sampleId));
+    if (mOwner->isFragmented()) {
+        return;
+    }
+    mStssTableEntries->add(sampleId);
 }
 
 void MPEG4Writer::Track::addOneSttsTableEntry(size_t sampleCount, int32_t delta) {
     if (delta == 0) {
         ALOGW("0-duration samples found: %zu", sampleCount);
     }
+    if (mOwner->isFragmented()) {
+        return;
+    }
     mSttsTableEntries->add(htonl(sampleCount));
     mSttsTableEntries->add(htonl(delta));
 }
 
 void MPEG4Writer::Track::addOneCttsTableEntry(size_t sampleCount, int32_t sampleOffset) {
-    if (!mIsVideo) {
+    if (!mIsVideo || mOwner->isFragmented()) {
         return;
     }
     mCttsTableEntries->add(htonl(sampleCount));
@@ -2283,7 +2468,7 @@ bool MPEG4Writer::Track::isExifData(
 
 void MPEG4Writer::Track::addChunkOffset(off64_t offset) {
     CHECK(!mIsHeic);
-    mCo64TableEntries->add(hton64(offset));
+    mCo64TableEntries->add(offset);
 }
 
 void MPEG4Writer::Track::addItemOffsetAndSize(off64_t offset, size_t size, bool isExif) {
@@ -2579,22 +2764,57 @@ void *MPEG4Writer::ThreadWrapper(void *me) {
     return NULL;
 }
 
+MPEG4Writer::ChunkInfo::ChunkInfo(Track *track, size_t index)
+    : mTrack(track),
+      mIndex(index),
+      mChunksHead(0),
+      mChunksTail(0),
+      mScheduled(false),
+      mPrevChunkTimestampUs(0),
+      mMaxInterChunkDurUs(0),
+      mMaxQueuedChunks(0),
+      mNumBlockedChunks(0),
+      mBlockedTimeUs(0) {
+}
+
 void MPEG4Writer::bufferChunk(const Chunk& chunk) {
     ALOGV("bufferChunk: %p", chunk.mTrack);
-    Mutex::Autolock autolock(mLock);
     CHECK_EQ(mDone, false);
 
-    for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+    ChunkInfo *info = NULL;
+    for (List<ChunkInfo *>::iterator it = mChunkInfos.begin();
          it != mChunkInfos.end(); ++it) {
+        if (chunk.mTrack == (*it)->mTrack) {  // Found owner
+            info = *it;
+            break;
+        }
+    }
+    CHECK(info != NULL);
 
-        if (chunk.mTrack == it->mTrack) {  // Found owner
-            it->mChunks.push_back(chunk);
-            mChunkReadyCondition.signal();
-            return;
+    uint32_t tail = info->mChunksTail.load(std::memory_order_relaxed);
+    if (tail - info->mChunksHead.load(std::memory_order_acquire) == kChunkQueueCapacity) {
+        // The writer thread is behind; wait for it to take a chunk.
+        int64_t startTimeUs = systemTime() / 1000;
+        Mutex::Autolock autolock(mChunkQueueLock);
+        while (tail - info->mChunksHead.load(std::memory_order_acquire) ==
+                kChunkQueueCapacity) {
+            mChunkSpaceCondition.wait(mChunkQueueLock);
         }
+        ++info->mNumBlockedChunks;
+        info->mBlockedTimeUs += systemTime() / 1000 - startTimeUs;
     }
 
-    CHECK(!"Received a chunk for a unknown track");
+    info->mChunks[tail & (kChunkQueueCapacity - 1)] = chunk;
+    info->mChunksTail.store(tail + 1, std::memory_order_release);
+
+    uint32_t queued = tail + 1 - info->mChunksHead.load(std::memory_order_acquire);
+    if (queued > info->mMaxQueuedChunks) {
+        info->mMaxQueuedChunks = queued;
+    }
+
+    mChunksQueuedGeneration.fetch_add(1, std::memory_order_release);
+    Mutex::Autolock autolock(mChunkQueueLock);
+    mChunkReadyCondition.signal();
 }
 
 void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
@@ -2602,9 +2822,8 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
         chunk->mTimeStampUs, chunk->mTrack->getTrackType());
 
     int32_t isFirstSample = true;
-    while (!chunk->mSamples.empty()) {
-        List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
-
+    for (List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
+         it != chunk->mSamples.end(); ++it) {
         uint32_t tiffHdrOffset;
         if (!(*it)->meta_data().findInt32(
                 kKeyExifTiffOffset, (int32_t*)&tiffHdrOffset)) {
@@ -2622,46 +2841,245 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
             chunk->mTrack->addChunkOffset(offset);
             isFirstSample = false;
         }
+    }
 
+    // The whole chunk goes out in one vectored write; only then may the
+    // samples backing the batch be released.
+    flushWriteBatch_l();
+
+    while (!chunk->mSamples.empty()) {
+        List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
         (*it)->release();
         (*it) = NULL;
         chunk->mSamples.erase(it);
     }
-    chunk->mSamples.clear();
 }
 
 void MPEG4Writer::writeAllChunks() {
     ALOGV("writeAllChunks");
     size_t outstandingChunks = 0;
     Chunk chunk;
-    while (findChunkToWrite(&chunk)) {
-        writeChunkToFile(&chunk);
+    while (true) {
+        {
+            Mutex::Autolock autolock(mChunkQueueLock);
+            if (!findChunkToWrite(&chunk)) {
+                break;
+            }
+        }
+        if (isFragmented()) {
+            mFragmentChunks.push_back(chunk);
+        } else {
+            writeChunkToFile(&chunk);
+        }
         ++outstandingChunks;
     }
 
+    if (isFragmented()) {
+        // Called with mLock held, but writing a fragment looks up the movie
+        // start time, which takes mLock as well.
+        mLock.unlock();
+        writeFragment();
+        if (mInitSegmentWritten) {
+            writeMfraBox();
+        }
+        mLock.lock();
+    }
+
     sendSessionSummary();
 
-    mChunkInfos.clear();
+    while (!mChunkInfos.empty()) {
+        List<ChunkInfo *>::iterator it = mChunkInfos.begin();
+        ChunkInfo *info = *it;
+        ALOGI("%s track: at most %u chunks queued, %u chunks waited %" PRId64 " us for the writer",
+                info->mTrack->getTrackType(), info->mMaxQueuedChunks,
+                info->mNumBlockedChunks, info->mBlockedTimeUs);
+        delete info;
+        mChunkInfos.erase(it);
+    }
+    while (!mChunkQueue.empty()) {
+        mChunkQueue.pop();
+    }
     ALOGD("%zu chunks are written in the last batch", outstandingChunks);
 }
 
+void MPEG4Writer::addChunkToFragment(const Chunk& chunk) {
+    mFragmentChunks.push_back(chunk);
+
+    int64_t durationUs = chunk.mTimeStampUs - mFragmentChunks.begin()->mTimeStampUs;
+
+    // The 'moov' needs the codec specific data of every track, which is
+    // known once a track has handed over its first chunk. A track that
+    // stalls before that would hold back every other track's chunks, so
+    // give up on it after a few fragment durations; it is left out of the
+    // file.
+    if (!mInitSegmentWritten && !allTracksHaveFragmentData()) {
+        if (durationUs < kMaxPendingFragments * mFragmentDurationUs) {
+            return;
+        }
+        ALOGW("Writing the init segment without the tracks that have no data after %" PRId64
+                " us", durationUs);
+    }
+    if (!mInitSegmentWritten) {
+        writeMoovBox(0);
+        mInitSegmentWritten = true;
+    }
+
+    if (durationUs >= mFragmentDurationUs) {
+        writeFragment();
+    }
+}
+
+bool MPEG4Writer::hasFragmentChunk(const Track *track) const {
+    for (List<Chunk>::const_iterator it = mFragmentChunks.begin();
+         it != mFragmentChunks.end(); ++it) {
+        if (it->mTrack == track) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MPEG4Writer::allTracksHaveFragmentData() {
+    for (List<Track *>::iterator it = mTracks.begin(); it != mTracks.end(); ++it) {
+        if (!(*it)->reachedEOS() && !hasFragmentChunk(*it)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MPEG4Writer::writeFragment() {
+    if (mFragmentChunks.empty()) {
+        return;
+    }
+    if (!mInitSegmentWritten) {
+        writeMoovBox(0);
+        mInitSegmentWritten = true;
+    }
+
+    // Samples of each track are laid out one after another in the 'mdat',
+    // in track order, each described by one 'traf'.
+    struct TrafSamples {
+        Track *mTrack;
+        int64_t mTrackStartTimeUs;
+        List<MediaBuffer *> mSamples;
+    };
+    std::vector<TrafSamples> trackSamples;
+    size_t moofSize = 8 + 16;  // moof, mfhd
+    for (List<Track *>::iterator it = mTracks.begin(); it != mTracks.end(); ++it) {
+        TrafSamples traf;
+        traf.mTrack = *it;
+        traf.mTrackStartTimeUs = -1;
+        for (List<Chunk>::iterator chunkIt = mFragmentChunks.begin();
+             chunkIt != mFragmentChunks.end(); ++chunkIt) {
+            if (chunkIt->mTrack == *it) {
+                traf.mTrackStartTimeUs = chunkIt->mTrackStartTimeUs;
+                traf.mSamples.insert(traf.mSamples.end(),
+                        chunkIt->mSamples.begin(), chunkIt->mSamples.end());
+            }
+        }
+        if (traf.mSamples.empty()) {
+            continue;
+        }
+        if (!(*it)->isInInitSegment()) {
+            // Without a sample description in the 'moov' the samples
+            // can't be played back.
+            ALOGW("Dropping %zu samples of a %s track missing from the init segment",
+                    traf.mSamples.size(), (*it)->getTrackType());
+            for (MediaBuffer *sample : traf.mSamples) {
+                sample->release();
+            }
+            continue;
+        }
+        moofSize += Track::getTrafBoxSize(traf.mSamples.size());
+        trackSamples.push_back(traf);
+    }
+    mFragmentChunks.clear();
+    if (trackSamples.empty()) {
+        return;
+    }
+
+    off64_t moofOffset = mOffset;
+    beginBox("moof");
+    beginBox("mfhd");
+    writeInt32(0);  // version=0, flags=0
+    writeInt32(++mFragmentSequenceNumber);
+    endBox();  // mfhd
+    uint64_t dataOffset = moofSize + 8;  // first sample follows the 'mdat' header
+    uint32_t trafNumber = 0;
+    for (auto &entry : trackSamples) {
+        CHECK_LE(dataOffset, (uint64_t)UINT32_MAX);
+        dataOffset += entry.mTrack->writeTrafBox(entry.mSamples, entry.mTrackStartTimeUs,
+                ++trafNumber, moofOffset, dataOffset);
+    }
+    endBox();  // moof
+    CHECK_EQ(mOffset - moofOffset, (off64_t)moofSize);
+
+    uint64_t mdatSize = dataOffset - moofSize;
+    CHECK_LE(mdatSize, (uint64_t)UINT32_MAX);
+    writeInt32(mdatSize);
+    write("mdat", 4);
+    for (auto &entry : trackSamples) {
+        Track *track = entry.mTrack;
+        for (MediaBuffer *sample : entry.mSamples) {
+            size_t bytesWritten;
+            addSample_l(sample, track->usePrefix(), 0 /* tiffHdrOffset */, &bytesWritten);
+        }
+        flushWriteBatch_l();
+        for (MediaBuffer *sample : entry.mSamples) {
+            sample->release();
+        }
+    }
+    ALOGV("Fragment %u: %zu tracks, %" PRIu64 " bytes of sample data",
+            mFragmentSequenceNumber, trackSamples.size(), mdatSize - 8);
+}
+
+void MPEG4Writer::writeMvexBox() {
+    beginBox("mvex");
+    for (List<Track *>::iterator it = mTracks.begin(); it != mTracks.end(); ++it) {
+        (*it)->writeTrexBox();
+    }
+    endBox();  // mvex
+}
+
+void MPEG4Writer::writeMfraBox() {
+    off64_t mfraOffset = mOffset;
+    beginBox("mfra");
+    for (List<Track *>::iterator it = mTracks.begin(); it != mTracks.end(); ++it) {
+        (*it)->writeTfraBox();
+    }
+    beginBox("mfro");
+    writeInt32(0);  // version=0, flags=0
+    writeInt32(mOffset + 4 - mfraOffset);  // size of the enclosing 'mfra'
+    endBox();  // mfro
+    endBox();  // mfra
+}
+
 bool MPEG4Writer::findChunkToWrite(Chunk *chunk) {
     ALOGV("findChunkToWrite");
 
-    int64_t minTimestampUs = 0x7FFFFFFFFFFFFFFFLL;
-    Track *track = NULL;
-    for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
-         it != mChunkInfos.end(); ++it) {
-        if (!it->mChunks.empty()) {
-            List<Chunk>::iterator chunkIt = it->mChunks.begin();
-            if (chunkIt->mTimeStampUs < minTimestampUs) {
-                minTimestampUs = chunkIt->mTimeStampUs;
-                track = it->mTrack;
+    // Tracks that were idle only need to be looked at again if some track
+    // queued a chunk since the last time.
+    uint32_t generation = mChunksQueuedGeneration.load(std::memory_order_acquire);
+    if (generation != mChunksScheduledGeneration) {
+        mChunksScheduledGeneration = generation;
+        for (List<ChunkInfo *>::iterator it = mChunkInfos.begin();
+             it != mChunkInfos.end(); ++it) {
+            ChunkInfo *info = *it;
+            uint32_t head = info->mChunksHead.load(std::memory_order_relaxed);
+            if (!info->mScheduled &&
+                    info->mChunksTail.load(std::memory_order_acquire) != head) {
+                ChunkQueueEntry entry;
+                entry.mTimeStampUs =
+                        info->mChunks[head & (kChunkQueueCapacity - 1)].mTimeStampUs;
+                entry.mInfo = info;
+                mChunkQueue.push(entry);
+                info->mScheduled = true;
             }
         }
     }
 
-    if (track == NULL) {
+    if (mChunkQueue.empty()) {
         ALOGV("Nothing to be written after all");
         return false;
     }
@@ -2670,23 +3088,33 @@ bool MPEG4Writer::findChunkToWrite(Chunk *chunk) {
         mIsFirstChunk = false;
     }
 
-    for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
-         it != mChunkInfos.end(); ++it) {
-        if (it->mTrack == track) {
-            *chunk = *(it->mChunks.begin());
-            it->mChunks.erase(it->mChunks.begin());
-            CHECK_EQ(chunk->mTrack, track);
-
-            int64_t interChunkTimeUs =
-                chunk->mTimeStampUs - it->mPrevChunkTimestampUs;
-            if (interChunkTimeUs > it->mPrevChunkTimestampUs) {
-                it->mMaxInterChunkDurUs = interChunkTimeUs;
-            }
-            return true;
-        }
+    ChunkInfo *info = mChunkQueue.top().mInfo;
+    mChunkQueue.pop();
+
+    uint32_t head = info->mChunksHead.load(std::memory_order_relaxed);
+    Chunk *queuedChunk = &info->mChunks[head & (kChunkQueueCapacity - 1)];
+    *chunk = *queuedChunk;
+    queuedChunk->mSamples.clear();
+    queuedChunk->mTrack = NULL;
+    info->mChunksHead.store(++head, std::memory_order_release);
+    mChunkSpaceCondition.broadcast();
+
+    int64_t interChunkTimeUs =
+        chunk->mTimeStampUs - info->mPrevChunkTimestampUs;
+    if (interChunkTimeUs > info->mPrevChunkTimestampUs) {
+        info->mMaxInterChunkDurUs = interChunkTimeUs;
     }
 
-    return false;
+    // Keep the track in the queue while it has more chunks waiting.
+    if (info->mChunksTail.load(std::memory_order_acquire) != head) {
+        ChunkQueueEntry entry;
+        entry.mTimeStampUs = info->mChunks[head & (kChunkQueueCapacity - 1)].mTimeStampUs;
+        entry.mInfo = info;
+        mChunkQueue.push(entry);
+    } else {
+        info->mScheduled = false;
+    }
+    return true;
 }
 
 void MPEG4Writer::threadFunc() {
@@ -2694,30 +3122,39 @@ void MPEG4Writer::threadFunc() {
 
     prctl(PR_SET_NAME, (unsigned long)"MPEG4Writer", 0, 0, 0);
 
-    Mutex::Autolock autoLock(mLock);
-    while (!mDone) {
+    while (true) {
         Chunk chunk;
         bool chunkFound = false;
-
-        while (!mDone && !(chunkFound = findChunkToWrite(&chunk))) {
-            mChunkReadyCondition.wait(mLock);
+        {
+            Mutex::Autolock autoLock(mChunkQueueLock);
+            while (!mDone && !(chunkFound = findChunkToWrite(&chunk))) {
+                mChunkReadyCondition.wait(mChunkQueueLock);
+            }
+        }
+        if (!chunkFound) {
+            break;
         }
 
-        // In real time recording mode, write without holding the lock in order
-        // to reduce the blocking time for media track threads.
-        // Otherwise, hold the lock until the existing chunks get written to the
-        // file.
-        if (chunkFound) {
-            if (mIsRealTimeRecording) {
-                mLock.unlock();
-            }
+        // Track threads hand over their chunks without taking mLock, so it
+        // only serializes file access. In real time recording mode, write
+        // without holding it in order to reduce the blocking time for tracks
+        // writing to the file directly. Fragments are always written without
+        // the lock, as writing them looks up the movie start time.
+        const bool lock = !mIsRealTimeRecording && !isFragmented();
+        if (lock) {
+            mLock.lock();
+        }
+        if (isFragmented()) {
+            addChunkToFragment(chunk);
+        } else {
             writeChunkToFile(&chunk);
-            if (mIsRealTimeRecording) {
-                mLock.lock();
-            }
+        }
+        if (lock) {
+            mLock.unlock();
         }
     }
 
+    Mutex::Autolock autoLock(mLock);
     writeAllChunks();
 }
 
@@ -2727,13 +3164,11 @@ status_t MPEG4Writer::startWriterThread() {
     mDone = false;
     mIsFirstChunk = true;
     mDriftTimeUs = 0;
+    mChunksQueuedGeneration = 0;
+    mChunksScheduledGeneration = 0;
     for (List<Track *>::iterator it = mTracks.begin();
          it != mTracks.end(); ++it) {
-        ChunkInfo info;
-        info.mTrack = *it;
-        info.mPrevChunkTimestampUs = 0;
-        info.mMaxInterChunkDurUs = 0;
-        mChunkInfos.push_back(info);
+        mChunkInfos.push_back(new ChunkInfo(*it, mChunkInfos.size()));
     }
 
     pthread_attr_t attr;
@@ -2806,6 +3241,7 @@ status_t MPEG4Writer::Track::start(MetaData *params) {
 
     status_t err = mSource->start(meta.get());
     if (err != OK) {
+        Mutex::Autolock autoLock(mStateLock);
         mDone = mReachedEOS = true;
         return err;
     }
@@ -2817,7 +3253,10 @@ status_t MPEG4Writer::Track::start(MetaData *params) {
     mDone = false;
     mStarted = true;
     mTrackDurationUs = 0;
-    mReachedEOS = false;
+    {
+        Mutex::Autolock autoLock(mStateLock);
+        mReachedEOS = false;
+    }
     mEstimatedTrackSizeBytes = 0;
     mMdatSizeBytes = 0;
     mMaxChunkDurationUs = 0;
@@ -2871,6 +3310,7 @@ status_t MPEG4Writer::Track::stop(bool stopSource) {
 }
 
 bool MPEG4Writer::Track::reachedEOS() {
+    Mutex::Autolock autoLock(mStateLock);
     return mReachedEOS;
 }
 
@@ -3259,7 +3699,9 @@ void MPEG4Writer::Track::dumpTimeStamps() {
 status_t MPEG4Writer::Track::threadEntry() {
     int32_t count = 0;
     const int64_t interleaveDurationUs = mOwner->interleaveDuration();
-    const bool hasMultipleTracks = (mOwner->numTracks() > 1);
+    // Fragmented files always go through the writer thread so that the
+    // samples can be gathered into movie fragments.
+    const bool hasMultipleTracks = (mOwner->numTracks() > 1) || mOwner->isFragmented();
     int64_t chunkTimestampUs = 0;
     int32_t nChunks = 0;
     int32_t nActualFrames = 0;        // frames containing non-CSD data (non-0 length)
@@ -3492,14 +3934,17 @@ status_t MPEG4Writer::Track::threadEntry() {
         }
 ////////////////////////////////////////////////////////////////////////////////
         if (!mIsHeic) {
-            if (mStszTableEntries->count() == 0) {
+            if (mNumSamples == 0) {
                 mFirstSampleTimeRealUs = systemTime() / 1000;
                 if (timestampUs < 0 && mFirstSampleStartOffsetUs == 0) {
                     mFirstSampleStartOffsetUs = -timestampUs;
                     timestampUs = 0;
                 }
                 mOwner->setStartTimestampUs(timestampUs);
-                mStartTimestampUs = timestampUs;
+                {
+                    Mutex::Autolock autoLock(mStateLock);
+                    mStartTimestampUs = timestampUs;
+                }
                 previousPausedDurationUs = mStartTimestampUs;
             }
 
@@ -3532,6 +3977,7 @@ status_t MPEG4Writer::Track::threadEntry() {
                 mIsMalformed = true;
                 break;
             }
+            const int64_t presentationTimeUs = timestampUs;
 
             if (mIsVideo) {
                 /*
@@ -3586,7 +4032,7 @@ status_t MPEG4Writer::Track::threadEntry() {
                     break;
                 }
 
-                if (mStszTableEntries->count() == 0) {
+                if (mNumSamples == 0) {
                     // Force the first ctts table entry to have one single entry
                     // so that we can do adjustment for the initial track start
                     // time offset easily in writeCttsBox().
@@ -3604,7 +4050,7 @@ status_t MPEG4Writer::Track::threadEntry() {
                 }
 
                 // Update ctts time offset range
-                if (mStszTableEntries->count() == 0) {
+                if (mNumSamples == 0) {
                     mMinCttsOffsetTicks = currCttsOffsetTimeTicks;
                     mMaxCttsOffsetTicks = currCttsOffsetTimeTicks;
                 } else {
@@ -3670,9 +4116,12 @@ status_t MPEG4Writer::Track::threadEntry() {
                     timestampUs += deltaUs;
                 }
             }
-            mStszTableEntries->add(htonl(sampleSize));
+            if (!mOwner->isFragmented()) {
+                mStszTableEntries->add(sampleSize);
+            }
+            ++mNumSamples;
 
-            if (mStszTableEntries->count() > 2) {
+            if (mNumSamples > 2) {
 
                 // Force the first sample to have its own stts entry so that
                 // we can adjust its value later to maintain the A/V sync.
@@ -3684,7 +4133,7 @@ status_t MPEG4Writer::Track::threadEntry() {
                 }
             }
             if (mSamplesHaveSameSize) {
-                if (mStszTableEntries->count() >= 2 && previousSampleSize != sampleSize) {
+                if (mNumSamples >= 2 && previousSampleSize != sampleSize) {
                     mSamplesHaveSameSize = false;
                 }
                 previousSampleSize = sampleSize;
@@ -3696,7 +4145,7 @@ status_t MPEG4Writer::Track::threadEntry() {
             lastTimestampUs = timestampUs;
 
             if (isSync != 0) {
-                addOneStssTableEntry(mStszTableEntries->count());
+                addOneStssTableEntry(mNumSamples);
             }
 
             if (mTrackingProgressStatus) {
@@ -3705,11 +4154,20 @@ status_t MPEG4Writer::Track::threadEntry() {
                 }
                 trackProgressStatus(timestampUs);
             }
+
+            if (mOwner->isFragmented()) {
+                // Movie fragments take their timing from the samples themselves.
+                copy->meta_data().setInt64(kKeyDecodingTime, timestampUs);
+                copy->meta_data().setInt64(
+                        kKeyTime, mIsVideo ? presentationTimeUs : timestampUs);
+                copy->meta_data().setInt32(kKeyIsSyncFrame, isSync);
+            }
         }
         if (!hasMultipleTracks) {
             size_t bytesWritten;
             off64_t offset = mOwner->addSample_l(
                     copy, usePrefix, tiffHdrOffset, &bytesWritten);
+            mOwner->flushWriteBatch_l();
 
             if (mIsHeic) {
                 addItemOffsetAndSize(offset, bytesWritten, isExif);
@@ -3760,7 +4218,7 @@ status_t MPEG4Writer::Track::threadEntry() {
     mOwner->trackProgressStatus(mTrackId.getId(), -1, err);
 
     // Add final entries only for non-empty tracks.
-    if (mStszTableEntries->count() > 0) {
+    if (mNumSamples > 0) {
         if (mIsHeic) {
             if (!mChunkSamples.empty()) {
                 bufferChunk(0);
@@ -3769,7 +4227,7 @@ status_t MPEG4Writer::Track::threadEntry() {
         } else {
             // Last chunk
             if (!hasMultipleTracks) {
-                addOneStscTableEntry(1, mStszTableEntries->count());
+                addOneStscTableEntry(1, mNumSamples);
             } else if (!mChunkSamples.empty()) {
                 addOneStscTableEntry(++nChunks, mChunkSamples.size());
                 bufferChunk(timestampUs);
@@ -3778,7 +4236,7 @@ status_t MPEG4Writer::Track::threadEntry() {
             // We don't really know how long the last frame lasts, since
             // there is no frame time after it, just repeat the previous
             // frame's duration.
-            if (mStszTableEntries->count() == 1) {
+            if (mNumSamples == 1) {
                 if (lastSampleDurationUs >= 0) {
                     addOneSttsTableEntry(sampleCount, lastSampleDurationTicks);
                 } else {
@@ -3808,12 +4266,19 @@ status_t MPEG4Writer::Track::threadEntry() {
             }
         }
     }
-    mReachedEOS = true;
+    {
+        Mutex::Autolock autoLock(mStateLock);
+        mReachedEOS = true;
+    }
 
     sendTrackSummary(hasMultipleTracks);
 
     ALOGI("Received total/0-length (%d/%d) buffers and encoded %d frames. - %s",
-            count, nZeroLengthFrames, mStszTableEntries->count(), trackName);
+            count, nZeroLengthFrames, mNumSamples, trackName);
+    ALOGV("%s sample size/offset/sync tables held %zu bytes for %u/%u/%u entries",
+            trackName, mStszTableEntries->memorySize() + mCo64TableEntries->memorySize()
+            + mStssTableEntries->memorySize(), mStszTableEntries->count(),
+            mCo64TableEntries->count(), mStssTableEntries->count());
     if (mIsAudio) {
         ALOGI("Audio track drift time: %" PRId64 " us", mOwner->getDriftTimeUs());
     }
@@ -3834,7 +4299,7 @@ bool MPEG4Writer::Track::isTrackMalFormed() {
         mOwner->mStartMeta->findInt32(kKeyEmptyTrackMalFormed, &emptyTrackMalformed) &&
         emptyTrackMalformed) {
         // MediaRecorder(sets kKeyEmptyTrackMalFormed by default) report empty tracks as malformed.
-        if (!mIsHeic && mStszTableEntries->count() == 0) {  // no samples written
+        if (!mIsHeic && mNumSamples == 0) {  // no samples written
             ALOGE("The number of recorded samples is 0");
             mIsMalformed = true;
             return true;
@@ -3846,14 +4311,15 @@ bool MPEG4Writer::Track::isTrackMalFormed() {
         }
     } else {
         // Through MediaMuxer, empty tracks can be added. No sync frames for video.
-        if (mIsVideo && mStszTableEntries->count() > 0 && mStssTableEntries->count() == 0) {
+        if (mIsVideo && mNumSamples > 0 && !mOwner->isFragmented() &&
+                mStssTableEntries->count() == 0) {
             ALOGE("There are no sync frames for video track");
             mIsMalformed = true;
             return true;
         }
     }
     // Don't check for CodecSpecificData when track is empty.
-    if (mStszTableEntries->count() > 0 && OK != checkCodecSpecificData()) {
+    if (mNumSamples > 0 && OK != checkCodecSpecificData()) {
         // No codec specific data.
         mIsMalformed = true;
         return true;
@@ -3881,7 +4347,7 @@ void MPEG4Writer::Track::sendTrackSummary(bool hasMultipleTracks) {
 
     mOwner->notify(MEDIA_RECORDER_TRACK_EVENT_INFO,
                     trackNum | MEDIA_RECORDER_TRACK_INFO_ENCODED_FRAMES,
-                    mStszTableEntries->count());
+                    mNumSamples);
 
     {
         // The system delay time excluding the requested initial delay that
@@ -3979,6 +4445,10 @@ void MPEG4Writer::Track::bufferChunk(int64_t timestampUs) {
     ALOGV("bufferChunk");
 
     Chunk chunk(this, timestampUs, mChunkSamples);
+    {
+        Mutex::Autolock autoLock(mStateLock);
+        chunk.mTrackStartTimeUs = mStartTimestampUs;
+    }
     mOwner->bufferChunk(chunk);
     mChunkSamples.clear();
 }
@@ -4070,7 +4540,10 @@ void MPEG4Writer::Track::writeTrackHeader() {
     uint32_t now = getMpeg4Time();
     mOwner->beginBox("trak");
         writeTkhdBox(now);
-        writeEdtsBox();
+        if (!mOwner->isFragmented()) {
+            // Track start offsets of fragmented files are carried by 'tfdt'.
+            writeEdtsBox();
+        }
         mOwner->beginBox("mdia");
             writeMdhdBox(now);
             writeHdlrBox();
@@ -4101,8 +4574,18 @@ int64_t MPEG4Writer::Track::getMinCttsOffsetTimeUs() {
 
 void MPEG4Writer::Track::writeStblBox() {
     mOwner->beginBox("stbl");
-    // Add subboxes for only non-empty and well-formed tracks.
-    if (mStszTableEntries->count() > 0 && !isTrackMalFormed()) {
+    // Add subboxes for only non-empty and well-formed tracks. The 'moov' of a
+    // fragmented file is written by the writer thread while this track's
+    // thread is still adding samples, so it goes by the chunks the writer
+    // thread has been handed instead of the sample count.
+    bool hasSamples;
+    if (mOwner->isFragmented()) {
+        hasSamples = mOwner->hasFragmentChunk(this) && checkCodecSpecificData() == OK;
+        mInInitSegment = hasSamples;
+    } else {
+        hasSamples = mNumSamples > 0 && !isTrackMalFormed();
+    }
+    if (hasSamples) {
         mOwner->beginBox("stsd");
         mOwner->writeInt32(0);               // version=0, flags=0
         mOwner->writeInt32(1);               // entry count
@@ -4114,9 +4597,12 @@ void MPEG4Writer::Track::writeStblBox() {
             writeMetadataFourCCBox();
         }
         mOwner->endBox();  // stsd
+        // The sample tables of a fragmented file stay empty.
         writeSttsBox();
         if (mIsVideo) {
-            writeCttsBox();
+            if (!mOwner->isFragmented()) {
+                writeCttsBox();
+            }
             writeStssBox();
         }
         writeStszBox();
@@ -4418,7 +4904,8 @@ void MPEG4Writer::Track::writeTkhdBox(uint32_t now) {
     mOwner->writeInt32(now);           // modification time
     mOwner->writeInt32(mTrackId.getId()); // track id starts with 1
     mOwner->writeInt32(0);             // reserved
-    int64_t trakDurationUs = getDurationUs();
+    // The 'moov' of a fragmented file holds no samples.
+    int64_t trakDurationUs = mOwner->isFragmented() ? 0 : getDurationUs();
     int32_t mvhdTimeScale = mOwner->getTimeScale();
     int32_t tkhdDuration =
         (trakDurationUs * mvhdTimeScale + 5E5) / 1E6;
@@ -4621,7 +5108,7 @@ void MPEG4Writer::Track::writeEdtsBox() {
 }
 
 void MPEG4Writer::Track::writeMdhdBox(uint32_t now) {
-    int64_t trakDurationUs = getDurationUs();
+    int64_t trakDurationUs = mOwner->isFragmented() ? 0 : getDurationUs();
     int64_t mdhdDuration = (trakDurationUs * mTimeScale + 5E5) / 1E6;
     mOwner->beginBox("mdhd");
 
@@ -4731,11 +5218,20 @@ void MPEG4Writer::Track::writePaspBox() {
 }
 
 int64_t MPEG4Writer::Track::getStartTimeOffsetTimeUs() const {
+    int64_t startTimestampUs;
+    {
+        Mutex::Autolock autoLock(mStateLock);
+        startTimestampUs = mStartTimestampUs;
+    }
+    return getStartTimeOffsetTimeUs(startTimestampUs);
+}
+
+int64_t MPEG4Writer::Track::getStartTimeOffsetTimeUs(int64_t trackStartTimeUs) const {
     int64_t trackStartTimeOffsetUs = 0;
     int64_t moovStartTimeUs = mOwner->getStartTimestampUs();
-    if (mStartTimestampUs != -1 && mStartTimestampUs != moovStartTimeUs) {
-        CHECK_GT(mStartTimestampUs, moovStartTimeUs);
-        trackStartTimeOffsetUs = mStartTimestampUs - moovStartTimeUs;
+    if (trackStartTimeUs != -1 && trackStartTimeUs != moovStartTimeUs) {
+        CHECK_GT(trackStartTimeUs, moovStartTimeUs);
+        trackStartTimeOffsetUs = trackStartTimeUs - moovStartTimeUs;
     }
     return trackStartTimeOffsetUs;
 }
@@ -4744,6 +5240,10 @@ int32_t MPEG4Writer::Track::getStartTimeOffsetScaledTime() const {
     return (getStartTimeOffsetTimeUs() * mTimeScale + 500000LL) / 1000000LL;
 }
 
+int32_t MPEG4Writer::Track::getStartTimeOffsetScaledTime(int64_t trackStartTimeUs) const {
+    return (getStartTimeOffsetTimeUs(trackStartTimeUs) * mTimeScale + 500000LL) / 1000000LL;
+}
+
 void MPEG4Writer::Track::writeSttsBox() {
     mOwner->beginBox("stts");
     mOwner->writeInt32(0);  // version=0, flags=0
@@ -4817,6 +5317,123 @@ void MPEG4Writer::Track::writeCo64Box() {
     mOwner->endBox();  // stco or co64
 }
 
+uint32_t MPEG4Writer::Track::getFragmentSampleSize(MediaBuffer *sample) const {
+    // Same as the bytes written by addSample_l(): start codes are replaced by
+    // NAL length fields, which are always 4 bytes long for fragmented files.
+    return sample->range_length() + (usePrefix() ? 4 : 0);
+}
+
+uint32_t MPEG4Writer::Track::writeTrafBox(
+        const List<MediaBuffer *> &samples, int64_t trackStartTimeUs,
+        uint32_t trafNumber, off64_t moofOffset, uint32_t dataOffset) {
+    CHECK(!samples.empty());
+    if (mFragmentStartOffsetTicks < 0) {
+        mFragmentStartOffsetTicks = getStartTimeOffsetScaledTime(trackStartTimeUs);
+    }
+
+    int64_t firstDecodingTimeUs;
+    CHECK((*samples.begin())->meta_data().findInt64(kKeyDecodingTime, &firstDecodingTimeUs));
+    int64_t baseDecodingTimeTicks = mFragmentStartOffsetTicks +
+            (firstDecodingTimeUs * mTimeScale + 500000LL) / 1000000LL;
+
+    mOwner->beginBox("traf");
+
+    mOwner->beginBox("tfhd");
+    mOwner->writeInt32(0x020000);  // version=0, flags=default-base-is-moof
+    mOwner->writeInt32(mTrackId.getId());
+    mOwner->endBox();  // tfhd
+
+    mOwner->beginBox("tfdt");
+    mOwner->writeInt32(0x01000000);  // version=1, flags=0
+    mOwner->writeInt64(baseDecodingTimeTicks);
+    mOwner->endBox();  // tfdt
+
+    mOwner->beginBox("trun");
+    // version=1 (signed composition offsets), flags=data-offset, sample-duration,
+    // sample-size, sample-flags and sample-composition-time-offset present
+    mOwner->writeInt32(0x01000f01);
+    mOwner->writeInt32(samples.size());
+    mOwner->writeInt32(dataOffset);
+
+    uint32_t dataSize = 0;
+    uint32_t sampleNumber = 0;
+    bool foundSyncSample = false;
+    for (List<MediaBuffer *>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+        ++sampleNumber;
+        int64_t decodingTimeUs, timeUs;
+        int32_t isSync = false;
+        CHECK((*it)->meta_data().findInt64(kKeyDecodingTime, &decodingTimeUs));
+        CHECK((*it)->meta_data().findInt64(kKeyTime, &timeUs));
+        (*it)->meta_data().findInt32(kKeyIsSyncFrame, &isSync);
+        isSync = isSync || !mIsVideo;
+
+        int64_t decodingTimeTicks = (decodingTimeUs * mTimeScale + 500000LL) / 1000000LL;
+        int64_t timeTicks = (timeUs * mTimeScale + 500000LL) / 1000000LL;
+
+        // The duration of the last sample is not known until the next
+        // fragment, so repeat the previous one. The 'tfdt' of the next
+        // fragment keeps the timeline exact.
+        List<MediaBuffer *>::const_iterator next = it;
+        if (++next != samples.end()) {
+            int64_t nextDecodingTimeUs;
+            CHECK((*next)->meta_data().findInt64(kKeyDecodingTime, &nextDecodingTimeUs));
+            mLastFragmentSampleDurationTicks =
+                    (nextDecodingTimeUs * mTimeScale + 500000LL) / 1000000LL - decodingTimeTicks;
+        }
+
+        uint32_t sampleSize = getFragmentSampleSize(*it);
+        mOwner->writeInt32(mLastFragmentSampleDurationTicks);
+        mOwner->writeInt32(sampleSize);
+        // sample_depends_on=2 for sync samples; depends_on=1 and
+        // sample_is_non_sync_sample otherwise.
+        mOwner->writeInt32(isSync ? 0x02000000 : 0x01010000);
+        mOwner->writeInt32(timeTicks - decodingTimeTicks);
+        dataSize += sampleSize;
+
+        if (isSync && !foundSyncSample) {
+            foundSyncSample = true;
+            FragmentRandomAccessEntry entry;
+            // 'tfra' entries are indexed by presentation time.
+            entry.timeTicks = mFragmentStartOffsetTicks + timeTicks;
+            entry.moofOffset = moofOffset;
+            entry.trafNumber = trafNumber;
+            entry.sampleNumber = sampleNumber;
+            mFragmentRandomAccessEntries.push_back(entry);
+        }
+    }
+    mOwner->endBox();  // trun
+
+    mOwner->endBox();  // traf
+    return dataSize;
+}
+
+void MPEG4Writer::Track::writeTrexBox() {
+    mOwner->beginBox("trex");
+    mOwner->writeInt32(0);  // version=0, flags=0
+    mOwner->writeInt32(mTrackId.getId());
+    mOwner->writeInt32(1);  // default sample description index
+    mOwner->writeInt32(0);  // default sample duration
+    mOwner->writeInt32(0);  // default sample size
+    mOwner->writeInt32(0);  // default sample flags
+    mOwner->endBox();  // trex
+}
+
+void MPEG4Writer::Track::writeTfraBox() {
+    mOwner->beginBox("tfra");
+    mOwner->writeInt32(0x01000000);  // version=1, flags=0
+    mOwner->writeInt32(mTrackId.getId());
+    mOwner->writeInt32(0x3f);  // 4-byte traf, trun and sample numbers
+    mOwner->writeInt32(mFragmentRandomAccessEntries.size());
+    for (const FragmentRandomAccessEntry &entry : mFragmentRandomAccessEntries) {
+        mOwner->writeInt64(entry.timeTicks);
+        mOwner->writeInt64(entry.moofOffset);
+        mOwner->writeInt32(entry.trafNumber);
+        mOwner->writeInt32(1);  // trun number
+        mOwner->writeInt32(entry.sampleNumber);
+    }
+    mOwner->endBox();  // tfra
+}
+
 void MPEG4Writer::writeUdtaBox() {
     beginBox("udta");
     writeGeoDataBox();
@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MediaAdapter"
 #include <utils/Log.h>
+#include <utils/Timers.h>
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/MediaAdapter.h>
@@ -24,45 +25,77 @@
 
 namespace android {
 
-MediaAdapter::MediaAdapter(const sp<MetaData> &meta)
-    : mCurrentMediaBuffer(NULL),
+// How long stop() waits for the reader to drain the buffers pushed before
+// the end of stream.
+static const nsecs_t kDrainTimeoutNs = 1000000000LL;
+
+MediaAdapter::MediaAdapter(const sp<MetaData> &meta, size_t maxQueuedBuffers)
+    : mMaxQueuedBuffers(maxQueuedBuffers),
       mStarted(false),
+      mEndOfStream(false),
       mOutputFormat(meta) {
 }
 
 MediaAdapter::~MediaAdapter() {
     Mutex::Autolock autoLock(mAdapterLock);
     mOutputFormat.clear();
-    CHECK(mCurrentMediaBuffer == NULL);
+    CHECK(mQueuedBuffers.empty());
 }
 
 status_t MediaAdapter::start(MetaData * /* params */) {
     Mutex::Autolock autoLock(mAdapterLock);
     if (!mStarted) {
         mStarted = true;
+        mEndOfStream = false;
     }
     return OK;
 }
 
+void MediaAdapter::signalEndOfStream() {
+    Mutex::Autolock autoLock(mAdapterLock);
+    mEndOfStream = true;
+    // Let a waiting read() report the end of stream.
+    mBufferReadCond.signal();
+}
+
 status_t MediaAdapter::stop() {
-    MediaBuffer *currentBuffer = NULL;
+    List<MediaBuffer *> queuedBuffers;
     {
         Mutex::Autolock autoLock(mAdapterLock);
         if (mStarted) {
+            // The reader stops the source before it stops reading, so give it
+            // a chance to drain what was pushed before the end of stream.
+            if (mEndOfStream) {
+                nsecs_t deadlineNs = systemTime() + kDrainTimeoutNs;
+                while (!mQueuedBuffers.empty()) {
+                    nsecs_t remainingNs = deadlineNs - systemTime();
+                    if (remainingNs <= 0 ||
+                            mQueueDrainedCond.waitRelative(mAdapterLock, remainingNs) != OK) {
+                        break;
+                    }
+                }
+                if (!mQueuedBuffers.empty()) {
+                    ALOGW("%zu buffers were not read before stop", mQueuedBuffers.size());
+                }
+            }
             mStarted = false;
             // If stop() happens immediately after a pushBuffer(), we should
-            // clean up the mCurrentMediaBuffer. But need to release without
+            // clean up the queued buffers. But need to release without
             // the lock as signalBufferReturned() will acquire the lock.
-            currentBuffer = mCurrentMediaBuffer;
-            mCurrentMediaBuffer = NULL;
+            queuedBuffers = mQueuedBuffers;
+            mQueuedBuffers.clear();
 
             // While read() is still waiting, we should signal it to finish.
             mBufferReadCond.signal();
+            // Wake up pushBuffer() waiting for room in the queue.
+            if (mMaxQueuedBuffers > 0) {
+                mBufferReturnedCond.broadcast();
+            }
         }
     }
-    if (currentBuffer != NULL) {
-        currentBuffer->release();
-        currentBuffer = NULL;
+    for (List<MediaBuffer *>::iterator it = queuedBuffers.begin();
+         it != queuedBuffers.end(); ++it) {
+        (*it)->release();
     }
     return OK;
 }
@@ -89,21 +122,26 @@ status_t MediaAdapter::read(
         return ERROR_END_OF_STREAM;
     }
 
-    while (mCurrentMediaBuffer == NULL && mStarted) {
+    while (mQueuedBuffers.empty() && mStarted && !mEndOfStream) {
         ALOGV("waiting @ read()");
         mBufferReadCond.wait(mAdapterLock);
     }
 
-    if (!mStarted) {
-        ALOGV("read interrupted after stop");
-        CHECK(mCurrentMediaBuffer == NULL);
+    // Buffers pushed before the end of stream are still handed out; stop()
+    // has already released the rest.
+    if (mQueuedBuffers.empty()) {
+        ALOGV("%s", mStarted ? "read reached end of stream" : "read interrupted after stop");
         return ERROR_END_OF_STREAM;
     }
 
-    CHECK(mCurrentMediaBuffer != NULL);
-
-    *buffer = mCurrentMediaBuffer;
-    mCurrentMediaBuffer = NULL;
+    *buffer = *mQueuedBuffers.begin();
+    mQueuedBuffers.erase(mQueuedBuffers.begin());
+    if (mMaxQueuedBuffers > 0) {
+        mBufferReturnedCond.signal();
+    }
+    if (mQueuedBuffers.empty()) {
+        mQueueDrainedCond.signal();
+    }
 
     return OK;
 }
@@ -114,13 +152,17 @@ status_t MediaAdapter::pushBuffer(MediaBuffer *buffer) {
         return -EINVAL;
     }
 
+    if (mMaxQueuedBuffers > 0) {
+        return queueBuffer(buffer);
+    }
+
     Mutex::Autolock autoLock(mAdapterLock);
-    if (!mStarted) {
-        ALOGE("pushBuffer called before start");
+    if (!mStarted || mEndOfStream) {
+        ALOGE("pushBuffer called %s", mStarted ? "after end of stream" : "before start");
         return INVALID_OPERATION;
     }
-    mCurrentMediaBuffer = buffer;
-    mCurrentMediaBuffer->setObserver(this);
+    mQueuedBuffers.push_back(buffer);
+    buffer->setObserver(this);
     mBufferReadCond.signal();
 
     ALOGV("wait for the buffer returned @ pushBuffer! %p", buffer);
@@ -129,5 +171,24 @@ status_t MediaAdapter::pushBuffer(MediaBuffer *buffer) {
     return OK;
 }
 
+status_t MediaAdapter::queueBuffer(MediaBuffer *buffer) {
+    {
+        Mutex::Autolock autoLock(mAdapterLock);
+        while (mStarted && mQueuedBuffers.size() >= mMaxQueuedBuffers) {
+            ALOGV("wait for room in the queue @ pushBuffer! %p", buffer);
+            mBufferReturnedCond.wait(mAdapterLock);
+        }
+        if (mStarted && !mEndOfStream) {
+            mQueuedBuffers.push_back(buffer);
+            mBufferReadCond.signal();
+            return OK;
+        }
+    }
+    // Release without the lock, as the buffer's observer may call back.
+    ALOGE("pushBuffer called while not started or after end of stream");
+    buffer->release();
+    return INVALID_OPERATION;
+}
+
 }  // namespace android
 
@@ -17,7 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MediaClock"
 #include <utils/Log.h>
-#include <map>
+#include <algorithm>
 
 #include <media/stagefright/MediaClock.h>
 
@@ -30,18 +30,24 @@ namespace android {
 // If larger than this threshold, it's treated as discontinuity.
 static const int64_t kAnchorFluctuationAllowedUs = 10000LL;
 
+// Lock-free anchor reads that keep racing with updates fall back to mLock.
+static const int kMaxAnchorReadRetries = 4;
+
 MediaClock::Timer::Timer(const sp<AMessage> &notify, int64_t mediaTimeUs, int64_t adjustRealUs)
     : mNotify(notify),
       mMediaTimeUs(mediaTimeUs),
-      mAdjustRealUs(adjustRealUs) {
+      mAdjustRealUs(adjustRealUs),
+      mTargetMediaUs(mediaTimeUs) {
 }
 
 MediaClock::MediaClock()
-    : mAnchorTimeMediaUs(-1),
+    : mAnchorSeq(0),
+      mAnchorTimeMediaUs(-1),
       mAnchorTimeRealUs(-1),
       mMaxTimeMediaUs(INT64_MAX),
       mStartingTimeMediaUs(-1),
       mPlaybackRate(1.0),
+      mAnchorChanged(false),
       mGeneration(0) {
     mLooper = new ALooper;
     mLooper->setName("MediaClock");
@@ -64,26 +70,32 @@ MediaClock::~MediaClock() {
 
 void MediaClock::reset() {
     Mutex::Autolock autoLock(mLock);
-    auto it = mTimers.begin();
-    while (it != mTimers.end()) {
+    for (auto it = mTimers.begin(); it != mTimers.end(); ++it) {
         it->mNotify->setInt32("reason", TIMER_REASON_RESET);
         it->mNotify->post();
-        it = mTimers.erase(it);
     }
+    mTimers.clear();
+
+    beginAnchorUpdate_l();
     mMaxTimeMediaUs = INT64_MAX;
     mStartingTimeMediaUs = -1;
     updateAnchorTimesAndPlaybackRate_l(-1, -1, 1.0);
+    endAnchorUpdate_l();
     ++mGeneration;
 }
 
 void MediaClock::setStartingTimeMedia(int64_t startingTimeMediaUs) {
     Mutex::Autolock autoLock(mLock);
+    beginAnchorUpdate_l();
     mStartingTimeMediaUs = startingTimeMediaUs;
+    endAnchorUpdate_l();
 }
 
 void MediaClock::clearAnchor() {
     Mutex::Autolock autoLock(mLock);
+    beginAnchorUpdate_l();
     updateAnchorTimesAndPlaybackRate_l(-1, -1, mPlaybackRate);
+    endAnchorUpdate_l();
 }
 
 void MediaClock::updateAnchor(
@@ -105,7 +117,9 @@ void MediaClock::updateAnchor(
     }
 
     if (maxTimeMediaUs != -1) {
+        beginAnchorUpdate_l();
         mMaxTimeMediaUs = maxTimeMediaUs;
+        endAnchorUpdate_l();
     }
     if (mAnchorTimeRealUs != -1) {
         int64_t oldNowMediaUs =
@@ -115,7 +129,9 @@ void MediaClock::updateAnchor(
             return;
         }
     }
+    beginAnchorUpdate_l();
     updateAnchorTimesAndPlaybackRate_l(nowMediaUs, nowUs, mPlaybackRate);
+    endAnchorUpdate_l();
 
     ++mGeneration;
     processTimers_l();
@@ -123,14 +139,19 @@ void MediaClock::updateAnchor(
 
 void MediaClock::updateMaxTimeMedia(int64_t maxTimeMediaUs) {
     Mutex::Autolock autoLock(mLock);
+    beginAnchorUpdate_l();
     mMaxTimeMediaUs = maxTimeMediaUs;
+    endAnchorUpdate_l();
 }
 
 void MediaClock::setPlaybackRate(float rate) {
     CHECK_GE(rate, 0.0);
     Mutex::Autolock autoLock(mLock);
     if (mAnchorTimeRealUs == -1) {
+        beginAnchorUpdate_l();
         mPlaybackRate = rate;
+        endAnchorUpdate_l();
+        updateTimerTargets_l();
         return;
     }
 
@@ -140,7 +161,9 @@ void MediaClock::setPlaybackRate(float rate) {
         ALOGW("setRate: anchor time should not be negative, set to 0.");
         nowMediaUs = 0;
     }
+    beginAnchorUpdate_l();
     updateAnchorTimesAndPlaybackRate_l(nowMediaUs, nowUs, rate);
+    endAnchorUpdate_l();
 
     if (rate > 0.0) {
         ++mGeneration;
@@ -149,8 +172,55 @@ void MediaClock::setPlaybackRate(float rate) {
 }
 
 float MediaClock::getPlaybackRate() const {
+    return mPlaybackRate.load(std::memory_order_acquire);
+}
+
+void MediaClock::beginAnchorUpdate_l() {
+    mAnchorSeq.store(mAnchorSeq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void MediaClock::endAnchorUpdate_l() {
+    mAnchorSeq.store(mAnchorSeq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+    // Listeners only hear about the new anchor once readers can see it.
+    if (mAnchorChanged) {
+        mAnchorChanged = false;
+        notifyDiscontinuity_l();
+    }
+}
+
+void MediaClock::getAnchor(Anchor *anchor) const {
+    // Retry while an update overlaps the reads, a writer holding mLock for
+    // long (or a steady stream of updates) must not keep readers spinning.
+    for (int retries = 0; retries < kMaxAnchorReadRetries; ++retries) {
+        uint32_t seq = mAnchorSeq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+
+        anchor->mAnchorTimeMediaUs = mAnchorTimeMediaUs.load(std::memory_order_relaxed);
+        anchor->mAnchorTimeRealUs = mAnchorTimeRealUs.load(std::memory_order_relaxed);
+        anchor->mMaxTimeMediaUs = mMaxTimeMediaUs.load(std::memory_order_relaxed);
+        anchor->mStartingTimeMediaUs = mStartingTimeMediaUs.load(std::memory_order_relaxed);
+        anchor->mPlaybackRate = mPlaybackRate.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (mAnchorSeq.load(std::memory_order_relaxed) == seq) {
+            return;
+        }
+    }
+
     Mutex::Autolock autoLock(mLock);
-    return mPlaybackRate;
+    getAnchor_l(anchor);
+}
+
+void MediaClock::getAnchor_l(Anchor *anchor) const {
+    anchor->mAnchorTimeMediaUs = mAnchorTimeMediaUs;
+    anchor->mAnchorTimeRealUs = mAnchorTimeRealUs;
+    anchor->mMaxTimeMediaUs = mMaxTimeMediaUs;
+    anchor->mStartingTimeMediaUs = mStartingTimeMediaUs;
+    anchor->mPlaybackRate = mPlaybackRate;
 }
 
 status_t MediaClock::getMediaTime(
@@ -159,23 +229,32 @@ status_t MediaClock::getMediaTime(
         return BAD_VALUE;
     }
 
-    Mutex::Autolock autoLock(mLock);
-    return getMediaTime_l(realUs, outMediaUs, allowPastMaxTime);
+    Anchor anchor;
+    getAnchor(&anchor);
+    return getMediaTime(anchor, realUs, outMediaUs, allowPastMaxTime);
 }
 
 status_t MediaClock::getMediaTime_l(
         int64_t realUs, int64_t *outMediaUs, bool allowPastMaxTime) const {
-    if (mAnchorTimeRealUs == -1) {
+    Anchor anchor;
+    getAnchor_l(&anchor);
+    return getMediaTime(anchor, realUs, outMediaUs, allowPastMaxTime);
+}
+
+// static
+status_t MediaClock::getMediaTime(
+        const Anchor &anchor, int64_t realUs, int64_t *outMediaUs, bool allowPastMaxTime) {
+    if (anchor.mAnchorTimeRealUs == -1) {
         return NO_INIT;
     }
 
-    int64_t mediaUs = mAnchorTimeMediaUs
-            + (realUs - mAnchorTimeRealUs) * (double)mPlaybackRate;
-    if (mediaUs > mMaxTimeMediaUs && !allowPastMaxTime) {
-        mediaUs = mMaxTimeMediaUs;
+    int64_t mediaUs = anchor.mAnchorTimeMediaUs
+            + (realUs - anchor.mAnchorTimeRealUs) * (double)anchor.mPlaybackRate;
+    if (mediaUs > anchor.mMaxTimeMediaUs && !allowPastMaxTime) {
+        mediaUs = anchor.mMaxTimeMediaUs;
     }
-    if (mediaUs < mStartingTimeMediaUs) {
-        mediaUs = mStartingTimeMediaUs;
+    if (mediaUs < anchor.mStartingTimeMediaUs) {
+        mediaUs = anchor.mStartingTimeMediaUs;
     }
     if (mediaUs < 0) {
         mediaUs = 0;
@@ -190,19 +269,20 @@ status_t MediaClock::getRealTimeFor(
         return BAD_VALUE;
     }
 
-    Mutex::Autolock autoLock(mLock);
-    if (mPlaybackRate == 0.0) {
+    Anchor anchor;
+    getAnchor(&anchor);
+    if (anchor.mPlaybackRate == 0.0) {
         return NO_INIT;
     }
 
     int64_t nowUs = ALooper::GetNowUs();
     int64_t nowMediaUs;
     status_t status =
-            getMediaTime_l(nowUs, &nowMediaUs, true /* allowPastMaxTime */);
+            getMediaTime(anchor, nowUs, &nowMediaUs, true /* allowPastMaxTime */);
     if (status != OK) {
         return status;
     }
-    *outRealUs = (targetMediaUs - nowMediaUs) / (double)mPlaybackRate + nowUs;
+    *outRealUs = (targetMediaUs - nowMediaUs) / (double)anchor.mPlaybackRate + nowUs;
     return OK;
 }
 
@@ -210,20 +290,15 @@ void MediaClock::addTimer(const sp<AMessage> &notify, int64_t mediaTimeUs,
                           int64_t adjustRealUs) {
     Mutex::Autolock autoLock(mLock);
 
-    bool updateTimer = (mPlaybackRate != 0.0);
-    if (updateTimer) {
-        auto it = mTimers.begin();
-        while (it != mTimers.end()) {
-            if (((it->mAdjustRealUs - (double)adjustRealUs) * (double)mPlaybackRate
-                + (it->mMediaTimeUs - mediaTimeUs)) <= 0) {
-                updateTimer = false;
-                break;
-            }
-            ++it;
-        }
-    }
+    Timer timer(notify, mediaTimeUs, adjustRealUs);
+    timer.mTargetMediaUs = mediaTimeUs + adjustRealUs * (double)mPlaybackRate;
 
-    mTimers.emplace_back(notify, mediaTimeUs, adjustRealUs);
+    // Only a timer that fires before all the others moves the wakeup.
+    bool updateTimer = (mPlaybackRate != 0.0)
+            && (mTimers.empty() || timer.mTargetMediaUs < mTimers.front().mTargetMediaUs);
+
+    mTimers.push_back(timer);
+    std::push_heap(mTimers.begin(), mTimers.end(), TimerLater());
 
     if (updateTimer) {
         ++mGeneration;
@@ -252,6 +327,14 @@ void MediaClock::onMessageReceived(const sp<AMessage> &msg) {
     }
 }
 
+// Timer targets depend on the playback rate; rebuilds the heap after a change.
+void MediaClock::updateTimerTargets_l() {
+    for (auto it = mTimers.begin(); it != mTimers.end(); ++it) {
+        it->mTargetMediaUs = it->mMediaTimeUs + it->mAdjustRealUs * (double)mPlaybackRate;
+    }
+    std::make_heap(mTimers.begin(), mTimers.end(), TimerLater());
+}
+
 void MediaClock::processTimers_l() {
     int64_t nowMediaTimeUs;
     status_t status = getMediaTime_l(
@@ -261,12 +344,11 @@ void MediaClock::processTimers_l() {
         return;
     }
 
+    // Fire every timer that is due in one pass, earliest first.
     int64_t nextLapseRealUs = INT64_MAX;
-    std::multimap<int64_t, Timer> notifyList;
-    auto it = mTimers.begin();
-    while (it != mTimers.end()) {
-        double diff = it->mAdjustRealUs * (double)mPlaybackRate
-            + it->mMediaTimeUs - nowMediaTimeUs;
+    while (!mTimers.empty()) {
+        const Timer &timer = mTimers.front();
+        double diff = timer.mTargetMediaUs - nowMediaTimeUs;
         int64_t diffMediaUs;
         if (diff > (double)INT64_MAX) {
             diffMediaUs = INT64_MAX;
@@ -276,26 +358,19 @@ void MediaClock::processTimers_l() {
             diffMediaUs = diff;
         }
 
-        if (diffMediaUs <= 0) {
-            notifyList.emplace(diffMediaUs, *it);
-            it = mTimers.erase(it);
-        } else {
+        if (diffMediaUs > 0) {
             if (mPlaybackRate != 0.0
                 && (double)diffMediaUs < (double)INT64_MAX * (double)mPlaybackRate) {
-                int64_t targetRealUs = diffMediaUs / (double)mPlaybackRate;
-                if (targetRealUs < nextLapseRealUs) {
-                    nextLapseRealUs = targetRealUs;
-                }
+                nextLapseRealUs = diffMediaUs / (double)mPlaybackRate;
             }
-            ++it;
+            break;
         }
-    }
 
-    auto itNotify = notifyList.begin();
-    while (itNotify != notifyList.end()) {
-        itNotify->second.mNotify->setInt32("reason", TIMER_REASON_REACHED);
-        itNotify->second.mNotify->post();
-        itNotify = notifyList.erase(itNotify);
+        timer.mNotify->setInt32("reason", TIMER_REASON_REACHED);
+        timer.mNotify->post();
+
+        std::pop_heap(mTimers.begin(), mTimers.end(), TimerLater());
+        mTimers.pop_back();
     }
 
     if (mTimers.empty() || mPlaybackRate == 0.0 || mAnchorTimeMediaUs < 0
@@ -308,15 +383,20 @@ void MediaClock::processTimers_l() {
     msg->post(nextLapseRealUs);
 }
 
+// Must be called between beginAnchorUpdate_l() and endAnchorUpdate_l().
 void MediaClock::updateAnchorTimesAndPlaybackRate_l(int64_t anchorTimeMediaUs,
         int64_t anchorTimeRealUs, float playbackRate) {
     if (mAnchorTimeMediaUs != anchorTimeMediaUs
             || mAnchorTimeRealUs != anchorTimeRealUs
             || mPlaybackRate != playbackRate) {
+        bool rateChanged = (mPlaybackRate != playbackRate);
         mAnchorTimeMediaUs = anchorTimeMediaUs;
         mAnchorTimeRealUs = anchorTimeRealUs;
         mPlaybackRate = playbackRate;
-        notifyDiscontinuity_l();
+        if (rateChanged) {
+            updateTimerTargets_l();
+        }
+        mAnchorChanged = true;
     }
 }
 
@@ -50,6 +50,12 @@ const int kStopTimeoutUs = 300000; // allow 1 sec for shutting down encoder
 // allow maximum 1 sec for stop time offset. This limits the the delay in the
 // input source.
 const int kMaxStopTimeOffsetUs = 1000000;
+// number of buffers the puller reads from the source before yielding the
+// pull looper to other messages.
+const size_t kMaxBuffersPerPull = 8;
+// input timestamps the encoder has not produced output for within this
+// window are considered dropped by the encoder.
+const int64_t kMaxEncoderLatencyUs = 1000000ll;
 
 struct MediaCodecSource::Puller : public AHandler {
     explicit Puller(const sp<MediaSource> &source);
@@ -88,7 +94,7 @@ private:
         int64_t mReadPendingSince;
         bool mPaused;
         bool mPulling;
-        Vector<MediaBufferBase *> mReadBuffers;
+        List<MediaBufferBase *> mReadBuffers;
 
         void flush();
         // if queue is empty, return false and set *|buffer| to NULL . Otherwise, pop
@@ -283,46 +289,56 @@ void MediaCodecSource::Puller::onMessageReceived(const sp<AMessage> &msg) {
 
         case kWhatPull:
         {
+            // Read up to kMaxBuffersPerPull buffers per message instead of
+            // bouncing through the looper for every buffer; the consumer is
+            // only notified when the queue goes from empty to non-empty, as
+            // feedEncoderInputBuffers() drains everything that is queued.
             Mutexed<Queue>::Locked queue(mQueue);
-            queue->mReadPendingSince = ALooper::GetNowUs();
-            if (!queue->mPulling) {
-                handleEOS();
-                break;
-            }
-
-            queue.unlock();
-            MediaBufferBase *mbuf = NULL;
-            status_t err = mSource->read(&mbuf);
-            queue.lock();
-
-            queue->mReadPendingSince = 0;
-            // if we need to discard buffer
-            if (!queue->mPulling || queue->mPaused || err != OK) {
-                if (mbuf != NULL) {
-                    mbuf->release();
-                    mbuf = NULL;
+            for (size_t numPulled = 0; ; ++numPulled) {
+                queue->mReadPendingSince = ALooper::GetNowUs();
+                if (!queue->mPulling) {
+                    handleEOS();
+                    break;
                 }
-                if (queue->mPulling && err == OK) {
-                    msg->post(); // if simply paused, keep pulling source
+                if (numPulled == kMaxBuffersPerPull) {
+                    // let other messages in before pulling some more
+                    queue->mReadPendingSince = 0;
+                    msg->post();
                     break;
-                } else if (err == ERROR_END_OF_STREAM) {
-                    ALOGV("stream ended, mbuf %p", mbuf);
-                } else if (err != OK) {
-                    ALOGE("error %d reading stream.", err);
                 }
-            }
 
-            if (mbuf != NULL) {
-                queue->pushBuffer(mbuf);
-            }
+                queue.unlock();
+                MediaBufferBase *mbuf = NULL;
+                status_t err = mSource->read(&mbuf);
+                queue.lock();
+
+                queue->mReadPendingSince = 0;
+                // if we need to discard buffer
+                if (!queue->mPulling || queue->mPaused || err != OK) {
+                    if (mbuf != NULL) {
+                        mbuf->release();
+                        mbuf = NULL;
+                    }
+                    if (queue->mPulling && err == OK) {
+                        continue; // if simply paused, keep pulling source
+                    } else if (err == ERROR_END_OF_STREAM) {
+                        ALOGV("stream ended, mbuf %p", mbuf);
+                    } else if (err != OK) {
+                        ALOGE("error %d reading stream.", err);
+                    }
+                }
 
-            queue.unlock();
+                if (mbuf == NULL) {
+                    queue.unlock();
+                    handleEOS();
+                    break;
+                }
 
-            if (mbuf != NULL) {
-                mNotify->post();
-                msg->post();
-            } else {
-                handleEOS();
+                bool wasEmpty = queue->mReadBuffers.empty();
+                queue->pushBuffer(mbuf);
+                if (wasEmpty) {
+                    mNotify->post();
+                }
             }
             break;
         }
@@ -447,6 +463,7 @@ MediaCodecSource::MediaCodecSource(
       mInputBufferTimeOffsetUs(0),
       mFirstSampleSystemTimeUs(-1LL),
       mPausePending(false),
+      mEncoderLatency(kMaxEncoderLatencyUs),
       mFirstSampleTimeUs(-1LL),
       mGeneration(0) {
     CHECK(mLooper != NULL);
@@ -644,6 +661,12 @@ void MediaCodecSource::signalEOS(status_t err) {
 
             reachedEOS = true;
             output.unlock();
+            if (mEncoderLatency.numSamples() > 0) {
+                ALOGI("encoder (%s) latency over %zu frames: avg %" PRId64 " us, max %" PRId64
+                        " us", mIsVideo ? "video" : "audio", mEncoderLatency.numSamples(),
+                        mEncoderLatency.averageLatencyUs(), mEncoderLatency.maxLatencyUs());
+            }
+            mEncoderLatency.clear();
             releaseEncoder();
         }
     }
@@ -769,6 +792,10 @@ status_t MediaCodecSource::feedEncoderInputBuffers() {
         if (err != OK) {
             return err;
         }
+
+        if (!(flags & MediaCodec::BUFFER_FLAG_EOS)) {
+            mEncoderLatency.onInputQueued(timeUs, ALooper::GetNowUs());
+        }
     }
 
     return OK;
@@ -969,6 +996,13 @@ void MediaCodecSource::onMessageReceived(const sp<AMessage> &msg) {
                             timeUs, timeUs / 1E6, driftTimeUs);
                 }
                 mbuf->meta_data().setInt64(kKeyTime, timeUs);
+
+                int64_t latencyUs;
+                if (mEncoderLatency.takeLatency(timeUs, ALooper::GetNowUs(), &latencyUs)) {
+                    mbuf->meta_data().setInt64(kKeyEncoderLatencyUs, latencyUs);
+                    ALOGV("[%s] time %" PRId64 " us, encoder latency %" PRId64 " us",
+                            mIsVideo ? "video" : "audio", timeUs, latencyUs);
+                }
             } else {
                 mbuf->meta_data().setInt64(kKeyTime, 0LL);
                 mbuf->meta_data().setInt32(kKeyIsCodecConfig, true);
@@ -979,9 +1013,14 @@ void MediaCodecSource::onMessageReceived(const sp<AMessage> &msg) {
             memcpy(mbuf->data(), outbuf->data(), outbuf->size());
 
             {
+                // the track thread only waits on an empty queue, so only the
+                // transition to non-empty needs to wake it up.
                 Mutexed<Output>::Locked output(mOutput);
+                bool wasEmpty = output->mBufferQueue.empty();
                 output->mBufferQueue.push_back(mbuf);
-                output->mCond.signal();
+                if (wasEmpty) {
+                    output->mCond.signal();
+                }
             }
 
             mEncoder->releaseOutputBuffer(index);
@@ -30,6 +30,7 @@
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaAdapter.h>
 #include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaBufferGroup.h>
 #include <media/stagefright/MediaCodec.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaErrors.h>
@@ -40,6 +41,10 @@
 
 namespace android {
 
+// Number of samples of a track that may wait for the writer before
+// writeSampleData() blocks.
+static const size_t kMaxQueuedSamples = 8;
+
 static bool isMp4Format(MediaMuxer::OutputFormat format) {
     return format == MediaMuxer::OUTPUT_FORMAT_MPEG_4 ||
            format == MediaMuxer::OUTPUT_FORMAT_THREE_GPP ||
@@ -76,6 +81,11 @@ MediaMuxer::~MediaMuxer() {
     mFileMeta.clear();
     mWriter.clear();
     mTrackList.clear();
+    // All pooled buffers have been returned once the writer is gone.
+    for (size_t i = 0; i < mSampleBufferPools.size(); ++i) {
+        delete mSampleBufferPools[i];
+    }
+    mSampleBufferPools.clear();
 }
 
 ssize_t MediaMuxer::addTrack(const sp<AMessage> &format) {
@@ -96,11 +106,13 @@ ssize_t MediaMuxer::addTrack(const sp<AMessage> &format) {
         return BAD_VALUE;
     }
 
-    sp<MediaAdapter> newTrack = new MediaAdapter(trackMeta);
+    sp<MediaAdapter> newTrack = new MediaAdapter(trackMeta, kMaxQueuedSamples);
     status_t result = mWriter->addSource(newTrack);
     if (result != OK) {
         return -1;
     }
+    // One more buffer than can be queued, for the one being consumed.
+    mSampleBufferPools.push_back(new MediaBufferGroup(kMaxQueuedSamples + 1));
     float captureFps = -1.0;
     if (format->findAsFloat("time-lapse-fps", &captureFps)) {
         ALOGV("addTrack() time-lapse-fps: %f", captureFps);
@@ -143,6 +155,25 @@ status_t MediaMuxer::setLocation(int latitude, int longitude) {
     return static_cast<MPEG4Writer*>(mWriter.get())->setGeoData(latitude, longitude);
 }
 
+status_t MediaMuxer::setFragmentDurationUs(int64_t durationUs) {
+    Mutex::Autolock autoLock(mMuxerLock);
+    if (mState != INITIALIZED) {
+        ALOGE("setFragmentDurationUs() must be called before start().");
+        return INVALID_OPERATION;
+    }
+    if (mFormat != OUTPUT_FORMAT_MPEG_4 && mFormat != OUTPUT_FORMAT_THREE_GPP) {
+        ALOGE("setFragmentDurationUs() is only supported for .mp4 or .3gp output.");
+        return INVALID_OPERATION;
+    }
+    if (durationUs <= 0) {
+        ALOGE("setFragmentDurationUs() get invalid duration %lld", (long long)durationUs);
+        return -EINVAL;
+    }
+
+    mFileMeta->setInt64(kKeyFragmentDurationUs, durationUs);
+    return OK;
+}
+
 status_t MediaMuxer::start() {
     Mutex::Autolock autoLock(mMuxerLock);
     if (mState == INITIALIZED) {
@@ -159,15 +190,21 @@ status_t MediaMuxer::stop() {
     Mutex::Autolock autoLock(mMuxerLock);
     if (mState == STARTED) {
         mState = STOPPED;
+        // Let the writer drain the samples still queued in the tracks; it
+        // stops the tracks itself.
         for (size_t i = 0; i < mTrackList.size(); i++) {
-            if (mTrackList[i]->stop() != OK) {
-                return INVALID_OPERATION;
-            }
+            mTrackList[i]->signalEndOfStream();
         }
         status_t err = mWriter->stop();
         if (err != OK) {
             ALOGE("stop() err: %d", err);
         }
+        // Release whatever the writer did not read, e.g. if it failed.
+        for (size_t i = 0; i < mTrackList.size(); i++) {
+            if (mTrackList[i]->stop() != OK) {
+                return INVALID_OPERATION;
+            }
+        }
         return err;
     } else {
         ALOGE("stop() is called in invalid state %d", mState);
@@ -194,10 +231,18 @@ status_t MediaMuxer::writeSampleData(const sp<ABuffer> &buffer, size_t trackInde
         return -EINVAL;
     }
 
-    MediaBuffer* mediaBuffer = new MediaBuffer(buffer);
-
-    mediaBuffer->add_ref(); // Released in MediaAdapter::signalBufferReturned().
-    mediaBuffer->set_range(buffer->offset(), buffer->size());
+    // The caller may reuse the buffer as soon as this returns, so the sample
+    // is copied into a pooled buffer that the writer releases back to the pool.
+    MediaBufferBase *pooledBuffer = NULL;
+    status_t err = mSampleBufferPools[trackIndex]->acquire_buffer(
+            &pooledBuffer, false /* nonBlocking */, buffer->size());
+    if (err != OK) {
+        ALOGE("WriteSampleData() failed to get a buffer of size %zu", buffer->size());
+        return err;
+    }
+    MediaBuffer* mediaBuffer = static_cast<MediaBuffer *>(pooledBuffer);
+    memcpy(mediaBuffer->data(), buffer->data(), buffer->size());
+    mediaBuffer->set_range(0, buffer->size());
 
     MetaDataBase &sampleMetaData = mediaBuffer->meta_data();
     sampleMetaData.setInt64(kKeyTime, timeUs);
@@ -218,7 +263,8 @@ status_t MediaMuxer::writeSampleData(const sp<ABuffer> &buffer, size_t trackInde
     }
 
     sp<MediaAdapter> currentTrack = mTrackList[trackIndex];
-    // This pushBuffer will wait until the mediaBuffer is consumed.
+    // This pushBuffer only waits while the track has kMaxQueuedSamples
+    // samples queued.
     return currentTrack->pushBuffer(mediaBuffer);
 }
 
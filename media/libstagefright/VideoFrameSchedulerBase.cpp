@@ -52,7 +52,7 @@ static const int64_t kErrorThreshold = (1 << (kPrecision * 2)) / 10;
 static const int64_t kMultiplesThresholdDiv = 4;                                     // 25%
 static const int64_t kReFitThresholdDiv = 100;                                       // 1%
 static const nsecs_t kMaxAllowedFrameSkip = VideoFrameSchedulerBase::kNanosIn1s;     // 1 sec
-static const nsecs_t kMinPeriod = VideoFrameSchedulerBase::kNanosIn1s / 120;         // 120Hz
+static const nsecs_t kMinPeriod = VideoFrameSchedulerBase::kNanosIn1s / 240;         // 240Hz
 static const nsecs_t kRefitRefreshPeriod = 10 * VideoFrameSchedulerBase::kNanosIn1s; // 10 sec
 
 VideoFrameSchedulerBase::PLL::PLL()
@@ -326,19 +326,29 @@ nsecs_t VideoFrameSchedulerBase::PLL::getPeriod() const {
 /*                             Frame Scheduler                             */
 /* ======================================================================= */
 
+static const nsecs_t kVsyncPhaseFilterDiv = 4;   // move 1/4 towards a new phase sample
+static const nsecs_t kVsyncPeriodFilterDiv = 8;  // move 1/8 towards a new period sample
+
 VideoFrameSchedulerBase::VideoFrameSchedulerBase()
     : mVsyncTime(0),
       mVsyncPeriod(0),
       mVsyncRefreshAt(0),
+      mModelVsyncTime(0),
+      mModelVsyncPeriod(0),
+      mNumPacedFrames(0),
+      mNumJudderFrames(0),
       mLastVsyncTime(-1),
       mTimeCorrection(0) {
 }
 
 void VideoFrameSchedulerBase::init(float videoFps) {
-    updateVsync();
+    mModelVsyncPeriod = 0;
+    refreshVsync();
 
     mLastVsyncTime = -1;
     mTimeCorrection = 0;
+    mNumPacedFrames = 0;
+    mNumJudderFrames = 0;
 
     mPll.reset(videoFps);
 }
@@ -357,6 +367,43 @@ nsecs_t VideoFrameSchedulerBase::getVsyncPeriod() {
     return kDefaultVsyncPeriod;
 }
 
+void VideoFrameSchedulerBase::refreshVsync() {
+    updateVsync();
+
+    if (mVsyncPeriod <= 0) {
+        mModelVsyncPeriod = 0;
+        return;
+    }
+
+    if (mModelVsyncPeriod > 0
+            && abs(mVsyncPeriod - mModelVsyncPeriod) <= mModelVsyncPeriod / kReFitThresholdDiv) {
+        // predict the vsync closest to the sample, and correct by a fraction of the error
+        nsecs_t numPeriods = divRound(mVsyncTime - mModelVsyncTime, mModelVsyncPeriod);
+        nsecs_t predictedTime = mModelVsyncTime + numPeriods * mModelVsyncPeriod;
+        nsecs_t phaseError = mVsyncTime - predictedTime;
+
+        mModelVsyncTime = predictedTime + phaseError / kVsyncPhaseFilterDiv;
+        mModelVsyncPeriod += (mVsyncPeriod - mModelVsyncPeriod) / kVsyncPeriodFilterDiv;
+        ALOGV("vsync model time:%lld period:%lld (phase error %lld)",
+                (long long)mModelVsyncTime, (long long)mModelVsyncPeriod, (long long)phaseError);
+    } else {
+        // first sample, or the display changed modes
+        mModelVsyncTime = mVsyncTime;
+        mModelVsyncPeriod = mVsyncPeriod;
+    }
+
+    mVsyncTime = mModelVsyncTime;
+    mVsyncPeriod = mModelVsyncPeriod;
+}
+
+size_t VideoFrameSchedulerBase::getPacedFrameCount() const {
+    return mNumPacedFrames;
+}
+
+size_t VideoFrameSchedulerBase::getJudderFrameCount() const {
+    return mNumJudderFrames;
+}
+
 float VideoFrameSchedulerBase::getFrameRate() {
     nsecs_t videoPeriod = mPll.getPeriod();
     if (videoPeriod > 0) {
@@ -370,7 +417,7 @@ nsecs_t VideoFrameSchedulerBase::schedule(nsecs_t renderTime) {
 
     nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
     if (now >= mVsyncRefreshAt) {
-        updateVsync();
+        refreshVsync();
     }
 
     // without VSYNC info, there is nothing to do
@@ -451,6 +498,14 @@ nsecs_t VideoFrameSchedulerBase::schedule(nsecs_t renderTime) {
                 return origRenderTime;
             }
 
+            // the last frame juddered if it was held for most of a vsync
+            // longer or shorter than its own duration
+            ++mNumPacedFrames;
+            nsecs_t heldFor = (nsecs_t)vsyncsForLastFrame * mVsyncPeriod;
+            if (abs(heldFor - videoPeriod) > mVsyncPeriod * 3 / 4) {
+                ++mNumJudderFrames;
+            }
+
             ATRACE_INT("FRAME_VSYNCS", vsyncsForLastFrame);
         }
         mLastVsyncTime = nextVsyncTime;
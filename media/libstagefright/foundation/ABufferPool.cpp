@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ABufferPool.h"
+
+#include "ABuffer.h"
+#include "ADebug.h"
+
+namespace android {
+
+struct ABufferPool::PooledBuffer : public ABuffer {
+    PooledBuffer(const sp<ABufferPool> &pool, void *data, size_t capacity)
+        : ABuffer(data, capacity),
+          mPool(pool),
+          mPoolData(data) {
+    }
+
+protected:
+    virtual ~PooledBuffer() {
+        mPool->release(mPoolData);
+    }
+
+private:
+    sp<ABufferPool> mPool;
+    void *mPoolData;
+
+    DISALLOW_EVIL_CONSTRUCTORS(PooledBuffer);
+};
+
+ABufferPool::ABufferPool(size_t bufferSize, size_t maxNumFree)
+    : mBufferSize(bufferSize),
+      mMaxNumFree(maxNumFree) {
+}
+
+ABufferPool::~ABufferPool() {
+    // Every buffer handed out holds a reference to the pool, so they are all back.
+    for (size_t i = 0; i < mFreeBuffers.size(); ++i) {
+        free(mFreeBuffers[i]);
+    }
+}
+
+size_t ABufferPool::numFree() const {
+    Mutex::Autolock autoLock(mLock);
+    return mFreeBuffers.size();
+}
+
+sp<ABuffer> ABufferPool::acquire() {
+    void *data = NULL;
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (!mFreeBuffers.empty()) {
+            data = mFreeBuffers.top();
+            mFreeBuffers.pop();
+        }
+    }
+
+    if (data == NULL) {
+        data = malloc(mBufferSize);
+        if (data == NULL) {
+            // Same as an ABuffer whose allocation failed: zero capacity.
+            return new ABuffer(mBufferSize);
+        }
+    }
+
+    return new PooledBuffer(this, data, mBufferSize);
+}
+
+void ABufferPool::release(void *data) {
+    Mutex::Autolock autoLock(mLock);
+    if (mFreeBuffers.size() < mMaxNumFree) {
+        mFreeBuffers.push(data);
+    } else {
+        free(data);
+    }
+}
+
+}  // namespace android
@@ -27,6 +27,7 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 
@@ -41,6 +42,13 @@ namespace android {
 static const size_t kMaxUDPSize = 1500;
 static const int32_t kMaxUDPRetries = 200;
 
+// Datagrams received or sent per recvmmsg/sendmmsg call.
+static const size_t kMaxDatagramBatch = 32;
+// Events handled per epoll_wait call.
+static const int kMaxEpollEvents = 64;
+// epoll user data of the wake-up pipe; session IDs start at 1.
+static const int32_t kPipeEventID = 0;
+
 struct ANetworkSession::NetworkThread : public Thread {
     explicit NetworkThread(ANetworkSession *session);
 
@@ -91,10 +99,19 @@ struct ANetworkSession::Session : public RefBase {
     status_t sendRequest(
             const void *data, ssize_t size, bool timeValid, int64_t timeUs);
 
+    status_t sendDatagrams(
+            const List<sp<ABuffer> > &datagrams, bool timeValid, int64_t timeUs);
+
     void setMode(Mode mode);
 
     status_t switchToWebSocketMode();
 
+    void setBatchedNotifications(bool enable);
+
+    // events the socket is currently registered for with epoll, 0 if none
+    uint32_t epollEvents() const;
+    void setEpollEvents(uint32_t events);
+
 protected:
     virtual ~Session();
 
@@ -122,6 +139,15 @@ private:
 
     int64_t mLastStallReportUs;
 
+    bool mBatchNotifications;
+    uint32_t mEpollEvents;
+
+    // receive buffers for recvmmsg; only the ones handed out get replaced
+    sp<ABuffer> mRecvBuffers[kMaxDatagramBatch];
+
+    status_t readDatagrams();
+    status_t writeDatagrams();
+
     void notifyError(bool send, status_t err, const char *detail);
     void notify(NotificationReason reason);
 
@@ -159,7 +185,9 @@ ANetworkSession::Session::Session(
       mSawReceiveFailure(false),
       mSawSendFailure(false),
       mUDPRetries(kMaxUDPRetries),
-      mLastStallReportUs(-1ll) {
+      mLastStallReportUs(-1ll),
+      mBatchNotifications(false),
+      mEpollEvents(0) {
     if (mState == CONNECTED) {
         struct sockaddr_in localAddr;
         socklen_t localAddrLen = sizeof(localAddr);
@@ -231,6 +259,18 @@ status_t ANetworkSession::Session::switchToWebSocketMode() {
     return OK;
 }
 
+void ANetworkSession::Session::setBatchedNotifications(bool enable) {
+    mBatchNotifications = enable;
+}
+
+uint32_t ANetworkSession::Session::epollEvents() const {
+    return mEpollEvents;
+}
+
+void ANetworkSession::Session::setEpollEvents(uint32_t events) {
+    mEpollEvents = events;
+}
+
 sp<AMessage> ANetworkSession::Session::getNotificationMessage() const {
     return mNotify;
 }
@@ -254,75 +294,120 @@ bool ANetworkSession::Session::wantsToWrite() {
             || (mState == DATAGRAM && !mOutFragments.empty()));
 }
 
-status_t ANetworkSession::Session::readMore() {
-    if (mState == DATAGRAM) {
-        CHECK_EQ(mMode, MODE_DATAGRAM);
+status_t ANetworkSession::Session::readDatagrams() {
+    struct mmsghdr msgs[kMaxDatagramBatch];
+    struct iovec iovs[kMaxDatagramBatch];
+    struct sockaddr_in remoteAddrs[kMaxDatagramBatch];
 
-        status_t err;
+    status_t err;
+    do {
+        for (size_t i = 0; i < kMaxDatagramBatch; ++i) {
+            if (mRecvBuffers[i] == NULL) {
+                mRecvBuffers[i] = new ABuffer(kMaxUDPSize);
+            }
+            iovs[i].iov_base = mRecvBuffers[i]->base();
+            iovs[i].iov_len = mRecvBuffers[i]->capacity();
+
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_name = &remoteAddrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(remoteAddrs[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int n;
         do {
-            sp<ABuffer> buf = new ABuffer(kMaxUDPSize);
+            n = recvmmsg(mSocket, msgs, kMaxDatagramBatch, 0, NULL /* timeout */);
+        } while (n < 0 && errno == EINTR);
 
-            struct sockaddr_in remoteAddr;
-            socklen_t remoteAddrLen = sizeof(remoteAddr);
+        err = OK;
+        if (n < 0) {
+            err = -errno;
+            break;
+        } else if (n == 0) {
+            err = -ECONNRESET;
+            break;
+        }
 
-            ssize_t n;
-            do {
-                n = recvfrom(
-                        mSocket, buf->data(), buf->capacity(), 0,
-                        (struct sockaddr *)&remoteAddr, &remoteAddrLen);
-            } while (n < 0 && errno == EINTR);
+        int64_t nowUs = ALooper::GetNowUs();
 
-            err = OK;
-            if (n < 0) {
-                err = -errno;
-            } else if (n == 0) {
-                err = -ECONNRESET;
-            } else {
-                buf->setRange(0, n);
+        sp<AMessage> batch;
+        if (mBatchNotifications) {
+            batch = mNotify->dup();
+            batch->setInt32("sessionID", mSessionID);
+            batch->setInt32("reason", kWhatDatagrams);
+        }
 
-                int64_t nowUs = ALooper::GetNowUs();
-                buf->meta()->setInt64("arrivalTimeUs", nowUs);
+        size_t count = 0;
+        for (int i = 0; i < n; ++i) {
+            sp<ABuffer> buf = mRecvBuffers[i];
+            mRecvBuffers[i].clear();
+
+            buf->setRange(0, msgs[i].msg_len);
+            buf->meta()->setInt64("arrivalTimeUs", nowUs);
+
+            uint32_t ip = ntohl(remoteAddrs[i].sin_addr.s_addr);
+            AString fromAddr = AStringPrintf(
+                    "%u.%u.%u.%u",
+                    ip >> 24,
+                    (ip >> 16) & 0xff,
+                    (ip >> 8) & 0xff,
+                    ip & 0xff);
+            int32_t fromPort = ntohs(remoteAddrs[i].sin_port);
+
+            if (batch != NULL) {
+                buf->meta()->setString("fromAddr", fromAddr.c_str());
+                buf->meta()->setInt32("fromPort", fromPort);
+                batch->setBuffer(AStringPrintf("data%zu", count++).c_str(), buf);
+                continue;
+            }
 
-                sp<AMessage> notify = mNotify->dup();
-                notify->setInt32("sessionID", mSessionID);
-                notify->setInt32("reason", kWhatDatagram);
+            sp<AMessage> notify = mNotify->dup();
+            notify->setInt32("sessionID", mSessionID);
+            notify->setInt32("reason", kWhatDatagram);
+            notify->setString("fromAddr", fromAddr.c_str());
+            notify->setInt32("fromPort", fromPort);
+            notify->setBuffer("data", buf);
+            notify->post();
+        }
 
-                uint32_t ip = ntohl(remoteAddr.sin_addr.s_addr);
-                notify->setString(
-                        "fromAddr",
-                        AStringPrintf(
-                            "%u.%u.%u.%u",
-                            ip >> 24,
-                            (ip >> 16) & 0xff,
-                            (ip >> 8) & 0xff,
-                            ip & 0xff).c_str());
+        if (batch != NULL) {
+            batch->setSize("count", count);
+            batch->post();
+        }
 
-                notify->setInt32("fromPort", ntohs(remoteAddr.sin_port));
+        if ((size_t)n < kMaxDatagramBatch) {
+            // socket is drained for now
+            break;
+        }
+    } while (err == OK);
 
-                notify->setBuffer("data", buf);
-                notify->post();
-            }
-        } while (err == OK);
+    if (err == -EAGAIN) {
+        err = OK;
+    }
 
-        if (err == -EAGAIN) {
+    if (err != OK) {
+        if (!mUDPRetries) {
+            notifyError(false /* send */, err, "Recvfrom failed.");
+            mSawReceiveFailure = true;
+        } else {
+            mUDPRetries--;
+            ALOGE("Recvfrom failed, %d/%d retries left",
+                    mUDPRetries, kMaxUDPRetries);
             err = OK;
         }
+    } else {
+        mUDPRetries = kMaxUDPRetries;
+    }
 
-        if (err != OK) {
-            if (!mUDPRetries) {
-                notifyError(false /* send */, err, "Recvfrom failed.");
-                mSawReceiveFailure = true;
-            } else {
-                mUDPRetries--;
-                ALOGE("Recvfrom failed, %d/%d retries left",
-                        mUDPRetries, kMaxUDPRetries);
-                err = OK;
-            }
-        } else {
-            mUDPRetries = kMaxUDPRetries;
-        }
+    return err;
+}
 
-        return err;
+status_t ANetworkSession::Session::readMore() {
+    if (mState == DATAGRAM) {
+        CHECK_EQ(mMode, MODE_DATAGRAM);
+
+        return readDatagrams();
     }
 
     char tmp[512];
@@ -537,57 +622,75 @@ void ANetworkSession::Session::dumpFragmentStats(const Fragment & /* frag */) {
 #endif
 }
 
-status_t ANetworkSession::Session::writeMore() {
-    if (mState == DATAGRAM) {
-        CHECK(!mOutFragments.empty());
+status_t ANetworkSession::Session::writeDatagrams() {
+    struct mmsghdr msgs[kMaxDatagramBatch];
+    struct iovec iovs[kMaxDatagramBatch];
 
-        status_t err;
-        do {
-            const Fragment &frag = *mOutFragments.begin();
-            const sp<ABuffer> &datagram = frag.mBuffer;
+    status_t err;
+    do {
+        size_t count = 0;
+        for (List<Fragment>::iterator it = mOutFragments.begin();
+                it != mOutFragments.end() && count < kMaxDatagramBatch; ++it, ++count) {
+            iovs[count].iov_base = it->mBuffer->data();
+            iovs[count].iov_len = it->mBuffer->size();
+
+            memset(&msgs[count], 0, sizeof(msgs[count]));
+            msgs[count].msg_hdr.msg_iov = &iovs[count];
+            msgs[count].msg_hdr.msg_iovlen = 1;
+        }
 
-            int n;
-            do {
-                n = send(mSocket, datagram->data(), datagram->size(), 0);
-            } while (n < 0 && errno == EINTR);
+        int n;
+        do {
+            n = sendmmsg(mSocket, msgs, count, 0);
+        } while (n < 0 && errno == EINTR);
 
-            err = OK;
+        err = OK;
 
-            if (n > 0) {
+        if (n > 0) {
+            for (int i = 0; i < n; ++i) {
+                const Fragment &frag = *mOutFragments.begin();
                 if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
                     dumpFragmentStats(frag);
                 }
 
                 mOutFragments.erase(mOutFragments.begin());
-            } else if (n < 0) {
-                err = -errno;
-            } else if (n == 0) {
-                err = -ECONNRESET;
             }
-        } while (err == OK && !mOutFragments.empty());
+        } else if (n < 0) {
+            err = -errno;
+        } else if (n == 0) {
+            err = -ECONNRESET;
+        }
+    } while (err == OK && !mOutFragments.empty());
 
-        if (err == -EAGAIN) {
-            if (!mOutFragments.empty()) {
-                ALOGI("%zu datagrams remain queued.", mOutFragments.size());
-            }
-            err = OK;
+    if (err == -EAGAIN) {
+        if (!mOutFragments.empty()) {
+            ALOGI("%zu datagrams remain queued.", mOutFragments.size());
         }
+        err = OK;
+    }
 
-        if (err != OK) {
-            if (!mUDPRetries) {
-                notifyError(true /* send */, err, "Send datagram failed.");
-                mSawSendFailure = true;
-            } else {
-                mUDPRetries--;
-                ALOGE("Send datagram failed, %d/%d retries left",
-                        mUDPRetries, kMaxUDPRetries);
-                err = OK;
-            }
+    if (err != OK) {
+        if (!mUDPRetries) {
+            notifyError(true /* send */, err, "Send datagram failed.");
+            mSawSendFailure = true;
         } else {
-            mUDPRetries = kMaxUDPRetries;
+            mUDPRetries--;
+            ALOGE("Send datagram failed, %d/%d retries left",
+                    mUDPRetries, kMaxUDPRetries);
+            err = OK;
         }
+    } else {
+        mUDPRetries = kMaxUDPRetries;
+    }
 
-        return err;
+    return err;
+}
+
+status_t ANetworkSession::Session::writeMore() {
+    if (mState == DATAGRAM) {
+        CHECK(!mOutFragments.empty());
+
+        return writeDatagrams();
     }
 
     if (mState == CONNECTING) {
@@ -766,6 +869,43 @@ status_t ANetworkSession::Session::sendRequest(
     return OK;
 }
 
+status_t ANetworkSession::Session::sendDatagrams(
+        const List<sp<ABuffer> > &datagrams, bool timeValid, int64_t timeUs) {
+    if (mState != DATAGRAM) {
+        return INVALID_OPERATION;
+    }
+
+    bool wasIdle = mOutFragments.empty();
+
+    for (List<sp<ABuffer> >::const_iterator it = datagrams.begin();
+            it != datagrams.end(); ++it) {
+        if ((*it)->size() == 0) {
+            continue;
+        }
+
+        Fragment frag;
+
+        frag.mFlags = 0;
+        if (timeValid) {
+            frag.mFlags = FRAGMENT_FLAG_TIME_VALID;
+            frag.mTimeUs = timeUs;
+        }
+
+        frag.mBuffer = *it;
+
+        mOutFragments.push_back(frag);
+    }
+
+    if (!wasIdle || mOutFragments.empty() || mSawSendFailure) {
+        // The network thread is already waiting for the socket to drain.
+        return OK;
+    }
+
+    // Nothing was queued, so the socket is almost certainly writable. Don't
+    // wait for the network thread to wake up and notice.
+    return writeDatagrams();
+}
+
 void ANetworkSession::Session::notifyError(
         bool send, status_t err, const char *detail) {
     sp<AMessage> msg = mNotify->dup();
@@ -787,7 +927,8 @@ void ANetworkSession::Session::notify(NotificationReason reason) {
 ////////////////////////////////////////////////////////////////////////////////
 
 ANetworkSession::ANetworkSession()
-    : mNextSessionID(1) {
+    : mNextSessionID(1),
+      mEpollFd(-1) {
     mPipeFd[0] = mPipeFd[1] = -1;
 }
 
@@ -806,13 +947,40 @@ status_t ANetworkSession::start() {
         return -errno;
     }
 
-    mThread = new NetworkThread(this);
+    status_t err = OK;
 
-    status_t err = mThread->run("ANetworkSession", ANDROID_PRIORITY_AUDIO);
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = kPipeEventID;
+
+        if (mEpollFd < 0
+                || epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mPipeFd[0], &ev) < 0) {
+            err = -errno;
+        } else {
+            // Sessions created before start() have not been registered yet.
+            for (size_t i = 0; i < mSessions.size(); ++i) {
+                updateEpollEvents_l(mSessions.valueAt(i));
+            }
+        }
+    }
+
+    if (err == OK) {
+        mThread = new NetworkThread(this);
+
+        err = mThread->run("ANetworkSession", ANDROID_PRIORITY_AUDIO);
+    }
 
     if (err != OK) {
         mThread.clear();
 
+        closeEpoll();
+
         close(mPipeFd[0]);
         close(mPipeFd[1]);
         mPipeFd[0] = mPipeFd[1] = -1;
@@ -834,6 +1002,8 @@ status_t ANetworkSession::stop() {
 
     mThread.clear();
 
+    closeEpoll();
+
     close(mPipeFd[0]);
     close(mPipeFd[1]);
     mPipeFd[0] = mPipeFd[1] = -1;
@@ -841,6 +1011,19 @@ status_t ANetworkSession::stop() {
     return OK;
 }
 
+void ANetworkSession::closeEpoll() {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
+
+    for (size_t i = 0; i < mSessions.size(); ++i) {
+        mSessions.valueAt(i)->setEpollEvents(0);
+    }
+}
+
 status_t ANetworkSession::createRTSPClient(
         const char *host, unsigned port, const sp<AMessage> &notify,
         int32_t *sessionID) {
@@ -926,9 +1109,13 @@ status_t ANetworkSession::destroySession(int32_t sessionID) {
         return -ENOENT;
     }
 
-    mSessions.removeItemsAt(index);
+    const sp<Session> session = mSessions.valueAt(index);
+    if (mEpollFd >= 0 && session->epollEvents() != 0) {
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, session->socket(), NULL);
+        session->setEpollEvents(0);
+    }
 
-    interrupt();
+    mSessions.removeItemsAt(index);
 
     return OK;
 }
@@ -1139,7 +1326,7 @@ status_t ANetworkSession::createClientOrServer(
 
     mSessions.add(session->sessionID(), session);
 
-    interrupt();
+    updateEpollEvents_l(session);
 
     *sessionID = session->sessionID();
 
@@ -1206,7 +1393,29 @@ status_t ANetworkSession::sendRequest(
 
     status_t err = session->sendRequest(data, size, timeValid, timeUs);
 
-    interrupt();
+    // Only touches epoll if the session was not already waiting to write.
+    updateEpollEvents_l(session);
+
+    return err;
+}
+
+status_t ANetworkSession::sendDatagrams(
+        int32_t sessionID, const List<sp<ABuffer> > &datagrams,
+        bool timeValid, int64_t timeUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    ssize_t index = mSessions.indexOfKey(sessionID);
+
+    if (index < 0) {
+        return -ENOENT;
+    }
+
+    const sp<Session> session = mSessions.valueAt(index);
+
+    status_t err = session->sendDatagrams(datagrams, timeValid, timeUs);
+
+    // Anything sendmmsg couldn't take right away is left to the network thread.
+    updateEpollEvents_l(session);
 
     return err;
 }
@@ -1224,6 +1433,63 @@ status_t ANetworkSession::switchToWebSocketMode(int32_t sessionID) {
     return session->switchToWebSocketMode();
 }
 
+status_t ANetworkSession::setBatchedNotifications(int32_t sessionID, bool enable) {
+    Mutex::Autolock autoLock(mLock);
+
+    ssize_t index = mSessions.indexOfKey(sessionID);
+
+    if (index < 0) {
+        return -ENOENT;
+    }
+
+    mSessions.valueAt(index)->setBatchedNotifications(enable);
+
+    return OK;
+}
+
+void ANetworkSession::updateEpollEvents_l(const sp<Session> &session) {
+    int s = session->socket();
+
+    if (mEpollFd < 0 || s < 0) {
+        return;
+    }
+
+    uint32_t events = 0;
+    if (session->wantsToRead()) {
+        events |= EPOLLIN;
+    }
+    if (session->wantsToWrite()) {
+        events |= EPOLLOUT;
+    }
+
+    uint32_t registered = session->epollEvents();
+    if (events == registered) {
+        return;
+    }
+
+    int op;
+    if (events == 0) {
+        op = EPOLL_CTL_DEL;
+    } else if (registered == 0) {
+        op = EPOLL_CTL_ADD;
+    } else {
+        op = EPOLL_CTL_MOD;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u32 = session->sessionID();
+
+    if (epoll_ctl(mEpollFd, op, s, &ev) < 0) {
+        ALOGE("epoll_ctl(%d) on socket %d failed w/ error %d (%s)",
+              op, s, errno, strerror(errno));
+        return;
+    }
+
+    session->setEpollEvents(events);
+}
+
 void ANetworkSession::interrupt() {
     static const char dummy = 0;
 
@@ -1238,42 +1504,9 @@ void ANetworkSession::interrupt() {
 }
 
 void ANetworkSession::threadLoop() {
-    fd_set rs, ws;
-    FD_ZERO(&rs);
-    FD_ZERO(&ws);
-
-    FD_SET(mPipeFd[0], &rs);
-    int maxFd = mPipeFd[0];
-
-    {
-        Mutex::Autolock autoLock(mLock);
-
-        for (size_t i = 0; i < mSessions.size(); ++i) {
-            const sp<Session> &session = mSessions.valueAt(i);
-
-            int s = session->socket();
-
-            if (s < 0) {
-                continue;
-            }
+    struct epoll_event events[kMaxEpollEvents];
 
-            if (session->wantsToRead()) {
-                FD_SET(s, &rs);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
-            }
-
-            if (session->wantsToWrite()) {
-                FD_SET(s, &ws);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
-            }
-        }
-    }
-
-    int res = select(maxFd + 1, &rs, &ws, NULL, NULL /* tv */);
+    int res = epoll_wait(mEpollFd, events, kMaxEpollEvents, -1 /* timeout */);
 
     if (res == 0) {
         return;
@@ -1284,117 +1517,127 @@ void ANetworkSession::threadLoop() {
             return;
         }
 
-        ALOGE("select failed w/ error %d (%s)", errno, strerror(errno));
+        ALOGE("epoll_wait failed w/ error %d (%s)", errno, strerror(errno));
         return;
     }
 
-    if (FD_ISSET(mPipeFd[0], &rs)) {
-        char c;
-        ssize_t n;
-        do {
-            n = read(mPipeFd[0], &c, 1);
-        } while (n < 0 && errno == EINTR);
+    Mutex::Autolock autoLock(mLock);
 
-        if (n < 0) {
-            ALOGW("Error reading from pipe (%s)", strerror(errno));
+    List<sp<Session> > sessionsToAdd;
+
+    for (int i = 0; i < res; ++i) {
+        int32_t sessionID = events[i].data.u32;
+        uint32_t what = events[i].events;
+
+        if (sessionID == kPipeEventID) {
+            char tmp[64];
+            ssize_t n;
+            do {
+                n = read(mPipeFd[0], tmp, sizeof(tmp));
+            } while (n < 0 && errno == EINTR);
+
+            if (n < 0) {
+                ALOGW("Error reading from pipe (%s)", strerror(errno));
+            }
+            continue;
         }
 
-        --res;
-    }
+        ssize_t index = mSessions.indexOfKey(sessionID);
+        if (index < 0) {
+            // destroyed after epoll_wait returned
+            continue;
+        }
 
-    {
-        Mutex::Autolock autoLock(mLock);
+        const sp<Session> session = mSessions.valueAt(index);
 
-        List<sp<Session> > sessionsToAdd;
+        int s = session->socket();
 
-        for (size_t i = mSessions.size(); res > 0 && i > 0;) {
-            i--;
-            const sp<Session> &session = mSessions.valueAt(i);
+        // Errors and hangups are reported to whichever side is interested,
+        // the subsequent read or write surfaces the actual error.
+        bool readable = (what & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                && session->wantsToRead();
 
-            int s = session->socket();
+        bool writable = (what & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                && session->wantsToWrite();
 
-            if (s < 0) {
-                continue;
-            }
+        if (readable) {
+            if (session->isRTSPServer() || session->isTCPDatagramServer()) {
+                struct sockaddr_in remoteAddr;
+                socklen_t remoteAddrLen = sizeof(remoteAddr);
 
-            if (FD_ISSET(s, &rs) || FD_ISSET(s, &ws)) {
-                --res;
-            }
+                int clientSocket = accept(
+                        s, (struct sockaddr *)&remoteAddr, &remoteAddrLen);
 
-            if (FD_ISSET(s, &rs)) {
-                if (session->isRTSPServer() || session->isTCPDatagramServer()) {
-                    struct sockaddr_in remoteAddr;
-                    socklen_t remoteAddrLen = sizeof(remoteAddr);
-
-                    int clientSocket = accept(
-                            s, (struct sockaddr *)&remoteAddr, &remoteAddrLen);
-
-                    if (clientSocket >= 0) {
-                        status_t err = MakeSocketNonBlocking(clientSocket);
-
-                        if (err != OK) {
-                            ALOGE("Unable to make client socket non blocking, "
-                                  "failed w/ error %d (%s)",
-                                  err, strerror(-err));
-
-                            close(clientSocket);
-                            clientSocket = -1;
-                        } else {
-                            in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
-
-                            ALOGI("incoming connection from %d.%d.%d.%d:%d "
-                                  "(socket %d)",
-                                  (addr >> 24),
-                                  (addr >> 16) & 0xff,
-                                  (addr >> 8) & 0xff,
-                                  addr & 0xff,
-                                  ntohs(remoteAddr.sin_port),
-                                  clientSocket);
-
-                            sp<Session> clientSession =
-                                new Session(
-                                        mNextSessionID++,
-                                        Session::CONNECTED,
-                                        clientSocket,
-                                        session->getNotificationMessage());
-
-                            clientSession->setMode(
-                                    session->isRTSPServer()
-                                        ? Session::MODE_RTSP
-                                        : Session::MODE_DATAGRAM);
-
-                            sessionsToAdd.push_back(clientSession);
-                        }
+                if (clientSocket >= 0) {
+                    status_t err = MakeSocketNonBlocking(clientSocket);
+
+                    if (err != OK) {
+                        ALOGE("Unable to make client socket non blocking, "
+                              "failed w/ error %d (%s)",
+                              err, strerror(-err));
+
+                        close(clientSocket);
+                        clientSocket = -1;
                     } else {
-                        ALOGE("accept returned error %d (%s)",
-                              errno, strerror(errno));
+                        in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
+
+                        ALOGI("incoming connection from %d.%d.%d.%d:%d "
+                              "(socket %d)",
+                              (addr >> 24),
+                              (addr >> 16) & 0xff,
+                              (addr >> 8) & 0xff,
+                              addr & 0xff,
+                              ntohs(remoteAddr.sin_port),
+                              clientSocket);
+
+                        sp<Session> clientSession =
+                            new Session(
+                                    mNextSessionID++,
+                                    Session::CONNECTED,
+                                    clientSocket,
+                                    session->getNotificationMessage());
+
+                        clientSession->setMode(
+                                session->isRTSPServer()
+                                    ? Session::MODE_RTSP
+                                    : Session::MODE_DATAGRAM);
+
+                        sessionsToAdd.push_back(clientSession);
                     }
                 } else {
-                    status_t err = session->readMore();
-                    if (err != OK) {
-                        ALOGE("readMore on socket %d failed w/ error %d (%s)",
-                              s, err, strerror(-err));
-                    }
+                    ALOGE("accept returned error %d (%s)",
+                          errno, strerror(errno));
                 }
-            }
-
-            if (FD_ISSET(s, &ws)) {
-                status_t err = session->writeMore();
+            } else {
+                status_t err = session->readMore();
                 if (err != OK) {
-                    ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+                    ALOGE("readMore on socket %d failed w/ error %d (%s)",
                           s, err, strerror(-err));
                 }
             }
         }
 
-        while (!sessionsToAdd.empty()) {
-            sp<Session> session = *sessionsToAdd.begin();
-            sessionsToAdd.erase(sessionsToAdd.begin());
+        if (writable && session->wantsToWrite()) {
+            status_t err = session->writeMore();
+            if (err != OK) {
+                ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+                      s, err, strerror(-err));
+            }
+        }
 
-            mSessions.add(session->sessionID(), session);
+        // Drop EPOLLOUT once the output queue drained, stop polling a
+        // session that saw a fatal error.
+        updateEpollEvents_l(session);
+    }
 
-            ALOGI("added clientSession %d", session->sessionID());
-        }
+    while (!sessionsToAdd.empty()) {
+        sp<Session> session = *sessionsToAdd.begin();
+        sessionsToAdd.erase(sessionsToAdd.begin());
+
+        mSessions.add(session->sessionID(), session);
+        updateEpollEvents_l(session);
+
+        ALOGI("added clientSession %d", session->sessionID());
     }
 }
 
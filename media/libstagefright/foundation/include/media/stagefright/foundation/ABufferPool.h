@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef A_BUFFER_POOL_H_
+
+#define A_BUFFER_POOL_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct ABuffer;
+
+// Hands out ABuffers of a fixed capacity whose memory goes back to the pool
+// once their last reference is gone, on whichever thread that happens. Up to
+// |maxNumFree| returned blocks are kept for reuse, the rest are freed.
+struct ABufferPool : public RefBase {
+    ABufferPool(size_t bufferSize, size_t maxNumFree);
+
+    size_t bufferSize() const { return mBufferSize; }
+    size_t numFree() const;
+
+    sp<ABuffer> acquire();
+
+protected:
+    virtual ~ABufferPool();
+
+private:
+    struct PooledBuffer;
+
+    mutable Mutex mLock;
+    size_t mBufferSize;
+    size_t mMaxNumFree;
+    Vector<void *> mFreeBuffers;
+
+    void release(void *data);
+
+    DISALLOW_EVIL_CONSTRUCTORS(ABufferPool);
+};
+
+}  // namespace android
+
+#endif  // A_BUFFER_POOL_H_
@@ -20,6 +20,7 @@
 
 #include <media/stagefright/foundation/ABase.h>
 #include <utils/KeyedVector.h>
+#include <utils/List.h>
 #include <utils/RefBase.h>
 #include <utils/Thread.h>
 
@@ -27,6 +28,7 @@
 
 namespace android {
 
+struct ABuffer;
 struct AMessage;
 
 // Helper class to manage a number of live sockets (datagram and stream-based)
@@ -77,8 +79,22 @@ struct ANetworkSession : public RefBase {
             int32_t sessionID, const void *data, ssize_t size = -1,
             bool timeValid = false, int64_t timeUs = -1ll);
 
+    // Queues |datagrams| on a UDP session without copying them. Unless earlier
+    // datagrams are still waiting for the socket, they are sent right away on
+    // the calling thread with a single sendmmsg. The buffers must not be
+    // modified afterwards.
+    status_t sendDatagrams(
+            int32_t sessionID, const List<sp<ABuffer> > &datagrams,
+            bool timeValid = false, int64_t timeUs = -1ll);
+
     status_t switchToWebSocketMode(int32_t sessionID);
 
+    // Datagrams received on a UDP session in a single wake-up are posted as
+    // one kWhatDatagrams notification carrying "count" buffers "data0".."dataN",
+    // with "fromAddr"/"fromPort" in each buffer's meta, instead of one
+    // kWhatDatagram notification per packet.
+    status_t setBatchedNotifications(int32_t sessionID, bool enable);
+
     enum NotificationReason {
         kWhatError,
         kWhatConnected,
@@ -88,6 +104,7 @@ struct ANetworkSession : public RefBase {
         kWhatBinaryData,
         kWhatWebSocketMessage,
         kWhatNetworkStall,
+        kWhatDatagrams,
     };
 
 protected:
@@ -103,6 +120,7 @@ private:
     int32_t mNextSessionID;
 
     int mPipeFd[2];
+    int mEpollFd;
 
     KeyedVector<int32_t, sp<Session> > mSessions;
 
@@ -125,6 +143,9 @@ private:
     void threadLoop();
     void interrupt();
 
+    void updateEpollEvents_l(const sp<Session> &session);
+    void closeEpoll();
+
     static status_t MakeSocketNonBlocking(int s);
 
     DISALLOW_EVIL_CONSTRUCTORS(ANetworkSession);
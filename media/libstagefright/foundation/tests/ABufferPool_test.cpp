@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <utils/Log.h>
+
+#include "gtest/gtest.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ABufferPool.h>
+
+#include <utils/RefBase.h>
+
+namespace android {
+
+class ABufferPoolTest : public ::testing::Test {
+};
+
+TEST_F(ABufferPoolTest, ReusesReleasedMemory) {
+    sp<ABufferPool> pool = new ABufferPool(1024, 4);
+
+    sp<ABuffer> buffer = pool->acquire();
+    ASSERT_EQ(buffer->capacity(), 1024u);
+    uint8_t *base = buffer->base();
+    buffer.clear();
+    EXPECT_EQ(pool->numFree(), 1u);
+
+    buffer = pool->acquire();
+    EXPECT_EQ(buffer->base(), base);
+    EXPECT_EQ(buffer->size(), 1024u);
+    EXPECT_EQ(pool->numFree(), 0u);
+}
+
+TEST_F(ABufferPoolTest, KeepsAtMostMaxNumFree) {
+    sp<ABufferPool> pool = new ABufferPool(256, 2);
+
+    sp<ABuffer> buffers[4];
+    for (size_t i = 0; i < 4; ++i) {
+        buffers[i] = pool->acquire();
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        buffers[i].clear();
+    }
+    EXPECT_EQ(pool->numFree(), 2u);
+}
+
+TEST_F(ABufferPoolTest, BuffersOutliveCallerReference) {
+    sp<ABufferPool> pool = new ABufferPool(64, 1);
+    sp<ABuffer> buffer = pool->acquire();
+    wp<ABufferPool> weakPool = pool;
+
+    // The pool stays around for as long as one of its buffers does.
+    pool.clear();
+    EXPECT_TRUE(weakPool.promote() != NULL);
+    buffer.clear();
+    EXPECT_TRUE(weakPool.promote() == NULL);
+}
+
+}  // namespace android
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ANetworkSession_test"
+#include <utils/Log.h>
+
+#include "gtest/gtest.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/ANetworkSession.h>
+#include <media/stagefright/foundation/AString.h>
+
+#include <utils/Condition.h>
+#include <utils/List.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+namespace {
+
+const unsigned kBasePort = 15550;
+const size_t kNumPackets = 4096;
+const size_t kPacketSize = 7 * 188;
+// Packets in flight before the sender waits for the receiver to catch up,
+// so that the loopback socket buffer never overflows.
+const size_t kMaxInFlight = 64;
+const int64_t kTimeoutNs = 5000000000ll;
+// An access unit's worth of RTP packets, sent back to back.
+const size_t kNumBursts = 200;
+const size_t kPacketsPerBurst = 16;
+
+struct DatagramCounter : public AHandler {
+    DatagramCounter()
+        : mNumPackets(0),
+          mNumNotifications(0),
+          mNumBytes(0) {
+    }
+
+    // Waits until at least |count| packets have been received.
+    bool waitFor(size_t count) {
+        Mutex::Autolock autoLock(mLock);
+        while (mNumPackets < count) {
+            if (mCondition.waitRelative(mLock, kTimeoutNs) != OK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t numNotifications() {
+        Mutex::Autolock autoLock(mLock);
+        return mNumNotifications;
+    }
+
+    size_t numBytes() {
+        Mutex::Autolock autoLock(mLock);
+        return mNumBytes;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        int32_t reason;
+        CHECK(msg->findInt32("reason", &reason));
+
+        Mutex::Autolock autoLock(mLock);
+
+        if (reason == ANetworkSession::kWhatDatagram) {
+            sp<ABuffer> data;
+            CHECK(msg->findBuffer("data", &data));
+            addPacket_l(data);
+        } else if (reason == ANetworkSession::kWhatDatagrams) {
+            size_t count;
+            CHECK(msg->findSize("count", &count));
+            for (size_t i = 0; i < count; ++i) {
+                sp<ABuffer> data;
+                CHECK(msg->findBuffer(AStringPrintf("data%zu", i).c_str(), &data));
+                addPacket_l(data);
+            }
+        } else {
+            return;
+        }
+
+        ++mNumNotifications;
+        mCondition.broadcast();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    size_t mNumPackets;
+    size_t mNumNotifications;
+    size_t mNumBytes;
+
+    void addPacket_l(const sp<ABuffer> &data) {
+        ++mNumPackets;
+        mNumBytes += data->size();
+    }
+};
+
+}  // namespace
+
+class ANetworkSessionTest : public ::testing::TestWithParam<bool> {
+public:
+    virtual void SetUp() {
+        mNetSession = new ANetworkSession;
+        ASSERT_EQ(OK, mNetSession->start());
+
+        mLooper = new ALooper;
+        mLooper->setName("ANetworkSessionTest");
+        mLooper->start();
+
+        mCounter = new DatagramCounter;
+        mLooper->registerHandler(mCounter);
+    }
+
+    virtual void TearDown() {
+        mLooper->stop();
+        mNetSession->stop();
+    }
+
+protected:
+    sp<ANetworkSession> mNetSession;
+    sp<ALooper> mLooper;
+    sp<DatagramCounter> mCounter;
+
+    // Creates a receiving UDP session and one sending to it over loopback.
+    void createSessionPair(int32_t *recvSessionID, int32_t *sendSessionID) {
+        sp<AMessage> notify = new AMessage(0, mCounter);
+
+        *recvSessionID = 0;
+        *sendSessionID = 0;
+        for (unsigned port = kBasePort; port < kBasePort + 100; port += 2) {
+            if (mNetSession->createUDPSession(port, notify, recvSessionID) != OK) {
+                continue;
+            }
+            if (mNetSession->createUDPSession(
+                        port + 1, "127.0.0.1", port, notify, sendSessionID) == OK) {
+                break;
+            }
+            mNetSession->destroySession(*recvSessionID);
+            *recvSessionID = 0;
+        }
+    }
+};
+
+TEST_P(ANetworkSessionTest, LoopbackPacketRate) {
+    const bool batched = GetParam();
+
+    int32_t recvSessionID;
+    int32_t sendSessionID;
+    createSessionPair(&recvSessionID, &sendSessionID);
+    ASSERT_NE(0, sendSessionID);
+
+    ASSERT_EQ(OK, mNetSession->setBatchedNotifications(recvSessionID, batched));
+
+    uint8_t payload[kPacketSize];
+    memset(payload, 0x47, sizeof(payload));
+
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < kNumPackets; ++i) {
+        if (i >= kMaxInFlight) {
+            ASSERT_TRUE(mCounter->waitFor(i - kMaxInFlight + 1));
+        }
+        ASSERT_EQ(OK, mNetSession->sendRequest(sendSessionID, payload, sizeof(payload)));
+    }
+    ASSERT_TRUE(mCounter->waitFor(kNumPackets));
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    EXPECT_EQ(kNumPackets * kPacketSize, mCounter->numBytes());
+    if (!batched) {
+        EXPECT_EQ(kNumPackets, mCounter->numNotifications());
+    }
+
+    ALOGI("%s: %zu packets in %lld us, %.0f packets/sec, %zu notifications",
+          batched ? "batched" : "per-packet",
+          kNumPackets,
+          (long long)elapsedUs,
+          kNumPackets * 1E6 / (elapsedUs > 0 ? elapsedUs : 1),
+          mCounter->numNotifications());
+
+    mNetSession->destroySession(sendSessionID);
+    mNetSession->destroySession(recvSessionID);
+}
+
+// Measures how long a burst of packets takes from being queued until the last
+// of them is received, with per-packet sendRequest or a single sendDatagrams.
+TEST_P(ANetworkSessionTest, LoopbackBurstLatency) {
+    const bool batched = GetParam();
+
+    int32_t recvSessionID;
+    int32_t sendSessionID;
+    createSessionPair(&recvSessionID, &sendSessionID);
+    ASSERT_NE(0, sendSessionID);
+
+    ASSERT_EQ(OK, mNetSession->setBatchedNotifications(recvSessionID, true));
+
+    int64_t sumLatencyUs = 0;
+    int64_t maxLatencyUs = 0;
+    for (size_t i = 0; i < kNumBursts; ++i) {
+        List<sp<ABuffer> > packets;
+        for (size_t j = 0; j < kPacketsPerBurst; ++j) {
+            sp<ABuffer> packet = new ABuffer(kPacketSize);
+            memset(packet->data(), (int)j, packet->size());
+            packets.push_back(packet);
+        }
+
+        int64_t startUs = ALooper::GetNowUs();
+        if (batched) {
+            ASSERT_EQ(OK, mNetSession->sendDatagrams(sendSessionID, packets));
+        } else {
+            for (List<sp<ABuffer> >::iterator it = packets.begin();
+                    it != packets.end(); ++it) {
+                ASSERT_EQ(OK, mNetSession->sendRequest(
+                            sendSessionID, (*it)->data(), (*it)->size()));
+            }
+        }
+        ASSERT_TRUE(mCounter->waitFor((i + 1) * kPacketsPerBurst));
+        int64_t latencyUs = ALooper::GetNowUs() - startUs;
+
+        sumLatencyUs += latencyUs;
+        if (latencyUs > maxLatencyUs) {
+            maxLatencyUs = latencyUs;
+        }
+    }
+
+    EXPECT_EQ(kNumBursts * kPacketsPerBurst * kPacketSize, mCounter->numBytes());
+
+    ALOGI("%s: %zu bursts of %zu packets, avg latency %lld us, max %lld us",
+          batched ? "sendDatagrams" : "sendRequest",
+          kNumBursts,
+          kPacketsPerBurst,
+          (long long)(sumLatencyUs / kNumBursts),
+          (long long)maxLatencyUs);
+
+    mNetSession->destroySession(sendSessionID);
+    mNetSession->destroySession(recvSessionID);
+}
+
+INSTANTIATE_TEST_CASE_P(
+        Batching, ANetworkSessionTest, ::testing::Values(false, true));
+
+}  // namespace android
@@ -56,6 +56,10 @@ const int64_t PlaylistFetcher::kMaxMonitorDelayUs = 3000000LL;
 // LCM of 188 (size of a TS packet) & 1k works well
 const int32_t PlaylistFetcher::kDownloadBlockSize = 47 * 1024;
 
+// A stream at its memory cap only holds off downloads while every other stream
+// has at least this much buffered.
+static const int64_t kFullStreamLowMarkUs = 10000000LL;
+
 struct PlaylistFetcher::DownloadState : public RefBase {
     DownloadState();
     void resetState();
@@ -872,6 +876,8 @@ void PlaylistFetcher::onMonitorQueue() {
 
     int64_t bufferedDurationUs = 0LL;
     status_t finalResult = OK;
+    bool full = false;
+    bool othersLow = false;
     if (mStreamTypeMask == LiveSession::STREAMTYPE_SUBTITLES) {
         sp<AnotherPacketSource> packetSource =
             mPacketSources.valueFor(LiveSession::STREAMTYPE_SUBTITLES);
@@ -892,6 +898,11 @@ void PlaylistFetcher::onMonitorQueue() {
 
             int64_t bufferedStreamDurationUs =
                 mPacketSources.valueAt(i)->getBufferedDurationUs(&finalResult);
+            if (mPacketSources.valueAt(i)->isFull()) {
+                full = true;
+            } else if (bufferedStreamDurationUs < kFullStreamLowMarkUs) {
+                othersLow = true;
+            }
 
             FSLOGV(mPacketSources.keyAt(i), "buffered %lld", (long long)bufferedStreamDurationUs);
 
@@ -905,7 +916,11 @@ void PlaylistFetcher::onMonitorQueue() {
         }
     }
 
-    if (finalResult == OK && bufferedDurationUs < kMinBufferedDurationUs) {
+    // Segments carry all streams, so one at its memory cap must not starve
+    // another that is running low.
+    full = full && !othersLow;
+
+    if (finalResult == OK && bufferedDurationUs < kMinBufferedDurationUs && !full) {
         FLOGV("monitoring, buffered=%lld < %lld",
                 (long long)bufferedDurationUs, (long long)kMinBufferedDurationUs);
 
@@ -920,6 +935,9 @@ void PlaylistFetcher::onMonitorQueue() {
         // again when buffer just about to go below durationToBufferUs
         // (or after targetDurationUs / 2, whichever is smaller).
         int64_t delayUs = bufferedDurationUs - kMinBufferedDurationUs + 1000000LL;
+        if (full && delayUs < 1000000LL) {
+            delayUs = 1000000LL;
+        }
         if (delayUs > targetDurationUs / 2) {
             delayUs = targetDurationUs / 2;
         }
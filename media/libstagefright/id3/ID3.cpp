@@ -331,31 +331,21 @@ struct id3_header {
     // tools do the right thing and not apply double-unsynchronization,
     // but will honor the flags if they are set.
     if (header.version_major == 4) {
-        void *copy = malloc(size);
-        if (copy == NULL) {
-            free(mData);
-            mData = NULL;
-            ALOGE("b/24623447, no more memory");
-            return false;
-        }
-
-        memcpy(copy, mData, size);
-
-        bool success = removeUnsynchronizationV2_4(false /* iTunesHack */);
-        if (!success) {
-            memcpy(mData, copy, size);
-            mSize = size;
-
+        // Validate the frame headers before touching the data, so that a tag
+        // that needs the iTunes hack doesn't have to be restored from a copy,
+        // and one without per-frame flags isn't rewritten at all.
+        bool needsRewrite;
+        bool success = true;
+        if (!scanFramesV2_4(&needsRewrite)) {
             success = removeUnsynchronizationV2_4(true /* iTunesHack */);
 
             if (success) {
                 ALOGV("Had to apply the iTunes hack to parse this ID3 tag");
             }
+        } else if (needsRewrite) {
+            success = removeUnsynchronizationV2_4(false /* iTunesHack */);
         }
 
-        free(copy);
-        copy = NULL;
-
         if (!success) {
             free(mData);
             mData = NULL;
@@ -364,8 +354,6 @@ struct id3_header {
         }
     }
 
-
-
     if (header.version_major == 2) {
         mVersion = ID3_V2_2;
     } else if (header.version_major == 3) {
@@ -375,6 +363,47 @@ struct id3_header {
         mVersion = ID3_V2_4;
     }
 
+    buildFrameIndex();
+
+    return true;
+}
+
+// Performs the checks of removeUnsynchronizationV2_4(false) without modifying
+// the data. Removing a data length indicator or unsynchronization shrinks a
+// frame and moves everything after it down by the same amount, so each frame
+// header is validated against the same number of remaining bytes here as it
+// would be after the preceding frames were rewritten.
+bool ID3::scanFramesV2_4(bool *needsRewrite) const {
+    *needsRewrite = false;
+
+    size_t offset = mFirstFrameOffset;
+    while (mSize >= 10 && offset <= mSize - 10) {
+        if (!memcmp(&mData[offset], "\0\0\0\0", 4)) {
+            break;
+        }
+
+        size_t dataSize;
+        if (!ParseSyncsafeInteger(&mData[offset + 4], &dataSize)) {
+            return false;
+        }
+
+        if (dataSize > mSize - 10 - offset) {
+            return false;
+        }
+
+        uint16_t flags = U16_AT(&mData[offset + 8]);
+
+        if ((flags & 1) && dataSize < 4) {
+            return false;
+        }
+
+        if (flags & 3) {
+            *needsRewrite = true;
+        }
+
+        offset += 10 + dataSize;
+    }
+
     return true;
 }
 
@@ -400,6 +429,103 @@ void ID3::removeUnsynchronization() {
 
 }
 
+// static
+uint32_t ID3::PackFrameID(const char *id, size_t length) {
+    // Like comparing the ids as C strings, anything from the first NUL on
+    // is ignored.
+    uint32_t packed = 0;
+    bool ended = false;
+    for (size_t i = 0; i < 4; ++i) {
+        ended = ended || i >= length || id[i] == '\0';
+        packed = (packed << 8) | (ended ? 0 : (uint8_t)id[i]);
+    }
+    return packed;
+}
+
+void ID3::buildFrameIndex() {
+    mFrames.clear();
+
+    if (mVersion != ID3_V2_2 && mVersion != ID3_V2_3 && mVersion != ID3_V2_4) {
+        return;
+    }
+
+    const size_t headerLength = (mVersion == ID3_V2_2) ? 6 : 10;
+    const size_t idLength = (mVersion == ID3_V2_2) ? 3 : 4;
+
+    size_t offset = mFirstFrameOffset;
+    for (;;) {
+        if (offset + headerLength > mSize) {
+            break;
+        }
+
+        if (!memcmp(&mData[offset], "\0\0\0\0", idLength)) {
+            break;
+        }
+
+        size_t baseSize;
+        if (mVersion == ID3_V2_2) {
+            baseSize = (mData[offset + 3] << 16)
+                | (mData[offset + 4] << 8)
+                | mData[offset + 5];
+        } else if (mVersion == ID3_V2_4) {
+            if (!ParseSyncsafeInteger(&mData[offset + 4], &baseSize)) {
+                break;
+            }
+        } else {
+            baseSize = U32_AT(&mData[offset + 4]);
+        }
+
+        if (baseSize == 0) {
+            break;
+        }
+
+        // Prevent integer overflow when adding
+        if (SIZE_MAX - headerLength <= baseSize) {
+            break;
+        }
+
+        size_t frameSize = headerLength + baseSize;
+
+        // Prevent integer overflow in validation
+        if (SIZE_MAX - offset <= frameSize) {
+            break;
+        }
+
+        if (offset + frameSize > mSize) {
+            ALOGV("partial frame at offset %zu (size = %zu, bytes-remaining = %zu)",
+                offset, frameSize, mSize - offset - headerLength);
+            break;
+        }
+
+        if (mVersion != ID3_V2_2) {
+            uint16_t flags = U16_AT(&mData[offset + 8]);
+
+            if ((mVersion == ID3_V2_4 && (flags & 0x000c))
+                || (mVersion == ID3_V2_3 && (flags & 0x00c0))) {
+                // Compression or encryption are not supported at this time.
+                // Per-frame unsynchronization and data-length indicator
+                // have already been taken care of.
+
+                ALOGV("Skipping unsupported frame (compression, encryption "
+                     "or per-frame unsynchronization flagged");
+
+                offset += frameSize;
+                continue;
+            }
+        }
+
+        FrameInfo frame;
+        frame.mOffset = offset;
+        frame.mSize = frameSize;
+        frame.mID = PackFrameID((const char *)&mData[offset], idLength);
+        mFrames.push(frame);
+
+        offset += frameSize;
+    }
+
+    ALOGV("indexed %zu frames", mFrames.size());
+}
+
 static void WriteSyncsafeInteger(uint8_t *dst, size_t x) {
     for (size_t i = 0; i < 4; ++i) {
         dst[3 - i] = (x & 0x7f);
@@ -407,37 +533,47 @@ static void WriteSyncsafeInteger(uint8_t *dst, size_t x) {
     }
 }
 
+// Frames are compacted in a single pass: |readOffset| walks the original
+// frames and |writeOffset| trails behind it by the number of bytes removed so
+// far, instead of moving the rest of the tag down after every frame.
 bool ID3::removeUnsynchronizationV2_4(bool iTunesHack) {
     size_t oldSize = mSize;
 
-    size_t offset = mFirstFrameOffset;
-    while (mSize >= 10 && offset <= mSize - 10) {
-        if (!memcmp(&mData[offset], "\0\0\0\0", 4)) {
+    size_t readOffset = mFirstFrameOffset;
+    size_t writeOffset = mFirstFrameOffset;
+    while (oldSize >= 10 && readOffset <= oldSize - 10) {
+        if (!memcmp(&mData[readOffset], "\0\0\0\0", 4)) {
             break;
         }
 
         size_t dataSize;
         if (iTunesHack) {
-            dataSize = U32_AT(&mData[offset + 4]);
-        } else if (!ParseSyncsafeInteger(&mData[offset + 4], &dataSize)) {
+            dataSize = U32_AT(&mData[readOffset + 4]);
+        } else if (!ParseSyncsafeInteger(&mData[readOffset + 4], &dataSize)) {
             return false;
         }
 
-        if (dataSize > mSize - 10 - offset) {
+        if (dataSize > oldSize - 10 - readOffset) {
             return false;
         }
 
-        uint16_t flags = U16_AT(&mData[offset + 8]);
+        uint16_t flags = U16_AT(&mData[readOffset + 8]);
         uint16_t prevFlags = flags;
 
+        size_t headerOffset = writeOffset;
+        if (writeOffset != readOffset) {
+            memmove(&mData[writeOffset], &mData[readOffset], 10);
+        }
+        readOffset += 10;
+        writeOffset += 10;
+
         if (flags & 1) {
             // Strip data length indicator
 
-            if (mSize < 14 || mSize - 14 < offset || dataSize < 4) {
+            if (dataSize < 4) {
                 return false;
             }
-            memmove(&mData[offset + 10], &mData[offset + 14], mSize - offset - 14);
-            mSize -= 4;
+            readOffset += 4;
             dataSize -= 4;
 
             flags &= ~1;
@@ -446,14 +582,14 @@ bool ID3::removeUnsynchronizationV2_4(bool iTunesHack) {
         if ((flags & 2) && (dataSize >= 2)) {
             // This frame has "unsynchronization", so we have to replace occurrences
             // of 0xff 0x00 with just 0xff in order to get the real data.
+            // Bytes are only ever written at or before the one being read, so
+            // mData[readOffset - 1] is still the original data.
 
-            size_t readOffset = offset + 11;
-            size_t writeOffset = offset + 11;
+            mData[writeOffset++] = mData[readOffset++];
             for (size_t i = 0; i + 1 < dataSize; ++i) {
                 if (mData[readOffset - 1] == 0xff
                         && mData[readOffset] == 0x00) {
                     ++readOffset;
-                    --mSize;
                     --dataSize;
                 }
                 if (i + 1 < dataSize) {
@@ -463,24 +599,27 @@ bool ID3::removeUnsynchronizationV2_4(bool iTunesHack) {
                     mData[writeOffset++] = mData[readOffset++];
                 }
             }
-            // move the remaining data following this frame
-            if (readOffset <= oldSize) {
-                memmove(&mData[writeOffset], &mData[readOffset], oldSize - readOffset);
-            } else {
-                ALOGE("b/34618607 (%zu %zu %zu %zu)", readOffset, writeOffset, oldSize, mSize);
-                android_errorWriteLog(0x534e4554, "34618607");
+        } else {
+            if (writeOffset != readOffset) {
+                memmove(&mData[writeOffset], &mData[readOffset], dataSize);
             }
-
+            readOffset += dataSize;
+            writeOffset += dataSize;
         }
+
         flags &= ~2;
         if (flags != prevFlags || iTunesHack) {
-            WriteSyncsafeInteger(&mData[offset + 4], dataSize);
-            mData[offset + 8] = flags >> 8;
-            mData[offset + 9] = flags & 0xff;
+            WriteSyncsafeInteger(&mData[headerOffset + 4], dataSize);
+            mData[headerOffset + 8] = flags >> 8;
+            mData[headerOffset + 9] = flags & 0xff;
         }
+    }
 
-        offset += 10 + dataSize;
+    // keep whatever follows the last frame, e.g. padding
+    if (writeOffset != readOffset) {
+        memmove(&mData[writeOffset], &mData[readOffset], oldSize - readOffset);
     }
+    mSize = oldSize - (readOffset - writeOffset);
 
     memset(&mData[mSize], 0, oldSize - mSize);
 
@@ -490,11 +629,20 @@ bool ID3::removeUnsynchronizationV2_4(bool iTunesHack) {
 ID3::Iterator::Iterator(const ID3 &parent, const char *id)
     : mParent(parent),
       mID(NULL),
+      mPackedID(0),
+      mHasPackedID(false),
       mOffset(mParent.mFirstFrameOffset),
+      mFrameIndex(0),
       mFrameData(NULL),
       mFrameSize(0) {
     if (id) {
         mID = strdup(id);
+
+        size_t idLength = (mParent.mVersion == ID3_V2_2) ? 3 : 4;
+        if (strlen(id) <= idLength) {
+            mPackedID = PackFrameID(id, idLength);
+            mHasPackedID = true;
+        }
     }
 
     findFrame();
@@ -517,6 +665,7 @@ void ID3::Iterator::next() {
     }
 
     mOffset += mFrameSize;
+    ++mFrameIndex;
 
     findFrame();
 }
@@ -746,169 +895,77 @@ size_t ID3::Iterator::getHeaderLength() const {
 }
 
 void ID3::Iterator::findFrame() {
-    for (;;) {
+    if (mParent.mVersion == ID3_V2_2
+            || mParent.mVersion == ID3_V2_3
+            || mParent.mVersion == ID3_V2_4) {
         mFrameData = NULL;
         mFrameSize = 0;
 
-        if (mParent.mVersion == ID3_V2_2) {
-            if (mOffset + 6 > mParent.mSize) {
-                return;
-            }
+        if (mID && !mHasPackedID) {
+            return;
+        }
 
-            if (!memcmp(&mParent.mData[mOffset], "\0\0\0", 3)) {
+        const size_t headerLength = getHeaderLength();
+        for (; mFrameIndex < mParent.mFrames.size(); ++mFrameIndex) {
+            const FrameInfo &frame = mParent.mFrames[mFrameIndex];
+            if (!mID || frame.mID == mPackedID) {
+                mOffset = frame.mOffset;
+                mFrameSize = frame.mSize;
+                mFrameData = &mParent.mData[mOffset + headerLength];
                 return;
             }
+        }
+        return;
+    }
 
-            mFrameSize =
-                (mParent.mData[mOffset + 3] << 16)
-                | (mParent.mData[mOffset + 4] << 8)
-                | mParent.mData[mOffset + 5];
-
-            if (mFrameSize == 0) {
-                return;
-            }
-            mFrameSize += 6; // add tag id and size field
+    CHECK(mParent.mVersion == ID3_V1 || mParent.mVersion == ID3_V1_1);
 
-            // Prevent integer overflow in validation
-            if (SIZE_MAX - mOffset <= mFrameSize) {
-                return;
-            }
+    for (;;) {
+        mFrameData = NULL;
+        mFrameSize = 0;
 
-            if (mOffset + mFrameSize > mParent.mSize) {
-                ALOGV("partial frame at offset %zu (size = %zu, bytes-remaining = %zu)",
-                    mOffset, mFrameSize, mParent.mSize - mOffset - (size_t)6);
-                return;
-            }
+        if (mOffset >= mParent.mSize) {
+            return;
+        }
 
-            mFrameData = &mParent.mData[mOffset + 6];
+        mFrameData = &mParent.mData[mOffset];
 
-            if (!mID) {
+        switch (mOffset) {
+            case 3:
+            case 33:
+            case 63:
+                mFrameSize = 30;
                 break;
-            }
-
-            char id[4];
-            memcpy(id, &mParent.mData[mOffset], 3);
-            id[3] = '\0';
-
-            if (!strcmp(id, mID)) {
+            case 93:
+                mFrameSize = 4;
                 break;
-            }
-        } else if (mParent.mVersion == ID3_V2_3
-                || mParent.mVersion == ID3_V2_4) {
-            if (mOffset + 10 > mParent.mSize) {
-                return;
-            }
-
-            if (!memcmp(&mParent.mData[mOffset], "\0\0\0\0", 4)) {
-                return;
-            }
-
-            size_t baseSize = 0;
-            if (mParent.mVersion == ID3_V2_4) {
-                if (!ParseSyncsafeInteger(
-                            &mParent.mData[mOffset + 4], &baseSize)) {
-                    return;
+            case 97:
+                if (mParent.mVersion == ID3_V1) {
+                    mFrameSize = 30;
+                } else {
+                    mFrameSize = 29;
                 }
-            } else {
-                baseSize = U32_AT(&mParent.mData[mOffset + 4]);
-            }
-
-            if (baseSize == 0) {
-                return;
-            }
-
-            // Prevent integer overflow when adding
-            if (SIZE_MAX - 10 <= baseSize) {
-                return;
-            }
-
-            mFrameSize = 10 + baseSize; // add tag id, size field and flags
-
-            // Prevent integer overflow in validation
-            if (SIZE_MAX - mOffset <= mFrameSize) {
-                return;
-            }
-
-            if (mOffset + mFrameSize > mParent.mSize) {
-                ALOGV("partial frame at offset %zu (size = %zu, bytes-remaining = %zu)",
-                    mOffset, mFrameSize, mParent.mSize - mOffset - (size_t)10);
-                return;
-            }
-
-            uint16_t flags = U16_AT(&mParent.mData[mOffset + 8]);
-
-            if ((mParent.mVersion == ID3_V2_4 && (flags & 0x000c))
-                || (mParent.mVersion == ID3_V2_3 && (flags & 0x00c0))) {
-                // Compression or encryption are not supported at this time.
-                // Per-frame unsynchronization and data-length indicator
-                // have already been taken care of.
-
-                ALOGV("Skipping unsupported frame (compression, encryption "
-                     "or per-frame unsynchronization flagged");
-
-                mOffset += mFrameSize;
-                continue;
-            }
-
-            mFrameData = &mParent.mData[mOffset + 10];
-
-            if (!mID) {
                 break;
-            }
-
-            char id[5];
-            memcpy(id, &mParent.mData[mOffset], 4);
-            id[4] = '\0';
-
-            if (!strcmp(id, mID)) {
+            case 126:
+                mFrameSize = 1;
                 break;
-            }
-        } else {
-            CHECK(mParent.mVersion == ID3_V1 || mParent.mVersion == ID3_V1_1);
-
-            if (mOffset >= mParent.mSize) {
-                return;
-            }
-
-            mFrameData = &mParent.mData[mOffset];
-
-            switch (mOffset) {
-                case 3:
-                case 33:
-                case 63:
-                    mFrameSize = 30;
-                    break;
-                case 93:
-                    mFrameSize = 4;
-                    break;
-                case 97:
-                    if (mParent.mVersion == ID3_V1) {
-                        mFrameSize = 30;
-                    } else {
-                        mFrameSize = 29;
-                    }
-                    break;
-                case 126:
-                    mFrameSize = 1;
-                    break;
-                case 127:
-                    mFrameSize = 1;
-                    break;
-                default:
-                    CHECK(!"Should not be here, invalid offset.");
-                    break;
-            }
-
-            if (!mID) {
+            case 127:
+                mFrameSize = 1;
                 break;
-            }
+            default:
+                CHECK(!"Should not be here, invalid offset.");
+                break;
+        }
 
-            String8 id;
-            getID(&id);
+        if (!mID) {
+            break;
+        }
 
-            if (id == mID) {
-                break;
-            }
+        String8 id;
+        getID(&id);
+
+        if (id == mID) {
+            break;
         }
 
         mOffset += mFrameSize;
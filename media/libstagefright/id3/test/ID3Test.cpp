@@ -20,9 +20,11 @@
 
 #include <ctype.h>
 #include <string>
+#include <vector>
 #include <sys/stat.h>
 #include <datasource/FileSource.h>
 
+#include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/hexdump.h>
 #include <media/MediaExtractorPluginHelper.h>
 #include <ID3.h>
@@ -158,6 +160,120 @@ TEST_P(ID3multiAlbumArtTest, MultiAlbumArtTest) {
                                   << " album arts! \n";
 }
 
+// A v2.4 tag as written by taggers that store many text frames next to a
+// large cover, with some of the frames unsynchronized.
+static const size_t kNumTextFrames = 2000;
+static const size_t kAlbumArtSize = 1024 * 1024;
+static const size_t kNumParses = 50;
+
+static void appendSyncsafeInteger(vector<uint8_t> *tag, size_t x) {
+    for (int i = 3; i >= 0; --i) {
+        tag->push_back((x >> (7 * i)) & 0x7f);
+    }
+}
+
+static void appendFrame(vector<uint8_t> *tag, const char *id, uint16_t flags,
+                        const vector<uint8_t> &data) {
+    tag->insert(tag->end(), id, id + 4);
+    appendSyncsafeInteger(tag, data.size());
+    tag->push_back(flags >> 8);
+    tag->push_back(flags & 0xff);
+    tag->insert(tag->end(), data.begin(), data.end());
+}
+
+static vector<uint8_t> makeTagHeavyTag() {
+    static const char *kTextIDs[] = {"TIT2", "TPE1", "TPE2", "TCOM", "TCON", "TRCK"};
+    static const size_t kNumTextIDs = sizeof(kTextIDs) / sizeof(kTextIDs[0]);
+
+    vector<uint8_t> frames;
+    for (size_t i = 0; i < kNumTextFrames; ++i) {
+        string text = "\x03value " + to_string(i);
+        vector<uint8_t> data(text.begin(), text.end());
+        if (i % 10 == 0) {
+            // 0xff 0x00 in the frame decodes to 0xff
+            data.push_back(0xff);
+            data.push_back(0x00);
+            appendFrame(&frames, kTextIDs[i % kNumTextIDs], 0x0002, data);
+        } else {
+            appendFrame(&frames, kTextIDs[i % kNumTextIDs], 0, data);
+        }
+    }
+
+    string album = "\x03" "album";
+    appendFrame(&frames, "TALB", 0, vector<uint8_t>(album.begin(), album.end()));
+
+    vector<uint8_t> apic;
+    string header = string("\x03image/jpeg\0", 12) + "\x03" + string("cover\0", 6);
+    apic.insert(apic.end(), header.begin(), header.end());
+    for (size_t i = 0; i < kAlbumArtSize; ++i) {
+        apic.push_back(i & 0x7f);
+    }
+    appendFrame(&frames, "APIC", 0, apic);
+
+    vector<uint8_t> tag = {'I', 'D', '3', 4, 0, 0};
+    appendSyncsafeInteger(&tag, frames.size());
+    tag.insert(tag.end(), frames.begin(), frames.end());
+    return tag;
+}
+
+TEST(ID3ScanTest, TagHeavyScanBenchmark) {
+    vector<uint8_t> data = makeTagHeavyTag();
+
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t n = 0; n < kNumParses; ++n) {
+        ID3 tag(data.data(), data.size(), true /* ignoreV1 */);
+        ASSERT_TRUE(tag.isValid());
+        ASSERT_EQ(ID3::ID3_V2_4, tag.version());
+
+        // What a scanner asks for, one lookup per key.
+        static const char *kKeys[] = {"TALB", "TIT2", "TPE1", "TPE2", "TCOM", "TYER", "TCON"};
+        for (const char *key : kKeys) {
+            ID3::Iterator it(tag, key);
+            if (!strcmp(key, "TYER")) {
+                ASSERT_TRUE(it.done());
+                continue;
+            }
+            ASSERT_FALSE(it.done()) << key;
+            String8 text;
+            it.getString(&text);
+            ASSERT_GT(text.length(), 0) << key;
+        }
+
+        size_t artSize;
+        String8 mime;
+        const uint8_t *art = (const uint8_t *)tag.getAlbumArt(&artSize, &mime);
+        ASSERT_NE(art, nullptr);
+        ASSERT_EQ(kAlbumArtSize, artSize);
+        ASSERT_STREQ("image/jpeg", mime.string());
+        ASSERT_EQ(0x7f, art[kAlbumArtSize - 1]);
+    }
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    ALOGI("%zu parses of a %zu byte tag with %zu text frames in %lld us, %.1f MB/s",
+          kNumParses, data.size(), kNumTextFrames, (long long)elapsedUs,
+          kNumParses * data.size() / (elapsedUs > 0 ? (double)elapsedUs : 1.0));
+}
+
+TEST(ID3ScanTest, PerFrameUnsynchronization) {
+    vector<uint8_t> data = makeTagHeavyTag();
+    ID3 tag(data.data(), data.size(), true /* ignoreV1 */);
+    ASSERT_TRUE(tag.isValid());
+
+    size_t count = 0;
+    ID3::Iterator it(tag, nullptr);
+    for (; !it.done(); it.next(), ++count) {
+        if (count >= kNumTextFrames || count % 10 != 0) {
+            continue;
+        }
+        size_t length;
+        const uint8_t *frameData = it.getData(&length);
+        string expected = "\x03value " + to_string(count) + "\xff";
+        ASSERT_EQ(expected.size(), length) << "frame " << count;
+        ASSERT_EQ(0, memcmp(expected.data(), frameData, length)) << "frame " << count;
+    }
+    EXPECT_EQ(kNumTextFrames + 2, count);
+}
+
 INSTANTIATE_TEST_SUITE_P(id3TestAll, ID3tagTest,
                          ::testing::Values("bbb_44100hz_2ch_128kbps_mp3_30sec.mp3",
                                            "bbb_44100hz_2ch_128kbps_mp3_30sec_1_image.mp3",
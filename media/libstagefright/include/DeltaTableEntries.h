@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DELTA_TABLE_ENTRIES_H_
+
+#define DELTA_TABLE_ENTRIES_H_
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/ByteUtils.h>
+#include <utils/List.h>
+
+namespace android {
+
+// A helper class to keep single-value tables (sample sizes, chunk offsets,
+// sync sample numbers) compact while recording. Consecutive values in these
+// tables are close to each other, so each value is stored as the zigzag
+// varint encoded difference to the previous one, usually taking one to
+// three bytes instead of four or eight. The values are expanded back into
+// big-endian entries only when the box is written out.
+template<class TYPE>
+struct DeltaTableEntries {
+    DeltaTableEntries()
+        : mTotalNumTableEntries(0),
+          mLastValue(0) {
+    }
+
+    ~DeltaTableEntries() {
+        while (!mBlockList.empty()) {
+            typename List<Block *>::iterator it = mBlockList.begin();
+            delete (*it);
+            mBlockList.erase(it);
+        }
+    }
+
+    // Store a single value.
+    // @arg value must be in host byte order.
+    void add(TYPE value) {
+        int64_t delta = (int64_t)value - (int64_t)mLastValue;
+        uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+
+        uint8_t encoded[kMaxVarintBytes];
+        size_t size = 0;
+        do {
+            uint8_t byte = zigzag & 0x7f;
+            zigzag >>= 7;
+            if (zigzag != 0) {
+                byte |= 0x80;
+            }
+            encoded[size++] = byte;
+        } while (zigzag != 0);
+
+        if (mBlockList.empty() || mBlockList.back()->used + size > kBlockSize) {
+            Block *block = new Block;
+            block->used = 0;
+            mBlockList.push_back(block);
+        }
+        Block *block = mBlockList.back();
+        memcpy(block->data + block->used, encoded, size);
+        block->used += size;
+
+        mLastValue = value;
+        ++mTotalNumTableEntries;
+    }
+
+    // Write out the table entries:
+    // 1. the number of entries goes first
+    // 2. followed by the decoded values in network byte order
+    // @arg writer the writer to actual write to the storage; it needs
+    //      writeInt32(int32_t) and write(const void *, size_t, size_t)
+    template<class WRITER>
+    void write(WRITER *writer) const {
+        writer->writeInt32(mTotalNumTableEntries);
+
+        TYPE entries[kWriteBatchEntries];
+        size_t nEntries = 0;
+        TYPE value = 0;
+        for (typename List<Block *>::const_iterator it = mBlockList.begin();
+                it != mBlockList.end(); ++it) {
+            const Block *block = *it;
+            size_t pos = 0;
+            while (pos < block->used) {
+                uint64_t zigzag = 0;
+                uint32_t shift = 0;
+                uint8_t byte;
+                do {
+                    byte = block->data[pos++];
+                    zigzag |= (uint64_t)(byte & 0x7f) << shift;
+                    shift += 7;
+                } while (byte & 0x80);
+                int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+                value = (TYPE)((int64_t)value + delta);
+
+                entries[nEntries++] = toNetworkOrder(value);
+                if (nEntries == kWriteBatchEntries) {
+                    writer->write(entries, sizeof(TYPE), nEntries);
+                    nEntries = 0;
+                }
+            }
+        }
+        if (nEntries > 0) {
+            writer->write(entries, sizeof(TYPE), nEntries);
+        }
+    }
+
+    // Return the number of entries in the table.
+    uint32_t count() const { return mTotalNumTableEntries; }
+
+    // Return the number of bytes held by the table.
+    size_t memorySize() const { return mBlockList.size() * sizeof(Block); }
+
+private:
+    static const size_t kBlockSize = 16 * 1024;
+    static const size_t kMaxVarintBytes = 10;
+    static const size_t kWriteBatchEntries = 256;
+
+    struct Block {
+        size_t  used;
+        uint8_t data[kBlockSize];
+    };
+
+    static uint32_t toNetworkOrder(uint32_t value) { return htonl(value); }
+    static off64_t toNetworkOrder(off64_t value) { return hton64(value); }
+
+    uint32_t         mTotalNumTableEntries;
+    TYPE             mLastValue;
+    List<Block *>    mBlockList;
+
+    DISALLOW_EVIL_CONSTRUCTORS(DeltaTableEntries);
+};
+
+}  // namespace android
+
+#endif  // DELTA_TABLE_ENTRIES_H_
@@ -19,6 +19,7 @@
 #define ID3_H_
 
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -59,7 +60,10 @@ struct ID3 {
     private:
         const ID3 &mParent;
         char *mID;
+        uint32_t mPackedID;
+        bool mHasPackedID;
         size_t mOffset;
+        size_t mFrameIndex;
 
         const uint8_t *mFrameData;
         size_t mFrameSize;
@@ -78,11 +82,20 @@ struct ID3 {
 private:
     class DataSourceUnwrapper;
     struct MemorySource;
+
+    // A v2 frame that iterators may return, built once after parsing.
+    struct FrameInfo {
+        size_t mOffset;
+        size_t mSize;  // including the frame header
+        uint32_t mID;  // see PackFrameID
+    };
+
     bool mIsValid;
     uint8_t *mData;
     size_t mSize;
     size_t mFirstFrameOffset;
     Version mVersion;
+    Vector<FrameInfo> mFrames;
 
     // size of the ID3 tag including header before any unsynchronization.
     // only valid for IDV2+
@@ -92,8 +105,11 @@ private:
     bool parseV2(DataSourceBase *source, off64_t offset);
     void removeUnsynchronization();
     bool removeUnsynchronizationV2_4(bool iTunesHack);
+    bool scanFramesV2_4(bool *needsRewrite) const;
+    void buildFrameIndex();
 
     static bool ParseSyncsafeInteger(const uint8_t encoded[4], size_t *x);
+    static uint32_t PackFrameID(const char *id, size_t length);
 
     ID3(const ID3 &);
     ID3 &operator=(const ID3 &);
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ENCODER_LATENCY_TRACKER_H_
+
+#define ENCODER_LATENCY_TRACKER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/List.h>
+
+namespace android {
+
+// Tracks how long an encoder takes to turn each input into an output.
+//
+// Outputs are matched to inputs by presentation time. Encoders that stamp
+// outputs on their own timeline (e.g. audio encoders with their own frame
+// size) are matched to the last input at or before the output time, or to
+// the oldest input if there is none. Inputs that never come out, because the
+// encoder dropped them, are aged out once they are older than the maximum
+// latency, so the number of pending inputs stays bounded by what is queued
+// within that window.
+struct EncoderLatencyTracker {
+    explicit EncoderLatencyTracker(int64_t maxLatencyUs);
+
+    // Records that the input with presentation time |timeUs| was queued to
+    // the encoder at system time |nowUs|.
+    void onInputQueued(int64_t timeUs, int64_t nowUs);
+
+    // Returns in |latencyUs| how long ago the input matching the output with
+    // presentation time |timeUs| was queued, or false if no input is pending.
+    bool takeLatency(int64_t timeUs, int64_t nowUs, int64_t *latencyUs);
+
+    // Forgets the pending inputs, but not the statistics.
+    void clear();
+
+    size_t numPendingInputs() const { return mPendingInputs.size(); }
+    size_t numSamples() const { return mNumSamples; }
+    int64_t maxLatencyUs() const { return mMaxLatencyUs; }
+    int64_t averageLatencyUs() const {
+        return mNumSamples > 0 ? mTotalLatencyUs / (int64_t)mNumSamples : 0;
+    }
+
+private:
+    struct PendingInput {
+        int64_t mTimeUs;
+        int64_t mQueuedUs;
+    };
+
+    const int64_t mMaxPendingUs;
+    // in queueing order
+    List<PendingInput> mPendingInputs;
+
+    int64_t mMaxLatencyUs;
+    int64_t mTotalLatencyUs;
+    size_t mNumSamples;
+};
+
+}  // namespace android
+
+#endif  // ENCODER_LATENCY_TRACKER_H_
@@ -72,6 +72,15 @@ private:
     int mPMTContinuityCounter;
     uint32_t mCrcTable[256];
 
+    // The PAT and PMT never change once the sources are known, only their
+    // continuity counters are patched in before they're written again.
+    sp<ABuffer> mPATPacket;
+    sp<ABuffer> mPMTPacket;
+
+    // All TS packets of an access unit are assembled here and written out
+    // in a single call.
+    sp<ABuffer> mOutputBuffer;
+
     void init();
 
     void writeTS();
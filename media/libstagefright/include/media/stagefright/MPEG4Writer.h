@@ -19,10 +19,12 @@
 #define MPEG4_WRITER_H_
 
 #include <stdio.h>
+#include <sys/uio.h>
 
 #include <media/stagefright/MediaWriter.h>
 #include <utils/List.h>
 #include <utils/threads.h>
+#include <atomic>
 #include <map>
 #include <media/stagefright/foundation/AHandlerReflector.h>
 #include <media/stagefright/foundation/ALooper.h>
@@ -63,6 +65,8 @@ public:
     inline size_t write(const void *ptr, size_t size, size_t nmemb);
     // Write to file system by calling ::write() or post error message to looper on failure.
     void writeOrPostError(int fd, const void *buf, size_t count);
+    // Write a vector of buffers by calling ::writev() or post error message to looper on failure.
+    void writevOrPostError(int fd, const struct iovec *iov, int iovcnt, size_t count);
     // Seek in the file by calling ::lseek64() or post error message to looper on failure.
     void seekOrPostError(int fd, off64_t offset, int whence);
     void endBox();
@@ -114,6 +118,9 @@ private:
     off64_t mFreeBoxOffset;
     bool mStreamableFile;
     off64_t mMoovExtraSize;
+    int64_t mFragmentDurationUs;  // > 0 if a fragmented file is written
+    bool mInitSegmentWritten;  // The 'moov' of a fragmented file has been written
+    uint32_t mFragmentSequenceNumber;
     uint32_t mInterleaveDurationUs;
     int32_t mTimeScale;
     int64_t mStartTimestampUs;
@@ -130,6 +137,20 @@ private:
     std::priority_queue<std::chrono::microseconds, std::vector<std::chrono::microseconds>,
                         std::greater<std::chrono::microseconds>> mWriteDurationPQ;
     const uint8_t kWriteDurationsCount = 5;
+    uint64_t mNumWriteSyscalls;
+    uint64_t mNumBytesWritten;
+
+    // Sample data of a chunk is gathered here and written with a single ::writev().
+    // Short fields (NAL length prefixes, exif offsets) are copied into the matching
+    // mWriteBatchFields slot so that they stay valid until the batch is flushed.
+    enum {
+        kMaxWriteBatchEntries = 256,
+        kMaxWriteBatchFieldSize = 4,
+    };
+    struct iovec mWriteBatch[kMaxWriteBatchEntries];
+    uint8_t mWriteBatchFields[kMaxWriteBatchEntries][kMaxWriteBatchFieldSize];
+    size_t mWriteBatchCount;
+    size_t mWriteBatchBytes;
 
     sp<ALooper> mLooper;
     sp<AHandlerReflector<MPEG4Writer> > mReflector;
@@ -156,22 +177,40 @@ private:
     void writeCachedBoxToFile(const char *type);
     void printWriteDurations();
 
+    // Number of chunks a track may have queued for the writer thread before
+    // its thread blocks. Must be a power of two.
+    static const uint32_t kChunkQueueCapacity = 64;
+
     struct Chunk {
         Track               *mTrack;        // Owner
         int64_t             mTimeStampUs;   // Timestamp of the 1st sample
         List<MediaBuffer *> mSamples;       // Sample data
+        // Start time of the owner track, taken under the track's lock when
+        // the chunk is queued so the writer thread never reads track state.
+        int64_t             mTrackStartTimeUs;
 
         // Convenient constructor
-        Chunk(): mTrack(NULL), mTimeStampUs(0) {}
+        Chunk(): mTrack(NULL), mTimeStampUs(0), mTrackStartTimeUs(-1) {}
 
         Chunk(Track *track, int64_t timeUs, List<MediaBuffer *> samples)
-            : mTrack(track), mTimeStampUs(timeUs), mSamples(samples) {
+            : mTrack(track), mTimeStampUs(timeUs), mSamples(samples),
+              mTrackStartTimeUs(-1) {
         }
 
     };
     struct ChunkInfo {
         Track               *mTrack;        // Owner
-        List<Chunk>         mChunks;        // Remaining chunks to be written
+        size_t              mIndex;         // Position of the track, breaks timestamp ties
+
+        // Remaining chunks to be written. The track thread is the only
+        // producer and the writer thread the only consumer, so the ring is
+        // accessed without holding a lock.
+        Chunk               mChunks[kChunkQueueCapacity];
+        std::atomic<uint32_t> mChunksHead;  // Next chunk to be written
+        std::atomic<uint32_t> mChunksTail;  // Next free slot
+
+        // True while the track has an entry in mChunkQueue (writer thread only)
+        bool mScheduled;
 
         // Previous chunk timestamp that has been written
         int64_t mPrevChunkTimestampUs;
@@ -179,13 +218,43 @@ private:
         // Max time interval between neighboring chunks
         int64_t mMaxInterChunkDurUs;
 
+        // Backpressure metrics, updated by the track thread only
+        uint32_t mMaxQueuedChunks;          // High water mark of the ring
+        uint32_t mNumBlockedChunks;         // Chunks that waited for a free slot
+        int64_t  mBlockedTimeUs;            // Total time spent waiting for a free slot
+
+        ChunkInfo(Track *track, size_t index);
+    };
+
+    // Entry of the writer thread's interleaving queue: the earliest queued
+    // chunk of a track.
+    struct ChunkQueueEntry {
+        int64_t     mTimeStampUs;
+        ChunkInfo   *mInfo;
+
+        bool operator>(const ChunkQueueEntry &other) const {
+            if (mTimeStampUs != other.mTimeStampUs) {
+                return mTimeStampUs > other.mTimeStampUs;
+            }
+            return mInfo->mIndex > other.mInfo->mIndex;
+        }
     };
 
     bool            mIsFirstChunk;
     volatile bool   mDone;                  // Writer thread is done?
     pthread_t       mThread;                // Thread id for the writer
-    List<ChunkInfo> mChunkInfos;            // Chunk infos
+    List<ChunkInfo *> mChunkInfos;          // Chunk infos
+    // Tracks with queued chunks, ordered by the timestamp of their earliest chunk
+    std::priority_queue<ChunkQueueEntry, std::vector<ChunkQueueEntry>,
+                        std::greater<ChunkQueueEntry>> mChunkQueue;
+    // Bumped by the track threads whenever a chunk is queued, so that the
+    // writer thread only looks for newly non-empty tracks when it changed.
+    std::atomic<uint32_t> mChunksQueuedGeneration;
+    uint32_t        mChunksScheduledGeneration;
+    Mutex           mChunkQueueLock;        // Only guards sleeping and waking up
     Condition       mChunkReadyCondition;   // Signal that chunks are available
+    Condition       mChunkSpaceCondition;   // Signal that a chunk ring has room again
+    List<Chunk>     mFragmentChunks;        // Chunks of the next movie fragment
 
     // HEIF writing
     typedef key_value_pair_t< const char *, Vector<uint16_t> > ItemRefs;
@@ -241,7 +310,8 @@ private:
     status_t setupAndStartLooper();
     void stopAndReleaseLooper();
 
-    // Buffer a single chunk to be written out later.
+    // Buffer a single chunk to be written out later. Blocks while the
+    // track already has kChunkQueueCapacity chunks waiting.
     void bufferChunk(const Chunk& chunk);
 
     // Write all buffered chunks from all tracks
@@ -249,11 +319,28 @@ private:
 
     // Retrieve the proper chunk to write if there is one
     // Return true if a chunk is found; otherwise, return false.
+    // Must be called with mChunkQueueLock held.
     bool findChunkToWrite(Chunk *chunk);
 
     // Actually write the given chunk to the file.
     void writeChunkToFile(Chunk* chunk);
 
+    // Fragmented file writing
+    bool isFragmented() const { return mFragmentDurationUs > 0; }
+    // Queue the given chunk for the next movie fragment and write the
+    // fragment out once it spans mFragmentDurationUs.
+    void addChunkToFragment(const Chunk& chunk);
+    // True if the given track has a chunk queued for the next fragment.
+    bool hasFragmentChunk(const Track *track) const;
+    // True once every track has either queued a chunk or reached EOS, i.e.
+    // all codec specific data needed by the 'moov' is known.
+    bool allTracksHaveFragmentData();
+    // Write the queued chunks as a 'moof'/'mdat' pair, preceded by the
+    // 'moov' if it has not been written yet.
+    void writeFragment();
+    void writeMvexBox();
+    void writeMfraBox();
+
     // Adjust other track media clock (presumably wall clock)
     // based on audio track media clock with the drift time.
     int64_t mDriftTimeUs;
@@ -285,6 +372,14 @@ private:
             uint32_t tiffHdrOffset, size_t *bytesWritten);
     void addLengthPrefixedSample_l(MediaBuffer *buffer);
     void addMultipleLengthPrefixedSamples_l(MediaBuffer *buffer);
+    // Queue |size| bytes at |data| for the next vectored write. The memory must
+    // stay valid until flushWriteBatch_l() is called.
+    void appendToWriteBatch_l(const void *data, size_t size);
+    // Queue a copy of a field of at most kMaxWriteBatchFieldSize bytes.
+    void appendFieldToWriteBatch_l(const void *data, size_t size);
+    // Write out everything queued so far. Must be called before the queued
+    // MediaBuffers are released and before any other write or seek on mFd.
+    void flushWriteBatch_l();
     uint16_t addProperty_l(const ItemProperty &);
     status_t reserveItemId_l(size_t numItems, uint16_t *itemIdBase);
     uint16_t addItem_l(const ItemInfo &);
@@ -21,6 +21,7 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MetaData.h>
+#include <utils/List.h>
 #include <utils/threads.h>
 
 namespace android {
@@ -30,7 +31,10 @@ namespace android {
 struct MediaAdapter : public MediaSource, public MediaBufferObserver {
 public:
     // MetaData is used to set the format and returned at getFormat.
-    MediaAdapter(const sp<MetaData> &meta);
+    // If maxQueuedBuffers is 0, every pushBuffer() waits for its buffer to be
+    // consumed. Otherwise up to maxQueuedBuffers buffers are queued for read()
+    // and pushBuffer() only waits when the queue is full.
+    MediaAdapter(const sp<MetaData> &meta, size_t maxQueuedBuffers = 0);
     virtual ~MediaAdapter();
     /////////////////////////////////////////////////
     // Inherited functions from MediaSource
@@ -54,18 +58,38 @@ public:
 
     // pushBuffer() will wait for the read() finish, and read() will have a
     // deep copy, such that after pushBuffer return, the buffer can be re-used.
+    // When buffers are queued, the adapter takes over the caller's reference
+    // instead: the buffer must own its data and keep its own observer (e.g. a
+    // MediaBufferGroup), and it is released by the reader, by stop(), or by
+    // pushBuffer() itself on failure.
     status_t pushBuffer(MediaBuffer *buffer);
 
+    // No more buffers will be pushed. read() keeps returning the buffers
+    // already pushed and reports ERROR_END_OF_STREAM once they are gone, and
+    // stop() waits a bounded time for them to be read instead of dropping
+    // them.
+    void signalEndOfStream();
+
 private:
+    // pushBuffer() for the queued mode.
+    status_t queueBuffer(MediaBuffer *buffer);
+
     Mutex mAdapterLock;
     // Make sure the read() wait for the incoming buffer.
     Condition mBufferReadCond;
-    // Make sure the pushBuffer() wait for the current buffer consumed.
+    // Make sure the pushBuffer() wait for the current buffer consumed, or for
+    // room in the queue.
     Condition mBufferReturnedCond;
+    // Make sure stop() waits for the buffers pushed before the end of stream.
+    Condition mQueueDrainedCond;
 
-    MediaBuffer *mCurrentMediaBuffer;
+    // Buffers pushed but not read yet. Holds at most one buffer unless
+    // mMaxQueuedBuffers > 0.
+    List<MediaBuffer *> mQueuedBuffers;
+    const size_t mMaxQueuedBuffers;
 
     bool mStarted;
+    bool mEndOfStream;
     sp<MetaData> mOutputFormat;
 
     DISALLOW_EVIL_CONSTRUCTORS(MediaAdapter);
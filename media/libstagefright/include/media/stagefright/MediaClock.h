@@ -18,7 +18,8 @@
 
 #define MEDIA_CLOCK_H_
 
-#include <list>
+#include <atomic>
+#include <vector>
 #include <media/stagefright/foundation/AHandler.h>
 #include <utils/Mutex.h>
 #include <utils/RefBase.h>
@@ -52,7 +53,7 @@ struct MediaClock : public AHandler {
     float getPlaybackRate() const;
 
     // query media time corresponding to real time |realUs|, and save the
-    // result in |outMediaUs|.
+    // result in |outMediaUs|. Doesn't block on concurrent anchor updates.
     status_t getMediaTime(
             int64_t realUs,
             int64_t *outMediaUs,
@@ -82,17 +83,51 @@ private:
 
     struct Timer {
         Timer(const sp<AMessage> &notify, int64_t mediaTimeUs, int64_t adjustRealUs);
-        const sp<AMessage> mNotify;
+        sp<AMessage> mNotify;
         int64_t mMediaTimeUs;
         int64_t mAdjustRealUs;
+        // media time the timer fires at, at the current playback rate.
+        double mTargetMediaUs;
     };
 
+    // Orders mTimers as a min-heap on mTargetMediaUs.
+    struct TimerLater {
+        bool operator()(const Timer &a, const Timer &b) const {
+            return a.mTargetMediaUs > b.mTargetMediaUs;
+        }
+    };
+
+    // Consistent copy of the fields getMediaTime() depends on.
+    struct Anchor {
+        int64_t mAnchorTimeMediaUs;
+        int64_t mAnchorTimeRealUs;
+        int64_t mMaxTimeMediaUs;
+        int64_t mStartingTimeMediaUs;
+        float mPlaybackRate;
+    };
+
+    // Brackets writes to the anchor fields, which readers retry across.
+    // Both must be called with mLock held, endAnchorUpdate_l() also sends
+    // the discontinuity notification if the anchor changed.
+    void beginAnchorUpdate_l();
+    void endAnchorUpdate_l();
+
+    void getAnchor(Anchor *anchor) const;
+    void getAnchor_l(Anchor *anchor) const;
+
+    static status_t getMediaTime(
+            const Anchor &anchor,
+            int64_t realUs,
+            int64_t *outMediaUs,
+            bool allowPastMaxTime);
+
     status_t getMediaTime_l(
             int64_t realUs,
             int64_t *outMediaUs,
             bool allowPastMaxTime) const;
 
     void processTimers_l();
+    void updateTimerTargets_l();
 
     void updateAnchorTimesAndPlaybackRate_l(
             int64_t anchorTimeMediaUs, int64_t anchorTimeRealUs , float playbackRate);
@@ -102,15 +137,23 @@ private:
     sp<ALooper> mLooper;
     mutable Mutex mLock;
 
-    int64_t mAnchorTimeMediaUs;
-    int64_t mAnchorTimeRealUs;
-    int64_t mMaxTimeMediaUs;
-    int64_t mStartingTimeMediaUs;
+    // Written under mLock, read lock-free through getAnchor(). Odd while an
+    // update is in progress.
+    std::atomic<uint32_t> mAnchorSeq;
+
+    std::atomic<int64_t> mAnchorTimeMediaUs;
+    std::atomic<int64_t> mAnchorTimeRealUs;
+    std::atomic<int64_t> mMaxTimeMediaUs;
+    std::atomic<int64_t> mStartingTimeMediaUs;
+
+    std::atomic<float> mPlaybackRate;
 
-    float mPlaybackRate;
+    // Set by updateAnchorTimesAndPlaybackRate_l(), endAnchorUpdate_l()
+    // notifies listeners once the update is visible.
+    bool mAnchorChanged;
 
     int32_t mGeneration;
-    std::list<Timer> mTimers;
+    std::vector<Timer> mTimers;
     sp<AMessage> mNotify;
 
     DISALLOW_EVIL_CONSTRUCTORS(MediaClock);
@@ -17,6 +17,7 @@
 #ifndef MediaCodecSource_H_
 #define MediaCodecSource_H_
 
+#include <media/stagefright/EncoderLatencyTracker.h>
 #include <media/stagefright/MediaSource.h>
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/foundation/AHandlerReflector.h>
@@ -143,6 +144,10 @@ private:
     int64_t mFirstSampleSystemTimeUs;
     bool mPausePending;
 
+    // when each input was queued to the encoder; only fed for pulled
+    // sources, as surface input reaches the encoder without passing here
+    EncoderLatencyTracker mEncoderLatency;
+
     // audio drift time
     int64_t mFirstSampleTimeUs;
     List<int64_t> mDriftTimeQueue;
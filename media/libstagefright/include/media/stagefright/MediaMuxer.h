@@ -30,6 +30,7 @@ struct ABuffer;
 struct AMessage;
 struct MediaAdapter;
 class MediaBuffer;
+class MediaBufferGroup;
 struct MediaSource;
 class MetaData;
 struct MediaWriter;
@@ -91,6 +92,16 @@ public:
      */
     status_t setLocation(int latitude, int longitude);
 
+    /**
+     * Write a fragmented file instead of a single 'moov' at the end.
+     * The movie header is written before the first fragment, followed
+     * by 'moof'/'mdat' pairs of about the given duration and an 'mfra'
+     * index when muxing stops. Only supported for .mp4 and .3gp output.
+     * @param durationUs The target fragment duration in microseconds.
+     * @return OK if no error.
+     */
+    status_t setFragmentDurationUs(int64_t durationUs);
+
     /**
      * Stop muxing.
      * This method is a blocking call. Depending on how
@@ -121,6 +132,10 @@ private:
     const OutputFormat mFormat;
     sp<MediaWriter> mWriter;
     Vector< sp<MediaAdapter> > mTrackList;  // Each track has its MediaAdapter.
+    // Samples are copied into buffers (and metadata) reused from a pool per
+    // track, so that writeSampleData() can return before the writer has
+    // consumed them.
+    Vector<MediaBufferGroup *> mSampleBufferPools;
     sp<MetaData> mFileMeta;  // Metadata for the whole file.
     Mutex mMuxerLock;
 
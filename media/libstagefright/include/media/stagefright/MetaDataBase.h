@@ -76,6 +76,7 @@ enum {
     kKeyNTPTime           = 'ntpT',  // uint64_t (ntp-timestamp)
     kKeyTargetTime        = 'tarT',  // int64_t (usecs)
     kKeyDriftTime         = 'dftT',  // int64_t (usecs)
+    kKeyEncoderLatencyUs  = 'eltT',  // int64_t (usecs from encoder input to output)
     kKeyAnchorTime        = 'ancT',  // int64_t (usecs)
     kKeyDuration          = 'dura',  // int64_t (usecs)
     kKeyPixelFormat       = 'pixf',  // int32_t
@@ -247,6 +248,13 @@ enum {
 
     // Treat empty track as malformed for MediaRecorder.
     kKeyEmptyTrackMalFormed = 'nemt', // bool (int32_t)
+
+    // Write a fragmented mp4 file with movie fragments of about this duration.
+    kKeyFragmentDurationUs = 'frgd', // int64_t
+
+    // Write a webm file for live streaming: the segment keeps an unknown
+    // size and the file is never seeked, so the fd may be a pipe or socket.
+    kKeyLiveStream        = 'live', // bool (int32_t)
 };
 
 enum {
@@ -40,6 +40,12 @@ struct VideoFrameSchedulerBase : public RefBase {
     // returns the current frames-per-second, or 0.f if not primed
     float getFrameRate();
 
+    // returns the number of frames paced against vsync since init()
+    size_t getPacedFrameCount() const;
+    // returns how many of those stayed on screen for a different number of
+    // vsyncs than the video frame period calls for
+    size_t getJudderFrameCount() const;
+
     virtual void release() = 0;
 
     static const size_t kHistorySize = 8;
@@ -87,6 +93,17 @@ private:
     };
 
     virtual void updateVsync() = 0;
+    // fetch vsync timing and run it through the vsync model
+    void refreshVsync();
+
+    // Filtered vsync model. Each display sample only nudges the predicted
+    // vsync phase and period, so a late or noisy sample does not shift the
+    // schedule of every following frame.
+    nsecs_t mModelVsyncTime;
+    nsecs_t mModelVsyncPeriod;
+
+    size_t mNumPacedFrames;
+    size_t mNumJudderFrames;
 
     nsecs_t mLastVsyncTime;    // estimated vsync time for last frame
     nsecs_t mTimeCorrection;   // running adjustment
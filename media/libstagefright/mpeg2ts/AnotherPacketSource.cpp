@@ -37,6 +37,12 @@ namespace android {
 
 const int64_t kNearEOSMarkUs = 2000000LL; // 2 secs
 
+// Default cap on the payload queued in a single source, beyond which
+// producers are expected to hold off (see isFull()).
+const size_t kDefaultMaxBufferedBytes = 64 * 1024 * 1024;
+
+const size_t kMinNumEntries = 16;
+
 AnotherPacketSource::AnotherPacketSource(const sp<MetaData> &meta)
     : mIsAudio(false),
       mIsVideo(false),
@@ -44,6 +50,12 @@ AnotherPacketSource::AnotherPacketSource(const sp<MetaData> &meta)
       mFormat(NULL),
       mLastQueuedTimeUs(0),
       mEstimatedBufferDurationUs(-1),
+      mHead(0),
+      mNumEntries(0),
+      mNumDiscontinuities(0),
+      mBufferedBytes(0),
+      mMaxBufferedBytes(kDefaultMaxBufferedBytes),
+      mHasSyncFlags(false),
       mEOSResult(OK),
       mLatestEnqueuedMeta(NULL),
       mLatestDequeuedMeta(NULL) {
@@ -95,62 +107,177 @@ sp<MetaData> AnotherPacketSource::getFormat() {
         return mFormat;
     }
 
-    List<sp<ABuffer> >::iterator it = mBuffers.begin();
-    while (it != mBuffers.end()) {
-        sp<ABuffer> buffer = *it;
-        int32_t discontinuity;
-        if (!buffer->meta()->findInt32("discontinuity", &discontinuity)) {
+    for (size_t i = 0; i < mNumEntries; ++i) {
+        const Entry &entry = entryAt_l(i);
+        if (!entry.mIsDiscontinuity) {
             sp<RefBase> object;
-            if (buffer->meta()->findObject("format", &object)) {
+            if (entry.mBuffer->meta()->findObject("format", &object)) {
                 setFormat(static_cast<MetaData*>(object.get()));
                 return mFormat;
             }
         }
-
-        ++it;
     }
     return NULL;
 }
 
-status_t AnotherPacketSource::dequeueAccessUnit(sp<ABuffer> *buffer) {
-    buffer->clear();
+AnotherPacketSource::Entry &AnotherPacketSource::entryAt_l(size_t index) {
+    return mEntries.editItemAt((mHead + index) & (mEntries.size() - 1));
+}
 
-    Mutex::Autolock autoLock(mLock);
-    while (mEOSResult == OK && mBuffers.empty()) {
-        mCondition.wait(mLock);
+void AnotherPacketSource::growEntries_l() {
+    size_t capacity = mEntries.size() * 2;
+    if (capacity < kMinNumEntries) {
+        capacity = kMinNumEntries;
     }
 
-    if (!mBuffers.empty()) {
-        *buffer = *mBuffers.begin();
-        mBuffers.erase(mBuffers.begin());
+    Vector<Entry> entries;
+    entries.insertAt(Entry(), 0, capacity);
+    for (size_t i = 0; i < mNumEntries; ++i) {
+        entries.editItemAt(i) = entryAt_l(i);
+    }
 
-        int32_t discontinuity;
-        if ((*buffer)->meta()->findInt32("discontinuity", &discontinuity)) {
-            if (wasFormatChange(discontinuity)) {
-                mFormat.clear();
-            }
+    mEntries = entries;
+    mHead = 0;
+}
 
-            mDiscontinuitySegments.erase(mDiscontinuitySegments.begin());
-            // CHECK(!mDiscontinuitySegments.empty());
-            return INFO_DISCONTINUITY;
+void AnotherPacketSource::pushBack_l(const Entry &entry) {
+    if (mNumEntries == mEntries.size()) {
+        growEntries_l();
+    }
+
+    entryAt_l(mNumEntries) = entry;
+    ++mNumEntries;
+
+    if (entry.mIsDiscontinuity) {
+        ++mNumDiscontinuities;
+    } else {
+        mBufferedBytes += entry.mSize;
+    }
+}
+
+void AnotherPacketSource::pushFront_l(const Entry &entry) {
+    if (mNumEntries == mEntries.size()) {
+        growEntries_l();
+    }
+
+    mHead = (mHead + mEntries.size() - 1) & (mEntries.size() - 1);
+    entryAt_l(0) = entry;
+    ++mNumEntries;
+
+    if (entry.mIsDiscontinuity) {
+        ++mNumDiscontinuities;
+    } else {
+        mBufferedBytes += entry.mSize;
+    }
+}
+
+void AnotherPacketSource::popFront_l(Entry *entry) {
+    CHECK_GT(mNumEntries, 0u);
+
+    Entry &front = entryAt_l(0);
+    if (front.mIsDiscontinuity) {
+        --mNumDiscontinuities;
+    } else {
+        mBufferedBytes -= front.mSize;
+    }
+
+    if (entry != NULL) {
+        *entry = front;
+    }
+    front = Entry();
+
+    mHead = (mHead + 1) & (mEntries.size() - 1);
+    --mNumEntries;
+}
+
+void AnotherPacketSource::popBack_l() {
+    CHECK_GT(mNumEntries, 0u);
+
+    Entry &back = entryAt_l(mNumEntries - 1);
+    if (back.mIsDiscontinuity) {
+        --mNumDiscontinuities;
+    } else {
+        mBufferedBytes -= back.mSize;
+    }
+
+    back = Entry();
+    --mNumEntries;
+}
+
+void AnotherPacketSource::clearEntries_l() {
+    mEntries.clear();
+    mHead = 0;
+    mNumEntries = 0;
+    mNumDiscontinuities = 0;
+    mBufferedBytes = 0;
+}
+
+AnotherPacketSource::Entry AnotherPacketSource::makeEntry_l(
+        const sp<ABuffer> &buffer) {
+    Entry entry;
+    entry.mBuffer = buffer;
+
+    int32_t discontinuity;
+    if (buffer->meta()->findInt32("discontinuity", &discontinuity)) {
+        entry.mIsDiscontinuity = true;
+        return entry;
+    }
+
+    entry.mSize = buffer->size();
+    CHECK(buffer->meta()->findInt64("timeUs", &entry.mTimeUs));
+
+    int32_t isSync;
+    if (buffer->meta()->findInt32("isSync", &isSync)) {
+        entry.mIsSync = (isSync != 0);
+        mHasSyncFlags = true;
+    }
+
+    return entry;
+}
+
+status_t AnotherPacketSource::dequeueEntry_l(sp<ABuffer> *buffer) {
+    Entry entry;
+    popFront_l(&entry);
+    *buffer = entry.mBuffer;
+
+    if (entry.mIsDiscontinuity) {
+        int32_t discontinuity;
+        CHECK((*buffer)->meta()->findInt32("discontinuity", &discontinuity));
+        if (wasFormatChange(discontinuity)) {
+            mFormat.clear();
         }
 
+        mDiscontinuitySegments.erase(mDiscontinuitySegments.begin());
         // CHECK(!mDiscontinuitySegments.empty());
-        DiscontinuitySegment &seg = *mDiscontinuitySegments.begin();
+        return INFO_DISCONTINUITY;
+    }
 
-        int64_t timeUs;
-        mLatestDequeuedMeta = (*buffer)->meta()->dup();
-        CHECK(mLatestDequeuedMeta->findInt64("timeUs", &timeUs));
-        if (timeUs > seg.mMaxDequeTimeUs) {
-            seg.mMaxDequeTimeUs = timeUs;
-        }
+    // CHECK(!mDiscontinuitySegments.empty());
+    DiscontinuitySegment &seg = *mDiscontinuitySegments.begin();
+    if (entry.mTimeUs > seg.mMaxDequeTimeUs) {
+        seg.mMaxDequeTimeUs = entry.mTimeUs;
+    }
 
-        sp<RefBase> object;
-        if ((*buffer)->meta()->findObject("format", &object)) {
-            setFormat(static_cast<MetaData*>(object.get()));
-        }
+    mLatestDequeuedMeta = (*buffer)->meta()->dup();
 
-        return OK;
+    sp<RefBase> object;
+    if ((*buffer)->meta()->findObject("format", &object)) {
+        setFormat(static_cast<MetaData*>(object.get()));
+    }
+
+    return OK;
+}
+
+status_t AnotherPacketSource::dequeueAccessUnit(sp<ABuffer> *buffer) {
+    buffer->clear();
+
+    Mutex::Autolock autoLock(mLock);
+    while (mEOSResult == OK && mNumEntries == 0) {
+        mCondition.wait(mLock);
+    }
+
+    if (mNumEntries > 0) {
+        return dequeueEntry_l(buffer);
     }
 
     return mEOSResult;
@@ -159,7 +286,7 @@ status_t AnotherPacketSource::dequeueAccessUnit(sp<ABuffer> *buffer) {
 void AnotherPacketSource::requeueAccessUnit(const sp<ABuffer> &buffer) {
     // TODO: update corresponding book keeping info.
     Mutex::Autolock autoLock(mLock);
-    mBuffers.push_front(buffer);
+    pushFront_l(makeEntry_l(buffer));
 }
 
 status_t AnotherPacketSource::read(
@@ -167,40 +294,19 @@ status_t AnotherPacketSource::read(
     *out = NULL;
 
     Mutex::Autolock autoLock(mLock);
-    while (mEOSResult == OK && mBuffers.empty()) {
+    while (mEOSResult == OK && mNumEntries == 0) {
         mCondition.wait(mLock);
     }
 
-    if (!mBuffers.empty()) {
-
-        const sp<ABuffer> buffer = *mBuffers.begin();
-        mBuffers.erase(mBuffers.begin());
-
-        int32_t discontinuity;
-        if (buffer->meta()->findInt32("discontinuity", &discontinuity)) {
-            if (wasFormatChange(discontinuity)) {
-                mFormat.clear();
-            }
-
-            mDiscontinuitySegments.erase(mDiscontinuitySegments.begin());
-            // CHECK(!mDiscontinuitySegments.empty());
-            return INFO_DISCONTINUITY;
-        }
-
-        mLatestDequeuedMeta = buffer->meta()->dup();
-
-        sp<RefBase> object;
-        if (buffer->meta()->findObject("format", &object)) {
-            setFormat(static_cast<MetaData*>(object.get()));
+    if (mNumEntries > 0) {
+        sp<ABuffer> buffer;
+        status_t err = dequeueEntry_l(&buffer);
+        if (err != OK) {
+            return err;
         }
 
         int64_t timeUs;
         CHECK(buffer->meta()->findInt64("timeUs", &timeUs));
-        // CHECK(!mDiscontinuitySegments.empty());
-        DiscontinuitySegment &seg = *mDiscontinuitySegments.begin();
-        if (timeUs > seg.mMaxDequeTimeUs) {
-            seg.mMaxDequeTimeUs = timeUs;
-        }
 
         MediaBufferBase *mediaBuffer = new MediaBuffer(buffer);
         MetaDataBase &bufmeta = mediaBuffer->meta_data();
@@ -292,11 +398,11 @@ void AnotherPacketSource::queueAccessUnit(const sp<ABuffer> &buffer) {
     }
 
     Mutex::Autolock autoLock(mLock);
-    mBuffers.push_back(buffer);
+    Entry entry = makeEntry_l(buffer);
+    pushBack_l(entry);
     mCondition.signal();
 
-    int32_t discontinuity;
-    if (buffer->meta()->findInt32("discontinuity", &discontinuity)){
+    if (entry.mIsDiscontinuity) {
         ALOGV("queueing a discontinuity with queueAccessUnit");
 
         mLastQueuedTimeUs = 0LL;
@@ -307,8 +413,7 @@ void AnotherPacketSource::queueAccessUnit(const sp<ABuffer> &buffer) {
         return;
     }
 
-    int64_t lastQueuedTimeUs;
-    CHECK(buffer->meta()->findInt64("timeUs", &lastQueuedTimeUs));
+    int64_t lastQueuedTimeUs = entry.mTimeUs;
     mLastQueuedTimeUs = lastQueuedTimeUs;
     ALOGV("queueAccessUnit timeUs=%" PRIi64 " us (%.2f secs)",
             mLastQueuedTimeUs, mLastQueuedTimeUs / 1E6);
@@ -343,7 +448,8 @@ void AnotherPacketSource::queueAccessUnit(const sp<ABuffer> &buffer) {
 void AnotherPacketSource::clear() {
     Mutex::Autolock autoLock(mLock);
 
-    mBuffers.clear();
+    clearEntries_l();
+    mHasSyncFlags = false;
     mEOSResult = OK;
 
     mDiscontinuitySegments.clear();
@@ -363,18 +469,16 @@ void AnotherPacketSource::queueDiscontinuity(
 
     if (discard) {
         // Leave only discontinuities in the queue.
-        List<sp<ABuffer> >::iterator it = mBuffers.begin();
-        while (it != mBuffers.end()) {
-            sp<ABuffer> oldBuffer = *it;
-
-            int32_t oldDiscontinuityType;
-            if (!oldBuffer->meta()->findInt32(
-                        "discontinuity", &oldDiscontinuityType)) {
-                it = mBuffers.erase(it);
-                continue;
+        if (mNumDiscontinuities == 0) {
+            clearEntries_l();
+        } else {
+            for (size_t n = mNumEntries; n > 0; --n) {
+                Entry entry;
+                popFront_l(&entry);
+                if (entry.mIsDiscontinuity) {
+                    pushBack_l(entry);
+                }
             }
-
-            ++it;
         }
 
         for (List<DiscontinuitySegment>::iterator it2 = mDiscontinuitySegments.begin();
@@ -400,7 +504,7 @@ void AnotherPacketSource::queueDiscontinuity(
     buffer->meta()->setInt32("discontinuity", static_cast<int32_t>(type));
     buffer->meta()->setMessage("extra", extra);
 
-    mBuffers.push_back(buffer);
+    pushBack_l(makeEntry_l(buffer));
     mCondition.signal();
 }
 
@@ -418,7 +522,7 @@ bool AnotherPacketSource::hasBufferAvailable(status_t *finalResult) {
     if (!mEnabled) {
         return false;
     }
-    if (!mBuffers.empty()) {
+    if (mNumEntries > 0) {
         return true;
     }
 
@@ -432,12 +536,8 @@ bool AnotherPacketSource::hasDataBufferAvailable(status_t *finalResult) {
     if (!mEnabled) {
         return false;
     }
-    List<sp<ABuffer> >::iterator it;
-    for (it = mBuffers.begin(); it != mBuffers.end(); it++) {
-        int32_t discontinuity;
-        if (!(*it)->meta()->findInt32("discontinuity", &discontinuity)) {
-            return true;
-        }
+    if (mNumEntries > mNumDiscontinuities) {
+        return true;
     }
 
     *finalResult = mEOSResult;
@@ -451,8 +551,8 @@ size_t AnotherPacketSource::getAvailableBufferCount(status_t *finalResult) {
     if (!mEnabled) {
         return 0;
     }
-    if (!mBuffers.empty()) {
-        return mBuffers.size();
+    if (mNumEntries > 0) {
+        return mNumEntries;
     }
     *finalResult = mEOSResult;
     return 0;
@@ -481,23 +581,47 @@ int64_t AnotherPacketSource::getEstimatedBufferDurationUs() {
         return mEstimatedBufferDurationUs;
     }
 
-    SortedVector<int64_t> maxTimesUs;
-    List<sp<ABuffer> >::iterator it;
+    // The two largest distinct timestamps, once at least three were seen.
     int64_t t1 = 0, t2 = 0;
-    for (it = mBuffers.begin(); it != mBuffers.end(); ++it) {
-        int64_t timeUs = 0;
-        const sp<ABuffer> &buffer = *it;
-        if (!buffer->meta()->findInt64("timeUs", &timeUs)) {
+    bool hasT1 = false, hasT2 = false, hasMore = false;
+    for (size_t i = 0; i < mNumEntries; ++i) {
+        const Entry &entry = entryAt_l(i);
+        if (entry.mIsDiscontinuity) {
+            continue;
+        }
+        int64_t timeUs = entry.mTimeUs;
+        if ((hasT2 && timeUs == t2) || (hasT1 && timeUs == t1)) {
             continue;
         }
-        maxTimesUs.add(timeUs);
-        while (maxTimesUs.size() > 2) {
-            maxTimesUs.removeAt(0);
-            t1 = maxTimesUs.itemAt(0);
-            t2 = maxTimesUs.itemAt(1);
+        if (hasT1) {
+            hasMore = true;
+        }
+        if (!hasT2 || timeUs > t2) {
+            t1 = t2;
+            hasT1 = hasT2;
+            t2 = timeUs;
+            hasT2 = true;
+        } else if (!hasT1 || timeUs > t1) {
+            t1 = timeUs;
+            hasT1 = true;
         }
     }
-    return mEstimatedBufferDurationUs = t2 - t1;
+    return mEstimatedBufferDurationUs = hasMore ? t2 - t1 : 0;
+}
+
+size_t AnotherPacketSource::getBufferedBytes() {
+    Mutex::Autolock autoLock(mLock);
+    return mBufferedBytes;
+}
+
+bool AnotherPacketSource::isFull() {
+    Mutex::Autolock autoLock(mLock);
+    return mMaxBufferedBytes > 0 && mBufferedBytes >= mMaxBufferedBytes;
+}
+
+void AnotherPacketSource::setMaxBufferedBytes(size_t maxBytes) {
+    Mutex::Autolock autoLock(mLock);
+    mMaxBufferedBytes = maxBytes;
 }
 
 status_t AnotherPacketSource::nextBufferTime(int64_t *timeUs) {
@@ -505,12 +629,13 @@ status_t AnotherPacketSource::nextBufferTime(int64_t *timeUs) {
 
     Mutex::Autolock autoLock(mLock);
 
-    if (mBuffers.empty()) {
+    if (mNumEntries == 0) {
         return mEOSResult != OK ? mEOSResult : -EWOULDBLOCK;
     }
 
-    sp<ABuffer> buffer = *mBuffers.begin();
-    CHECK(buffer->meta()->findInt64("timeUs", timeUs));
+    const Entry &entry = entryAt_l(0);
+    CHECK(!entry.mIsDiscontinuity);
+    *timeUs = entry.mTimeUs;
 
     return OK;
 }
@@ -551,27 +676,23 @@ sp<AMessage> AnotherPacketSource::getMetaAfterLastDequeued(int64_t delayUs) {
     int64_t lastUs = -1;
     int64_t durationUs = 0;
 
-    List<sp<ABuffer> >::iterator it;
-    for (it = mBuffers.begin(); it != mBuffers.end(); ++it) {
-        const sp<ABuffer> &buffer = *it;
-        int32_t discontinuity;
-        if (buffer->meta()->findInt32("discontinuity", &discontinuity)) {
+    for (size_t i = 0; i < mNumEntries; ++i) {
+        const Entry &entry = entryAt_l(i);
+        if (entry.mIsDiscontinuity) {
             durationUs += lastUs - firstUs;
             firstUs = -1;
             lastUs = -1;
             continue;
         }
-        int64_t timeUs;
-        if (buffer->meta()->findInt64("timeUs", &timeUs)) {
-            if (firstUs < 0) {
-                firstUs = timeUs;
-            }
-            if (lastUs < 0 || timeUs > lastUs) {
-                lastUs = timeUs;
-            }
-            if (durationUs + (lastUs - firstUs) >= delayUs) {
-                return buffer->meta();
-            }
+        int64_t timeUs = entry.mTimeUs;
+        if (firstUs < 0) {
+            firstUs = timeUs;
+        }
+        if (lastUs < 0 || timeUs > lastUs) {
+            lastUs = timeUs;
+        }
+        if (durationUs + (lastUs - firstUs) >= delayUs) {
+            return entry.mBuffer->meta();
         }
     }
     return NULL;
@@ -588,7 +709,7 @@ void AnotherPacketSource::trimBuffersAfterMeta(
     }
 
     Mutex::Autolock autoLock(mLock);
-    if (mBuffers.empty()) {
+    if (mNumEntries == 0) {
         return;
     }
 
@@ -596,30 +717,31 @@ void AnotherPacketSource::trimBuffersAfterMeta(
     ALOGV("trimBuffersAfterMeta: discontinuitySeq %d, timeUs %lld",
             stopTime.mSeq, (long long)stopTime.mTimeUs);
 
-    List<sp<ABuffer> >::iterator it;
+    size_t i;
     List<DiscontinuitySegment >::iterator it2;
     sp<AMessage> newLatestEnqueuedMeta = NULL;
     int64_t newLastQueuedTimeUs = 0;
-    for (it = mBuffers.begin(), it2 = mDiscontinuitySegments.begin(); it != mBuffers.end(); ++it) {
-        const sp<ABuffer> &buffer = *it;
-        int32_t discontinuity;
-        if (buffer->meta()->findInt32("discontinuity", &discontinuity)) {
+    for (i = 0, it2 = mDiscontinuitySegments.begin(); i < mNumEntries; ++i) {
+        const Entry &entry = entryAt_l(i);
+        if (entry.mIsDiscontinuity) {
             // CHECK(it2 != mDiscontinuitySegments.end());
             ++it2;
             continue;
         }
 
-        HLSTime curTime(buffer->meta());
+        HLSTime curTime(entry.mBuffer->meta());
         if (!(curTime < stopTime)) {
             ALOGV("trimming from %lld (inclusive) to end",
                     (long long)curTime.mTimeUs);
             break;
         }
-        newLatestEnqueuedMeta = buffer->meta();
+        newLatestEnqueuedMeta = entry.mBuffer->meta();
         newLastQueuedTimeUs = curTime.mTimeUs;
     }
 
-    mBuffers.erase(it, mBuffers.end());
+    while (mNumEntries > i) {
+        popBack_l();
+    }
     mLatestEnqueuedMeta = newLatestEnqueuedMeta;
     mLastQueuedTimeUs = newLastQueuedTimeUs;
 
@@ -648,18 +770,18 @@ sp<AMessage> AnotherPacketSource::trimBuffersBeforeMeta(
     sp<AMessage> firstMeta;
     int64_t firstTimeUs = -1;
     Mutex::Autolock autoLock(mLock);
-    if (mBuffers.empty()) {
+    if (mNumEntries == 0) {
         return NULL;
     }
 
     sp<MetaData> format;
     bool isAvc = false;
 
-    List<sp<ABuffer> >::iterator it;
-    for (it = mBuffers.begin(); it != mBuffers.end(); ++it) {
-        const sp<ABuffer> &buffer = *it;
-        int32_t discontinuity;
-        if (buffer->meta()->findInt32("discontinuity", &discontinuity)) {
+    size_t i;
+    for (i = 0; i < mNumEntries; ++i) {
+        const Entry &entry = entryAt_l(i);
+        const sp<ABuffer> &buffer = entry.mBuffer;
+        if (entry.mIsDiscontinuity) {
             mDiscontinuitySegments.erase(mDiscontinuitySegments.begin());
             // CHECK(!mDiscontinuitySegments.empty());
             format = NULL;
@@ -676,7 +798,9 @@ sp<AMessage> AnotherPacketSource::trimBuffersBeforeMeta(
                         && !strcasecmp(mime, MEDIA_MIMETYPE_VIDEO_AVC);
             }
         }
-        if (isAvc && !IsIDR(buffer->data(), buffer->size())) {
+        // Producers that flag sync frames save scanning every access unit.
+        if (isAvc && !(mHasSyncFlags
+                ? entry.mIsSync : IsIDR(buffer->data(), buffer->size()))) {
             continue;
         }
 
@@ -689,7 +813,9 @@ sp<AMessage> AnotherPacketSource::trimBuffersBeforeMeta(
             break;
         }
     }
-    mBuffers.erase(mBuffers.begin(), it);
+    for (; i > 0; --i) {
+        popFront_l(NULL);
+    }
     mLatestDequeuedMeta = NULL;
 
     // CHECK(!mDiscontinuitySegments.empty());
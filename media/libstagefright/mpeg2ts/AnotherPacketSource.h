@@ -22,6 +22,7 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <utils/threads.h>
 #include <utils/List.h>
+#include <utils/Vector.h>
 
 #include "ATSParser.h"
 
@@ -60,6 +61,15 @@ struct AnotherPacketSource : public MediaSource {
     // Returns the difference between the two largest timestamps queued
     int64_t getEstimatedBufferDurationUs();
 
+    // Returns the total payload size of the queued access units.
+    size_t getBufferedBytes();
+
+    // Returns true once the queued access units take up the memory cap.
+    // Producers should stop feeding the source until it drains.
+    bool isFull();
+
+    void setMaxBufferedBytes(size_t maxBytes);
+
     status_t nextBufferTime(int64_t *timeUs);
 
     void queueAccessUnit(const sp<ABuffer> &buffer);
@@ -89,6 +99,22 @@ protected:
     virtual ~AnotherPacketSource();
 
 private:
+    // Queued access unit or discontinuity marker, with the meta fields
+    // the queue needs cached so it doesn't have to look them up.
+    struct Entry {
+        Entry()
+            : mSize(0),
+              mTimeUs(-1),
+              mIsDiscontinuity(false),
+              mIsSync(false) {
+        }
+
+        sp<ABuffer> mBuffer;
+        size_t mSize;
+        int64_t mTimeUs;
+        bool mIsDiscontinuity;
+        bool mIsSync;
+    };
 
     struct DiscontinuitySegment {
         int64_t mMaxDequeTimeUs, mMaxEnqueTimeUs;
@@ -117,13 +143,37 @@ private:
     sp<MetaData> mFormat;
     int64_t mLastQueuedTimeUs;
     int64_t mEstimatedBufferDurationUs;
-    List<sp<ABuffer> > mBuffers;
+
+    // Queued entries, in a ring of power-of-two capacity. The entry at
+    // the front of the queue is mEntries[mHead].
+    Vector<Entry> mEntries;
+    size_t mHead;
+    size_t mNumEntries;
+
+    size_t mNumDiscontinuities;
+    size_t mBufferedBytes;
+    size_t mMaxBufferedBytes;
+    // Set once the producer flags sync frames with "isSync".
+    bool mHasSyncFlags;
     status_t mEOSResult;
     sp<AMessage> mLatestEnqueuedMeta;
     sp<AMessage> mLatestDequeuedMeta;
 
     bool wasFormatChange(int32_t discontinuityType) const;
 
+    Entry &entryAt_l(size_t index);
+    void growEntries_l();
+    void pushBack_l(const Entry &entry);
+    void pushFront_l(const Entry &entry);
+    void popFront_l(Entry *entry);
+    void popBack_l();
+    void clearEntries_l();
+    Entry makeEntry_l(const sp<ABuffer> &buffer);
+
+    // Removes the front entry, updating the bookkeeping. Returns
+    // INFO_DISCONTINUITY for discontinuity markers.
+    status_t dequeueEntry_l(sp<ABuffer> *buffer);
+
     DISALLOW_EVIL_CONSTRUCTORS(AnotherPacketSource);
 };
 
@@ -92,7 +92,7 @@ ARTPAssembler::AssemblyStatus AAVCAssembler::addNALUnit(
 
     unsigned nalType = data[0] & 0x1f;
     if (nalType >= 1 && nalType <= 23) {
-        addSingleNALUnit(buffer);
+        addSingleNALUnit(buffer, 0, size);
         queue->erase(queue->begin());
         ++mNextExpectedSeqNo;
         return OK;
@@ -123,21 +123,27 @@ ARTPAssembler::AssemblyStatus AAVCAssembler::addNALUnit(
     }
 }
 
-void AAVCAssembler::addSingleNALUnit(const sp<ABuffer> &buffer) {
-    ALOGV("addSingleNALUnit of size %zu", buffer->size());
-#if !LOG_NDEBUG
-    hexdump(buffer->data(), buffer->size());
-#endif
-
+void AAVCAssembler::beginNALUnit(const sp<ABuffer> &buffer) {
     uint32_t rtpTime;
     CHECK(buffer->meta()->findInt32("rtp-time", (int32_t *)&rtpTime));
 
-    if (!mNALUnits.empty() && rtpTime != mAccessUnitRTPTime) {
+    if (!mAccessUnit.empty() && rtpTime != mAccessUnitRTPTime) {
         submitAccessUnit();
     }
     mAccessUnitRTPTime = rtpTime;
 
-    mNALUnits.push_back(buffer);
+    mAccessUnit.appendBytes("\x00\x00\x00\x01", 4);
+}
+
+void AAVCAssembler::addSingleNALUnit(
+        const sp<ABuffer> &buffer, size_t offset, size_t size) {
+    ALOGV("addSingleNALUnit of size %zu", size);
+#if !LOG_NDEBUG
+    hexdump(buffer->data() + offset, size);
+#endif
+
+    beginNALUnit(buffer);
+    mAccessUnit.append(buffer, offset, size);
 }
 
 bool AAVCAssembler::addSingleTimeAggregationPacket(const sp<ABuffer> &buffer) {
@@ -159,12 +165,7 @@ bool AAVCAssembler::addSingleTimeAggregationPacket(const sp<ABuffer> &buffer) {
             return false;
         }
 
-        sp<ABuffer> unit = new ABuffer(nalSize);
-        memcpy(unit->data(), &data[2], nalSize);
-
-        CopyTimes(unit, buffer);
-
-        addSingleNALUnit(unit);
+        addSingleNALUnit(buffer, &data[2] - buffer->data(), nalSize);
 
         data += 2 + nalSize;
         size -= 2 + nalSize;
@@ -278,18 +279,14 @@ ARTPAssembler::AssemblyStatus AAVCAssembler::addFragmentedNALUnit(
 
     mNextExpectedSeqNo = expectedSeqNo;
 
-    // We found all the fragments that make up the complete NAL unit.
-
-    // Leave room for the header. So far totalSize did not include the
-    // header byte.
-    ++totalSize;
+    // We found all the fragments that make up the complete NAL unit,
+    // reference their payloads behind the rebuilt header byte.
 
-    sp<ABuffer> unit = new ABuffer(totalSize);
-    CopyTimes(unit, *queue->begin());
+    beginNALUnit(*queue->begin());
 
-    unit->data()[0] = (nri << 5) | nalType;
+    uint8_t header = (nri << 5) | nalType;
+    mAccessUnit.appendBytes(&header, 1);
 
-    size_t offset = 1;
     List<sp<ABuffer> >::iterator it = queue->begin();
     for (size_t i = 0; i < totalCount; ++i) {
         const sp<ABuffer> &buffer = *it;
@@ -299,45 +296,23 @@ ARTPAssembler::AssemblyStatus AAVCAssembler::addFragmentedNALUnit(
         hexdump(buffer->data(), buffer->size());
 #endif
 
-        memcpy(unit->data() + offset, buffer->data() + 2, buffer->size() - 2);
-        offset += buffer->size() - 2;
+        mAccessUnit.append(buffer, 2, buffer->size() - 2);
 
         it = queue->erase(it);
     }
 
-    unit->setRange(0, totalSize);
-
-    addSingleNALUnit(unit);
-
-    ALOGV("successfully assembled a NAL unit from fragments.");
+    ALOGV("successfully assembled a NAL unit of %zu bytes from fragments.",
+          totalSize + 1);
 
     return OK;
 }
 
 void AAVCAssembler::submitAccessUnit() {
-    CHECK(!mNALUnits.empty());
-
-    ALOGV("Access unit complete (%zu nal units)", mNALUnits.size());
+    CHECK(!mAccessUnit.empty());
 
-    size_t totalSize = 0;
-    for (List<sp<ABuffer> >::iterator it = mNALUnits.begin();
-         it != mNALUnits.end(); ++it) {
-        totalSize += 4 + (*it)->size();
-    }
-
-    sp<ABuffer> accessUnit = new ABuffer(totalSize);
-    size_t offset = 0;
-    for (List<sp<ABuffer> >::iterator it = mNALUnits.begin();
-         it != mNALUnits.end(); ++it) {
-        memcpy(accessUnit->data() + offset, "\x00\x00\x00\x01", 4);
-        offset += 4;
-
-        sp<ABuffer> nal = *it;
-        memcpy(accessUnit->data() + offset, nal->data(), nal->size());
-        offset += nal->size();
-    }
+    ALOGV("Access unit complete (%zu bytes)", mAccessUnit.size());
 
-    CopyTimes(accessUnit, *mNALUnits.begin());
+    sp<ABuffer> accessUnit = mAccessUnit.build();
 
 #if 0
     printf(mAccessUnitDamaged ? "X" : ".");
@@ -348,7 +323,6 @@ void AAVCAssembler::submitAccessUnit() {
         accessUnit->meta()->setInt32("damaged", true);
     }
 
-    mNALUnits.clear();
     mAccessUnitDamaged = false;
 
     sp<AMessage> msg = mNotifyMsg->dup();
@@ -45,10 +45,12 @@ private:
     bool mNextExpectedSeqNoValid;
     uint32_t mNextExpectedSeqNo;
     bool mAccessUnitDamaged;
-    List<sp<ABuffer> > mNALUnits;
+    AccessUnitBuilder mAccessUnit;
 
     AssemblyStatus addNALUnit(const sp<ARTPSource> &source);
-    void addSingleNALUnit(const sp<ABuffer> &buffer);
+    void beginNALUnit(const sp<ABuffer> &buffer);
+    void addSingleNALUnit(
+            const sp<ABuffer> &buffer, size_t offset, size_t size);
     AssemblyStatus addFragmentedNALUnit(List<sp<ABuffer> > *queue);
     bool addSingleTimeAggregationPacket(const sp<ABuffer> &buffer);
 
@@ -88,7 +88,7 @@ ARTPAssembler::AssemblyStatus AH263Assembler::addPacket(
     uint32_t rtpTime;
     CHECK(buffer->meta()->findInt32("rtp-time", (int32_t *)&rtpTime));
 
-    if (mPackets.size() > 0 && rtpTime != mAccessUnitRTPTime) {
+    if (!mAccessUnit.empty() && rtpTime != mAccessUnitRTPTime) {
         submitAccessUnit();
     }
     mAccessUnitRTPTime = rtpTime;
@@ -132,16 +132,14 @@ ARTPAssembler::AssemblyStatus AH263Assembler::addPacket(
         return MALFORMED_PACKET;
     }
 
-    size_t skip = V + PLEN + (P ? 0 : 2);
-
-    buffer->setRange(buffer->offset() + skip, buffer->size() - skip);
-
+    // With P set the payload header stands in for the two zero bytes of
+    // the picture start code.
     if (P) {
-        buffer->data()[0] = 0x00;
-        buffer->data()[1] = 0x00;
+        mAccessUnit.appendBytes("\x00\x00", 2);
     }
 
-    mPackets.push_back(buffer);
+    size_t skip = V + PLEN + 2;
+    mAccessUnit.append(buffer, skip, buffer->size() - skip);
 
     queue->erase(queue->begin());
     ++mNextExpectedSeqNo;
@@ -150,36 +148,13 @@ ARTPAssembler::AssemblyStatus AH263Assembler::addPacket(
 }
 
 void AH263Assembler::submitAccessUnit() {
-    CHECK(!mPackets.empty());
+    CHECK(!mAccessUnit.empty());
 
 #if VERBOSE
-    LOG(VERBOSE) << "Access unit complete (" << mPackets.size() << " packets)";
+    LOG(VERBOSE) << "Access unit complete (" << mAccessUnit.size() << " bytes)";
 #endif
 
-    size_t totalSize = 0;
-    List<sp<ABuffer> >::iterator it = mPackets.begin();
-    while (it != mPackets.end()) {
-        const sp<ABuffer> &unit = *it;
-
-        totalSize += unit->size();
-        ++it;
-    }
-
-    sp<ABuffer> accessUnit = new ABuffer(totalSize);
-    size_t offset = 0;
-    it = mPackets.begin();
-    while (it != mPackets.end()) {
-        const sp<ABuffer> &unit = *it;
-
-        memcpy((uint8_t *)accessUnit->data() + offset,
-               unit->data(), unit->size());
-
-        offset += unit->size();
-
-        ++it;
-    }
-
-    CopyTimes(accessUnit, *mPackets.begin());
+    sp<ABuffer> accessUnit = mAccessUnit.build();
 
 #if 0
     printf(mAccessUnitDamaged ? "X" : ".");
@@ -190,7 +165,6 @@ void AH263Assembler::submitAccessUnit() {
         accessUnit->meta()->setInt32("damaged", true);
     }
 
-    mPackets.clear();
     mAccessUnitDamaged = false;
 
     sp<AMessage> msg = mNotifyMsg->dup();
@@ -44,7 +44,7 @@ private:
     bool mNextExpectedSeqNoValid;
     uint32_t mNextExpectedSeqNo;
     bool mAccessUnitDamaged;
-    List<sp<ABuffer> > mPackets;
+    AccessUnitBuilder mAccessUnit;
 
     AssemblyStatus addPacket(const sp<ARTPSource> &source);
     void submitAccessUnit();
@@ -550,7 +550,10 @@ void AMPEG4AudioAssembler::submitAccessUnit() {
     LOG(VERBOSE) << "Access unit complete (" << mPackets.size() << " packets)";
 #endif
 
-    sp<ABuffer> accessUnit = MakeCompoundFromPackets(mPackets);
+    // removeLATMFraming() copies the payload out, so a single packet
+    // doesn't need to be made contiguous first.
+    sp<ABuffer> accessUnit = mPackets.size() == 1
+        ? *mPackets.begin() : MakeCompoundFromPackets(mPackets);
     accessUnit = removeLATMFraming(accessUnit);
     CopyTimes(accessUnit, *mPackets.begin());
 
@@ -16,6 +16,8 @@
 
 #include "ARTPAssembler.h"
 
+#include "ARTPSource.h"
+
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ALooper.h>
@@ -35,6 +37,13 @@ void ARTPAssembler::onPacketReceived(const sp<ARTPSource> &source) {
         status = assembleMore(source);
 
         if (status == WRONG_SEQUENCE_NUMBER) {
+            if (source->consumeDeclaredLoss()) {
+                // The jitter buffer already waited for this one.
+                mFirstFailureTimeUs = -1;
+                packetLost();
+                continue;
+            }
+
             if (mFirstFailureTimeUs >= 0) {
                 if (ALooper::GetNowUs() - mFirstFailureTimeUs > 10000LL) {
                     mFirstFailureTimeUs = -1;
@@ -68,6 +77,79 @@ void ARTPAssembler::CopyTimes(const sp<ABuffer> &to, const sp<ABuffer> &from) {
     to->setInt32Data(from->int32Data());
 }
 
+ARTPAssembler::AccessUnitBuilder::AccessUnitBuilder()
+    : mSize(0) {
+}
+
+void ARTPAssembler::AccessUnitBuilder::append(
+        const sp<ABuffer> &buffer, size_t offset, size_t size) {
+    CHECK_LE(offset + size, buffer->size());
+
+    if (mFirstBuffer == NULL) {
+        mFirstBuffer = buffer;
+    }
+
+    Piece piece;
+    piece.mBuffer = buffer;
+    piece.mOffset = buffer->offset() + offset;
+    piece.mSize = size;
+    mPieces.push(piece);
+
+    mSize += size;
+}
+
+void ARTPAssembler::AccessUnitBuilder::appendBytes(
+        const void *data, size_t size) {
+    if (!mPieces.empty()) {
+        Piece *last = &mPieces.editItemAt(mPieces.size() - 1);
+        if (last->mBuffer == NULL && last->mSize + size <= kMaxInlineSize) {
+            memcpy(&last->mInline[last->mSize], data, size);
+            last->mSize += size;
+            mSize += size;
+            return;
+        }
+    }
+
+    CHECK_LE(size, (size_t)kMaxInlineSize);
+
+    Piece piece;
+    piece.mOffset = 0;
+    piece.mSize = size;
+    memcpy(piece.mInline, data, size);
+    mPieces.push(piece);
+
+    mSize += size;
+}
+
+sp<ABuffer> ARTPAssembler::AccessUnitBuilder::build() {
+    CHECK(mFirstBuffer != NULL);
+
+    sp<ABuffer> accessUnit = new ABuffer(mSize);
+    uint8_t *dst = accessUnit->data();
+
+    for (size_t i = 0; i < mPieces.size(); ++i) {
+        const Piece &piece = mPieces.itemAt(i);
+
+        const uint8_t *src = piece.mBuffer != NULL
+            ? piece.mBuffer->base() + piece.mOffset : piece.mInline;
+
+        memcpy(dst, src, piece.mSize);
+        dst += piece.mSize;
+    }
+
+    CopyTimes(accessUnit, mFirstBuffer);
+
+    clear();
+
+    return accessUnit;
+}
+
+void ARTPAssembler::AccessUnitBuilder::clear() {
+    mPieces.clear();
+    mSize = 0;
+    mFirstBuffer.clear();
+}
+
 // static
 sp<ABuffer> ARTPAssembler::MakeADTSCompoundFromAACFrames(
         unsigned profile,
@@ -21,6 +21,7 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <utils/List.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -45,6 +46,43 @@ protected:
     virtual AssemblyStatus assembleMore(const sp<ARTPSource> &source) = 0;
     virtual void packetLost() = 0;
 
+    // Collects the pieces of an access unit as references into the packets
+    // carrying them, the payload is copied only once the unit is complete.
+    struct AccessUnitBuilder {
+        AccessUnitBuilder();
+
+        bool empty() const { return mPieces.empty(); }
+        size_t size() const { return mSize; }
+
+        // Appends |size| bytes starting |offset| bytes into |buffer|'s data.
+        void append(const sp<ABuffer> &buffer, size_t offset, size_t size);
+
+        // Appends a few bytes by value, i.e. start codes or rebuilt headers.
+        void appendBytes(const void *data, size_t size);
+
+        // Returns the contiguous access unit carrying the times of the first
+        // packet appended and resets the builder.
+        sp<ABuffer> build();
+
+        void clear();
+
+    private:
+        enum {
+            kMaxInlineSize = 8,
+        };
+
+        struct Piece {
+            sp<ABuffer> mBuffer;
+            size_t mOffset;  // relative to mBuffer->base()
+            size_t mSize;
+            uint8_t mInline[kMaxInlineSize];
+        };
+
+        Vector<Piece> mPieces;
+        size_t mSize;
+        sp<ABuffer> mFirstBuffer;
+    };
+
     static void CopyTimes(const sp<ABuffer> &to, const sp<ABuffer> &from);
 
     static sp<ABuffer> MakeADTSCompoundFromAACFrames(
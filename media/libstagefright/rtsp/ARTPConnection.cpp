@@ -25,6 +25,7 @@
 #include "ASessionDescription.h"
 
 #include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ABufferPool.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/AString.h>
@@ -37,6 +38,15 @@ namespace android {
 
 static const size_t kMaxUDPSize = 1500;
 
+// Largest RTP datagram accepted and the number of them read per recvmmsg.
+static const size_t kMaxRTPPacketSize = 65536;
+static const size_t kMaxRTPPacketsPerReceive = 8;
+
+// RTP packets are received straight into recycled buffers of this size,
+// larger datagrams spill into the scratch area and are copied out.
+static const size_t kPooledPacketSize = 2048;
+static const size_t kMaxPooledPackets = 256;
+
 static uint16_t u16at(const uint8_t *data) {
     return data[0] << 8 | data[1];
 }
@@ -70,7 +80,8 @@ struct ARTPConnection::StreamInfo {
 ARTPConnection::ARTPConnection(uint32_t flags)
     : mFlags(flags),
       mPollEventPending(false),
-      mLastReceiverReportTimeUs(-1) {
+      mLastReceiverReportTimeUs(-1),
+      mPacketPool(new ABufferPool(kPooledPacketSize, kMaxPooledPackets)) {
 }
 
 ARTPConnection::~ARTPConnection() {
@@ -305,6 +316,13 @@ void ARTPConnection::onPollStreams() {
         }
     }
 
+    for (List<StreamInfo>::iterator it = mStreams.begin();
+         it != mStreams.end(); ++it) {
+        for (size_t i = 0; i < it->mSources.size(); ++i) {
+            it->mSources.valueAt(i)->releaseExpiredPackets();
+        }
+    }
+
     int64_t nowUs = ALooper::GetNowUs();
     if (mLastReceiverReportTimeUs <= 0
             || mLastReceiverReportTimeUs + 5000000LL <= nowUs) {
@@ -375,6 +393,10 @@ status_t ARTPConnection::receive(StreamInfo *s, bool receiveRTP) {
 
     CHECK(!s->mIsInjected);
 
+    if (receiveRTP) {
+        return receiveRTPPackets(s);
+    }
+
     sp<ABuffer> buffer = new ABuffer(65536);
 
     socklen_t remoteAddrLen =
@@ -410,6 +432,70 @@ status_t ARTPConnection::receive(StreamInfo *s, bool receiveRTP) {
     return err;
 }
 
+status_t ARTPConnection::receiveRTPPackets(StreamInfo *s) {
+    if (mReceiveScratch == NULL) {
+        mReceiveScratch = new ABuffer(
+                (kMaxRTPPacketSize - kPooledPacketSize)
+                    * kMaxRTPPacketsPerReceive);
+    }
+
+    sp<ABuffer> buffers[kMaxRTPPacketsPerReceive];
+    struct mmsghdr msgs[kMaxRTPPacketsPerReceive];
+    struct iovec iovs[kMaxRTPPacketsPerReceive][2];
+    for (size_t i = 0; i < kMaxRTPPacketsPerReceive; ++i) {
+        buffers[i] = mPacketPool->acquire();
+
+        iovs[i][0].iov_base = buffers[i]->base();
+        iovs[i][0].iov_len = kPooledPacketSize;
+        iovs[i][1].iov_base = mReceiveScratch->base()
+            + i * (kMaxRTPPacketSize - kPooledPacketSize);
+        iovs[i][1].iov_len = kMaxRTPPacketSize - kPooledPacketSize;
+
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    // The socket was reported readable, pick up whatever else has queued
+    // up behind the first datagram without blocking.
+    int n;
+    do {
+        n = recvmmsg(
+                s->mRTPSocket, msgs, kMaxRTPPacketsPerReceive,
+                MSG_DONTWAIT, NULL /* timeout */);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // Spurious wakeup, whatever made the socket readable is gone.
+        return OK;
+    }
+
+    if (n <= 0) {
+        return -ECONNRESET;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        size_t nbytes = msgs[i].msg_len;
+        if (nbytes == 0) {
+            return -ECONNRESET;
+        }
+
+        sp<ABuffer> buffer = buffers[i];
+        if (nbytes <= kPooledPacketSize) {
+            buffer->setRange(0, nbytes);
+        } else {
+            buffer = new ABuffer(nbytes);
+            memcpy(buffer->data(), iovs[i][0].iov_base, kPooledPacketSize);
+            memcpy(buffer->data() + kPooledPacketSize,
+                   iovs[i][1].iov_base, nbytes - kPooledPacketSize);
+        }
+
+        parseRTP(s, buffer);
+    }
+
+    return OK;
+}
+
 status_t ARTPConnection::parseRTP(StreamInfo *s, const sp<ABuffer> &buffer) {
     if (s->mNumRTPPacketsReceived++ == 0) {
         sp<AMessage> notify = s->mNotifyMsg->dup();
@@ -24,6 +24,7 @@
 namespace android {
 
 struct ABuffer;
+struct ABufferPool;
 struct ARTPSource;
 struct ASessionDescription;
 
@@ -72,6 +73,10 @@ private:
     bool mPollEventPending;
     int64_t mLastReceiverReportTimeUs;
 
+    sp<ABuffer> mReceiveScratch;
+
+    sp<ABufferPool> mPacketPool;
+
     void onAddStream(const sp<AMessage> &msg);
     void onRemoveStream(const sp<AMessage> &msg);
     void onPollStreams();
@@ -79,6 +84,7 @@ private:
     void onSendReceiverReports();
 
     status_t receive(StreamInfo *info, bool receiveRTP);
+    status_t receiveRTPPackets(StreamInfo *info);
 
     status_t parseRTP(StreamInfo *info, const sp<ABuffer> &buffer);
     status_t parseRTCP(StreamInfo *info, const sp<ABuffer> &buffer);
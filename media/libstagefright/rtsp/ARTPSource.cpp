@@ -37,6 +37,15 @@ namespace android {
 
 static const uint32_t kSourceID = 0xdeadbeef;
 
+// Must be a power of two.
+static const size_t kReorderRingSize = 512;
+static const uint32_t kReorderRingMask = kReorderRingSize - 1;
+
+// How long packets following a gap are held back before the missing
+// packets are given up on, scaled from the measured jitter.
+static const int64_t kMinReorderDelayUs = 10000LL;
+static const int64_t kMaxReorderDelayUs = 100000LL;
+
 ARTPSource::ARTPSource(
         uint32_t id,
         const sp<ASessionDescription> &sessionDesc, size_t index,
@@ -47,6 +56,16 @@ ARTPSource::ARTPSource(
       mBaseSeqNumber(0),
       mNumBuffersReceived(0),
       mPrevNumBuffersReceived(0),
+      mNextReleaseSeqNumber(0),
+      mNumPacketsHeld(0),
+      mNumDeclaredLost(0),
+      mClockRate(0),
+      mLastTransitValid(false),
+      mLastTransit(0),
+      mJitterQ4(0),
+      mNumPacketsReordered(0),
+      mNumPacketsLost(0),
+      mNumDuplicates(0),
       mLastNTPTime(0),
       mLastNTPTimeUpdateUs(0),
       mIssueFIRRequests(false),
@@ -58,6 +77,15 @@ ARTPSource::ARTPSource(
     AString params;
     sessionDesc->getFormatType(index, &PT, &desc, &params);
 
+    if (strchr(desc.c_str(), '/') != NULL) {
+        int32_t numChannels;
+        ASessionDescription::ParseFormatDesc(
+                desc.c_str(), &mClockRate, &numChannels);
+    }
+
+    mReorderRing.insertAt(sp<ABuffer>(), 0, kReorderRingSize);
+    mArrivalTimesUs.insertAt(0LL, 0, kReorderRingSize);
+
     if (!strncmp(desc.c_str(), "H264/", 5)) {
         mAssembler = new AAVCAssembler(notify);
         mIssueFIRRequests = true;
@@ -98,6 +126,25 @@ void ARTPSource::processRTPPacket(const sp<ABuffer> &buffer) {
     }
 }
 
+bool ARTPSource::consumeDeclaredLoss() {
+    if (mNumDeclaredLost == 0) {
+        return false;
+    }
+
+    --mNumDeclaredLost;
+    return true;
+}
+
+void ARTPSource::releaseExpiredPackets() {
+    if (mNumPacketsHeld == 0 || mAssembler == NULL) {
+        return;
+    }
+
+    if (releasePackets(ALooper::GetNowUs(), false /* flush */)) {
+        mAssembler->onPacketReceived(this);
+    }
+}
+
 void ARTPSource::timeUpdate(uint32_t rtpTime, uint64_t ntpTime) {
     mLastNTPTime = ntpTime;
     mLastNTPTimeUpdateUs = ALooper::GetNowUs();
@@ -111,10 +158,14 @@ void ARTPSource::timeUpdate(uint32_t rtpTime, uint64_t ntpTime) {
 
 bool ARTPSource::queuePacket(const sp<ABuffer> &buffer) {
     uint32_t seqNum = (uint32_t)buffer->int32Data();
+    int64_t nowUs = ALooper::GetNowUs();
+
+    updateJitter(buffer, nowUs);
 
     if (mNumBuffersReceived++ == 0) {
         mHighestSeqNumber = seqNum;
         mBaseSeqNumber = seqNum;
+        mNextReleaseSeqNumber = seqNum + 1;
         mQueue.push_back(buffer);
         return true;
     }
@@ -155,26 +206,171 @@ bool ARTPSource::queuePacket(const sp<ABuffer> &buffer) {
 
     if (seqNum > mHighestSeqNumber) {
         mHighestSeqNumber = seqNum;
+    } else {
+        ++mNumPacketsReordered;
     }
 
     buffer->setInt32Data(seqNum);
 
-    List<sp<ABuffer> >::iterator it = mQueue.begin();
-    while (it != mQueue.end() && (uint32_t)(*it)->int32Data() < seqNum) {
-        ++it;
+    if (mQueue.empty()) {
+        // The assembler has caught up, nothing is left to skip.
+        mNumDeclaredLost = 0;
+    }
+
+    if (seqNum < mNextReleaseSeqNumber) {
+        return insertLatePacket(seqNum, buffer);
+    }
+
+    return insertPacket(seqNum, buffer, nowUs);
+}
+
+bool ARTPSource::insertPacket(
+        uint32_t seqNum, const sp<ABuffer> &buffer, int64_t nowUs) {
+    if (seqNum == mNextReleaseSeqNumber && mNumPacketsHeld == 0) {
+        // In order, which is the common case.
+        mQueue.push_back(buffer);
+        ++mNextReleaseSeqNumber;
+        return true;
     }
 
-    if (it != mQueue.end() && (uint32_t)(*it)->int32Data() == seqNum) {
+    if (seqNum - mNextReleaseSeqNumber >= kReorderRingSize) {
+        // Sequence discontinuity, release whatever is held and resume
+        // from here. The assembler resynchronizes on its own.
+        ALOGV("sequence jump from %u to %u", mNextReleaseSeqNumber, seqNum);
+
+        releasePackets(nowUs, true /* flush */);
+        mNumDeclaredLost = 0;
+        mNextReleaseSeqNumber = seqNum;
+    }
+
+    size_t index = seqNum & kReorderRingMask;
+    if (mReorderRing[index] != NULL) {
         ALOGW("Discarding duplicate buffer");
+        ++mNumDuplicates;
         return false;
     }
 
+    mReorderRing.editItemAt(index) = buffer;
+    mArrivalTimesUs.editItemAt(index) = nowUs;
+    ++mNumPacketsHeld;
+
+    return releasePackets(nowUs, false /* flush */);
+}
+
+bool ARTPSource::insertLatePacket(uint32_t seqNum, const sp<ABuffer> &buffer) {
+    // Arrived after the jitter buffer released its successors, let the
+    // assembler decide whether it still has a use for it. Late packets
+    // are rare and belong near the tail of the queue.
+    List<sp<ABuffer> >::iterator it = mQueue.end();
+    while (it != mQueue.begin()) {
+        List<sp<ABuffer> >::iterator prev = it;
+        --prev;
+
+        uint32_t prevSeqNum = (uint32_t)(*prev)->int32Data();
+        if (prevSeqNum == seqNum) {
+            ALOGW("Discarding duplicate buffer");
+            ++mNumDuplicates;
+            return false;
+        } else if (prevSeqNum < seqNum) {
+            break;
+        }
+
+        it = prev;
+    }
+
     mQueue.insert(it, buffer);
 
     return true;
 }
 
+bool ARTPSource::releasePackets(int64_t nowUs, bool flush) {
+    bool released = false;
+
+    while (mNumPacketsHeld > 0) {
+        size_t index = mNextReleaseSeqNumber & kReorderRingMask;
+
+        if (mReorderRing[index] != NULL) {
+            mQueue.push_back(mReorderRing[index]);
+            mReorderRing.editItemAt(index).clear();
+            --mNumPacketsHeld;
+            ++mNextReleaseSeqNumber;
+            released = true;
+            continue;
+        }
+
+        // There's a gap, find the first packet following it.
+        uint32_t seqNum = mNextReleaseSeqNumber + 1;
+        while (mReorderRing[seqNum & kReorderRingMask] == NULL) {
+            ++seqNum;
+        }
+
+        if (!flush
+                && nowUs - mArrivalTimesUs[seqNum & kReorderRingMask]
+                        < reorderDelayUs()) {
+            break;
+        }
+
+        uint32_t numLost = seqNum - mNextReleaseSeqNumber;
+
+        ALOGV("giving up on %u packet(s) starting at %u",
+              numLost, mNextReleaseSeqNumber);
+
+        mNumPacketsLost += numLost;
+        mNumDeclaredLost += numLost;
+        mNextReleaseSeqNumber = seqNum;
+    }
+
+    return released;
+}
+
+void ARTPSource::updateJitter(const sp<ABuffer> &buffer, int64_t nowUs) {
+    uint32_t rtpTime;
+    if (mClockRate <= 0
+            || !buffer->meta()->findInt32("rtp-time", (int32_t *)&rtpTime)) {
+        return;
+    }
+
+    // According to appendix A.8 in RFC 3550
+    int64_t arrival = nowUs * mClockRate / 1000000LL;
+    int64_t transit = arrival - (int64_t)rtpTime;
+
+    if (mLastTransitValid) {
+        int64_t d = transit - mLastTransit;
+        if (d < 0) {
+            d = -d;
+        }
+
+        // Ignore the sample straddling a wrap of the RTP timestamp.
+        if (d < (1LL << 31)) {
+            mJitterQ4 += d - ((mJitterQ4 + 8) >> 4);
+        }
+    }
+
+    mLastTransit = transit;
+    mLastTransitValid = true;
+}
+
+int64_t ARTPSource::reorderDelayUs() const {
+    int64_t delayUs = 0;
+    if (mClockRate > 0) {
+        delayUs = 3 * (mJitterQ4 >> 4) * 1000000LL / mClockRate;
+    }
+
+    if (delayUs < kMinReorderDelayUs) {
+        delayUs = kMinReorderDelayUs;
+    } else if (delayUs > kMaxReorderDelayUs) {
+        delayUs = kMaxReorderDelayUs;
+    }
+
+    return delayUs;
+}
+
 void ARTPSource::byeReceived() {
+    if (releasePackets(ALooper::GetNowUs(), true /* flush */)
+            && mAssembler != NULL) {
+        mAssembler->onPacketReceived(this);
+    }
+
     if (mAssembler != NULL) {
         mAssembler->onByeReceived();
     }
@@ -279,10 +475,12 @@ void ARTPSource::addReceiverReport(const sp<ABuffer> &buffer) {
     data[18] = (mHighestSeqNumber >> 8) & 0xff;
     data[19] = mHighestSeqNumber & 0xff;
 
-    data[20] = 0x00;  // Interarrival jitter
-    data[21] = 0x00;
-    data[22] = 0x00;
-    data[23] = 0x00;
+    uint32_t jitter = (uint32_t)(mJitterQ4 >> 4);
+
+    data[20] = jitter >> 24;  // Interarrival jitter
+    data[21] = (jitter >> 16) & 0xff;
+    data[22] = (jitter >> 8) & 0xff;
+    data[23] = jitter & 0xff;
 
     uint32_t LSR = 0;
     uint32_t DLSR = 0;
@@ -304,6 +502,11 @@ void ARTPSource::addReceiverReport(const sp<ABuffer> &buffer) {
     data[31] = DLSR & 0xff;
 
     buffer->setRange(buffer->offset(), buffer->size() + 32);
+
+    ALOGV("ssrc 0x%08x: jitter %u, reordered %u, lost %u, duplicates %u, "
+          "awaiting %zu",
+          mID, jitter, mNumPacketsReordered, mNumPacketsLost, mNumDuplicates,
+          mNumPacketsHeld);
 }
 
 }  // namespace android
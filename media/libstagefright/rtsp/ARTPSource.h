@@ -23,6 +23,7 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <utils/List.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -43,6 +44,15 @@ struct ARTPSource : public RefBase {
 
     List<sp<ABuffer> > *queue() { return &mQueue; }
 
+    // Returns true, once per missing packet, if the jitter buffer gave up
+    // waiting for a packet preceding those in the queue. The assembler can
+    // then skip it right away instead of timing out on it again.
+    bool consumeDeclaredLoss();
+
+    // Called periodically, hands packets whose reorder delay expired
+    // to the assembler even if no further packets arrive.
+    void releaseExpiredPackets();
+
     void addReceiverReport(const sp<ABuffer> &buffer);
     void addFIR(const sp<ABuffer> &buffer);
 
@@ -57,6 +67,26 @@ private:
     List<sp<ABuffer> > mQueue;
     sp<ARTPAssembler> mAssembler;
 
+    // Packets arriving ahead of a gap wait in a ring indexed by extended
+    // sequence number until the gap fills or the reorder delay expires,
+    // everything in mQueue is contiguous except for declared losses.
+    Vector<sp<ABuffer> > mReorderRing;
+    Vector<int64_t> mArrivalTimesUs;
+    uint32_t mNextReleaseSeqNumber;
+    size_t mNumPacketsHeld;
+    uint32_t mNumDeclaredLost;
+
+    // Interarrival jitter according to appendix A.8 in RFC 3550,
+    // in RTP timestamp units scaled by 16.
+    int32_t mClockRate;
+    bool mLastTransitValid;
+    int64_t mLastTransit;
+    int64_t mJitterQ4;
+
+    uint32_t mNumPacketsReordered;
+    uint32_t mNumPacketsLost;
+    uint32_t mNumDuplicates;
+
     uint64_t mLastNTPTime;
     int64_t mLastNTPTimeUpdateUs;
 
@@ -67,6 +97,11 @@ private:
     sp<AMessage> mNotify;
 
     bool queuePacket(const sp<ABuffer> &buffer);
+    bool insertPacket(uint32_t seqNum, const sp<ABuffer> &buffer, int64_t nowUs);
+    bool insertLatePacket(uint32_t seqNum, const sp<ABuffer> &buffer);
+    bool releasePackets(int64_t nowUs, bool flush);
+    void updateJitter(const sp<ABuffer> &buffer, int64_t nowUs);
+    int64_t reorderDelayUs() const;
 
     DISALLOW_EVIL_CONSTRUCTORS(ARTPSource);
 };
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ARTPSourceUnitTest"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+#include "ARTPConnection.h"
+#include "ASessionDescription.h"
+
+using namespace android;
+
+namespace {
+
+const char kSDP[] =
+    "v=0\r\n"
+    "o=- 0 0 IN IP4 127.0.0.1\r\n"
+    "s=ARTPSourceUnitTest\r\n"
+    "c=IN IP4 127.0.0.1\r\n"
+    "t=0 0\r\n"
+    "m=audio 0 RTP/AVP 0\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n";
+
+const uint32_t kSSRC = 0x12345678;
+const uint16_t kBaseSeqNum = 65500;  // exercises the 16-bit wrap
+const size_t kNumPackets = 200;
+const size_t kPayloadSize = 160;
+// Doesn't fit the pooled receive buffers and spills into the scratch area.
+const size_t kLargePayloadSize = 3000;
+// Packets carry 20ms of audio but are sent faster than real time. The
+// resulting interarrival jitter grows the reorder delay past the span of
+// the reordering below, so the test doesn't depend on scheduling latency.
+const int64_t kPacketIntervalUs = 2000LL;
+const int64_t kTimeoutNs = 5000000000LL;
+
+struct AccessUnitCollector : public AHandler {
+    // Waits until at least |count| access units have been received.
+    bool waitFor(size_t count) {
+        Mutex::Autolock autoLock(mLock);
+        while (mSeqNums.size() < count) {
+            if (mCondition.waitRelative(mLock, kTimeoutNs) != OK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Vector<uint32_t> seqNums() {
+        Mutex::Autolock autoLock(mLock);
+        return mSeqNums;
+    }
+
+    Vector<sp<ABuffer> > accessUnits() {
+        Mutex::Autolock autoLock(mLock);
+        return mAccessUnits;
+    }
+
+    void clear() {
+        Mutex::Autolock autoLock(mLock);
+        mSeqNums.clear();
+        mAccessUnits.clear();
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        sp<ABuffer> accessUnit;
+        if (!msg->findBuffer("access-unit", &accessUnit)) {
+            return;
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        mSeqNums.push((uint32_t)accessUnit->int32Data());
+        mAccessUnits.push(accessUnit);
+        mCondition.broadcast();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    Vector<uint32_t> mSeqNums;
+    Vector<sp<ABuffer> > mAccessUnits;
+};
+
+}  // namespace
+
+class ARTPSourceUnitTest : public ::testing::Test {
+public:
+    ARTPSourceUnitTest()
+        : mRTPSocket(-1),
+          mRTCPSocket(-1),
+          mSenderSocket(-1),
+          mRTPPort(0) {
+    }
+
+    virtual void SetUp() override {
+        mLooper = new ALooper;
+        mLooper->setName("ARTPSourceUnitTest");
+        mLooper->start();
+
+        mConnection = new ARTPConnection;
+        mLooper->registerHandler(mConnection);
+
+        mCollector = new AccessUnitCollector;
+        mLooper->registerHandler(mCollector);
+
+        sp<ASessionDescription> desc = new ASessionDescription;
+        ASSERT_TRUE(desc->setTo(kSDP, strlen(kSDP)));
+
+        ARTPConnection::MakePortPair(&mRTPSocket, &mRTCPSocket, &mRTPPort);
+
+        mConnection->addStream(
+                mRTPSocket, mRTCPSocket, desc, 1 /* index */,
+                new AMessage(0, mCollector), false /* injected */);
+
+        mSenderSocket = socket(AF_INET, SOCK_DGRAM, 0);
+        ASSERT_GE(mSenderSocket, 0);
+
+        memset(&mRemoteAddr, 0, sizeof(mRemoteAddr));
+        mRemoteAddr.sin_family = AF_INET;
+        mRemoteAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        mRemoteAddr.sin_port = htons(mRTPPort);
+    }
+
+    virtual void TearDown() override {
+        mConnection->removeStream(mRTPSocket, mRTCPSocket);
+        mLooper->stop();
+
+        close(mSenderSocket);
+        close(mRTPSocket);
+        close(mRTCPSocket);
+    }
+
+protected:
+    sp<ALooper> mLooper;
+    sp<ARTPConnection> mConnection;
+    sp<AccessUnitCollector> mCollector;
+
+    int mRTPSocket;
+    int mRTCPSocket;
+    int mSenderSocket;
+    unsigned mRTPPort;
+    struct sockaddr_in mRemoteAddr;
+
+    // Sends the packet with the |index|-th sequence number after kBaseSeqNum,
+    // its payload bytes are all set to the low byte of |index|.
+    void sendPacket(size_t index, size_t payloadSize = kPayloadSize) {
+        uint8_t packet[12 + kLargePayloadSize];
+        ASSERT_LE(payloadSize, kLargePayloadSize);
+        uint16_t seqNum = (uint16_t)((kBaseSeqNum + index) & 0xffff);
+        uint32_t rtpTime = index * kPayloadSize;
+
+        packet[0] = 0x80;
+        packet[1] = 0;  // PT 0, PCMU
+        packet[2] = seqNum >> 8;
+        packet[3] = seqNum & 0xff;
+        packet[4] = rtpTime >> 24;
+        packet[5] = (rtpTime >> 16) & 0xff;
+        packet[6] = (rtpTime >> 8) & 0xff;
+        packet[7] = rtpTime & 0xff;
+        packet[8] = kSSRC >> 24;
+        packet[9] = (kSSRC >> 16) & 0xff;
+        packet[10] = (kSSRC >> 8) & 0xff;
+        packet[11] = kSSRC & 0xff;
+        memset(&packet[12], index & 0xff, payloadSize);
+
+        ASSERT_EQ((ssize_t)(12 + payloadSize),
+                  sendto(mSenderSocket, packet, 12 + payloadSize, 0,
+                         (const struct sockaddr *)&mRemoteAddr,
+                         sizeof(mRemoteAddr)));
+    }
+};
+
+TEST_F(ARTPSourceUnitTest, ReorderAndLossTest) {
+    // Packets swapped or shuffled on the way, and packets never sent.
+    Vector<size_t> order;
+    for (size_t i = 0; i < kNumPackets; ++i) {
+        order.push(i);
+    }
+    std::swap(order.editItemAt(10), order.editItemAt(11));
+    std::swap(order.editItemAt(40), order.editItemAt(43));
+    std::swap(order.editItemAt(41), order.editItemAt(42));
+    std::swap(order.editItemAt(120), order.editItemAt(125));
+
+    const size_t kDropped[] = { 60, 90, 91, 92, 150 };
+    const size_t kNumDropped = sizeof(kDropped) / sizeof(kDropped[0]);
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        bool dropped = false;
+        for (size_t j = 0; j < kNumDropped; ++j) {
+            dropped |= (order[i] == kDropped[j]);
+        }
+        if (!dropped) {
+            sendPacket(order[i]);
+        }
+        usleep(kPacketIntervalUs);
+    }
+
+    ASSERT_TRUE(mCollector->waitFor(kNumPackets - kNumDropped));
+
+    // Everything that was sent comes out exactly once and in order.
+    Vector<uint32_t> seqNums = mCollector->seqNums();
+    ASSERT_EQ(kNumPackets - kNumDropped, seqNums.size());
+
+    size_t next = 0;
+    for (size_t i = 0; i < seqNums.size(); ++i, ++next) {
+        for (size_t j = 0; j < kNumDropped; ++j) {
+            if (next == kDropped[j]) {
+                ++next;
+            }
+        }
+        EXPECT_EQ(kBaseSeqNum + next, seqNums[i]) << "access unit " << i;
+    }
+}
+
+TEST_F(ARTPSourceUnitTest, HeldPacketReleasedWithoutFurtherTrafficTest) {
+    // The last packet sent follows a gap, nothing arrives afterwards that
+    // would make the jitter buffer give up on the missing one.
+    const size_t kNumSent = 20;
+    for (size_t i = 0; i < kNumSent; ++i) {
+        if (i != kNumSent - 2) {
+            sendPacket(i);
+        }
+        usleep(kPacketIntervalUs);
+    }
+
+    ASSERT_TRUE(mCollector->waitFor(kNumSent - 1));
+
+    Vector<uint32_t> seqNums = mCollector->seqNums();
+    ASSERT_EQ(kNumSent - 1, seqNums.size());
+    EXPECT_EQ(kBaseSeqNum + kNumSent - 3, seqNums[kNumSent - 3]);
+    EXPECT_EQ(kBaseSeqNum + kNumSent - 1, seqNums[kNumSent - 2]);
+}
+
+TEST_F(ARTPSourceUnitTest, PooledReceiveBuffersTest) {
+    // Back to back bursts are picked up several datagrams per receive call.
+    // Access units are held on to while more packets arrive, so a receive
+    // buffer recycled too early would show up as corrupted payload.
+    const size_t kNumBursts = 4;
+    const size_t kPacketsPerBurst = 24;
+
+    size_t numSent = 0;
+    size_t firstHeld = 0;
+    for (size_t burst = 0; burst < kNumBursts; ++burst) {
+        for (size_t i = 0; i < kPacketsPerBurst; ++i, ++numSent) {
+            sendPacket(numSent,
+                       (numSent % 3) ? kPayloadSize : kLargePayloadSize);
+        }
+
+        ASSERT_TRUE(mCollector->waitFor(numSent - firstHeld));
+
+        Vector<sp<ABuffer> > accessUnits = mCollector->accessUnits();
+        ASSERT_EQ(numSent - firstHeld, accessUnits.size());
+
+        for (size_t i = 0; i < accessUnits.size(); ++i) {
+            size_t index = firstHeld + i;
+            const sp<ABuffer> &accessUnit = accessUnits[i];
+
+            ASSERT_EQ((index % 3) ? kPayloadSize : kLargePayloadSize,
+                      accessUnit->size()) << "packet " << index;
+            for (size_t j = 0; j < accessUnit->size(); ++j) {
+                ASSERT_EQ(index & 0xff, accessUnit->data()[j])
+                        << "packet " << index << " offset " << j;
+            }
+        }
+
+        if (burst == kNumBursts / 2 - 1) {
+            // Hand the buffers back for the remaining bursts to reuse.
+            accessUnits.clear();
+            mCollector->clear();
+            firstHeld = numSent;
+        }
+    }
+}
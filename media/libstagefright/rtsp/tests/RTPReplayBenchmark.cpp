@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "RTPReplayBenchmark"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+#include "ARTPConnection.h"
+#include "ASessionDescription.h"
+
+using namespace android;
+
+namespace {
+
+const char kSDP[] =
+    "v=0\r\n"
+    "o=- 0 0 IN IP4 127.0.0.1\r\n"
+    "s=RTPReplayBenchmark\r\n"
+    "c=IN IP4 127.0.0.1\r\n"
+    "t=0 0\r\n"
+    "m=video 0 RTP/AVP 96\r\n"
+    "a=rtpmap:96 H264/90000\r\n";
+
+// Stand-ins for the RTP and RTCP sockets of the injected stream.
+const int kRTPIndex = 0;
+const int kRTCPIndex = 1;
+
+const uint32_t kSSRC = 0x12345678;
+const size_t kMaxPayloadSize = 1400;
+const size_t kNumFrames = 600;
+const size_t kKeyFrameInterval = 30;
+const size_t kKeyFrameSize = 60000;
+const size_t kFrameSize = 12000;
+const int64_t kTimeoutNs = 10000000000LL;
+
+struct AccessUnitCollector : public AHandler {
+    // Waits until at least |count| access units have been received.
+    bool waitFor(size_t count) {
+        Mutex::Autolock autoLock(mLock);
+        while (mAccessUnits.size() < count) {
+            if (mCondition.waitRelative(mLock, kTimeoutNs) != OK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Vector<sp<ABuffer> > accessUnits() {
+        Mutex::Autolock autoLock(mLock);
+        return mAccessUnits;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        sp<ABuffer> accessUnit;
+        if (!msg->findBuffer("access-unit", &accessUnit)) {
+            return;
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        mAccessUnits.push(accessUnit);
+        mCondition.broadcast();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    Vector<sp<ABuffer> > mAccessUnits;
+};
+
+}  // namespace
+
+class RTPReplayBenchmark : public ::testing::Test {
+public:
+    RTPReplayBenchmark() : mSeqNum(0) {}
+
+    virtual void SetUp() override {
+        mLooper = new ALooper;
+        mLooper->setName("RTPReplayBenchmark");
+        mLooper->start();
+
+        mConnection = new ARTPConnection;
+        mLooper->registerHandler(mConnection);
+
+        mCollector = new AccessUnitCollector;
+        mLooper->registerHandler(mCollector);
+
+        sp<ASessionDescription> desc = new ASessionDescription;
+        ASSERT_TRUE(desc->setTo(kSDP, strlen(kSDP)));
+
+        mConnection->addStream(
+                kRTPIndex, kRTCPIndex, desc, 1 /* index */,
+                new AMessage(0, mCollector), true /* injected */);
+    }
+
+    virtual void TearDown() override {
+        mConnection->removeStream(kRTPIndex, kRTCPIndex);
+        mLooper->stop();
+    }
+
+protected:
+    sp<ALooper> mLooper;
+    sp<ARTPConnection> mConnection;
+    sp<AccessUnitCollector> mCollector;
+    uint16_t mSeqNum;
+    Vector<sp<ABuffer> > mPackets;
+
+    void addPacket(uint32_t rtpTime, const uint8_t *payload, size_t size) {
+        sp<ABuffer> packet = new ABuffer(12 + size);
+        uint8_t *data = packet->data();
+
+        data[0] = 0x80;
+        data[1] = 96;
+        data[2] = mSeqNum >> 8;
+        data[3] = mSeqNum & 0xff;
+        data[4] = rtpTime >> 24;
+        data[5] = (rtpTime >> 16) & 0xff;
+        data[6] = (rtpTime >> 8) & 0xff;
+        data[7] = rtpTime & 0xff;
+        data[8] = kSSRC >> 24;
+        data[9] = (kSSRC >> 16) & 0xff;
+        data[10] = (kSSRC >> 8) & 0xff;
+        data[11] = kSSRC & 0xff;
+        memcpy(&data[12], payload, size);
+
+        mPackets.push(packet);
+        ++mSeqNum;
+    }
+
+    // Packetizes |nal| into a single NAL unit packet or FU-A fragments.
+    void addNALUnit(uint32_t rtpTime, const uint8_t *nal, size_t size) {
+        if (size <= kMaxPayloadSize) {
+            addPacket(rtpTime, nal, size);
+            return;
+        }
+
+        uint8_t fragment[kMaxPayloadSize];
+        fragment[0] = (nal[0] & 0xe0) | 28;  // FU indicator
+
+        size_t offset = 1;
+        while (offset < size) {
+            size_t copy = size - offset;
+            if (copy > kMaxPayloadSize - 2) {
+                copy = kMaxPayloadSize - 2;
+            }
+
+            fragment[1] = nal[0] & 0x1f;  // FU header
+            if (offset == 1) {
+                fragment[1] |= 0x80;
+            }
+            if (offset + copy == size) {
+                fragment[1] |= 0x40;
+            }
+
+            memcpy(&fragment[2], &nal[offset], copy);
+            addPacket(rtpTime, fragment, copy + 2);
+
+            offset += copy;
+        }
+    }
+
+    static sp<ABuffer> MakeNALUnit(uint8_t header, size_t size, size_t seed) {
+        sp<ABuffer> nal = new ABuffer(size);
+        nal->data()[0] = header;
+        for (size_t i = 1; i < size; ++i) {
+            nal->data()[i] = (uint8_t)((seed * 31 + i * 7) & 0x7f);
+        }
+        return nal;
+    }
+
+    // Appends the packets of frame |index| and returns the access unit the
+    // assembler is expected to rebuild from them.
+    sp<ABuffer> addFrame(size_t index) {
+        uint32_t rtpTime = index * 3000;
+
+        Vector<sp<ABuffer> > nals;
+        if (index % kKeyFrameInterval == 0) {
+            sp<ABuffer> sps = MakeNALUnit(0x67, 12, index);
+            sp<ABuffer> pps = MakeNALUnit(0x68, 4, index);
+            nals.push(sps);
+            nals.push(pps);
+
+            // SPS and PPS travel together in a STAP-A.
+            uint8_t stap[1 + 2 + 12 + 2 + 4];
+            stap[0] = 0x78;
+            stap[1] = 0;
+            stap[2] = 12;
+            memcpy(&stap[3], sps->data(), 12);
+            stap[15] = 0;
+            stap[16] = 4;
+            memcpy(&stap[17], pps->data(), 4);
+            addPacket(rtpTime, stap, sizeof(stap));
+
+            sp<ABuffer> idr = MakeNALUnit(0x65, kKeyFrameSize, index);
+            nals.push(idr);
+            addNALUnit(rtpTime, idr->data(), idr->size());
+        } else {
+            sp<ABuffer> slice = MakeNALUnit(0x41, kFrameSize, index);
+            nals.push(slice);
+            addNALUnit(rtpTime, slice->data(), slice->size());
+        }
+
+        size_t size = 0;
+        for (size_t i = 0; i < nals.size(); ++i) {
+            size += 4 + nals[i]->size();
+        }
+
+        sp<ABuffer> accessUnit = new ABuffer(size);
+        size_t offset = 0;
+        for (size_t i = 0; i < nals.size(); ++i) {
+            memcpy(accessUnit->data() + offset, "\x00\x00\x00\x01", 4);
+            memcpy(accessUnit->data() + offset + 4,
+                   nals[i]->data(), nals[i]->size());
+            offset += 4 + nals[i]->size();
+        }
+
+        return accessUnit;
+    }
+};
+
+TEST_F(RTPReplayBenchmark, AVCReplayTest) {
+    Vector<sp<ABuffer> > expected;
+    for (size_t i = 0; i < kNumFrames; ++i) {
+        expected.push(addFrame(i));
+    }
+
+    // An access unit is only complete once the next one starts.
+    addFrame(kNumFrames);
+
+    size_t numBytes = 0;
+    for (size_t i = 0; i < mPackets.size(); ++i) {
+        numBytes += mPackets[i]->size();
+    }
+
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < mPackets.size(); ++i) {
+        mConnection->injectPacket(kRTPIndex, mPackets[i]);
+    }
+    ASSERT_TRUE(mCollector->waitFor(kNumFrames));
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    Vector<sp<ABuffer> > accessUnits = mCollector->accessUnits();
+    ASSERT_EQ(kNumFrames, accessUnits.size());
+
+    for (size_t i = 0; i < kNumFrames; ++i) {
+        const sp<ABuffer> &accessUnit = accessUnits[i];
+        ASSERT_EQ(expected[i]->size(), accessUnit->size()) << "frame " << i;
+        ASSERT_EQ(0, memcmp(expected[i]->data(), accessUnit->data(),
+                            accessUnit->size())) << "frame " << i;
+
+        int32_t damaged;
+        EXPECT_FALSE(accessUnit->meta()->findInt32("damaged", &damaged));
+    }
+
+    ALOGI("replayed %zu packets (%zu bytes) into %zu access units in %lld us, "
+          "%.1f MB/s",
+          mPackets.size(), numBytes, kNumFrames, (long long)elapsedUs,
+          numBytes / (elapsedUs > 0 ? (double)elapsedUs : 1.0));
+}
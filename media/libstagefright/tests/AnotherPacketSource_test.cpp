@@ -0,0 +1,247 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "AnotherPacketSource_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MetaData.h>
+
+#include "AnotherPacketSource.h"
+
+namespace android {
+
+// An hour of 30fps video, with a discontinuity every 10 minutes.
+static const size_t kNumAccessUnits = 108000;
+static const size_t kDiscontinuityInterval = 18000;
+static const int64_t kFrameDurationUs = 33333LL;
+static const size_t kAccessUnitSize = 64;
+static const size_t kSyncInterval = 30;
+
+class AnotherPacketSourceTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        sp<MetaData> meta = new MetaData;
+        meta->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_MPEG2);
+        mSource = new AnotherPacketSource(meta);
+    }
+
+protected:
+    sp<AnotherPacketSource> mSource;
+
+    static sp<ABuffer> MakeAccessUnit(size_t index) {
+        sp<ABuffer> accessUnit = new ABuffer(kAccessUnitSize);
+        accessUnit->meta()->setInt64("timeUs", (index % kDiscontinuityInterval) * kFrameDurationUs);
+        accessUnit->meta()->setInt32("discontinuitySeq", index / kDiscontinuityInterval);
+        if (index % kSyncInterval == 0) {
+            accessUnit->meta()->setInt32("isSync", 1);
+        }
+        return accessUnit;
+    }
+
+    // Queues all access units and returns the time it took.
+    int64_t fill() {
+        int64_t startUs = ALooper::GetNowUs();
+        for (size_t i = 0; i < kNumAccessUnits; ++i) {
+            if (i > 0 && i % kDiscontinuityInterval == 0) {
+                mSource->queueDiscontinuity(
+                        ATSParser::DISCONTINUITY_TIME, NULL /* extra */, false /* discard */);
+            }
+            mSource->queueAccessUnit(MakeAccessUnit(i));
+        }
+        return ALooper::GetNowUs() - startUs;
+    }
+};
+
+TEST_F(AnotherPacketSourceTest, LargeBufferBenchmark) {
+    const size_t kNumDiscontinuities = (kNumAccessUnits - 1) / kDiscontinuityInterval;
+
+    int64_t queueUs = fill();
+
+    status_t finalResult;
+    ASSERT_EQ(kNumAccessUnits + kNumDiscontinuities,
+              mSource->getAvailableBufferCount(&finalResult));
+    EXPECT_EQ(kNumAccessUnits * kAccessUnitSize, mSource->getBufferedBytes());
+    EXPECT_EQ((int64_t)(kNumAccessUnits - kNumDiscontinuities - 1) * kFrameDurationUs,
+              mSource->getBufferedDurationUs(&finalResult));
+
+    // Queries on the full queue.
+    const size_t kNumQueries = 1000;
+    int64_t startUs = ALooper::GetNowUs();
+    for (size_t i = 0; i < kNumQueries; ++i) {
+        EXPECT_TRUE(mSource->hasDataBufferAvailable(&finalResult));
+        mSource->getBufferedDurationUs(&finalResult);
+    }
+    int64_t queryUs = ALooper::GetNowUs() - startUs;
+
+    // Seek-style lookup deep into the queue.
+    startUs = ALooper::GetNowUs();
+    sp<AMessage> meta = mSource->getMetaAfterLastDequeued(
+            (kNumAccessUnits - kDiscontinuityInterval) * kFrameDurationUs);
+    int64_t lookupUs = ALooper::GetNowUs() - startUs;
+    ASSERT_TRUE(meta != NULL);
+
+    // Trim the first discontinuity segment away.
+    sp<AMessage> stopMeta = new AMessage;
+    stopMeta->setInt32("discontinuitySeq", 0);
+    stopMeta->setInt64("timeUs", (kDiscontinuityInterval - 1) * kFrameDurationUs);
+    startUs = ALooper::GetNowUs();
+    sp<AMessage> firstMeta = mSource->trimBuffersBeforeMeta(stopMeta);
+    int64_t trimUs = ALooper::GetNowUs() - startUs;
+    ASSERT_TRUE(firstMeta != NULL);
+
+    int32_t seq;
+    int64_t timeUs;
+    ASSERT_TRUE(firstMeta->findInt32("discontinuitySeq", &seq));
+    ASSERT_TRUE(firstMeta->findInt64("timeUs", &timeUs));
+    EXPECT_EQ(1, seq);
+    EXPECT_EQ(0, timeUs);
+
+    // Drain, checking order.
+    startUs = ALooper::GetNowUs();
+    size_t index = kDiscontinuityInterval;
+    sp<ABuffer> accessUnit;
+    while (mSource->hasBufferAvailable(&finalResult)) {
+        status_t err = mSource->dequeueAccessUnit(&accessUnit);
+        if (err == INFO_DISCONTINUITY) {
+            continue;
+        }
+        ASSERT_EQ(OK, err);
+        ASSERT_TRUE(accessUnit->meta()->findInt64("timeUs", &timeUs));
+        ASSERT_EQ((int64_t)(index % kDiscontinuityInterval) * kFrameDurationUs, timeUs);
+        ++index;
+    }
+    int64_t drainUs = ALooper::GetNowUs() - startUs;
+
+    EXPECT_EQ(kNumAccessUnits, index);
+    EXPECT_EQ(0u, mSource->getBufferedBytes());
+    EXPECT_FALSE(mSource->hasDataBufferAvailable(&finalResult));
+
+    ALOGI("%zu access units: queue %lld us, %zu queries %lld us, lookup %lld us, "
+          "trim %lld us, drain %lld us",
+          kNumAccessUnits, (long long)queueUs, kNumQueries, (long long)queryUs,
+          (long long)lookupUs, (long long)trimUs, (long long)drainUs);
+}
+
+TEST_F(AnotherPacketSourceTest, DiscardKeepsDiscontinuities) {
+    fill();
+
+    mSource->queueDiscontinuity(
+            ATSParser::DISCONTINUITY_TIME, NULL /* extra */, true /* discard */);
+
+    status_t finalResult;
+    EXPECT_FALSE(mSource->hasDataBufferAvailable(&finalResult));
+    EXPECT_EQ(0u, mSource->getBufferedBytes());
+    EXPECT_EQ(0, mSource->getBufferedDurationUs(&finalResult));
+
+    const size_t kNumDiscontinuities = (kNumAccessUnits - 1) / kDiscontinuityInterval + 1;
+    ASSERT_EQ(kNumDiscontinuities, mSource->getAvailableBufferCount(&finalResult));
+
+    sp<ABuffer> buffer;
+    for (size_t i = 0; i < kNumDiscontinuities; ++i) {
+        EXPECT_EQ(INFO_DISCONTINUITY, mSource->dequeueAccessUnit(&buffer));
+    }
+    EXPECT_FALSE(mSource->hasBufferAvailable(&finalResult));
+}
+
+TEST_F(AnotherPacketSourceTest, MemoryCap) {
+    const size_t kMaxBytes = 100 * kAccessUnitSize;
+    mSource->setMaxBufferedBytes(kMaxBytes);
+
+    for (size_t i = 0; i < 99; ++i) {
+        mSource->queueAccessUnit(MakeAccessUnit(i));
+    }
+    EXPECT_FALSE(mSource->isFull());
+
+    mSource->queueAccessUnit(MakeAccessUnit(99));
+    EXPECT_TRUE(mSource->isFull());
+
+    sp<ABuffer> accessUnit;
+    ASSERT_EQ(OK, mSource->dequeueAccessUnit(&accessUnit));
+    EXPECT_FALSE(mSource->isFull());
+    EXPECT_EQ(kMaxBytes - kAccessUnitSize, mSource->getBufferedBytes());
+
+    mSource->requeueAccessUnit(accessUnit);
+    EXPECT_TRUE(mSource->isFull());
+
+    mSource->clear();
+    EXPECT_EQ(0u, mSource->getBufferedBytes());
+    EXPECT_FALSE(mSource->isFull());
+}
+
+// An AVC access unit holding a single IDR or non-IDR slice.
+static sp<ABuffer> MakeAvcAccessUnit(size_t index, bool idr) {
+    static const uint8_t kIdrSlice[] = { 0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00 };
+    static const uint8_t kNonIdrSlice[] = { 0x00, 0x00, 0x00, 0x01, 0x41, 0x9a, 0x02, 0x00 };
+
+    sp<ABuffer> accessUnit = ABuffer::CreateAsCopy(
+            idr ? kIdrSlice : kNonIdrSlice, idr ? sizeof(kIdrSlice) : sizeof(kNonIdrSlice));
+    accessUnit->meta()->setInt64("timeUs", index * kFrameDurationUs);
+    accessUnit->meta()->setInt32("discontinuitySeq", 0);
+    if (index == 0) {
+        sp<MetaData> format = new MetaData;
+        format->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_AVC);
+        accessUnit->meta()->setObject("format", format);
+    }
+    return accessUnit;
+}
+
+// Trims to 40 frames in, and checks the queue now starts at the sync frame at 60.
+static void trimAvcAndCheck(const sp<AnotherPacketSource> &source) {
+    sp<AMessage> stopMeta = new AMessage;
+    stopMeta->setInt32("discontinuitySeq", 0);
+    stopMeta->setInt64("timeUs", 40 * kFrameDurationUs);
+    sp<AMessage> firstMeta = source->trimBuffersBeforeMeta(stopMeta);
+    ASSERT_TRUE(firstMeta != NULL);
+
+    int64_t timeUs;
+    ASSERT_TRUE(firstMeta->findInt64("timeUs", &timeUs));
+    EXPECT_EQ(60 * kFrameDurationUs, timeUs);
+
+    sp<ABuffer> accessUnit;
+    ASSERT_EQ(OK, source->dequeueAccessUnit(&accessUnit));
+    ASSERT_TRUE(accessUnit->meta()->findInt64("timeUs", &timeUs));
+    EXPECT_EQ(60 * kFrameDurationUs, timeUs);
+}
+
+TEST_F(AnotherPacketSourceTest, AvcTrimUsesSyncFlags) {
+    // Only the flag marks the sync frames here, the slices are all non-IDR,
+    // so the trim point can only come from the flags.
+    for (size_t i = 0; i < 3 * kSyncInterval; ++i) {
+        sp<ABuffer> accessUnit = MakeAvcAccessUnit(i, false /* idr */);
+        accessUnit->meta()->setInt32("isSync", i % kSyncInterval == 0);
+        mSource->queueAccessUnit(accessUnit);
+    }
+
+    trimAvcAndCheck(mSource);
+}
+
+TEST_F(AnotherPacketSourceTest, AvcTrimFallsBackToIdrScan) {
+    // No producer flags, the IDR slices mark the sync frames.
+    for (size_t i = 0; i < 3 * kSyncInterval; ++i) {
+        mSource->queueAccessUnit(MakeAvcAccessUnit(i, i % kSyncInterval == 0 /* idr */));
+    }
+
+    trimAvcAndCheck(mSource);
+}
+
+}  // namespace android
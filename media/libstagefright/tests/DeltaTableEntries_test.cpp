@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "DeltaTableEntries_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <media/stagefright/foundation/ByteUtils.h>
+
+#include "include/DeltaTableEntries.h"
+
+namespace android {
+
+// Collects what a table writes out, the way MPEG4Writer lays it out in the
+// stsz, co64 and stss boxes.
+struct TableWriter {
+    void writeInt32(int32_t x) {
+        uint32_t value = htonl(x);
+        write(&value, sizeof(value), 1);
+    }
+
+    size_t write(const void *ptr, size_t size, size_t nmemb) {
+        const uint8_t *data = (const uint8_t *)ptr;
+        mData.insert(mData.end(), data, data + size * nmemb);
+        ++mNumWrites;
+        return nmemb;
+    }
+
+    std::vector<uint8_t> mData;
+    size_t mNumWrites = 0;
+};
+
+static void checkSampleSizes(const std::vector<uint32_t> &values) {
+    DeltaTableEntries<uint32_t> table;
+    for (uint32_t value : values) {
+        table.add(value);
+    }
+    ASSERT_EQ(table.count(), values.size());
+
+    TableWriter writer;
+    table.write(&writer);
+    ASSERT_EQ(writer.mData.size(), 4 + values.size() * 4);
+    ASSERT_EQ(U32_AT(&writer.mData[0]), values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        ASSERT_EQ(U32_AT(&writer.mData[4 + i * 4]), values[i]) << "entry " << i;
+    }
+}
+
+static void checkChunkOffsets(const std::vector<off64_t> &values) {
+    DeltaTableEntries<off64_t> table;
+    for (off64_t value : values) {
+        table.add(value);
+    }
+    ASSERT_EQ(table.count(), values.size());
+
+    TableWriter writer;
+    table.write(&writer);
+    ASSERT_EQ(writer.mData.size(), 4 + values.size() * 8);
+    ASSERT_EQ(U32_AT(&writer.mData[0]), values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        ASSERT_EQ((off64_t)U64_AT(&writer.mData[4 + i * 8]), values[i]) << "entry " << i;
+    }
+}
+
+TEST(DeltaTableEntriesTest, EmptyTable) {
+    DeltaTableEntries<uint32_t> table;
+    TableWriter writer;
+    table.write(&writer);
+    ASSERT_EQ(table.count(), 0u);
+    ASSERT_EQ(writer.mData.size(), 4u);
+    ASSERT_EQ(U32_AT(&writer.mData[0]), 0u);
+    ASSERT_EQ(table.memorySize(), 0u);
+}
+
+// Deltas around the one and two byte varint boundaries in both directions.
+TEST(DeltaTableEntriesTest, SampleSizeVarintBoundaries) {
+    checkSampleSizes({0, 0, 63, 64, 127, 128, 0, 128, 255, 256, 16383, 16384, 0,
+                      8191, 8192, 1, 0x7fffffff, 0x80000000, 0xffffffff, 0, 0xffffffff,
+                      0xfffffffe, 1});
+}
+
+TEST(DeltaTableEntriesTest, ChunkOffsetEdgeValues) {
+    checkChunkOffsets({0, 0, 127, 128, 0, 0xffffffffLL, 0x100000000LL, 0xffffffffLL, 127,
+                       0x7fffffffffffLL, 128, 0xffffffffLL, 0});
+}
+
+TEST(DeltaTableEntriesTest, SyncSampleNumbers) {
+    std::vector<uint32_t> values;
+    for (uint32_t i = 1; i < 100000; i += 30) {
+        values.push_back(i);
+    }
+    values.push_back(0xffffffff);
+    checkSampleSizes(values);
+}
+
+// Enough entries to span several storage blocks and output batches, with
+// deltas of every encoded length.
+TEST(DeltaTableEntriesTest, ManyEntriesAcrossBlocks) {
+    std::vector<off64_t> offsets;
+    off64_t offset = 0;
+    for (uint32_t i = 0; i < 50000; ++i) {
+        offset += (i * 2654435761u) % ((i % 5 == 0) ? 0xffffffffu : 4096u);
+        offsets.push_back(offset);
+    }
+    checkChunkOffsets(offsets);
+
+    std::vector<uint32_t> sizes;
+    for (uint32_t i = 0; i < 50000; ++i) {
+        sizes.push_back((i % 7 == 0) ? 0xffffffff - i : (i * 40503u) % 100000u);
+    }
+    checkSampleSizes(sizes);
+
+    DeltaTableEntries<uint32_t> table;
+    for (uint32_t size : sizes) {
+        table.add(size);
+    }
+    // Deltas of up to 2^32 take at most five bytes.
+    ASSERT_LE(table.memorySize(), sizes.size() * 5 * 2);
+}
+
+// Bytes the same table took in the ListTableEntries<TYPE, 1>(1000) it
+// replaced: one heap array of 1000 entries per 1000 values.
+template<class TYPE>
+static size_t listTableMemorySize(size_t numEntries) {
+    const size_t kElementCapacity = 1000;
+    return (numEntries + kElementCapacity - 1) / kElementCapacity
+            * kElementCapacity * sizeof(TYPE);
+}
+
+// Memory benchmark: the sample tables of an hour of 240 fps video, with one
+// sync frame and one chunk per second, compared with the previous tables.
+TEST(DeltaTableEntriesTest, LongSessionMemory) {
+    const uint32_t kFrameRate = 240;
+    const uint32_t kNumSamples = kFrameRate * 3600;
+
+    DeltaTableEntries<uint32_t> stsz;
+    DeltaTableEntries<off64_t> co64;
+    DeltaTableEntries<uint32_t> stss;
+    off64_t offset = 32;
+    for (uint32_t i = 0; i < kNumSamples; ++i) {
+        bool isSync = (i % kFrameRate) == 0;
+        uint32_t size = isSync ? 150000 + (i * 2654435761u) % 50000
+                               : 12000 + (i * 40503u) % 16000;
+        if (isSync) {
+            co64.add(offset);
+            stss.add(i + 1);
+        }
+        stsz.add(size);
+        offset += size;
+    }
+
+    size_t compactBytes = stsz.memorySize() + co64.memorySize() + stss.memorySize();
+    size_t listBytes = listTableMemorySize<uint32_t>(stsz.count())
+            + listTableMemorySize<off64_t>(co64.count())
+            + listTableMemorySize<uint32_t>(stss.count());
+    ALOGI("%u samples: stsz %zu, co64 %zu, stss %zu bytes; %zu bytes in total, "
+            "%zu bytes with the previous tables", kNumSamples, stsz.memorySize(),
+            co64.memorySize(), stss.memorySize(), compactBytes, listBytes);
+    ASSERT_LT(compactBytes, listBytes * 3 / 4);
+}
+
+}  // namespace android
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "EncoderLatencyTracker_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <media/stagefright/EncoderLatencyTracker.h>
+
+namespace android {
+
+static const int64_t kMaxLatencyUs = 1000000LL;
+static const int64_t kFrameDurationUs = 33333LL;
+static const int64_t kEncodeDelayUs = 5000LL;
+static const size_t kNumFrames = 3000;
+
+// Every input comes out with its own timestamp, one frame later.
+TEST(EncoderLatencyTrackerTest, MatchesByPresentationTime) {
+    EncoderLatencyTracker tracker(kMaxLatencyUs);
+    int64_t nowUs = 0;
+    for (size_t i = 0; i < kNumFrames; ++i) {
+        tracker.onInputQueued(i * kFrameDurationUs, nowUs);
+        nowUs += kEncodeDelayUs;
+        if (i > 0) {
+            int64_t latencyUs;
+            ASSERT_TRUE(tracker.takeLatency((i - 1) * kFrameDurationUs, nowUs, &latencyUs));
+            ASSERT_EQ(latencyUs, kFrameDurationUs + kEncodeDelayUs);
+        }
+        nowUs += kFrameDurationUs - kEncodeDelayUs;
+    }
+    ASSERT_EQ(tracker.numPendingInputs(), 1u);
+    ASSERT_EQ(tracker.numSamples(), kNumFrames - 1);
+    ASSERT_EQ(tracker.maxLatencyUs(), kFrameDurationUs + kEncodeDelayUs);
+    ASSERT_EQ(tracker.averageLatencyUs(), kFrameDurationUs + kEncodeDelayUs);
+}
+
+// Reordering encoders (B frames) output a later frame before earlier ones.
+TEST(EncoderLatencyTrackerTest, MatchesReorderedOutputs) {
+    EncoderLatencyTracker tracker(kMaxLatencyUs);
+    for (int64_t i = 0; i < 3; ++i) {
+        tracker.onInputQueued(i * kFrameDurationUs, i * 1000);
+    }
+    int64_t latencyUs;
+    ASSERT_TRUE(tracker.takeLatency(2 * kFrameDurationUs, 10000, &latencyUs));
+    ASSERT_EQ(latencyUs, 8000);
+    ASSERT_TRUE(tracker.takeLatency(0, 10000, &latencyUs));
+    ASSERT_EQ(latencyUs, 10000);
+    ASSERT_TRUE(tracker.takeLatency(kFrameDurationUs, 10000, &latencyUs));
+    ASSERT_EQ(latencyUs, 9000);
+    ASSERT_EQ(tracker.numPendingInputs(), 0u);
+    ASSERT_FALSE(tracker.takeLatency(0, 10000, &latencyUs));
+}
+
+// An encoder that stamps its outputs with its own timeline (here an audio
+// encoder with 1024 sample frames fed 10ms input buffers) rarely produces a
+// matching timestamp. Its outputs are matched to the input they start in,
+// and the inputs it consumed without an output of their own do not pile up.
+TEST(EncoderLatencyTrackerTest, OutputTimestampsDifferFromInput) {
+    static const int64_t kInputDurationUs = 10000LL;
+    static const int64_t kOutputDurationUs = 1024 * 1000000LL / 48000;
+
+    EncoderLatencyTracker tracker(kMaxLatencyUs);
+    int64_t nowUs = 0;
+    int64_t nextOutputTimeUs = 7;  // never matches an input
+    size_t numOutputs = 0;
+    size_t maxPendingInputs = 0;
+    for (size_t i = 0; i < kNumFrames; ++i) {
+        int64_t inputTimeUs = i * kInputDurationUs;
+        tracker.onInputQueued(inputTimeUs, nowUs);
+        nowUs += kInputDurationUs;
+        while (nextOutputTimeUs + kOutputDurationUs <= inputTimeUs + kInputDurationUs) {
+            int64_t latencyUs;
+            ASSERT_TRUE(tracker.takeLatency(nextOutputTimeUs, nowUs, &latencyUs));
+            // The output comes out once its last sample is queued.
+            ASSERT_GE(latencyUs, kOutputDurationUs - kInputDurationUs);
+            ASSERT_LE(latencyUs, kOutputDurationUs + 2 * kInputDurationUs);
+            nextOutputTimeUs += kOutputDurationUs;
+            ++numOutputs;
+        }
+        if (tracker.numPendingInputs() > maxPendingInputs) {
+            maxPendingInputs = tracker.numPendingInputs();
+        }
+    }
+    ASSERT_EQ(tracker.numSamples(), numOutputs);
+    // At most the inputs of the output being encoded are pending.
+    ASSERT_LE(maxPendingInputs, (size_t)(kOutputDurationUs / kInputDurationUs) + 2);
+}
+
+// Inputs the encoder drops are aged out on later inputs, even if no output
+// ever matches again.
+TEST(EncoderLatencyTrackerTest, DroppedInputsAgeOut) {
+    EncoderLatencyTracker tracker(kMaxLatencyUs);
+    int64_t nowUs = 0;
+    for (size_t i = 0; i < kNumFrames; ++i) {
+        tracker.onInputQueued(i * kFrameDurationUs, nowUs);
+        nowUs += kFrameDurationUs;
+        ASSERT_LE(tracker.numPendingInputs(), (size_t)(kMaxLatencyUs / kFrameDurationUs) + 1);
+    }
+    ASSERT_EQ(tracker.numSamples(), 0u);
+
+    // Once the encoder produces output again, the latency is that of a
+    // recent input, not of one dropped long ago.
+    int64_t latencyUs;
+    ASSERT_TRUE(tracker.takeLatency(-1, nowUs, &latencyUs));
+    ASSERT_LE(latencyUs, kMaxLatencyUs + kFrameDurationUs);
+
+    tracker.clear();
+    ASSERT_EQ(tracker.numPendingInputs(), 0u);
+    ASSERT_EQ(tracker.numSamples(), 1u);
+}
+
+}  // namespace android
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "MediaClock_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaClock.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+static const size_t kNumReaderThreads = 4;
+static const size_t kNumReadsPerThread = 200000;
+static const size_t kNumTimers = 200;
+static const int64_t kTimerSpacingUs = 1000LL;
+static const int64_t kTimeoutNs = 5000000000LL;
+
+// Records the media time of each timer in the order they fire.
+struct TimerCollector : public AHandler {
+    bool waitFor(size_t count) {
+        Mutex::Autolock autoLock(mLock);
+        while (mMediaTimesUs.size() < count) {
+            if (mCondition.waitRelative(mLock, kTimeoutNs) != OK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<int64_t> mediaTimesUs() {
+        Mutex::Autolock autoLock(mLock);
+        return mMediaTimesUs;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        int32_t reason;
+        int64_t mediaTimeUs;
+        CHECK(msg->findInt32("reason", &reason));
+        CHECK(msg->findInt64("mediaTimeUs", &mediaTimeUs));
+        if (reason != MediaClock::TIMER_REASON_REACHED) {
+            return;
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        mMediaTimesUs.push_back(mediaTimeUs);
+        mCondition.broadcast();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    std::vector<int64_t> mMediaTimesUs;
+};
+
+class MediaClockTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        mClock = new MediaClock;
+        mClock->init();
+    }
+
+protected:
+    sp<MediaClock> mClock;
+};
+
+// Renderer and audio callback threads read the clock while the anchor is
+// being moved.
+TEST_F(MediaClockTest, ConcurrentReadsBenchmark) {
+    mClock->updateAnchor(0, ALooper::GetNowUs());
+
+    std::atomic<bool> done(false);
+    std::thread writer([this, &done]() {
+        float rate = 1.0;
+        while (!done.load()) {
+            rate = (rate == 1.0f) ? 2.0f : 1.0f;
+            mClock->setPlaybackRate(rate);
+        }
+    });
+
+    std::vector<std::thread> readers;
+    std::vector<int64_t> elapsedUs(kNumReaderThreads);
+    std::vector<size_t> numFailures(kNumReaderThreads);
+    for (size_t i = 0; i < kNumReaderThreads; ++i) {
+        readers.emplace_back([this, i, &elapsedUs, &numFailures]() {
+            int64_t startUs = ALooper::GetNowUs();
+            for (size_t j = 0; j < kNumReadsPerThread; ++j) {
+                int64_t mediaUs;
+                if (mClock->getMediaTime(ALooper::GetNowUs(), &mediaUs) != OK
+                        || mediaUs < 0) {
+                    ++numFailures[i];
+                }
+            }
+            elapsedUs[i] = ALooper::GetNowUs() - startUs;
+        });
+    }
+
+    for (size_t i = 0; i < kNumReaderThreads; ++i) {
+        readers[i].join();
+    }
+    done = true;
+    writer.join();
+
+    int64_t totalUs = 0;
+    for (size_t i = 0; i < kNumReaderThreads; ++i) {
+        EXPECT_EQ(0u, numFailures[i]) << "reader " << i;
+        totalUs += elapsedUs[i];
+    }
+
+    ALOGI("%zu threads x %zu getMediaTime calls, %.1f ns per call",
+          kNumReaderThreads, kNumReadsPerThread,
+          totalUs * 1000.0 / (kNumReaderThreads * kNumReadsPerThread));
+}
+
+TEST_F(MediaClockTest, TimersFireInOrder) {
+    sp<ALooper> looper = new ALooper;
+    looper->setName("MediaClockTest");
+    looper->start();
+
+    sp<TimerCollector> collector = new TimerCollector;
+    looper->registerHandler(collector);
+
+    // Queued in an order unrelated to their media times.
+    for (size_t i = 0; i < kNumTimers; ++i) {
+        int64_t mediaTimeUs = ((i * 7) % kNumTimers + 1) * kTimerSpacingUs;
+        sp<AMessage> notify = new AMessage(0, collector);
+        notify->setInt64("mediaTimeUs", mediaTimeUs);
+        mClock->addTimer(notify, mediaTimeUs);
+    }
+
+    mClock->updateAnchor(0, ALooper::GetNowUs());
+    ASSERT_TRUE(collector->waitFor(kNumTimers));
+
+    std::vector<int64_t> mediaTimesUs = collector->mediaTimesUs();
+    ASSERT_EQ(kNumTimers, mediaTimesUs.size());
+    for (size_t i = 1; i < mediaTimesUs.size(); ++i) {
+        EXPECT_LE(mediaTimesUs[i - 1], mediaTimesUs[i]) << "timer " << i;
+    }
+
+    looper->stop();
+}
+
+}  // namespace android
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "VideoFrameScheduler_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <vector>
+
+#include <media/stagefright/VideoFrameSchedulerBase.h>
+
+namespace android {
+
+static const nsecs_t kStartTimeNs = 10 * VideoFrameSchedulerBase::kNanosIn1s;
+
+// Synthetic display: reports the last vsync before the current render time,
+// with a deterministic phase jitter, on every schedule() call.
+struct SyntheticVsyncScheduler : public VideoFrameSchedulerBase {
+    SyntheticVsyncScheduler(nsecs_t vsyncPeriod, nsecs_t jitter)
+        : mDisplayVsyncPeriod(vsyncPeriod),
+          mJitter(jitter),
+          mNow(kStartTimeNs),
+          mNumSamples(0) {
+    }
+
+    void release() override {}
+
+    void setNow(nsecs_t now) {
+        mNow = now;
+    }
+
+    nsecs_t vsyncTime() const {
+        return mVsyncTime;
+    }
+
+    nsecs_t vsyncPeriod() const {
+        return mVsyncPeriod;
+    }
+
+protected:
+    virtual ~SyntheticVsyncScheduler() {}
+
+private:
+    void updateVsync() override {
+        // refresh on every call
+        mVsyncRefreshAt = 0;
+        nsecs_t jitter = ((nsecs_t)(mNumSamples++ % 3) - 1) * mJitter;  // -1, 0, +1
+        mVsyncTime = mNow - mNow % mDisplayVsyncPeriod + jitter;
+        mVsyncPeriod = mDisplayVsyncPeriod;
+    }
+
+    const nsecs_t mDisplayVsyncPeriod;
+    const nsecs_t mJitter;
+    nsecs_t mNow;
+    size_t mNumSamples;
+};
+
+class VideoFrameSchedulerTest : public ::testing::Test {
+protected:
+    // schedules |numFrames| frames of |fps| video on the scheduler, and
+    // returns the scheduled render times
+    std::vector<nsecs_t> runFrames(
+            const sp<SyntheticVsyncScheduler> &scheduler, float fps, size_t numFrames) {
+        std::vector<nsecs_t> renderTimes;
+        for (size_t i = 0; i < numFrames; ++i) {
+            nsecs_t renderTime = kStartTimeNs + (nsecs_t)(i * 1e9 / fps);
+            scheduler->setNow(renderTime);
+            renderTimes.push_back(scheduler->schedule(renderTime));
+        }
+        return renderTimes;
+    }
+};
+
+TEST_F(VideoFrameSchedulerTest, VsyncModelFiltersJitter) {
+    const nsecs_t period = VideoFrameSchedulerBase::kNanosIn1s / 120;
+    const nsecs_t jitter = 1000000;  // 1 ms
+    sp<SyntheticVsyncScheduler> scheduler = new SyntheticVsyncScheduler(period, jitter);
+    scheduler->init();
+
+    runFrames(scheduler, 120.f, 240);
+
+    // the model vsync stays well within the raw sample jitter of the true grid
+    nsecs_t phase = scheduler->vsyncTime() % period;
+    if (phase > period / 2) {
+        phase -= period;
+    }
+    EXPECT_LT(std::abs(phase), jitter / 2);
+    EXPECT_NEAR(scheduler->vsyncPeriod(), period, period / 1000);
+}
+
+TEST_F(VideoFrameSchedulerTest, HighFrameRatePrimesAndPaces) {
+    const nsecs_t period = VideoFrameSchedulerBase::kNanosIn1s / 120;
+    sp<SyntheticVsyncScheduler> scheduler = new SyntheticVsyncScheduler(period, 0);
+    scheduler->init();
+
+    std::vector<nsecs_t> renderTimes = runFrames(scheduler, 120.f, 600);
+
+    EXPECT_NEAR(scheduler->getFrameRate(), 120.f, 1.f);
+    EXPECT_GT(scheduler->getPacedFrameCount(), 0u);
+    EXPECT_LE(scheduler->getJudderFrameCount() * 100, scheduler->getPacedFrameCount());
+
+    // one frame per vsync once settled
+    for (size_t i = renderTimes.size() / 2; i < renderTimes.size(); ++i) {
+        EXPECT_NEAR(renderTimes[i] - renderTimes[i - 1], period, period / 2);
+    }
+}
+
+TEST_F(VideoFrameSchedulerTest, PulldownIsNotJudder) {
+    const nsecs_t period = VideoFrameSchedulerBase::kNanosIn1s / 60;
+    sp<SyntheticVsyncScheduler> scheduler = new SyntheticVsyncScheduler(period, 0);
+    scheduler->init(24.f);
+
+    runFrames(scheduler, 24.f, 240);
+
+    // 3:2 cadence holds frames for 2 or 3 vsyncs, which is inherent to 24 on 60
+    EXPECT_GT(scheduler->getPacedFrameCount(), 0u);
+    EXPECT_LE(scheduler->getJudderFrameCount() * 20, scheduler->getPacedFrameCount());
+}
+
+} // namespace android
@@ -17,10 +17,15 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "WriterTest"
 #include <utils/Log.h>
+#include <utils/Timers.h>
 
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <thread>
 
+#include <media/stagefright/foundation/ByteUtils.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
@@ -31,7 +36,10 @@
 #include <media/stagefright/AMRWriter.h>
 #include <media/stagefright/MPEG2TSWriter.h>
 #include <media/stagefright/MPEG4Writer.h>
+#include <media/stagefright/MediaCodecConstants.h>
+#include <media/stagefright/MediaMuxer.h>
 #include <media/stagefright/OggWriter.h>
+#include <webm/WebmConstants.h>
 #include <webm/WebmWriter.h>
 
 #include "WriterTestEnvironment.h"
@@ -451,8 +459,581 @@ TEST_P(WriterTest, MultiStartStopPauseTest) {
     close(fd);
 }
 
+struct Mp4Box {
+    string type;
+    size_t offset;
+    size_t size;
+    size_t headerSize;
+
+    size_t payload() const { return offset + headerSize; }
+    size_t end() const { return offset + size; }
+};
+
+// Splits [begin, end) of the given file data into boxes. Stops at the first box
+// that is not complete.
+static vector<Mp4Box> parseBoxes(const vector<uint8_t> &data, size_t begin, size_t end) {
+    vector<Mp4Box> boxes;
+    size_t offset = begin;
+    while (offset + 8 <= end) {
+        uint64_t size = U32_AT(&data[offset]);
+        size_t headerSize = 8;
+        if (size == 1) {
+            if (offset + 16 > end) break;
+            size = U64_AT(&data[offset + 8]);
+            headerSize = 16;
+        }
+        if (size < headerSize || size > end - offset) break;
+        boxes.push_back({string((const char *)&data[offset + 4], 4), offset, (size_t)size,
+                         headerSize});
+        offset += size;
+    }
+    return boxes;
+}
+
+static vector<Mp4Box> parseChildBoxes(const vector<uint8_t> &data, const Mp4Box &box) {
+    return parseBoxes(data, box.payload(), box.end());
+}
+
+static const Mp4Box *findBox(const vector<Mp4Box> &boxes, const char *type) {
+    for (const Mp4Box &box : boxes) {
+        if (box.type == type) return &box;
+    }
+    return nullptr;
+}
+
+struct FragmentSample {
+    uint32_t size;
+    bool isSync;
+    int64_t timeTicks;
+};
+
+TEST_P(WriterTest, FragmentedMpeg4WriterTest) {
+    if (mDisableTest || mWriterName != standardWriters::MPEG4) return;
+    ALOGV("Checks the moof/mdat pairs and the mfra of a fragmented mp4 file");
+
+    string writerFormat = GetParam().first;
+    string outputFile = OUTPUT_FILE_NAME;
+    int32_t fd =
+            open(outputFile.c_str(), O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0) << "Failed to open output file to dump writer's data";
+
+    int32_t status = createWriter(fd);
+    ASSERT_EQ((status_t)OK, status) << "Failed to create writer for output format:" << writerFormat;
+    mFileMeta->setInt64(kKeyFragmentDurationUs, kFragmentDurationUs);
+
+    string inputFile = gEnv->getRes();
+    string inputInfo = gEnv->getRes();
+    configFormat param;
+    bool isAudio;
+    int32_t inputFileIdx = GetParam().second;
+    getFileDetails(inputFile, inputInfo, param, isAudio, inputFileIdx);
+    ASSERT_NE(inputFile.compare(gEnv->getRes()), 0) << "No input file specified";
+
+    ASSERT_NO_FATAL_FAILURE(getInputBufferInfo(inputFile, inputInfo));
+    status = addWriterSource(isAudio, param);
+    ASSERT_EQ((status_t)OK, status) << "Failed to add source for " << writerFormat << "Writer";
+
+    status = mWriter->start(mFileMeta.get());
+    ASSERT_EQ((status_t)OK, status);
+    status = sendBuffersToWriter(mInputStream, mBufferInfo, mInputFrameId, mCurrentTrack, 0,
+                                 mBufferInfo.size());
+    ASSERT_EQ((status_t)OK, status) << writerFormat << " writer failed";
+    mCurrentTrack->stop();
+
+    status = mWriter->stop();
+    ASSERT_EQ((status_t)OK, status) << "Failed to stop the writer";
+    close(fd);
+
+    ifstream file(outputFile.c_str(), ifstream::binary);
+    ASSERT_TRUE(file.is_open()) << "Failed to open " << outputFile;
+    vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    file.close();
+
+    vector<Mp4Box> boxes = parseBoxes(data, 0, data.size());
+    ASSERT_GE(boxes.size(), 5u) << "Too few boxes in fragmented file";
+    ASSERT_EQ(boxes[0].type, "ftyp");
+    ASSERT_EQ(boxes[1].type, "moov");
+    ASSERT_EQ(boxes.back().type, "mfra");
+    ASSERT_EQ(boxes.back().end(), data.size()) << "Trailing bytes after mfra";
+
+    // Track id and timescale from the init segment.
+    vector<Mp4Box> moov = parseChildBoxes(data, boxes[1]);
+    const Mp4Box *mvex = findBox(moov, "mvex");
+    ASSERT_NE(mvex, nullptr) << "No mvex in fragmented file";
+    vector<Mp4Box> mvexBoxes = parseChildBoxes(data, *mvex);
+    const Mp4Box *trex = findBox(mvexBoxes, "trex");
+    ASSERT_NE(trex, nullptr);
+    uint32_t trackId = U32_AT(&data[trex->payload() + 4]);
+    const Mp4Box *trak = findBox(moov, "trak");
+    ASSERT_NE(trak, nullptr);
+    vector<Mp4Box> trakBoxes = parseChildBoxes(data, *trak);
+    const Mp4Box *mdia = findBox(trakBoxes, "mdia");
+    ASSERT_NE(mdia, nullptr);
+    vector<Mp4Box> mdiaBoxes = parseChildBoxes(data, *mdia);
+    const Mp4Box *mdhd = findBox(mdiaBoxes, "mdhd");
+    ASSERT_NE(mdhd, nullptr);
+    bool mdhdVersion1 = data[mdhd->payload()] == 1;
+    uint32_t timeScale = U32_AT(&data[mdhd->payload() + (mdhdVersion1 ? 20 : 12)]);
+    ASSERT_GT(timeScale, 0u);
+
+    // Every fragment is complete by itself, so a recording cut short stays
+    // playable up to its last fragment.
+    map<size_t, size_t> moofSampleBase;  // moof offset -> index of its first sample
+    vector<FragmentSample> samples;
+    uint32_t sequenceNumber = 0;
+    int64_t lastBaseTicks = -1;
+    for (size_t i = 2; i < boxes.size() - 1; i += 2) {
+        const Mp4Box &moofBox = boxes[i];
+        ASSERT_EQ(moofBox.type, "moof") << "Unexpected box at index " << i;
+        ASSERT_LT(i + 1, boxes.size() - 1);
+        const Mp4Box &mdatBox = boxes[i + 1];
+        ASSERT_EQ(mdatBox.type, "mdat") << "Unexpected box at index " << i + 1;
+        moofSampleBase[moofBox.offset] = samples.size();
+
+        vector<Mp4Box> moof = parseChildBoxes(data, moofBox);
+        const Mp4Box *mfhd = findBox(moof, "mfhd");
+        ASSERT_NE(mfhd, nullptr);
+        ASSERT_EQ(U32_AT(&data[mfhd->payload() + 4]), ++sequenceNumber);
+        const Mp4Box *traf = findBox(moof, "traf");
+        ASSERT_NE(traf, nullptr);
+        vector<Mp4Box> trafBoxes = parseChildBoxes(data, *traf);
+
+        const Mp4Box *tfhd = findBox(trafBoxes, "tfhd");
+        ASSERT_NE(tfhd, nullptr);
+        ASSERT_EQ(U32_AT(&data[tfhd->payload()]), 0x020000u) << "Expected default-base-is-moof";
+        ASSERT_EQ(U32_AT(&data[tfhd->payload() + 4]), trackId);
+
+        const Mp4Box *tfdt = findBox(trafBoxes, "tfdt");
+        ASSERT_NE(tfdt, nullptr);
+        ASSERT_EQ(data[tfdt->payload()], 1) << "Expected a 64-bit tfdt";
+        int64_t baseTicks = U64_AT(&data[tfdt->payload() + 4]);
+        ASSERT_GT(baseTicks, lastBaseTicks) << "tfdt of fragment " << sequenceNumber;
+        lastBaseTicks = baseTicks;
+
+        const Mp4Box *trun = findBox(trafBoxes, "trun");
+        ASSERT_NE(trun, nullptr);
+        size_t offset = trun->payload();
+        ASSERT_EQ(data[offset], 1) << "Expected signed composition offsets";
+        ASSERT_EQ(U32_AT(&data[offset]) & 0xffffff, 0x000f01u);
+        uint32_t sampleCount = U32_AT(&data[offset + 4]);
+        int32_t dataOffset = U32_AT(&data[offset + 8]);
+        ASSERT_GT(sampleCount, 0u);
+        ASSERT_EQ(trun->size, trun->headerSize + 12 + sampleCount * 16);
+        ASSERT_EQ(moofBox.offset + dataOffset, mdatBox.payload())
+                << "Samples of fragment " << sequenceNumber << " do not start the mdat";
+
+        offset += 12;
+        int64_t decodingTimeTicks = baseTicks;
+        size_t dataSize = 0;
+        for (uint32_t sample = 0; sample < sampleCount; ++sample, offset += 16) {
+            uint32_t duration = U32_AT(&data[offset]);
+            uint32_t size = U32_AT(&data[offset + 4]);
+            uint32_t flags = U32_AT(&data[offset + 8]);
+            int32_t compositionOffset = U32_AT(&data[offset + 12]);
+            bool isSync = !(flags & 0x00010000);
+            samples.push_back({size, isSync, decodingTimeTicks + compositionOffset});
+            decodingTimeTicks += duration;
+            dataSize += size;
+        }
+        ASSERT_EQ(dataSize, mdatBox.size - mdatBox.headerSize)
+                << "Sample sizes of fragment " << sequenceNumber << " do not add up";
+    }
+
+    // Every input buffer but the codec config ends up in exactly one fragment,
+    // at its own presentation time.
+    ASSERT_EQ(samples.size(), mBufferInfo.size() - mNumCsds);
+    int64_t toleranceTicks = timeScale / 10000 + 1;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        int64_t inputTimeUs = mBufferInfo[mNumCsds + i].timeUs - mBufferInfo[mNumCsds].timeUs;
+        int64_t expectedTicks = (inputTimeUs * timeScale + 500000LL) / 1000000LL;
+        ASSERT_NEAR(samples[i].timeTicks - samples[0].timeTicks, expectedTicks, toleranceTicks)
+                << "Sample " << i << " presentation time";
+        ASSERT_EQ(samples[i].isSync, isAudio || mBufferInfo[mNumCsds + i].flags == 1)
+                << "Sample " << i << " sync flag";
+    }
+
+    // The random access table points at the first sync sample of fragments,
+    // by presentation time.
+    vector<Mp4Box> mfra = parseChildBoxes(data, boxes.back());
+    const Mp4Box *tfra = findBox(mfra, "tfra");
+    ASSERT_NE(tfra, nullptr);
+    size_t offset = tfra->payload();
+    ASSERT_EQ(data[offset], 1) << "Expected a 64-bit tfra";
+    ASSERT_EQ(U32_AT(&data[offset + 4]), trackId);
+    ASSERT_EQ(U32_AT(&data[offset + 8]) & 0x3f, 0x3fu);
+    uint32_t entryCount = U32_AT(&data[offset + 12]);
+    ASSERT_EQ(tfra->size, tfra->headerSize + 16 + entryCount * 28);
+    if (isAudio) {
+        ASSERT_EQ(entryCount, sequenceNumber) << "Expected one tfra entry per fragment";
+    } else {
+        ASSERT_GT(entryCount, 0u);
+    }
+    offset += 16;
+    for (uint32_t entry = 0; entry < entryCount; ++entry, offset += 28) {
+        int64_t timeTicks = U64_AT(&data[offset]);
+        size_t moofOffset = U64_AT(&data[offset + 8]);
+        uint32_t trafNumber = U32_AT(&data[offset + 16]);
+        uint32_t trunNumber = U32_AT(&data[offset + 20]);
+        uint32_t sampleNumber = U32_AT(&data[offset + 24]);
+        ASSERT_NE(moofSampleBase.find(moofOffset), moofSampleBase.end())
+                << "tfra entry " << entry << " does not point at a moof";
+        ASSERT_EQ(trafNumber, 1u);
+        ASSERT_EQ(trunNumber, 1u);
+        ASSERT_GE(sampleNumber, 1u);
+        size_t sampleIndex = moofSampleBase[moofOffset] + sampleNumber - 1;
+        ASSERT_LT(sampleIndex, samples.size());
+        ASSERT_TRUE(samples[sampleIndex].isSync) << "tfra entry " << entry;
+        ASSERT_EQ(timeTicks, samples[sampleIndex].timeTicks) << "tfra entry " << entry;
+    }
+
+    const Mp4Box *mfro = findBox(mfra, "mfro");
+    ASSERT_NE(mfro, nullptr);
+    ASSERT_EQ(U32_AT(&data[mfro->payload() + 4]), boxes.back().size);
+}
+
+TEST_P(WriterTest, FragmentedTwoByteNalLengthTest) {
+    if (mDisableTest || mWriterName != standardWriters::MPEG4) return;
+    ALOGV("Checks that fragmented output refuses 2-byte NAL length fields");
+
+    string writerFormat = GetParam().first;
+    string outputFile = OUTPUT_FILE_NAME;
+    int32_t fd =
+            open(outputFile.c_str(), O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0) << "Failed to open output file to dump writer's data";
+
+    int32_t status = createWriter(fd);
+    ASSERT_EQ((status_t)OK, status) << "Failed to create writer for output format:" << writerFormat;
+    mFileMeta->setInt64(kKeyFragmentDurationUs, kFragmentDurationUs);
+    mFileMeta->setInt32(kKey2ByteNalLength, 1);
+
+    string inputFile = gEnv->getRes();
+    string inputInfo = gEnv->getRes();
+    configFormat param;
+    bool isAudio;
+    int32_t inputFileIdx = GetParam().second;
+    getFileDetails(inputFile, inputInfo, param, isAudio, inputFileIdx);
+    ASSERT_NE(inputFile.compare(gEnv->getRes()), 0) << "No input file specified";
+
+    ASSERT_NO_FATAL_FAILURE(getInputBufferInfo(inputFile, inputInfo));
+    status = addWriterSource(isAudio, param);
+    ASSERT_EQ((status_t)OK, status) << "Failed to add source for " << writerFormat << "Writer";
+
+    // Sample sizes in 'trun' boxes are only right for 4-byte NAL lengths.
+    EXPECT_EQ((status_t)BAD_VALUE, mWriter->start(mFileMeta.get()));
+    close(fd);
+}
+
+// Checks that every sample written through MediaMuxer ends up in the file,
+// including the ones still queued for the writer when stop() is called.
+TEST_P(WriterTest, MediaMuxerSampleCountTest) {
+    if (mDisableTest || mWriterName != standardWriters::MPEG4) return;
+    ALOGV("Writes samples through MediaMuxer and counts the samples in the output");
+
+    string outputFile = OUTPUT_FILE_NAME;
+    int32_t fd =
+            open(outputFile.c_str(), O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0) << "Failed to open output file to dump writer's data";
+
+    string inputFile = gEnv->getRes();
+    string inputInfo = gEnv->getRes();
+    configFormat param;
+    bool isAudio;
+    int32_t inputFileIdx = GetParam().second;
+    getFileDetails(inputFile, inputInfo, param, isAudio, inputFileIdx);
+    ASSERT_NE(inputFile.compare(gEnv->getRes()), 0) << "No input file specified";
+    ASSERT_NO_FATAL_FAILURE(getInputBufferInfo(inputFile, inputInfo));
+
+    sp<AMessage> format = new AMessage;
+    format->setString("mime", param.mime);
+    if (isAudio) {
+        format->setInt32("channel-count", param.channelCount);
+        format->setInt32("sample-rate", param.sampleRate);
+    } else {
+        format->setInt32("width", param.width);
+        format->setInt32("height", param.height);
+    }
+    int32_t status =
+            writeHeaderBuffers(mInputStream, mBufferInfo, mInputFrameId, format, mNumCsds);
+    ASSERT_EQ(status, 0) << "Failed to read the codec specific data";
+
+    sp<MediaMuxer> muxer = new MediaMuxer(fd, MediaMuxer::OUTPUT_FORMAT_MPEG_4);
+    ssize_t trackIndex = muxer->addTrack(format);
+    ASSERT_GE(trackIndex, 0) << "Failed to add track";
+    ASSERT_EQ((status_t)OK, muxer->start());
+
+    size_t numSamples = 0;
+    for (; mInputFrameId < (int32_t)mBufferInfo.size(); ++mInputFrameId) {
+        const BufferInfo &info = mBufferInfo[mInputFrameId];
+        sp<ABuffer> buffer = new ABuffer(info.size);
+        mInputStream.read((char *)buffer->data(), info.size);
+        ASSERT_EQ(mInputStream.gcount(), info.size);
+        uint32_t flags = (info.flags == 1) ? BUFFER_FLAG_SYNC_FRAME : 0;
+        ASSERT_EQ((status_t)OK, muxer->writeSampleData(buffer, trackIndex, info.timeUs, flags))
+                << "Failed to write sample " << numSamples;
+        ++numSamples;
+    }
+    // Stop right away, with samples still queued for the writer.
+    ASSERT_EQ((status_t)OK, muxer->stop());
+    muxer.clear();
+    close(fd);
+
+    ifstream file(outputFile.c_str(), ifstream::binary);
+    ASSERT_TRUE(file.is_open()) << "Failed to open " << outputFile;
+    vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    file.close();
+
+    vector<Mp4Box> boxes = parseBoxes(data, 0, data.size());
+    const Mp4Box *moov = findBox(boxes, "moov");
+    ASSERT_NE(moov, nullptr) << "No moov in output";
+    const Mp4Box *box = moov;
+    vector<Mp4Box> children;
+    for (const char *type : {"trak", "mdia", "minf", "stbl", "stsz"}) {
+        children = parseChildBoxes(data, *box);
+        box = findBox(children, type);
+        ASSERT_NE(box, nullptr) << "No " << type << " in output";
+    }
+    // stsz: version/flags, default sample size, sample count.
+    uint32_t sampleCount = U32_AT(&data[box->payload() + 8]);
+    ASSERT_EQ(sampleCount, numSamples) << "Samples were lost between MediaMuxer and the file";
+}
+
+// Checks the transport stream packet structure of the MPEG2TS writer's output
+// and reports its packetization throughput.
+TEST_P(WriterTest, MPEG2TSPacketizerTest) {
+    if (mDisableTest || mWriterName != standardWriters::MPEG2TS) return;
+    ALOGV("Validates TS packets, continuity counters and periodic PAT/PMT");
+
+    string writerFormat = GetParam().first;
+    string outputFile = OUTPUT_FILE_NAME;
+    int32_t fd =
+            open(outputFile.c_str(), O_CREAT | O_LARGEFILE | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR);
+    ASSERT_GE(fd, 0) << "Failed to open output file to dump writer's data";
+
+    int32_t status = createWriter(fd);
+    ASSERT_EQ((status_t)OK, status) << "Failed to create writer for output format:" << writerFormat;
+
+    string inputFile = gEnv->getRes();
+    string inputInfo = gEnv->getRes();
+    configFormat param;
+    bool isAudio;
+    int32_t inputFileIdx = GetParam().second;
+    getFileDetails(inputFile, inputInfo, param, isAudio, inputFileIdx);
+    ASSERT_NE(inputFile.compare(gEnv->getRes()), 0) << "No input file specified";
+
+    ASSERT_NO_FATAL_FAILURE(getInputBufferInfo(inputFile, inputInfo));
+    status = addWriterSource(isAudio, param);
+    ASSERT_EQ((status_t)OK, status) << "Failed to add source for " << writerFormat << "Writer";
+
+    nsecs_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    status = mWriter->start(mFileMeta.get());
+    ASSERT_EQ((status_t)OK, status);
+    status = sendBuffersToWriter(mInputStream, mBufferInfo, mInputFrameId, mCurrentTrack, 0,
+                                 mBufferInfo.size());
+    ASSERT_EQ((status_t)OK, status) << writerFormat << " writer failed";
+    mCurrentTrack->stop();
+
+    status = mWriter->stop();
+    ASSERT_EQ((status_t)OK, status) << "Failed to stop the writer";
+    nsecs_t elapsedNs = systemTime(SYSTEM_TIME_MONOTONIC) - startNs;
+    close(fd);
+
+    ifstream file(outputFile, ifstream::binary);
+    ASSERT_TRUE(file.is_open());
+    vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    ASSERT_GT(data.size(), 0u);
+    ASSERT_EQ(data.size() % 188, 0u) << "Output is not made of whole TS packets";
+
+    size_t numPackets = data.size() / 188;
+    size_t numPATs = 0;
+    map<uint32_t, uint32_t> continuityCounters;
+    for (size_t i = 0; i < numPackets; ++i) {
+        const uint8_t *packet = &data[i * 188];
+        ASSERT_EQ(packet[0], 0x47) << "Lost sync at packet " << i;
+
+        uint32_t pid = ((packet[1] & 0x1f) << 8) | packet[2];
+        uint32_t counter = packet[3] & 0x0f;
+        if (pid == 0) {
+            ++numPATs;
+        }
+        if (!(packet[3] & 0x10)) {
+            // The continuity counter only advances with payload.
+            continue;
+        }
+
+        auto it = continuityCounters.find(pid);
+        if (it != continuityCounters.end()) {
+            ASSERT_EQ((it->second + 1) & 0x0f, counter)
+                    << "Discontinuity on PID " << pid << " at packet " << i;
+        }
+        continuityCounters[pid] = counter;
+    }
+
+    // The tables go out again every 2500 packets, give or take an access unit.
+    ASSERT_GE(numPATs, numPackets > 5000 ? 2u : 1u) << "PAT/PMT are not repeated";
+
+    ALOGI("%s: %zu TS packets in %lld us, %.1f MB/s", writerFormat.c_str(), numPackets,
+          (long long)(elapsedNs / 1000),
+          data.size() * 1E3 / (elapsedNs > 0 ? (double)elapsedNs : 1.0));
+}
+
 // TODO: (b/144476164)
 // Add AAC_ADTS, FLAC, AV1 input
+struct EbmlElement {
+    uint64_t id;
+    size_t payload;
+    uint64_t size;
+    bool unknownSize;
+
+    size_t end(size_t limit) const { return unknownSize ? limit : payload + size; }
+};
+
+// Reads an EBML variable length integer at data[*offset]. Element ids keep
+// their length marker, sizes do not. Returns false if the data ends first.
+static bool readEbmlVint(const vector<uint8_t> &data, size_t *offset, bool isId,
+                         uint64_t *value, size_t *length) {
+    if (*offset >= data.size() || data[*offset] == 0) return false;
+    size_t len = 1;
+    while (!(data[*offset] & (0x80 >> (len - 1)))) ++len;
+    if (*offset + len > data.size()) return false;
+    uint64_t v = isId ? data[*offset] : (data[*offset] & (0xff >> len));
+    for (size_t i = 1; i < len; ++i) {
+        v = (v << 8) | data[*offset + i];
+    }
+    *offset += len;
+    *value = v;
+    *length = len;
+    return true;
+}
+
+// Splits [begin, end) into EBML elements. Stops at the first element that is
+// not complete; an element of unknown size extends to end.
+static vector<EbmlElement> parseEbmlElements(const vector<uint8_t> &data, size_t begin,
+                                             size_t end) {
+    vector<EbmlElement> elements;
+    size_t offset = begin;
+    while (offset < end) {
+        EbmlElement element;
+        size_t idLength, sizeLength;
+        if (!readEbmlVint(data, &offset, true, &element.id, &idLength) ||
+            !readEbmlVint(data, &offset, false, &element.size, &sizeLength)) {
+            break;
+        }
+        element.payload = offset;
+        element.unknownSize = element.size == (1ULL << (7 * sizeLength)) - 1;
+        if (!element.unknownSize && element.size > end - offset) break;
+        elements.push_back(element);
+        if (element.unknownSize) break;
+        offset += element.size;
+    }
+    return elements;
+}
+
+// Checks that a live webm stream can be written to a pipe, and that it holds
+// every frame without any of the elements filled in at stop.
+TEST_P(WriterTest, WebmLiveStreamTest) {
+    if (mDisableTest || mWriterName != standardWriters::WEBM) return;
+    ALOGV("Writes a live webm stream to a pipe and checks its structure");
+
+    string writerFormat = GetParam().first;
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0) << "Failed to create a pipe";
+
+    int32_t status = createWriter(fds[1]);
+    // The writer holds its own copy of the write end.
+    close(fds[1]);
+    ASSERT_EQ((status_t)OK, status) << "Failed to create writer for output format:" << writerFormat;
+    mFileMeta->setInt32(kKeyLiveStream, true);
+
+    string inputFile = gEnv->getRes();
+    string inputInfo = gEnv->getRes();
+    configFormat param;
+    bool isAudio;
+    int32_t inputFileIdx = GetParam().second;
+    getFileDetails(inputFile, inputInfo, param, isAudio, inputFileIdx);
+    ASSERT_NE(inputFile.compare(gEnv->getRes()), 0) << "No input file specified";
+
+    ASSERT_NO_FATAL_FAILURE(getInputBufferInfo(inputFile, inputInfo));
+    status = addWriterSource(isAudio, param);
+    ASSERT_EQ((status_t)OK, status) << "Failed to add source for " << writerFormat << "Writer";
+
+    vector<uint8_t> data;
+    int readFd = fds[0];
+    std::thread reader([&data, readFd]() {
+        uint8_t buffer[4096];
+        while (true) {
+            ssize_t n = read(readFd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            data.insert(data.end(), buffer, buffer + n);
+        }
+    });
+
+    // Keep going on failures so that the writer closes the pipe and the
+    // reader finishes.
+    status = mWriter->start(mFileMeta.get());
+    EXPECT_EQ((status_t)OK, status);
+    if (status == OK) {
+        status = sendBuffersToWriter(mInputStream, mBufferInfo, mInputFrameId, mCurrentTrack, 0,
+                                     mBufferInfo.size());
+        EXPECT_EQ((status_t)OK, status) << writerFormat << " writer failed";
+    }
+    mCurrentTrack->stop();
+    EXPECT_EQ((status_t)OK, mWriter->stop()) << "Failed to stop the writer";
+    reader.join();
+    close(readFd);
+    ASSERT_FALSE(HasFailure());
+
+    vector<EbmlElement> elements = parseEbmlElements(data, 0, data.size());
+    ASSERT_EQ(elements.size(), 2u) << "Expected an EBML header and a segment";
+    ASSERT_EQ(elements[0].id, (uint64_t)webm::kMkvEbml);
+    ASSERT_EQ(elements[1].id, (uint64_t)webm::kMkvSegment);
+    ASSERT_TRUE(elements[1].unknownSize) << "A live segment keeps its unknown size";
+
+    // Nothing that needs seeking back: no seek head, no cues and no space
+    // reserved for them.
+    size_t numSimpleBlocks = 0;
+    bool seenInfo = false;
+    bool seenTracks = false;
+    size_t numClusters = 0;
+    for (const EbmlElement &element : parseEbmlElements(data, elements[1].payload, data.size())) {
+        ASSERT_FALSE(element.unknownSize);
+        switch (element.id) {
+            case webm::kMkvInfo:
+                ASSERT_FALSE(seenInfo);
+                seenInfo = true;
+                break;
+            case webm::kMkvTracks:
+                ASSERT_TRUE(seenInfo) << "Tracks before segment info";
+                ASSERT_FALSE(seenTracks);
+                seenTracks = true;
+                break;
+            case webm::kMkvCluster: {
+                ASSERT_TRUE(seenTracks) << "Cluster before tracks";
+                ++numClusters;
+                vector<EbmlElement> children =
+                        parseEbmlElements(data, element.payload, element.end(data.size()));
+                ASSERT_FALSE(children.empty());
+                ASSERT_EQ(children[0].id, (uint64_t)webm::kMkvTimecode);
+                for (const EbmlElement &child : children) {
+                    if (child.id == (uint64_t)webm::kMkvSimpleBlock) ++numSimpleBlocks;
+                }
+                break;
+            }
+            default:
+                FAIL() << "Unexpected element 0x" << std::hex << element.id
+                       << " in a live segment";
+        }
+    }
+    ASSERT_TRUE(seenTracks);
+    ASSERT_GT(numClusters, 0u);
+
+    size_t numFrames = 0;
+    for (size_t i = mNumCsds; i < mBufferInfo.size(); ++i) {
+        if (mBufferInfo[i].size > 0) ++numFrames;
+    }
+    ASSERT_EQ(numSimpleBlocks, numFrames) << "Frames were lost in the live stream";
+}
+
 INSTANTIATE_TEST_SUITE_P(WriterTestAll, WriterTest,
                          ::testing::Values(make_pair("ogg", 0), make_pair("webm", 0),
                                            make_pair("aac", 1), make_pair("mpeg4", 1),
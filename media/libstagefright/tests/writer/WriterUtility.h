@@ -34,6 +34,7 @@ using namespace std;
 
 constexpr uint32_t kMaxCSDStrlen = 16;
 constexpr uint32_t kMaxCount = 20;
+constexpr int64_t kFragmentDurationUs = 500000;
 
 struct BufferInfo {
     int32_t size;
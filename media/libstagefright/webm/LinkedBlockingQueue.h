@@ -17,26 +17,58 @@
 #ifndef LINKEDBLOCKINGQUEUE_H_
 #define LINKEDBLOCKINGQUEUE_H_
 
-#include <utils/List.h>
 #include <utils/Mutex.h>
 #include <utils/Condition.h>
 
+#include <atomic>
+#include <type_traits>
+
 namespace android {
 
+// Unbounded queue between a single producer and a single consumer thread.
+// Elements are handed over through an atomically linked list, so neither
+// side takes a lock unless the consumer finds the queue empty and has to
+// sleep until the next push(). Pushes from different threads (e.g. the EOS
+// pushed on stop) must not overlap.
 template<typename T>
 class LinkedBlockingQueue {
-    List<T> mList;
+    typedef typename std::remove_const<T>::type Value;
+
+    struct Node {
+        Value mValue;
+        std::atomic<Node *> mNext;
+
+        Node() : mNext(NULL) {
+        }
+        explicit Node(const Value &value) : mValue(value), mNext(NULL) {
+        }
+    };
+
+    // mHead is a dummy node owned by the consumer; the front element is
+    // held by mHead->mNext. mTail is only touched by the producer.
+    Node *mHead;
+    Node *mTail;
+
+    std::atomic<bool> mConsumerWaiting;
     Mutex mLock;
     Condition mContentAvailableCondition;
 
     T front(bool remove) {
-        Mutex::Autolock autolock(mLock);
-        while (mList.empty()) {
-            mContentAvailableCondition.wait(mLock);
+        Node *next = mHead->mNext.load(std::memory_order_acquire);
+        if (next == NULL) {
+            Mutex::Autolock autolock(mLock);
+            mConsumerWaiting.store(true);
+            while ((next = mHead->mNext.load()) == NULL) {
+                mContentAvailableCondition.wait(mLock);
+            }
+            mConsumerWaiting.store(false);
         }
-        T e = *(mList.begin());
+        T e = next->mValue;
         if (remove) {
-            mList.erase(mList.begin());
+            delete mHead;
+            // next becomes the dummy node; drop its reference to the element.
+            next->mValue = Value();
+            mHead = next;
         }
         return e;
     }
@@ -44,20 +76,34 @@ class LinkedBlockingQueue {
     DISALLOW_EVIL_CONSTRUCTORS(LinkedBlockingQueue);
 
 public:
-    LinkedBlockingQueue() {
+    LinkedBlockingQueue()
+        : mHead(new Node),
+          mConsumerWaiting(false) {
+        mTail = mHead;
     }
 
     ~LinkedBlockingQueue() {
+        while (mHead != NULL) {
+            Node *next = mHead->mNext.load();
+            delete mHead;
+            mHead = next;
+        }
     }
 
     bool empty() {
-        Mutex::Autolock autolock(mLock);
-        return mList.empty();
+        return mHead->mNext.load(std::memory_order_acquire) == NULL;
     }
 
+    // Only valid while neither the producer nor the consumer is active.
     void clear() {
-        Mutex::Autolock autolock(mLock);
-        mList.clear();
+        Node *node = mHead->mNext.load();
+        while (node != NULL) {
+            Node *next = node->mNext.load();
+            delete node;
+            node = next;
+        }
+        mHead->mNext.store(NULL);
+        mTail = mHead;
     }
 
     T peek() {
@@ -69,9 +115,15 @@ public:
     }
 
     void push(T e) {
-        Mutex::Autolock autolock(mLock);
-        mList.push_back(e);
-        mContentAvailableCondition.signal();
+        Node *node = new Node(e);
+        // Sequentially consistent, so that either the consumer sees the new
+        // node or we see it waiting.
+        mTail->mNext.store(node);
+        mTail = node;
+        if (mConsumerWaiting.load()) {
+            Mutex::Autolock autolock(mLock);
+            mContentAvailableCondition.signal();
+        }
     }
 };
 
@@ -30,7 +30,6 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <sys/mman.h>
 
 using namespace android;
 using namespace webm;
@@ -111,25 +110,29 @@ uint8_t *WebmElement::serialize(uint64_t& size) {
 }
 
 int WebmElement::write(int fd, uint64_t& size) {
-    uint8_t buf[8];
-    size = totalSize();
-    off64_t off = ::lseek64(fd, (size - 1), SEEK_CUR) - (size - 1);
-    ::write(fd, buf, 1); // extend file
-
-    off64_t curOff = off + size;
-    off64_t alignedOff = off & ~(::sysconf(_SC_PAGE_SIZE) - 1);
-    off64_t mapSize = curOff - alignedOff;
-    off64_t pageOff = off - alignedOff;
-    void *dst = ::mmap64(NULL, mapSize, PROT_WRITE, MAP_SHARED, fd, alignedOff);
-    if (dst == MAP_FAILED) {
-        ALOGE("mmap64 failed; errno = %d", errno);
-        ALOGE("fd %d; flags: %o", fd, ::fcntl(fd, F_GETFL, 0));
-        return errno;
-    } else {
-        serializeInto((uint8_t*) dst + pageOff);
-        ::msync(dst, mapSize, MS_SYNC);
-        return ::munmap(dst, mapSize);
+    uint8_t *buf = serialize(size);
+    int err = writeFully(fd, buf, size);
+    delete[] buf;
+    return err;
+}
+
+// static
+int WebmElement::writeFully(int fd, const uint8_t *buf, uint64_t size) {
+    // Plain sequential writes, so that fd may also be a pipe or socket.
+    while (size > 0) {
+        ssize_t n = ::write(fd, buf, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("write failed; errno = %d", errno);
+            ALOGE("fd %d; flags: %o", fd, ::fcntl(fd, F_GETFL, 0));
+            return errno;
+        }
+        buf += n;
+        size -= n;
     }
+    return 0;
 }
 
 //=================================================================================================
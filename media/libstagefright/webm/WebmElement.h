@@ -38,6 +38,8 @@ struct WebmElement : public LightRefBase<WebmElement> {
     uint64_t serializeInto(uint8_t *buf);
     uint8_t *serialize(uint64_t& size);
     int write(int fd, uint64_t& size);
+    // Write size bytes of buf to fd at its current position; returns 0 or errno.
+    static int writeFully(int fd, const uint8_t *buf, uint64_t size);
 
     static sp<WebmElement> EbmlHeader(
             int ver = 1,
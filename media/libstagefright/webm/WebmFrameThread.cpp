@@ -72,13 +72,17 @@ WebmFrameSinkThread::WebmFrameSinkThread(
         const uint64_t& off,
         sp<WebmFrameSourceThread> videoThread,
         sp<WebmFrameSourceThread> audioThread,
-        List<sp<WebmElement> >& cues)
+        Vector<WebmCuePoint>& cues,
+        const bool& live)
     : mFd(fd),
       mSegmentDataStart(off),
       mVideoFrames(videoThread->mSink),
       mAudioFrames(audioThread->mSink),
       mCues(cues),
+      mLive(live),
       mStartOffsetTimecode(UINT64_MAX),
+      mClusterBuffer(NULL),
+      mClusterBufferSize(0),
       mDone(true) {
 }
 
@@ -87,16 +91,24 @@ WebmFrameSinkThread::WebmFrameSinkThread(
         const uint64_t& off,
         LinkedBlockingQueue<const sp<WebmFrame> >& videoSource,
         LinkedBlockingQueue<const sp<WebmFrame> >& audioSource,
-        List<sp<WebmElement> >& cues)
+        Vector<WebmCuePoint>& cues,
+        const bool& live)
     : mFd(fd),
       mSegmentDataStart(off),
       mVideoFrames(videoSource),
       mAudioFrames(audioSource),
       mCues(cues),
+      mLive(live),
       mStartOffsetTimecode(UINT64_MAX),
+      mClusterBuffer(NULL),
+      mClusterBufferSize(0),
       mDone(true) {
 }
 
+WebmFrameSinkThread::~WebmFrameSinkThread() {
+    delete[] mClusterBuffer;
+}
+
 // Initializes a webm cluster with its starting timecode.
 //
 // frames:
@@ -128,9 +140,16 @@ void WebmFrameSinkThread::writeCluster(List<sp<WebmElement> >& children) {
     // children must contain at least one simpleblock and its timecode
     CHECK_GE(children.size(), 2u);
 
-    uint64_t size;
     sp<WebmElement> cluster = new WebmMaster(kMkvCluster, children);
-    cluster->write(mFd, size);
+    uint64_t size = cluster->totalSize();
+    if (size > mClusterBufferSize) {
+        delete[] mClusterBuffer;
+        // Leave some headroom so that slightly larger clusters don't reallocate.
+        mClusterBufferSize = size + size / 4;
+        mClusterBuffer = new uint8_t[mClusterBufferSize];
+    }
+    cluster->serializeInto(mClusterBuffer);
+    WebmElement::writeFully(mFd, mClusterBuffer, size);
     children.clear();
 }
 
@@ -148,7 +167,7 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
     initCluster(frames, clusterTimecodeL, children);
 
     uint64_t cueTime = clusterTimecodeL;
-    off_t fpos = ::lseek(mFd, 0, SEEK_CUR);
+    off_t fpos = mLive ? 0 : ::lseek(mFd, 0, SEEK_CUR);
     size_t n = frames.size();
     if (!last) {
         // If we are not flushing the last sequence of outstanding frames, flushFrames
@@ -187,8 +206,13 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
     }
 
     writeCluster(children);
-    sp<WebmElement> cuePoint = WebmElement::CuePointEntry(cueTime, 1, fpos - mSegmentDataStart);
-    mCues.push_back(cuePoint);
+    if (!mLive) {
+        WebmCuePoint cuePoint;
+        cuePoint.mTime = cueTime;
+        cuePoint.mTrack = 1;
+        cuePoint.mClusterOffset = fpos - mSegmentDataStart;
+        mCues.push_back(cuePoint);
+    }
 }
 
 status_t WebmFrameSinkThread::start() {
@@ -206,7 +230,9 @@ status_t WebmFrameSinkThread::stop() {
 void WebmFrameSinkThread::run() {
     int numVideoKeyFrames = 0;
     List<const sp<WebmFrame> > outstandingFrames;
-    while (!mDone) {
+    // Run until both queues reach their EOS rather than until stop(), so that
+    // frames queued by the sources before they stopped are not dropped.
+    while (true) {
         ALOGV("wait v frame");
         const sp<WebmFrame> videoFrame = mVideoFrames.peek();
         ALOGV("v frame: %p", videoFrame.get());
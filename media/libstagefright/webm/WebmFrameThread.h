@@ -25,6 +25,7 @@
 
 #include <utils/List.h>
 #include <utils/Errors.h>
+#include <utils/Vector.h>
 
 #include <pthread.h>
 
@@ -53,6 +54,14 @@ private:
 
 //=================================================================================================
 
+// A cue point as collected while recording; the cue elements are only built
+// when the cues are written out.
+struct WebmCuePoint {
+    uint64_t mTime;
+    int mTrack;
+    uint64_t mClusterOffset;  // relative to the start of the segment data
+};
+
 class WebmFrameSourceThread;
 class WebmFrameSinkThread : public WebmFrameThread {
 public:
@@ -61,14 +70,17 @@ public:
             const uint64_t& off,
             sp<WebmFrameSourceThread> videoThread,
             sp<WebmFrameSourceThread> audioThread,
-            List<sp<WebmElement> >& cues);
+            Vector<WebmCuePoint>& cues,
+            const bool& live);
 
     WebmFrameSinkThread(
             const int& fd,
             const uint64_t& off,
             LinkedBlockingQueue<const sp<WebmFrame> >& videoSource,
             LinkedBlockingQueue<const sp<WebmFrame> >& audioSource,
-            List<sp<WebmElement> >& cues);
+            Vector<WebmCuePoint>& cues,
+            const bool& live);
+    ~WebmFrameSinkThread();
 
     void run();
     bool running() {
@@ -82,9 +94,15 @@ private:
     const uint64_t& mSegmentDataStart;
     LinkedBlockingQueue<const sp<WebmFrame> >& mVideoFrames;
     LinkedBlockingQueue<const sp<WebmFrame> >& mAudioFrames;
-    List<sp<WebmElement> >& mCues;
+    Vector<WebmCuePoint>& mCues;
+    // No cues are collected and the file is never seeked in live mode.
+    const bool& mLive;
     uint64_t mStartOffsetTimecode;
 
+    // Each cluster is serialized here and written with a single write.
+    uint8_t *mClusterBuffer;
+    uint64_t mClusterBufferSize;
+
     volatile bool mDone;
 
     static void initCluster(
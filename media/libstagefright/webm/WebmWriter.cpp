@@ -71,6 +71,7 @@ WebmWriter::WebmWriter(int fd)
       mIsFileSizeLimitExplicitlyRequested(false),
       mIsRealTimeRecording(false),
       mStreamableFile(true),
+      mIsLive(false),
       mEstimatedCuesSize(0) {
     mStreams[kAudioIndex] = WebmStream(kAudioType, "Audio", &WebmWriter::audioTrack);
     mStreams[kVideoIndex] = WebmStream(kVideoType, "Video", &WebmWriter::videoTrack);
@@ -79,7 +80,8 @@ WebmWriter::WebmWriter(int fd)
             mSegmentDataStart,
             mStreams[kVideoIndex].mSink,
             mStreams[kAudioIndex].mSink,
-            mCuePoints);
+            mCuePoints,
+            mIsLive);
 }
 
 // static
@@ -362,13 +364,22 @@ status_t WebmWriter::reset() {
 
     mSinkThread->stop();
 
-    // Do not write out movie header on error.
-    if (err != OK) {
+    // Do not write out movie header on error. A live stream has no
+    // header to update.
+    if (err != OK || mIsLive) {
+        mStreams[kVideoIndex].mSink.clear();
+        mStreams[kAudioIndex].mSink.clear();
         release();
         return err;
     }
 
-    sp<WebmElement> cues = new WebmMaster(kMkvCues, mCuePoints);
+    List<sp<WebmElement> > cuePoints;
+    for (size_t i = 0; i < mCuePoints.size(); ++i) {
+        const WebmCuePoint &cuePoint = mCuePoints[i];
+        cuePoints.push_back(WebmElement::CuePointEntry(
+                cuePoint.mTime, cuePoint.mTrack, cuePoint.mClusterOffset));
+    }
+    sp<WebmElement> cues = new WebmMaster(kMkvCues, cuePoints);
     uint64_t cuesSize = cues->totalSize();
     // TRICKY Even when the cues do fit in the space we reserved, if they do not fit
     // perfectly, we still need to check if there is enough "extra space" to write an
@@ -500,6 +511,13 @@ status_t WebmWriter::start(MetaData *params) {
         mIsRealTimeRecording = isRealTimeRecording;
     }
 
+    if (!mStarted && params) {
+        int32_t isLive;
+        if (params->findInt32(kKeyLiveStream, &isLive)) {
+            mIsLive = isLive;
+        }
+    }
+
     if (mStarted) {
         if (mPaused) {
             mPaused = false;
@@ -527,8 +545,8 @@ status_t WebmWriter::start(MetaData *params) {
      * to make the file streamable. mStreamableFile does not tell
      * whether the actual recorded file is streamable or not.
      */
-    mStreamableFile = (!mMaxFileSizeLimitBytes)
-        || (mMaxFileSizeLimitBytes >= kMinStreamableFileSizeInBytes);
+    mStreamableFile = !mIsLive && ((!mMaxFileSizeLimitBytes)
+        || (mMaxFileSizeLimitBytes >= kMinStreamableFileSizeInBytes));
 
     /*
      * Write various metadata.
@@ -536,7 +554,8 @@ status_t WebmWriter::start(MetaData *params) {
     sp<WebmElement> ebml, segment, info, seekHead, tracks, cues;
     ebml = WebmElement::EbmlHeader();
     segment = new WebmMaster(kMkvSegment);
-    seekHead = new EbmlVoid(kMaxMetaSeekSize);
+    // The seek head is filled in on stop, which a live stream never gets to.
+    seekHead = mIsLive ? NULL : new EbmlVoid(kMaxMetaSeekSize);
     info = WebmElement::SegmentInfo(mTimeCodeScale, 0);
 
     List<sp<WebmElement> > children;
@@ -561,16 +580,21 @@ status_t WebmWriter::start(MetaData *params) {
     static const size_t nElems = sizeof(elems) / sizeof(elems[0]);
     uint64_t offsets[nElems];
     uint64_t sizes[nElems];
+    // Track the offsets ourselves rather than asking the fd, which may not
+    // be seekable in live mode.
+    uint64_t offset = mIsLive ? 0 : ::lseek(mFd, 0, SEEK_CUR);
     for (uint32_t i = 0; i < nElems; i++) {
         WebmElement *e = elems[i].get();
+        offsets[i] = offset;
+        sizes[i] = 0;
         if (!e) {
             continue;
         }
 
         uint64_t size;
-        offsets[i] = ::lseek(mFd, 0, SEEK_CUR);
         sizes[i] = e->mSize;
         e->write(mFd, size);
+        offset += size;
     }
 
     mSegmentOffset = offsets[1];
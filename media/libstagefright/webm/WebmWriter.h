@@ -69,10 +69,11 @@ private:
     bool mIsFileSizeLimitExplicitlyRequested;
     bool mIsRealTimeRecording;
     bool mStreamableFile;
+    bool mIsLive;
     uint64_t mEstimatedCuesSize;
 
     Mutex mLock;
-    List<sp<WebmElement> > mCuePoints;
+    Vector<WebmCuePoint> mCuePoints;
 
     enum {
         kAudioIndex     =  0,
@@ -20,6 +20,8 @@
 
 #include <gtest/gtest.h>
 
+#include <thread>
+
 #include <media/stagefright/MediaAdapter.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaData.h>
@@ -107,7 +109,8 @@ class WebmFrameThreadUnitTest : public ::testing::TestWithParam<std::pair<int32_
     sp<WebmFrameSourceThread> mAudioThread;
     sp<WebmFrameSourceThread> mVideoThread;
 
-    List<sp<WebmElement>> mCuePoints;
+    Vector<WebmCuePoint> mCuePoints;
+    bool mIsLive = false;
     sp<MediaAdapter> mSource[kMaxStreamCount];
     LinkedBlockingQueue<const sp<WebmFrame>> mVSink;
     LinkedBlockingQueue<const sp<WebmFrame>> mASink;
@@ -169,7 +172,8 @@ void WebmFrameThreadUnitTest::addTrack(bool isAudio, int32_t index) {
 }
 
 void WebmFrameThreadUnitTest::createWebmThreads(std::initializer_list<int32_t> indexList) {
-    mSinkThread = new WebmFrameSinkThread(mFd, mSegmentDataStart, mVSink, mASink, mCuePoints);
+    mSinkThread = new WebmFrameSinkThread(mFd, mSegmentDataStart, mVSink, mASink, mCuePoints,
+                                          mIsLive);
     ASSERT_NE(mSinkThread, nullptr) << "Failed to create Sink Thread";
 
     bool isAudio;
@@ -300,6 +304,59 @@ TEST_P(WebmFrameThreadUnitTest, PauseTest) {
     ASSERT_NO_FATAL_FAILURE(stopWebmFrameThreads());
 }
 
+// Hands a long sequence of values from one thread to another, in bursts so that
+// the consumer keeps switching between the lock-free path and sleeping on an
+// empty queue, then ends it with a push from a third thread like the EOS
+// pushed on stop.
+TEST(LinkedBlockingQueueTest, SingleProducerSingleConsumerStressTest) {
+    static constexpr int64_t kNumValues = 1000000;
+    static constexpr int64_t kBurstSize = 4096;
+    static constexpr int64_t kEndOfValues = -1;
+
+    LinkedBlockingQueue<int64_t> queue;
+    int64_t numMismatches = 0;
+    int64_t numTaken = 0;
+    std::thread consumer([&queue, &numMismatches, &numTaken]() {
+        int64_t expected = 0;
+        while (true) {
+            int64_t value = queue.peek();
+            if (queue.take() != value) ++numMismatches;
+            if (value == kEndOfValues) break;
+            if (value != expected) ++numMismatches;
+            expected = value + 1;
+            ++numTaken;
+        }
+    });
+
+    std::thread producer([&queue]() {
+        for (int64_t value = 0; value < kNumValues; ++value) {
+            queue.push(value);
+            if (value % kBurstSize == kBurstSize - 1) {
+                // Let the consumer drain the queue and go to sleep on it.
+                usleep(1000);
+            }
+        }
+    });
+    producer.join();
+    queue.push(kEndOfValues);
+    consumer.join();
+
+    ASSERT_EQ(numMismatches, 0) << "Values were reordered or duplicated";
+    ASSERT_EQ(numTaken, kNumValues) << "Values were lost";
+    ASSERT_TRUE(queue.empty());
+
+    // The queue drops its references to the values it hands out.
+    LinkedBlockingQueue<const sp<WebmFrame>> frames;
+    const sp<WebmFrame> frame = WebmFrame::EOS;
+    int32_t strongCount = frame->getStrongCount();
+    frames.push(frame);
+    frames.push(frame);
+    ASSERT_EQ(frame->getStrongCount(), strongCount + 2);
+    frames.take();
+    frames.take();
+    ASSERT_EQ(frame->getStrongCount(), strongCount);
+}
+
 INSTANTIATE_TEST_SUITE_P(WebmFrameThreadUnitTestAll, WebmFrameThreadUnitTest,
                          ::testing::Values(std::make_pair(0, 1), std::make_pair(0, 2),
                                            std::make_pair(0, 3), std::make_pair(1, 0),
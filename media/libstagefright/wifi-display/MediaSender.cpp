@@ -225,6 +225,10 @@ status_t MediaSender::queueAccessUnit(
                 const TrackInfo &info = mTrackInfos.itemAt(i);
 
                 if (info.mAccessUnits.empty()) {
+                    if (info.mFlags & FLAG_LOW_LATENCY) {
+                        continue;
+                    }
+
                     minTrackIndex = -1;
                     minTimeUs = -1ll;
                     break;
@@ -397,9 +401,11 @@ status_t MediaSender::packetizeAccessUnit(
     uint64_t inputCTR;
     uint8_t HDCP_private_data[16];
 
+    int32_t isContinuation;
     bool manuallyPrependSPSPPS =
         !info.mIsAudio
         && (info.mFlags & FLAG_MANUALLY_PREPEND_SPS_PPS)
+        && !accessUnit->meta()->findInt32("slice-continuation", &isContinuation)
         && IsIDR(accessUnit->data(), accessUnit->size());
 
     if (mHDCP != NULL && !info.mIsAudio) {
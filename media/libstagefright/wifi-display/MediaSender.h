@@ -54,6 +54,9 @@ struct MediaSender : public AHandler {
 
     enum FlagBits {
         FLAG_MANUALLY_PREPEND_SPS_PPS = 1,
+        // Don't hold back other tracks while waiting for this track's next
+        // access unit when interleaving into the transport stream.
+        FLAG_LOW_LATENCY              = 2,
     };
     ssize_t addTrack(const sp<AMessage> &format, uint32_t flags);
 
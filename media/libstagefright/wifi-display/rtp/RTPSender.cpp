@@ -21,9 +21,11 @@
 #include "RTPSender.h"
 
 #include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ABufferPool.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/ANetworkSession.h>
+#include <media/stagefright/foundation/AString.h>
 #include <media/stagefright/foundation/hexdump.h>
 #include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/Utils.h>
@@ -50,7 +52,10 @@ RTPSender::RTPSender(
       mNumRTPOctetsSent(0),
       mNumSRsSent(0),
       mRTPSeqNo(0),
-      mHistorySize(0) {
+      mHistorySize(0),
+      mTSPacketPool(new ABufferPool(
+                  12 + kMaxNumTSPacketsPerRTPPacket * 188,
+                  kMaxNumFreeTSPackets)) {
 }
 
 RTPSender::~RTPSender() {
@@ -144,6 +149,10 @@ status_t RTPSender::initAsync(
                     remoteRTCPPort,
                     rtcpNotify,
                     &mRTCPSessionID);
+
+            if (err == OK) {
+                mNetSession->setBatchedNotifications(mRTCPSessionID, true);
+            }
         } else {
             CHECK_EQ(rtcpMode, TRANSPORT_TCP);
             err = mNetSession->createTCPDatagramSession(
@@ -253,10 +262,17 @@ status_t RTPSender::queueTSPackets(
     int64_t timeUs;
     CHECK(tsPackets->meta()->findInt64("timeUs", &timeUs));
 
+    // Over UDP all RTP packets of a buffer are handed to the network session
+    // at once, which sends them with a single sendmmsg without copying them.
+    const bool batched = (mRTPMode == TRANSPORT_UDP);
+    List<sp<ABuffer> > udpPackets;
+
+    int64_t nowUs = ALooper::GetNowUs();
+    uint32_t rtpTime = (nowUs * 9) / 100ll;
+
     size_t srcOffset = 0;
     while (srcOffset < tsPackets->size()) {
-        sp<ABuffer> udpPacket =
-            new ABuffer(12 + kMaxNumTSPacketsPerRTPPacket * 188);
+        sp<ABuffer> udpPacket = mTSPacketPool->acquire();
 
         udpPacket->setInt32Data(mRTPSeqNo);
 
@@ -268,8 +284,10 @@ status_t RTPSender::queueTSPackets(
         rtp[3] = mRTPSeqNo & 0xff;
         ++mRTPSeqNo;
 
-        int64_t nowUs = ALooper::GetNowUs();
-        uint32_t rtpTime = (nowUs * 9) / 100ll;
+        if (!batched) {
+            nowUs = ALooper::GetNowUs();
+            rtpTime = (nowUs * 9) / 100ll;
+        }
 
         rtp[4] = rtpTime >> 24;
         rtp[5] = (rtpTime >> 16) & 0xff;
@@ -291,6 +309,12 @@ status_t RTPSender::queueTSPackets(
         udpPacket->setRange(0, 12 + numTSPackets * 188);
 
         srcOffset += numTSPackets * 188;
+
+        if (batched) {
+            udpPackets.push_back(udpPacket);
+            continue;
+        }
+
         bool isLastPacket = (srcOffset == tsPackets->size());
 
         status_t err = sendRTPPacket(
@@ -304,6 +328,24 @@ status_t RTPSender::queueTSPackets(
         }
     }
 
+    if (!batched) {
+        return OK;
+    }
+
+    CHECK(mRTPConnected);
+
+    status_t err = mNetSession->sendDatagrams(
+            mRTPSessionID, udpPackets, true /* timeValid */, timeUs);
+
+    if (err != OK) {
+        return err;
+    }
+
+    for (List<sp<ABuffer> >::iterator it = udpPackets.begin();
+            it != udpPackets.end(); ++it) {
+        onRTPPacketSent(*it, true /* storeInHistory */);
+    }
+
     return OK;
 }
 
@@ -470,22 +512,29 @@ status_t RTPSender::sendRTPPacket(
         return err;
     }
 
+    onRTPPacketSent(buffer, storeInHistory);
+
+    return OK;
+}
+
+void RTPSender::onRTPPacketSent(
+        const sp<ABuffer> &buffer, bool storeInHistory) {
     mLastNTPTime = GetNowNTP();
     mLastRTPTime = U32_AT(buffer->data() + 4);
 
     ++mNumRTPSent;
     mNumRTPOctetsSent += buffer->size() - 12;
 
-    if (storeInHistory) {
-        if (mHistorySize == kMaxHistorySize) {
-            mHistory.erase(mHistory.begin());
-        } else {
-            ++mHistorySize;
-        }
-        mHistory.push_back(buffer);
+    if (!storeInHistory) {
+        return;
     }
 
-    return OK;
+    if (mHistorySize == kMaxHistorySize) {
+        mHistory.erase(mHistory.begin());
+    } else {
+        ++mHistorySize;
+    }
+    mHistory.push_back(buffer);
 }
 
 // static
@@ -575,6 +624,24 @@ void RTPSender::onNetNotify(bool isRTP, const sp<AMessage> &msg) {
             break;
         }
 
+        case ANetworkSession::kWhatDatagrams:
+        {
+            size_t count;
+            CHECK(msg->findSize("count", &count));
+
+            for (size_t i = 0; i < count; ++i) {
+                sp<ABuffer> data;
+                CHECK(msg->findBuffer(AStringPrintf("data%zu", i).c_str(), &data));
+
+                if (isRTP) {
+                    ALOGW("Huh? Received data on RTP connection...");
+                } else {
+                    onRTCPData(data);
+                }
+            }
+            break;
+        }
+
         case ANetworkSession::kWhatConnected:
         {
             int32_t sessionID;
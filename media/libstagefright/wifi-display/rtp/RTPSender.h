@@ -25,6 +25,7 @@
 namespace android {
 
 struct ABuffer;
+struct ABufferPool;
 struct ANetworkSession;
 
 // An object of this class facilitates sending of media data over an RTP
@@ -68,6 +69,7 @@ private:
 
     const unsigned int kMaxNumTSPacketsPerRTPPacket = (kMaxUDPPacketSize - 12) / 188;
     const unsigned int kMaxHistorySize              = 1024;
+    const unsigned int kMaxNumFreeTSPackets         = 64;
     const unsigned int kSourceID                    = 0xdeadbeef;
 
     sp<ANetworkSession> mNetSession;
@@ -90,6 +92,10 @@ private:
     List<sp<ABuffer> > mHistory;
     size_t mHistorySize;
 
+    // Memory of TS RTP packets that aged out of mHistory and were released
+    // by the network session, ready to be filled again.
+    sp<ABufferPool> mTSPacketPool;
+
     static uint64_t GetNowNTP();
 
     status_t queueRawPacket(const sp<ABuffer> &tsPackets, uint8_t packetType);
@@ -100,6 +106,8 @@ private:
             const sp<ABuffer> &packet, bool storeInHistory,
             bool timeValid = false, int64_t timeUs = -1ll);
 
+    void onRTPPacketSent(const sp<ABuffer> &packet, bool storeInHistory);
+
     void onNetNotify(bool isRTP, const sp<AMessage> &msg);
 
     status_t onRTCPData(const sp<ABuffer> &data);
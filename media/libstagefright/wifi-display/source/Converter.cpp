@@ -55,7 +55,8 @@ Converter::Converter(
       mIsH264(false),
       mIsPCMAudio(false),
       mNeedToManuallyPrependSPSPPS(false),
-      mDoMoreWorkPending(false)
+      mDoMoreWorkPending(false),
+      mInPartialFrame(false)
 #if ENABLE_SILENCE_DETECTION
       ,mFirstSilentFrameUs(-1ll)
       ,mInSilentMode(false)
@@ -191,6 +192,13 @@ status_t Converter::initEncoder() {
         // to recover from a lost/corrupted packet.
         mbs = (((width + 15) / 16) * ((height + 15) / 16) * 10) / 100;
         mOutputFormat->setInt32("intra-refresh-CIR-mbs", mbs);
+
+        if (mFlags & FLAG_LOW_LATENCY) {
+            // Emit each frame (or slice) as soon as it's encoded and run the
+            // encoder at realtime priority.
+            mOutputFormat->setInt32("latency", 1);
+            mOutputFormat->setInt32("priority", 0);
+        }
     }
 
     ALOGV("output format is '%s'", mOutputFormat->debugString(0).c_str());
@@ -757,6 +765,15 @@ status_t Converter::doMoreWork() {
 
             memcpy(buffer->data(), outbuf->base() + offset, size);
 
+            bool isContinuation = mInPartialFrame;
+            if (!(flags & MediaCodec::BUFFER_FLAG_CODECCONFIG)) {
+                mInPartialFrame = (flags & MediaCodec::BUFFER_FLAG_PARTIAL_FRAME) != 0;
+            }
+
+            if (isContinuation) {
+                buffer->meta()->setInt32("slice-continuation", 1);
+            }
+
             if (flags & MediaCodec::BUFFER_FLAG_CODECCONFIG) {
                 if (!handle) {
                     if (mIsH264) {
@@ -766,6 +783,7 @@ status_t Converter::doMoreWork() {
                 }
             } else {
                 if (mNeedToManuallyPrependSPSPPS
+                        && !isContinuation
                         && mIsH264
                         && (mFlags & FLAG_PREPEND_CSD_IF_NECESSARY)
                         && IsIDR(buffer->data(), buffer->size())) {
@@ -43,6 +43,10 @@ struct Converter : public AHandler {
     enum FlagBits {
         FLAG_USE_SURFACE_INPUT          = 1,
         FLAG_PREPEND_CSD_IF_NECESSARY   = 2,
+        // Ask the encoder not to hold back output and forward partial frames
+        // (slices) as soon as they're produced. Buffers continuing a frame
+        // carry "slice-continuation" in their meta.
+        FLAG_LOW_LATENCY                = 4,
     };
     Converter(const sp<AMessage> &notify,
               const sp<ALooper> &codecLooper,
@@ -118,6 +122,9 @@ private:
 
     bool mDoMoreWorkPending;
 
+    // The last encoder output buffer ended in the middle of a frame.
+    bool mInPartialFrame;
+
 #if ENABLE_SILENCE_DETECTION
     int64_t mFirstSilentFrameUs;
     bool mInSilentMode;
@@ -964,10 +964,16 @@ status_t WifiDisplaySource::PlaybackSession::addSource(
         }
     }
 
+    // Trades encoder efficiency and muxing order for glass-to-glass latency,
+    // meant for casting to a sink on the local network.
+    bool lowLatency = property_get_bool("media.wfd.low-latency", false);
+
     notify = new AMessage(kWhatConverterNotify, this);
     notify->setSize("trackIndex", trackIndex);
 
-    sp<Converter> converter = new Converter(notify, codecLooper, format);
+    sp<Converter> converter = new Converter(
+            notify, codecLooper, format,
+            lowLatency ? Converter::FLAG_LOW_LATENCY : 0);
 
     looper()->registerHandler(converter);
 
@@ -1011,6 +1017,9 @@ status_t WifiDisplaySource::PlaybackSession::addSource(
     if (converter->needToManuallyPrependSPSPPS()) {
         flags |= MediaSender::FLAG_MANUALLY_PREPEND_SPS_PPS;
     }
+    if (lowLatency) {
+        flags |= MediaSender::FLAG_LOW_LATENCY;
+    }
 
     ssize_t mediaSenderTrackIndex =
         mMediaSender->addTrack(converter->getOutputFormat(), flags);
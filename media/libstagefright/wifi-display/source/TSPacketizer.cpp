@@ -435,6 +435,10 @@ ssize_t TSPacketizer::addTrack(const sp<AMessage> &format) {
         return -ERANGE;
     }
 
+    // The program map needs to list the new track.
+    mPATPacket.clear();
+    mPMTPacket.clear();
+
     sp<Track> track = new Track(format, PID, streamType, streamID);
     return mTracks.add(track);
 }
@@ -640,9 +644,28 @@ status_t TSPacketizer::packetize(
     }
 
     sp<ABuffer> buffer = new ABuffer(numTSPackets * 188);
+
     uint8_t *packetDataStart = buffer->data();
 
-    if (flags & EMIT_PAT_AND_PMT) {
+    if ((flags & EMIT_PAT_AND_PMT) && mPATPacket != NULL) {
+        // Only the continuity counters differ from the tables emitted
+        // before, they're part of the TS header and not covered by the CRC.
+        if (++mPATContinuityCounter == 16) {
+            mPATContinuityCounter = 0;
+        }
+
+        memcpy(packetDataStart, mPATPacket->data(), 188);
+        packetDataStart[3] = 0x10 | mPATContinuityCounter;
+        packetDataStart += 188;
+
+        if (++mPMTContinuityCounter == 16) {
+            mPMTContinuityCounter = 0;
+        }
+
+        memcpy(packetDataStart, mPMTPacket->data(), 188);
+        packetDataStart[3] = 0x10 | mPMTContinuityCounter;
+        packetDataStart += 188;
+    } else if (flags & EMIT_PAT_AND_PMT) {
         // Program Association Table (PAT):
         // 0x47
         // transport_error_indicator = b0
@@ -819,6 +842,12 @@ status_t TSPacketizer::packetize(
         sizeLeft = packetDataStart + 188 - ptr;
         memset(ptr, 0xff, sizeLeft);
 
+        mPATPacket = new ABuffer(188);
+        memcpy(mPATPacket->data(), packetDataStart - 188, 188);
+
+        mPMTPacket = new ABuffer(188);
+        memcpy(mPMTPacket->data(), packetDataStart, 188);
+
         packetDataStart += 188;
     }
 
@@ -1004,7 +1033,7 @@ status_t TSPacketizer::packetize(
         packetDataStart += 188;
     }
 
-    CHECK(packetDataStart == buffer->data() + buffer->capacity());
+    CHECK(packetDataStart == buffer->data() + buffer->size());
 
     *packets = buffer;
 
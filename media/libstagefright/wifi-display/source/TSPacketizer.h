@@ -82,6 +82,10 @@ private:
 
     uint32_t mCrcTable[256];
 
+    // PAT and PMT as first emitted, they only change when tracks are added.
+    sp<ABuffer> mPATPacket;
+    sp<ABuffer> mPMTPacket;
+
     void initCrcTable();
     uint32_t crc32(const uint8_t *start, size_t size) const;
 
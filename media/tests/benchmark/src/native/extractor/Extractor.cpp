@@ -111,9 +111,53 @@ int32_t Extractor::extract(int32_t trackId) {
     return AMEDIA_OK;
 }
 
+int32_t Extractor::seek(int32_t trackId, int32_t numSeeks, int32_t numReadsPerSeek,
+                        int32_t numPasses) {
+    int32_t status = setupTrackFormat(trackId);
+    if (status != AMEDIA_OK) return status;
+    if (numSeeks <= 0 || numReadsPerSeek <= 0 || numPasses <= 0) {
+        return AMEDIA_ERROR_INVALID_PARAMETER;
+    }
+
+    mOperation = numReadsPerSeek > 1 ? "seek_read" : "seek";
+    AMediaCodecBufferInfo frameInfo;
+    mStats->setStartTime();
+    // Visit evenly spaced positions in a scattered order, so that both
+    // forward and backward seeks into played and unplayed regions are timed.
+    // Later passes revisit the positions, like scrubbing back and forth does.
+    for (int32_t idx = 0; idx < numSeeks * numPasses && status == AMEDIA_OK; idx++) {
+        int32_t position = (idx * 7) % numSeeks;
+        int64_t seekTimeUs = mDurationUs * position / numSeeks;
+        status = AMediaExtractor_seekTo(mExtractor, seekTimeUs, AMEDIAEXTRACTOR_SEEK_CLOSEST_SYNC);
+        if (status != AMEDIA_OK) break;
+        for (int32_t read = 0; read < numReadsPerSeek; read++) {
+            status = getFrameSample(frameInfo);
+            if (status != AMEDIA_OK || !frameInfo.size) {
+                if (read > 0) {
+                    // Reached the end of the stream after the seek.
+                    status = AMEDIA_OK;
+                } else if (status == AMEDIA_OK) {
+                    ALOGE("No sample after seeking to %lld us", (long long)seekTimeUs);
+                    status = AMEDIA_ERROR_MALFORMED;
+                }
+                break;
+            }
+            mStats->addOutputTime();
+        }
+    }
+
+    if (mFormat) {
+        AMediaFormat_delete(mFormat);
+        mFormat = nullptr;
+    }
+
+    AMediaExtractor_unselectTrack(mExtractor, trackId);
+
+    return status;
+}
+
 void Extractor::dumpStatistics(string inputReference, string componentName, string statsFile) {
-    string operation = "extract";
-    mStats->dumpStatistics(operation, inputReference, mDurationUs, componentName, "", statsFile);
+    mStats->dumpStatistics(mOperation, inputReference, mDurationUs, componentName, "", statsFile);
 }
 
 void Extractor::deInitExtractor() {
@@ -29,7 +29,8 @@ class Extractor {
           mExtractor(nullptr),
           mStats(nullptr),
           mFrameBuf{nullptr},
-          mDurationUs{0} {}
+          mDurationUs{0},
+          mOperation("extract") {}
 
     ~Extractor() {
         if (mStats) delete mStats;
@@ -45,6 +46,9 @@ class Extractor {
 
     int32_t extract(int32_t trackId);
 
+    int32_t seek(int32_t trackId, int32_t numSeeks, int32_t numReadsPerSeek = 1,
+                 int32_t numPasses = 1);
+
     void dumpStatistics(string inputReference, string componentName = "", string statsFile = "");
 
     void deInitExtractor();
@@ -61,6 +65,7 @@ class Extractor {
     Stats *mStats;
     uint8_t *mFrameBuf;
     int64_t mDurationUs;
+    string mOperation;
 };
 
 #endif  // __EXTRACTOR_H__
\ No newline at end of file
@@ -22,7 +22,7 @@
 
 #include "Muxer.h"
 
-int32_t Muxer::initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat) {
+int32_t Muxer::initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat, int32_t numTracks) {
     if (!mFormat) mFormat = mExtractor->getFormat();
     if (!mStats) mStats = new Stats();
 
@@ -36,11 +36,14 @@ int32_t Muxer::initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat) {
      * AMediaMuxer_addTrack returns the index of the new track or a negative value
      * in case of failure, which can be interpreted as a media_status_t.
      */
-    ssize_t index = AMediaMuxer_addTrack(mMuxer, mFormat);
-    if (index < 0) {
-        ALOGV("Format not supported");
-        return index;
+    for (int32_t track = 0; track < numTracks; track++) {
+        ssize_t index = AMediaMuxer_addTrack(mMuxer, mFormat);
+        if (index < 0) {
+            ALOGV("Format not supported");
+            return index;
+        }
     }
+    mNumTracks = numTracks;
     AMediaMuxer_start(mMuxer);
     int64_t eTime = mStats->getCurTime();
     int64_t timeTaken = mStats->getTimeDiff(sTime, eTime);
@@ -78,13 +81,16 @@ int32_t Muxer::mux(uint8_t *inputBuffer, vector<AMediaCodecBufferInfo> &frameInf
     mStats->setStartTime();
     while (frameIdx < frameInfos.size()) {
         AMediaCodecBufferInfo info = frameInfos.at(frameIdx);
-        media_status_t status = AMediaMuxer_writeSampleData(mMuxer, 0, inputBuffer, &info);
-        if (status != 0) {
-            ALOGE("Error in AMediaMuxer_writeSampleData");
-            return status;
+        for (int32_t track = 0; track < mNumTracks; track++) {
+            media_status_t status =
+                    AMediaMuxer_writeSampleData(mMuxer, track, inputBuffer, &info);
+            if (status != 0) {
+                ALOGE("Error in AMediaMuxer_writeSampleData");
+                return status;
+            }
         }
         mStats->addOutputTime();
-        mStats->addFrameSize(info.size);
+        mStats->addFrameSize(info.size * mNumTracks);
         frameIdx++;
     }
     return AMEDIA_OK;
@@ -33,7 +33,9 @@ typedef enum {
 
 class Muxer {
   public:
-    Muxer() : mFormat(nullptr), mMuxer(nullptr), mStats(nullptr) { mExtractor = new Extractor(); }
+    Muxer() : mFormat(nullptr), mMuxer(nullptr), mStats(nullptr), mNumTracks(1) {
+        mExtractor = new Extractor();
+    }
 
     virtual ~Muxer() {
         if (mStats) delete mStats;
@@ -44,7 +46,8 @@ class Muxer {
     Extractor *getExtractor() { return mExtractor; }
 
     /* Muxer related utilities */
-    int32_t initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat);
+    /* numTracks copies of the extracted track are added to the output */
+    int32_t initMuxer(int32_t fd, MUXER_OUTPUT_T outputFormat, int32_t numTracks = 1);
     void deInitMuxer();
     void resetMuxer();
 
@@ -58,6 +61,7 @@ class Muxer {
     AMediaMuxer *mMuxer;
     Extractor *mExtractor;
     Stats *mStats;
+    int32_t mNumTracks;
 };
 
 #endif  // __MUXER_H__
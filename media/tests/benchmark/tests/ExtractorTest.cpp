@@ -19,9 +19,14 @@
 
 #include <gtest/gtest.h>
 
+#include <unistd.h>
+#include <vector>
+
 #include "BenchmarkTestEnvironment.h"
 #include "Extractor.h"
 
+#define SYNTHETIC_FLAC_DIR "/data/local/tmp/"
+
 static BenchmarkTestEnvironment *gEnv = nullptr;
 
 class ExtractorTest : public ::testing::TestWithParam<pair<string, int32_t>> {};
@@ -55,6 +60,145 @@ TEST_P(ExtractorTest, Extract) {
     delete extractObj;
 }
 
+// Number of seeks; co-prime with the stride used by Extractor::seek()
+constexpr int32_t kNumSeeks = 20;
+
+// Samples read after each seek in the seek-then-read cases, and the number
+// of times the seek positions are visited.
+constexpr int32_t kNumReadsPerSeek = 256;
+constexpr int32_t kNumSeekPasses = 2;
+
+static void runSeekBenchmark(const string &inputFile, const string &inputReference,
+                             int32_t trackId, int32_t numReadsPerSeek, int32_t numPasses) {
+    Extractor *extractObj = new Extractor();
+    ASSERT_NE(extractObj, nullptr) << "Extractor creation failed";
+
+    FILE *inputFp = fopen(inputFile.c_str(), "rb");
+    if (!inputFp) delete extractObj;
+    ASSERT_NE(inputFp, nullptr) << "Unable to open " << inputFile << " file for reading";
+
+    struct stat buf;
+    stat(inputFile.c_str(), &buf);
+    size_t fileSize = buf.st_size;
+    int32_t fd = fileno(inputFp);
+
+    int32_t trackCount = extractObj->initExtractor(fd, fileSize);
+    int32_t status = AMEDIA_ERROR_UNKNOWN;
+    if (trackCount > 0) {
+        status = extractObj->seek(trackId, kNumSeeks, numReadsPerSeek, numPasses);
+        extractObj->deInitExtractor();
+        extractObj->dumpStatistics(inputReference);
+    }
+
+    fclose(inputFp);
+    delete extractObj;
+
+    ASSERT_GT(trackCount, 0) << "initExtractor failed";
+    ASSERT_EQ(status, AMEDIA_OK) << "Seek failed \n";
+}
+
+// Writes a mono 8-bit FLAC stream of |numFrames| frames made of constant
+// subframes. It decodes quickly but has far more frames than the clips in
+// the resources, which is what seeking within a FLAC stream scales with.
+static bool writeSyntheticFlac(const string &path, uint32_t sampleRate, uint32_t numFrames) {
+    // 192 samples per frame (block size code 1), 48 kHz (sample rate code 10).
+    constexpr uint32_t kBlockSize = 192;
+    if (sampleRate != 48000 || numFrames >= 0x200000) return false;
+
+    auto crc8 = [](const vector<uint8_t> &data) {
+        uint8_t crc = 0;
+        for (uint8_t byte : data) {
+            crc ^= byte;
+            for (int bit = 0; bit < 8; bit++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+        return crc;
+    };
+    auto crc16 = [](const vector<uint8_t> &data) {
+        uint16_t crc = 0;
+        for (uint8_t byte : data) {
+            crc ^= byte << 8;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+            }
+        }
+        return crc;
+    };
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+
+    // "fLaC" marker and the STREAMINFO block, flagged as the last metadata block.
+    vector<uint8_t> header = {'f', 'L', 'a', 'C', 0x80, 0x00, 0x00, 34};
+    header.insert(header.end(), {kBlockSize >> 8, kBlockSize & 0xff,
+                                 kBlockSize >> 8, kBlockSize & 0xff,
+                                 0, 0, 0, 0, 0, 0});  // frame sizes unknown
+    uint64_t totalSamples = (uint64_t)numFrames * kBlockSize;
+    uint64_t info = (uint64_t)sampleRate << 44 | (uint64_t)(1 - 1) << 41
+            | (uint64_t)(8 - 1) << 36 | totalSamples;
+    for (int shift = 56; shift >= 0; shift -= 8) header.push_back((info >> shift) & 0xff);
+    header.insert(header.end(), 16, 0);  // no MD5 signature
+    bool ok = fwrite(header.data(), 1, header.size(), fp) == header.size();
+
+    vector<uint8_t> frame;
+    for (uint32_t n = 0; ok && n < numFrames; n++) {
+        frame = {0xff, 0xf8, 0x1a, 0x02};
+        // Frame number, UTF-8 coded.
+        if (n < 0x80) {
+            frame.push_back(n);
+        } else if (n < 0x800) {
+            frame.insert(frame.end(), {(uint8_t)(0xc0 | n >> 6), (uint8_t)(0x80 | (n & 0x3f))});
+        } else if (n < 0x10000) {
+            frame.insert(frame.end(), {(uint8_t)(0xe0 | n >> 12),
+                                       (uint8_t)(0x80 | ((n >> 6) & 0x3f)),
+                                       (uint8_t)(0x80 | (n & 0x3f))});
+        } else {
+            frame.insert(frame.end(), {(uint8_t)(0xf0 | n >> 18),
+                                       (uint8_t)(0x80 | ((n >> 12) & 0x3f)),
+                                       (uint8_t)(0x80 | ((n >> 6) & 0x3f)),
+                                       (uint8_t)(0x80 | (n & 0x3f))});
+        }
+        frame.push_back(crc8(frame));
+        // CONSTANT subframe with a value that changes from frame to frame.
+        frame.insert(frame.end(), {0x00, (uint8_t)((n % 64) - 32)});
+        uint16_t crc = crc16(frame);
+        frame.insert(frame.end(), {(uint8_t)(crc >> 8), (uint8_t)(crc & 0xff)});
+        ok = fwrite(frame.data(), 1, frame.size(), fp) == frame.size();
+    }
+
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) unlink(path.c_str());
+    return ok;
+}
+
+class ExtractorSeekTest : public ::testing::TestWithParam<pair<string, int32_t>> {};
+
+TEST_P(ExtractorSeekTest, Seek) {
+    runSeekBenchmark(gEnv->getRes() + GetParam().first, GetParam().first, GetParam().second,
+                     1 /* numReadsPerSeek */, 1 /* numPasses */);
+}
+
+TEST_P(ExtractorSeekTest, SeekAndRead) {
+    runSeekBenchmark(gEnv->getRes() + GetParam().first, GetParam().first, GetParam().second,
+                     kNumReadsPerSeek, kNumSeekPasses);
+}
+
+TEST(ExtractorLongFlacSeekTest, SeekAndRead) {
+    // One hour at 48 kHz in 192 sample frames, 900000 frames in about 11MB.
+    const string inputReference = "synthetic_48000hz_1ch_192spf_60mins.flac";
+    const string inputFile = string(SYNTHETIC_FLAC_DIR) + inputReference;
+    ASSERT_TRUE(writeSyntheticFlac(inputFile, 48000, 900000))
+            << "Unable to write " << inputFile;
+
+    runSeekBenchmark(inputFile, inputReference, 0, kNumReadsPerSeek, kNumSeekPasses);
+
+    unlink(inputFile.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(ExtractorSeekTestAll, ExtractorSeekTest,
+                         ::testing::Values(make_pair("bbb_44100hz_2ch_600kbps_flac_5mins.flac", 0),
+                                           make_pair("bbb_44100hz_2ch_128kbps_mp3_5mins.mp3", 0),
+                                           make_pair("bbb_44100hz_2ch_128kbps_aac_5mins.mp4", 0)));
+
 INSTANTIATE_TEST_SUITE_P(ExtractorTestAll, ExtractorTest,
                          ::testing::Values(make_pair("crowd_1920x1080_25fps_4000kbps_vp9.webm", 0),
                                            make_pair("crowd_1920x1080_25fps_6000kbps_h263.3gp", 0),
@@ -30,6 +30,8 @@ static BenchmarkTestEnvironment *gEnv = nullptr;
 
 class MuxerTest : public ::testing::TestWithParam<pair<string, string>> {};
 
+class MuxerMultiTrackTest : public ::testing::TestWithParam<pair<string, int32_t>> {};
+
 static MUXER_OUTPUT_T getMuxerOutFormat(string fmt) {
     static const struct {
         string name;
@@ -49,11 +51,74 @@ static MUXER_OUTPUT_T getMuxerOutFormat(string fmt) {
     return format;
 }
 
+// Opens the input file and sets up the muxer's extractor on it.
+static void openInput(const string &inputFile, Muxer *muxerObj, FILE **inputFp,
+                      int32_t *trackCount) {
+    *inputFp = fopen(inputFile.c_str(), "rb");
+    ASSERT_NE(*inputFp, nullptr) << "Unable to open " << inputFile << " file for reading";
+
+    Extractor *extractor = muxerObj->getExtractor();
+    ASSERT_NE(extractor, nullptr) << "Extractor creation failed";
+
+    // Read file properties
+    struct stat buf;
+    stat(inputFile.c_str(), &buf);
+    size_t fileSize = buf.st_size;
+    int32_t fd = fileno(*inputFp);
+
+    *trackCount = extractor->initExtractor(fd, fileSize);
+    ASSERT_GT(*trackCount, 0) << "initExtractor failed";
+}
+
+// Reads every sample of the given track into inputBuffer, one after another.
+static void extractTrack(Extractor *extractor, int32_t trackId, uint8_t *inputBuffer,
+                         vector<AMediaCodecBufferInfo> *frameInfos) {
+    int32_t status = extractor->setupTrackFormat(trackId);
+    ASSERT_EQ(status, 0) << "Track Format invalid";
+
+    // AMediaCodecBufferInfo : <size of frame> <flags> <presentationTimeUs> <offset>
+    AMediaCodecBufferInfo info;
+    uint32_t inputBufferOffset = 0;
+
+    // Get Frame Data
+    while (1) {
+        status = extractor->getFrameSample(info);
+        if (status || !info.size) break;
+        // copy the meta data and buffer to be passed to muxer
+        ASSERT_LE(inputBufferOffset + info.size, kMaxBufferSize)
+                << "Memory allocated not sufficient";
+
+        memcpy(inputBuffer + inputBufferOffset, extractor->getFrameBuf(), info.size);
+        info.offset = inputBufferOffset;
+        frameInfos->push_back(info);
+        inputBufferOffset += info.size;
+    }
+}
+
+// Muxes the extracted samples into numTracks tracks of the output file.
+static void writeOutput(Muxer *muxerObj, MUXER_OUTPUT_T outputFormat, int32_t numTracks,
+                        uint8_t *inputBuffer, vector<AMediaCodecBufferInfo> &frameInfos,
+                        const string &statsFile) {
+    string outputFileName = OUTPUT_FILE_NAME;
+    FILE *outputFp = fopen(outputFileName.c_str(), "w+b");
+    ASSERT_NE(outputFp, nullptr)
+            << "Unable to open output file" << outputFileName << " for writing";
+
+    int32_t status = muxerObj->initMuxer(fileno(outputFp), outputFormat, numTracks);
+    if (status == 0) {
+        status = muxerObj->mux(inputBuffer, frameInfos);
+        muxerObj->deInitMuxer();
+    }
+    fclose(outputFp);
+    ASSERT_EQ(status, 0) << "Mux failed";
+
+    muxerObj->dumpStatistics(statsFile);
+    muxerObj->resetMuxer();
+}
+
 TEST_P(MuxerTest, Mux) {
     ALOGV("Mux the samples given by extractor");
     string inputFile = gEnv->getRes() + GetParam().first;
-    FILE *inputFp = fopen(inputFile.c_str(), "rb");
-    ASSERT_NE(inputFp, nullptr) << "Unable to open " << inputFile << " file for reading";
 
     string fmt = GetParam().second;
     MUXER_OUTPUT_T outputFormat = getMuxerOutFormat(fmt);
@@ -62,67 +127,63 @@ TEST_P(MuxerTest, Mux) {
     Muxer *muxerObj = new Muxer();
     ASSERT_NE(muxerObj, nullptr) << "Muxer creation failed";
 
+    FILE *inputFp = nullptr;
+    int32_t trackCount = 0;
+    ASSERT_NO_FATAL_FAILURE(openInput(inputFile, muxerObj, &inputFp, &trackCount));
     Extractor *extractor = muxerObj->getExtractor();
-    ASSERT_NE(extractor, nullptr) << "Extractor creation failed";
-
-    // Read file properties
-    struct stat buf;
-    stat(inputFile.c_str(), &buf);
-    size_t fileSize = buf.st_size;
-    int32_t fd = fileno(inputFp);
-
-    int32_t trackCount = extractor->initExtractor(fd, fileSize);
-    ASSERT_GT(trackCount, 0) << "initExtractor failed";
 
     for (int curTrack = 0; curTrack < trackCount; curTrack++) {
-        int32_t status = extractor->setupTrackFormat(curTrack);
-        ASSERT_EQ(status, 0) << "Track Format invalid";
-
         uint8_t *inputBuffer = (uint8_t *)malloc(kMaxBufferSize);
         ASSERT_NE(inputBuffer, nullptr) << "Insufficient memory";
 
-        // AMediaCodecBufferInfo : <size of frame> <flags> <presentationTimeUs> <offset>
         vector<AMediaCodecBufferInfo> frameInfos;
-        AMediaCodecBufferInfo info;
-        uint32_t inputBufferOffset = 0;
-
-        // Get Frame Data
-        while (1) {
-            status = extractor->getFrameSample(info);
-            if (status || !info.size) break;
-            // copy the meta data and buffer to be passed to muxer
-            ASSERT_LE(inputBufferOffset + info.size, kMaxBufferSize)
-                    << "Memory allocated not sufficient";
-
-            memcpy(inputBuffer + inputBufferOffset, extractor->getFrameBuf(), info.size);
-            info.offset = inputBufferOffset;
-            frameInfos.push_back(info);
-            inputBufferOffset += info.size;
-        }
+        ASSERT_NO_FATAL_FAILURE(extractTrack(extractor, curTrack, inputBuffer, &frameInfos));
+        ASSERT_NO_FATAL_FAILURE(writeOutput(muxerObj, outputFormat, 1, inputBuffer, frameInfos,
+                                            GetParam().first + "." + fmt.c_str()));
+        free(inputBuffer);
+    }
+    fclose(inputFp);
+    extractor->deInitExtractor();
+    delete muxerObj;
+}
 
-        string outputFileName = OUTPUT_FILE_NAME;
-        FILE *outputFp = fopen(outputFileName.c_str(), "w+b");
-        ASSERT_NE(outputFp, nullptr)
-                << "Unable to open output file" << outputFileName << " for writing";
+TEST_P(MuxerMultiTrackTest, Mux) {
+    ALOGV("Mux the first track given by extractor into several tracks");
+    string inputFile = gEnv->getRes() + GetParam().first;
+    int32_t numTracks = GetParam().second;
 
-        int32_t fd = fileno(outputFp);
-        status = muxerObj->initMuxer(fd, outputFormat);
-        ASSERT_EQ(status, 0) << "initMuxer failed";
+    Muxer *muxerObj = new Muxer();
+    ASSERT_NE(muxerObj, nullptr) << "Muxer creation failed";
 
-        status = muxerObj->mux(inputBuffer, frameInfos);
-        ASSERT_EQ(status, 0) << "Mux failed";
+    FILE *inputFp = nullptr;
+    int32_t trackCount = 0;
+    ASSERT_NO_FATAL_FAILURE(openInput(inputFile, muxerObj, &inputFp, &trackCount));
+    Extractor *extractor = muxerObj->getExtractor();
+
+    uint8_t *inputBuffer = (uint8_t *)malloc(kMaxBufferSize);
+    ASSERT_NE(inputBuffer, nullptr) << "Insufficient memory";
+
+    vector<AMediaCodecBufferInfo> frameInfos;
+    ASSERT_NO_FATAL_FAILURE(extractTrack(extractor, 0, inputBuffer, &frameInfos));
+    ASSERT_NO_FATAL_FAILURE(
+            writeOutput(muxerObj, MUXER_OUTPUT_FORMAT_MPEG_4, numTracks, inputBuffer, frameInfos,
+                        GetParam().first + "." + to_string(numTracks) + "tracks.mp4"));
+    free(inputBuffer);
 
-        muxerObj->deInitMuxer();
-        muxerObj->dumpStatistics(GetParam().first + "." + fmt.c_str());
-        free(inputBuffer);
-        fclose(outputFp);
-        muxerObj->resetMuxer();
-    }
     fclose(inputFp);
     extractor->deInitExtractor();
     delete muxerObj;
 }
 
+INSTANTIATE_TEST_SUITE_P(
+        MuxerMultiTrackTestAll, MuxerMultiTrackTest,
+        ::testing::Values(make_pair("bbb_44100hz_2ch_128kbps_aac_5mins.mp4", 2),
+                          make_pair("bbb_44100hz_2ch_128kbps_aac_5mins.mp4", 4),
+                          make_pair("bbb_44100hz_2ch_128kbps_aac_5mins.mp4", 8),
+                          make_pair("bbb_44100hz_2ch_128kbps_aac_5mins.mp4", 16),
+                          make_pair("crowd_1920x1080_25fps_6000kbps_mpeg4.mp4", 2),
+                          make_pair("crowd_1920x1080_25fps_6000kbps_mpeg4.mp4", 4)));
+
 INSTANTIATE_TEST_SUITE_P(
         MuxerTestAll, MuxerTest,
         ::testing::Values(make_pair("crowd_1920x1080_25fps_4000kbps_vp8.webm", "webm"),